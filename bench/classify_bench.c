@@ -0,0 +1,79 @@
+/*
+ * classify_bench.c - extension classifier microbenchmark
+ *
+ * Times the generated perfect-hash classifier (ext_hash.h) against the
+ * strcmp chain organizer_cli used before it, over a corpus of mixed known,
+ * upper-case and unknown extensions.
+ *
+ * Usage: classify_bench [names]     (default 10000000)
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ext_hash.h"
+
+/* ---- OLD CLASSIFIER (pre ext_rules.conf) ---- */
+static int is_doc(const char *ext) {
+    return strcmp(ext, ".txt") == 0 || strcmp(ext, ".pdf") == 0 || strcmp(ext, ".docx") == 0;
+}
+static int is_img(const char *ext) {
+    return strcmp(ext, ".jpg") == 0 || strcmp(ext, ".jpeg") == 0 || strcmp(ext, ".png") == 0;
+}
+static int is_aud(const char *ext) {
+    return strcmp(ext, ".mp3") == 0 || strcmp(ext, ".wav") == 0 || strcmp(ext, ".aac") == 0;
+}
+static int is_vid(const char *ext) {
+    return strcmp(ext, ".mp4") == 0 || strcmp(ext, ".mkv") == 0 || strcmp(ext, ".avi") == 0;
+}
+
+static int strcmp_classify(const char *name) {
+    const char *ext = strrchr(name, '.');
+    if (ext && is_doc(ext)) return EXT_CAT_DOCUMENTS;
+    if (ext && is_img(ext)) return EXT_CAT_IMAGES;
+    if (ext && is_aud(ext)) return EXT_CAT_AUDIO;
+    if (ext && is_vid(ext)) return EXT_CAT_VIDEOS;
+    return EXT_CAT_OTHERS;
+}
+
+/* ---- HARNESS ---- */
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static const char *const exts[] = {
+    "txt", "pdf", "docx", "jpg", "jpeg", "png", "mp3", "wav", "aac", "mp4", "mkv", "avi",
+    "JPG", "PNG", "Pdf", "MP4", "webp", "flac", "mov", "c", "json", "tar.gz", "md", "",
+};
+#define NUM_EXTS (sizeof(exts) / sizeof(exts[0]))
+
+int main(int argc, char *argv[]) {
+    long n = argc > 1 ? atol(argv[1]) : 10000000;
+    enum { POOL = 4096 };   /* distinct names, cycled to reach n */
+    static char names[POOL][32];
+    unsigned seed = 12345;
+    for (int i = 0; i < POOL; i++) {
+        seed = seed * 1103515245u + 12345u;
+        const char *e = exts[(seed >> 16) % NUM_EXTS];
+        snprintf(names[i], sizeof(names[i]), "file_%d%s%s", i, *e ? "." : "", e);
+    }
+
+    long hist_old[EXT_NUM_CATS] = { 0 }, hist_new[EXT_NUM_CATS] = { 0 };
+    double t0 = now_sec();
+    for (long i = 0; i < n; i++) hist_old[strcmp_classify(names[i & (POOL - 1)])]++;
+    double t1 = now_sec();
+    for (long i = 0; i < n; i++) hist_new[ext_classify(names[i & (POOL - 1)])]++;
+    double t2 = now_sec();
+
+    printf("names: %ld\n", n);
+    printf("strcmp chain: %.2f ns/name\n", (t1 - t0) * 1e9 / n);
+    printf("perfect hash: %.2f ns/name\n", (t2 - t1) * 1e9 / n);
+    printf("%-10s %12s %12s\n", "category", "strcmp", "hash");
+    for (int c = 0; c < EXT_NUM_CATS; c++)
+        printf("%-10s %12ld %12ld\n", ext_cat_names[c], hist_old[c], hist_new[c]);
+    return 0;
+}
@@ -0,0 +1,84 @@
+/*
+ * gen_vectors.c - synthetic embeddings for the vector index benchmarks
+ *
+ *   gen_vectors [--count N] [--dim D] [--clusters C] [--noise X] [--seed S]
+ *               [--query]
+ *
+ * Prints N "path<TAB>[v,...]" lines for organizer_cli vindex add --stdin.
+ * C random centres are drawn first, and each vector is one of them plus
+ * noise of amplitude X (default 0.5) per component, so the set clusters
+ * the way real embeddings do and IVF has something to find. Paths are
+ * d<i % 100>/v<i>.txt. --query prints one bare vector, drawn the same way
+ * from its own stream, for search. The same seed gives the same vectors.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+static uint64_t rng_state;
+
+static uint64_t rng_next(void) {
+    uint64_t z = (rng_state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/* Uniform in [0, 1). */
+static double rng_unit(void) {
+    return (rng_next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: gen_vectors [--count N] [--dim D] [--clusters C] [--noise X] [--seed S] [--query]\n");
+}
+
+static void print_vector(const float *centre, long dim, double noise) {
+    putchar('[');
+    for (long d = 0; d < dim; d++) {
+        /* Four uniforms summed: close enough to a normal, no libm. */
+        double n = rng_unit() + rng_unit() + rng_unit() + rng_unit() - 2;
+        printf(d ? ",%.4f" : "%.4f", centre[d] + n * noise);
+    }
+    putchar(']');
+}
+
+int main(int argc, char *argv[]) {
+    long count = 10000, dim = 1536, clusters = 64;
+    double noise = 0.5;
+    int query = 0;
+    rng_state = 42;
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i], *v = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(a, "--query") == 0) { query = 1; continue; }
+        if (!v) { usage(); return 1; }
+        if (strcmp(a, "--count") == 0) count = atol(v);
+        else if (strcmp(a, "--dim") == 0) dim = atol(v);
+        else if (strcmp(a, "--clusters") == 0) clusters = atol(v);
+        else if (strcmp(a, "--noise") == 0) noise = atof(v);
+        else if (strcmp(a, "--seed") == 0) rng_state = strtoull(v, NULL, 10);
+        else { usage(); return 1; }
+        i++;
+    }
+    if (count < 0 || dim < 1 || clusters < 1 || noise < 0) {
+        usage();
+        return 1;
+    }
+    float *centres = malloc((size_t)clusters * dim * sizeof(float));
+    if (!centres) { perror("malloc"); return 1; }
+    for (long i = 0; i < clusters * dim; i++) centres[i] = (float)(rng_unit() * 2 - 1);
+
+    if (query) {
+        rng_state ^= 0x5eedULL;
+        print_vector(centres + (rng_next() % clusters) * dim, dim, noise);
+        putchar('\n');
+        return 0;
+    }
+    for (long i = 0; i < count; i++) {
+        printf("d%ld/v%ld.txt\t", i % 100, i);
+        print_vector(centres + (rng_next() % clusters) * dim, dim, noise);
+        putchar('\n');
+    }
+    return 0;
+}
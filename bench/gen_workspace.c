@@ -0,0 +1,217 @@
+/*
+ * gen_workspace.c - synthetic workspace generator for the benchmarks
+ *
+ * Fills <dir> with a reproducible tree of files:
+ *
+ *   gen_workspace <dir> [--files N] [--layout flat|nested] [--depth D]
+ *                 [--fanout F] [--name-len MIN-MAX] [--exts SPEC]
+ *                 [--sizes SPEC] [--dup PERCENT] [--seed S]
+ *
+ * flat puts every file in <dir>; nested builds a tree of directories up
+ * to --depth levels with --fanout children each (capped at one directory
+ * per ten files) and scatters the files over all of them. --exts and
+ * --sizes are weighted lists, "txt:30,jpg:20,none:5" and "0:10,4k:60,1m:5"
+ * (sizes accept k/m/g; each file gets a size between half the bucket and
+ * the bucket). Files are filled with pseudo-random bytes stamped with
+ * their index, so contents differ unless --dup makes a file a copy of an
+ * earlier one of the same bucket. The same seed gives the same tree.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define MAX_ITEMS 32
+#define FILL_BYTES (1 << 20)
+
+typedef struct {
+    char name[16];
+    uint64_t value;
+    unsigned weight;
+} Item;
+
+typedef struct {
+    Item items[MAX_ITEMS];
+    int n;
+    unsigned total;
+} Weighted;
+
+static uint64_t rng_state;
+
+static uint64_t rng_next(void) {
+    uint64_t z = (rng_state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static uint64_t rng_below(uint64_t n) {
+    return n ? rng_next() % n : 0;
+}
+
+static uint64_t parse_size(const char *s) {
+    char *end;
+    uint64_t v = strtoull(s, &end, 10);
+    switch (*end) {
+        case 'k': case 'K': return v << 10;
+        case 'm': case 'M': return v << 20;
+        case 'g': case 'G': return v << 30;
+        default: return v;
+    }
+}
+
+/* "a:3,b:1" -> items; sizes are parsed when is_size is set. */
+static int parse_weighted(const char *spec, Weighted *w, int is_size) {
+    memset(w, 0, sizeof(*w));
+    char buf[1024];
+    snprintf(buf, sizeof(buf), "%s", spec);
+    for (char *tok = strtok(buf, ","); tok && w->n < MAX_ITEMS; tok = strtok(NULL, ",")) {
+        char *colon = strchr(tok, ':');
+        Item *it = &w->items[w->n];
+        it->weight = colon ? (unsigned)atoi(colon + 1) : 1;
+        if (colon) *colon = '\0';
+        snprintf(it->name, sizeof(it->name), "%s", tok);
+        if (is_size) it->value = parse_size(tok);
+        if (it->weight == 0) continue;
+        w->total += it->weight;
+        w->n++;
+    }
+    return w->n > 0 ? 0 : -1;
+}
+
+static int pick(const Weighted *w) {
+    uint64_t r = rng_below(w->total);
+    for (int i = 0; i < w->n; i++) {
+        if (r < w->items[i].weight) return i;
+        r -= w->items[i].weight;
+    }
+    return w->n - 1;
+}
+
+static int write_file(const char *path, const unsigned char *fill, uint64_t size, uint64_t stamp) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return -1;
+    uint64_t off = 0;
+    while (off < size) {
+        size_t n = size - off < FILL_BYTES ? (size_t)(size - off) : FILL_BYTES;
+        /* Start each chunk somewhere else in the fill so files differ inside too. */
+        size_t at = (size_t)((stamp * 4099 + off) % (FILL_BYTES / 2));
+        if (n > FILL_BYTES - at) n = FILL_BYTES - at;
+        if (write(fd, fill + at, n) != (ssize_t)n) { close(fd); return -1; }
+        off += n;
+    }
+    if (size >= sizeof(stamp) && pwrite(fd, &stamp, sizeof(stamp), 0) != (ssize_t)sizeof(stamp)) {
+        close(fd);
+        return -1;
+    }
+    return close(fd);
+}
+
+static int mkdir_p(const char *path) {
+    char buf[4096];
+    snprintf(buf, sizeof(buf), "%s", path);
+    for (char *p = strchr(buf + 1, '/'); p; p = strchr(p + 1, '/')) {
+        *p = '\0';
+        if (mkdir(buf, 0755) != 0 && errno != EEXIST) return -1;
+        *p = '/';
+    }
+    return mkdir(buf, 0755) != 0 && errno != EEXIST ? -1 : 0;
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: gen_workspace <dir> [--files N] [--layout flat|nested] [--depth D] [--fanout F]\n"
+                    "                     [--name-len MIN-MAX] [--exts SPEC] [--sizes SPEC] [--dup PERCENT]\n"
+                    "                     [--seed S]\n");
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) { usage(); return 1; }
+    const char *root = argv[1];
+    long files = 10000, depth = 4, fanout = 8, name_min = 8, name_max = 24, dup_pct = 0;
+    int nested = 0;
+    const char *exts_spec = "txt:15,pdf:10,docx:5,md:5,jpg:20,png:10,mp3:8,wav:2,mp4:6,mkv:2,zip:7,none:10";
+    const char *sizes_spec = "0:10,1k:30,16k:35,256k:20,4m:5";
+    rng_state = 42;
+    for (int i = 2; i < argc; i++) {
+        const char *a = argv[i], *v = i + 1 < argc ? argv[i + 1] : NULL;
+        if (!v) { usage(); return 1; }
+        if (strcmp(a, "--files") == 0) files = atol(v);
+        else if (strcmp(a, "--layout") == 0) nested = strcmp(v, "nested") == 0;
+        else if (strcmp(a, "--depth") == 0) depth = atol(v);
+        else if (strcmp(a, "--fanout") == 0) fanout = atol(v);
+        else if (strcmp(a, "--name-len") == 0) {
+            if (sscanf(v, "%ld-%ld", &name_min, &name_max) != 2) name_max = name_min = atol(v);
+        }
+        else if (strcmp(a, "--exts") == 0) exts_spec = v;
+        else if (strcmp(a, "--sizes") == 0) sizes_spec = v;
+        else if (strcmp(a, "--dup") == 0) dup_pct = atol(v);
+        else if (strcmp(a, "--seed") == 0) rng_state = strtoull(v, NULL, 10);
+        else { usage(); return 1; }
+        i++;
+    }
+    Weighted exts, sizes;
+    if (files < 0 || name_min < 1 || name_max < name_min || name_max > 200 || fanout < 1 || depth < 0 ||
+        parse_weighted(exts_spec, &exts, 0) != 0 || parse_weighted(sizes_spec, &sizes, 1) != 0) {
+        usage();
+        return 1;
+    }
+
+    /* Directories, breadth first, as paths relative to root. */
+    long max_dirs = nested ? files / 10 + 1 : 1, ndirs = 1;
+    char **dirs = calloc(max_dirs, sizeof(char *));
+    int *level = calloc(max_dirs, sizeof(int));
+    if (!dirs || !level) { perror("calloc"); return 1; }
+    if (mkdir_p(root) != 0) { perror(root); return 1; }
+    dirs[0] = strdup("");
+    for (long d = 0; nested && d < ndirs && ndirs < max_dirs; d++) {
+        if (level[d] >= depth) continue;
+        for (long c = 0; c < fanout && ndirs < max_dirs; c++) {
+            char rel[4096], path[8192];
+            snprintf(rel, sizeof(rel), "%s%sd%ld", dirs[d], dirs[d][0] ? "/" : "", c);
+            snprintf(path, sizeof(path), "%s/%s", root, rel);
+            if (mkdir(path, 0755) != 0 && errno != EEXIST) { perror(path); return 1; }
+            dirs[ndirs] = strdup(rel);
+            level[ndirs++] = level[d] + 1;
+        }
+    }
+
+    unsigned char *fill = malloc(FILL_BYTES);
+    if (!fill) { perror("malloc"); return 1; }
+    for (size_t i = 0; i < FILL_BYTES; i += 8) {
+        uint64_t r = rng_next();
+        memcpy(fill + i, &r, 8);
+    }
+    uint64_t last_stamp[MAX_ITEMS];
+    for (int i = 0; i < MAX_ITEMS; i++) last_stamp[i] = UINT64_MAX;
+    static const char alpha[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789 _-";
+    unsigned long long bytes = 0;
+    for (long i = 0; i < files; i++) {
+        const char *dir = dirs[rng_below(ndirs)];
+        const Item *ext = &exts.items[pick(&exts)];
+        int si = pick(&sizes);
+        uint64_t cap = sizes.items[si].value;
+        char name[256];
+        long len = name_min + (long)rng_below(name_max - name_min + 1);
+        int at = snprintf(name, sizeof(name), "%ld_", i);
+        for (; at < len; at++) name[at] = alpha[rng_below(sizeof(alpha) - 1)];
+        name[at] = '\0';
+        if (strcmp(ext->name, "none") != 0) snprintf(name + at, sizeof(name) - at, ".%s", ext->name);
+        /* Size and content follow from the stamp; a duplicate repeats the
+         * previous stamp of its size bucket. */
+        uint64_t stamp = (uint64_t)i;
+        if (last_stamp[si] != UINT64_MAX && (long)rng_below(100) < dup_pct) stamp = last_stamp[si];
+        last_stamp[si] = stamp;
+        uint64_t size = cap ? cap / 2 + stamp * 0x9e3779b97f4a7c15ULL % (cap - cap / 2 + 1) : 0;
+        char path[4608];
+        snprintf(path, sizeof(path), "%s/%s%s%s", root, dir, dir[0] ? "/" : "", name);
+        if (write_file(path, fill, size, stamp) != 0) { perror(path); return 1; }
+        bytes += size;
+    }
+    printf("{\"files\":%ld,\"dirs\":%ld,\"bytes\":%llu}\n", files, ndirs, bytes);
+    return 0;
+}
@@ -0,0 +1,46 @@
+#!/usr/bin/env bash
+# Side-by-side timing of organizer_cli's sync and io_uring I/O backends.
+#
+#   bench/io_backend.sh [files] [depth] [dir]
+#
+# Organizes a fresh flat directory of <files> empty files (default 100000)
+# with --io sync and --io uring, then times create-dir with a tenth as many
+# names. Point <dir> at the disk you care about (default: a temp dir); the
+# ring pays off most where each call waits on the device or the network.
+set -euo pipefail
+
+FILES=${1:-100000}
+DEPTH=${2:-64}
+ROOT=${3:-$(mktemp -d)}
+CLI=${CLI:-./organizer_cli}
+EXTS=(txt pdf jpg png mp3 wav mp4 mkv zip md)
+
+populate() {
+    rm -rf "$ROOT/ws"
+    mkdir -p "$ROOT/ws/flat"
+    (cd "$ROOT/ws/flat" && seq 1 "$FILES" | awk -v n="${#EXTS[@]}" -v e="${EXTS[*]}" \
+        'BEGIN { split(e, x, " ") } { print "f" $1 "." x[$1 % n + 1] }' | xargs touch)
+}
+
+ms_since() { echo $(( ($(date +%s%N) - $1) / 1000000 )); }
+
+printf '%-10s %-8s %10s\n' "mode" "io" "ms"
+for io in sync uring; do
+    populate
+    sync
+    t=$(date +%s%N)
+    "$CLI" organize "$ROOT/ws" flat --io "$io" --io-depth "$DEPTH" --output ndjson > /dev/null
+    printf '%-10s %-8s %10s\n' "organize" "$io" "$(ms_since "$t")"
+done
+
+names=$(seq 1 $(( FILES / 10 )) | sed 's/^/n/; s/$/.txt/')
+for io in sync uring; do
+    rm -rf "$ROOT/ws/created"
+    t=$(date +%s%N)
+    # shellcheck disable=SC2086
+    "$CLI" create-dir "$ROOT/ws" created $names --io "$io" --io-depth "$DEPTH" --output ndjson > /dev/null
+    printf '%-10s %-8s %10s\n' "create-dir" "$io" "$(ms_since "$t")"
+done
+
+[ -z "${3:-}" ] && rm -rf "$ROOT"
+exit 0
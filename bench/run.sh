@@ -0,0 +1,123 @@
+#!/usr/bin/env bash
+# End-to-end benchmark of organizer_cli's subcommands (make bench).
+#
+#   bench/run.sh [files] [runs] [out.json]
+#
+# Generates flat and nested workspaces of <files> files (default 20000)
+# with bench/gen_workspace, runs every subcommand <runs> times (default 5)
+# through bench/runstat under the bench/syscount.so shim, and writes one
+# JSON document to <out.json> (default bench/results/<commit>.json). Each
+# case is one line of it, so two commits' results diff line by line.
+# Set ROOT to keep the generated trees somewhere other than a temp dir.
+set -euo pipefail
+
+FILES=${1:-20000}
+RUNS=${2:-5}
+COMMIT=$(git rev-parse --short HEAD 2>/dev/null || echo local)
+OUT=${3:-bench/results/$COMMIT.json}
+CLI=${CLI:-$PWD/organizer_cli}
+GEN=$PWD/bench/gen_workspace
+GENVEC=$PWD/bench/gen_vectors
+SHIM=$PWD/bench/syscount.so
+KEEP=${ROOT:+1}
+ROOT=${ROOT:-$(mktemp -d)}
+export ORGANIZER_CACHE_DIR="$ROOT/cache"
+[ -z "$KEEP" ] && trap 'rm -rf "$ROOT"' EXIT
+
+mkdir -p "$(dirname "$OUT")" "$ROOT"
+LINES="$ROOT/lines"
+: > "$LINES"
+
+# bench <name> <files> <setup> <cmd...>; set STDIN to feed a file to each run
+bench() {
+    local name=$1 files=$2 setup=$3
+    shift 3
+    echo "  $name" >&2
+    ./bench/runstat --name "$name" --runs "$RUNS" --files "$files" --setup "$setup" --shim "$SHIM" \
+        ${STDIN:+--stdin "$STDIN"} -- "$@" >> "$LINES" || echo "    (some runs failed)" >&2
+}
+
+NESTED="$ROOT/nested"
+echo "generating $FILES-file workspaces in $ROOT" >&2
+"$GEN" "$NESTED/tree" --files "$FILES" --layout nested --depth 4 --fanout 6 --dup 10 > /dev/null
+FLAT_SETUP="rm -rf '$ROOT/flat' && '$GEN' '$ROOT/flat/in' --files $FILES --sizes 0 > /dev/null"
+NEST_SETUP="rm -rf '$ROOT/nest2' && '$GEN' '$ROOT/nest2/in' --files $FILES --layout nested --sizes 0 > /dev/null"
+
+bench organize-flat "$FILES" "$FLAT_SETUP" "$CLI" organize "$ROOT/flat" in --output ndjson
+bench organize-flat-uring "$FILES" "$FLAT_SETUP" "$CLI" organize "$ROOT/flat" in --output ndjson --io uring
+bench organize-sniff "$FILES" "$FLAT_SETUP" "$CLI" organize "$ROOT/flat" in --output ndjson --sniff
+bench organize-recursive "$FILES" "$NEST_SETUP" "$CLI" organize "$ROOT/nest2" in --recursive --output ndjson
+
+NAMES=$(( FILES / 10 ))
+mapfile -t names < <(seq 1 "$NAMES" | sed 's/^/n/; s/$/.txt/')
+bench create-dir "$NAMES" "rm -rf '$ROOT/created'" "$CLI" create-dir "$ROOT" created "${names[@]}" --output ndjson
+
+bench copy "$FILES" "rm -rf '$NESTED/copy'" "$CLI" copy "$NESTED" tree copy --output ndjson
+bench dedupe "$FILES" "" "$CLI" dedupe "$NESTED" tree --output ndjson
+bench du-cold "$FILES" "rm -rf '$ROOT/cache'" "$CLI" du "$NESTED" tree
+bench du-warm "$FILES" "" "$CLI" du "$NESTED" tree
+bench index-cold "$FILES" "rm -rf '$ROOT/cache'" "$CLI" index "$NESTED"
+bench index-refresh "$FILES" "" "$CLI" index "$NESTED"
+bench search "$FILES" "" "$CLI" search "$NESTED" "ab" --limit 20
+
+# One tag per name, set in a single call, then the whole store read back.
+mapfile -t metaops < <(seq 1 "$NAMES" | awk '{ printf "set\nd%d/n%d.txt\nmeta\n{\"tags\":[\"t%d\"]}\n", $1 % 100, $1, $1 % 7 }')
+bench meta-set "$NAMES" "" "$CLI" meta "$NESTED" "${metaops[@]}"
+bench meta-list "$NAMES" "" "$CLI" meta "$NESTED" list ""
+
+# A quarter as many 1536-dimension embeddings as files: bulk add, exact
+# search, k-means training, then search through the trained lists.
+VECS=$(( FILES / 4 ))
+"$GENVEC" --count "$VECS" --dim 1536 > "$ROOT/vectors.tsv"
+QUERY=$("$GENVEC" --dim 1536 --query)
+STDIN="$ROOT/vectors.tsv" bench vindex-add "$VECS" "rm -rf '$ROOT/cache'" "$CLI" vindex "$NESTED" add --stdin
+bench vindex-exact "$VECS" "" "$CLI" vindex "$NESTED" search "$QUERY" --exact
+bench vindex-train "$VECS" "" "$CLI" vindex "$NESTED" train
+bench vindex-ivf "$VECS" "" "$CLI" vindex "$NESTED" search "$QUERY"
+
+# Plain-text documents for the full-text index, a quarter as many as
+# files: 300 words each from a 5000-word vocabulary with a Zipf-like skew.
+# Cold build, a no-change refresh, then an AND query and a phrase query.
+DOCS=$(( FILES / 4 ))
+awk -v n="$DOCS" -v dir="$ROOT/docs" 'BEGIN {
+    srand(42)
+    for (d = 0; d < 100 && d < n; d++) system("mkdir -p " dir "/d" d)
+    for (i = 0; i < n; i++) {
+        f = dir "/d" (i % 100) "/t" i ".txt"
+        for (w = 0; w < 300; w++) printf "w%d%s", int(5000 ^ rand()), (w % 12 == 11 ? "\n" : " ") > f
+        close(f)
+    }
+}'
+bench ftindex-cold "$DOCS" "rm -rf '$ROOT/cache'" "$CLI" ftindex "$ROOT/docs"
+bench ftindex-refresh "$DOCS" "" "$CLI" ftindex "$ROOT/docs"
+bench ftindex-query "$DOCS" "" "$CLI" ftindex "$ROOT/docs" query "w3 w17"
+bench ftindex-phrase "$DOCS" "" "$CLI" ftindex "$ROOT/docs" query '"w1 w2"'
+
+# The recycle bin: a batch trash of NAMES files named on stdin, then a
+# purge of a whole nested tree (a fresh bin each run, so its id is known).
+seq 1 "$NAMES" | sed 's|^|in/n|; s|$|.txt|' > "$ROOT/trash.txt"
+BIN_SETUP="rm -rf '$ROOT/binws' && mkdir -p '$ROOT/binws/in' && (cd '$ROOT/binws' && xargs touch < '$ROOT/trash.txt')"
+STDIN="$ROOT/trash.txt" bench bin-trash "$NAMES" "$BIN_SETUP" "$CLI" bin "$ROOT/binws" trash --stdin --output ndjson
+PURGE_SETUP="rm -rf '$ROOT/purge' && '$GEN' '$ROOT/purge/tree' --files $FILES --layout nested --sizes 0 > /dev/null && '$CLI' bin '$ROOT/purge' trash tree > /dev/null"
+bench bin-purge "$FILES" "$PURGE_SETUP" "$CLI" bin "$ROOT/purge" purge 0000000000000001
+
+# Folder download: the text documents as a streamed ZIP, and zip -r on
+# the same tree for reference.
+bench archive "$DOCS" "" "$CLI" archive "$ROOT" docs
+if command -v zip > /dev/null; then
+    bench archive-zip-r "$DOCS" "" sh -c "cd '$ROOT' && zip -qr - docs"
+fi
+
+{
+    printf '{"commit":"%s","date":"%s","files":%s,"runs":%s,"cpus":%s,"results":[\n' \
+        "$COMMIT" "$(date -u +%Y-%m-%dT%H:%M:%SZ)" "$FILES" "$RUNS" "$(nproc)"
+    sed '$!s/$/,/' "$LINES"
+    printf ']}\n'
+} > "$OUT"
+
+printf '%-20s %10s %10s %12s %10s %10s\n' case p50ms p99ms files/s sys/file rssKB >&2
+sed 's/[{}"]//g' "$LINES" | awk -F, '{
+    for (i = 1; i <= NF; i++) { split($i, kv, ":"); v[kv[1]] = kv[2] }
+    printf "%-20s %10s %10s %12s %10s %10s\n", v["name"], v["p50Ms"], v["p99Ms"], v["filesPerSec"], v["syscallsPerFile"], v["peakRssKb"]
+}' >&2
+echo "results: $OUT" >&2
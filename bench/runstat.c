@@ -0,0 +1,137 @@
+/*
+ * runstat.c - run a command repeatedly and summarise it as one JSON line
+ *
+ *   runstat --name NAME [--runs R] [--files N] [--setup CMD] [--shim SO]
+ *           [--stdin FILE] -- command [args...]
+ *
+ * Before every run the optional setup command runs through sh -c (not
+ * timed), so runs that consume their input, like organize, start from the
+ * same tree. The command's stdout goes to /dev/null, and its stdin comes
+ * from FILE, opened afresh for every run, when --stdin is given. Each run is timed on
+ * CLOCK_MONOTONIC and reaped with wait4 for its peak RSS. With --shim, it
+ * runs under LD_PRELOAD=SO, and SYSCOUNT_OUT pointed at a scratch file
+ * (see syscount.c). The line carries p50/p99/min/max milliseconds, files
+ * per second at the median when --files is given, syscalls per file, the
+ * largest peak RSS, and the last run's syscall breakdown.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+/* Nearest-rank percentile of a sorted array. */
+static double percentile(const double *v, int n, double p) {
+    int k = (int)(p / 100 * n + 0.999999);
+    if (k < 1) k = 1;
+    if (k > n) k = n;
+    return v[k - 1];
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: runstat --name NAME [--runs R] [--files N] [--setup CMD] [--shim SO] [--stdin FILE] -- cmd [args...]\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *name = NULL, *setup = NULL, *shim = NULL, *input = NULL;
+    int runs = 5, i = 1;
+    long files = 0;
+    for (; i < argc && strcmp(argv[i], "--") != 0; i++) {
+        const char *v = i + 1 < argc ? argv[i + 1] : NULL;
+        if (!v) { usage(); return 1; }
+        if (strcmp(argv[i], "--name") == 0) name = v;
+        else if (strcmp(argv[i], "--runs") == 0) runs = atoi(v);
+        else if (strcmp(argv[i], "--files") == 0) files = atol(v);
+        else if (strcmp(argv[i], "--setup") == 0) setup = v;
+        else if (strcmp(argv[i], "--shim") == 0) shim = v;
+        else if (strcmp(argv[i], "--stdin") == 0) input = v;
+        else { usage(); return 1; }
+        i++;
+    }
+    if (!name || runs < 1 || i + 1 >= argc) { usage(); return 1; }
+    char **cmd = argv + i + 1;
+
+    char counts_path[] = "/tmp/runstat-XXXXXX";
+    int cfd = shim ? mkstemp(counts_path) : -1;
+    if (shim && cfd < 0) { perror("mkstemp"); return 1; }
+    if (cfd >= 0) close(cfd);
+
+    double *ms = calloc(runs, sizeof(double));
+    unsigned long long syscalls = 0;
+    long max_rss = 0;
+    int failed = 0;
+    char calls[4096] = "{}";
+    if (!ms) return 1;
+    for (int r = 0; r < runs; r++) {
+        if (setup && system(setup) != 0) {
+            fprintf(stderr, "runstat: setup failed: %s\n", setup);
+            return 1;
+        }
+        double t0 = now_ms();
+        pid_t pid = fork();
+        if (pid < 0) { perror("fork"); return 1; }
+        if (pid == 0) {
+            int null = open("/dev/null", O_WRONLY);
+            if (null >= 0) dup2(null, STDOUT_FILENO);
+            if (input) {
+                int in = open(input, O_RDONLY);
+                if (in < 0) { perror(input); _exit(127); }
+                dup2(in, STDIN_FILENO);
+            }
+            if (shim) {
+                setenv("LD_PRELOAD", shim, 1);
+                setenv("SYSCOUNT_OUT", counts_path, 1);
+            }
+            execvp(cmd[0], cmd);
+            perror(cmd[0]);
+            _exit(127);
+        }
+        int status;
+        struct rusage ru;
+        if (wait4(pid, &status, 0, &ru) < 0) { perror("wait4"); return 1; }
+        ms[r] = now_ms() - t0;
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) failed++;
+        if (ru.ru_maxrss > max_rss) max_rss = ru.ru_maxrss;
+        FILE *f = shim ? fopen(counts_path, "r") : NULL;
+        if (f) {
+            unsigned long long total = 0;
+            char line[sizeof(calls) + 64];
+            if (fgets(line, sizeof(line), f) && sscanf(line, "{\"total\":%llu", &total) == 1) {
+                syscalls += total;
+                char *c = strstr(line, "\"calls\":");
+                if (c) {
+                    snprintf(calls, sizeof(calls), "%s", c + 8);
+                    char *end = strrchr(calls, '}');
+                    if (end) *end = '\0';   /* drop the outer object's brace */
+                }
+            }
+            fclose(f);
+        }
+    }
+    if (shim) unlink(counts_path);
+    qsort(ms, runs, sizeof(double), cmp_double);
+    double p50 = percentile(ms, runs, 50);
+    printf("{\"name\":\"%s\",\"runs\":%d,\"failed\":%d,\"files\":%ld,\"p50Ms\":%.3f,\"p99Ms\":%.3f,"
+           "\"minMs\":%.3f,\"maxMs\":%.3f,\"filesPerSec\":%.0f,\"syscallsPerFile\":%.2f,\"peakRssKb\":%ld,"
+           "\"syscalls\":%s}\n",
+           name, runs, failed, files, p50, percentile(ms, runs, 99), ms[0], ms[runs - 1],
+           files && p50 > 0 ? files / (p50 / 1e3) : 0, files && shim ? (double)syscalls / runs / files : 0,
+           max_rss, shim ? calls : "{}");
+    free(ms);
+    return failed ? 2 : 0;
+}
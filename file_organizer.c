@@ -1,8 +1,10 @@
+#define _DEFAULT_SOURCE  // d_type constants (DT_DIR) under -std=c99
 #include <stdio.h>      // printf, scanf, FILE
 #include <dirent.h>    // DIR, struct dirent, opendir, readdir
-#include <string.h>    // strcmp, strcpy, strrchr
+#include <string.h>    // strcmp, strcpy
 #include <sys/stat.h>  // mkdir
 #include <stdlib.h>    // exit, NULL
+#include "ext_hash.h" // ext_classify, generated from ext_rules.conf
 
 // ---------- FUNCTION PROTOTYPES ----------
 void create_directory_and_files();
@@ -12,7 +14,7 @@ void organize_directory(char directoryPath[]);
 void create_directory_and_files() {
     char dirName[256];
     char fileName[256];
-    char filePath[300];
+    char filePath[520];
 
     printf("Enter new directory name: ");
     scanf("%255s", dirName);
@@ -76,56 +78,41 @@ void organize_directory(char directoryPath[]) {
         if (entry->d_type == DT_DIR)
             continue;
 
-        char oldPath[300], newPath[300];
-        char *ext = strrchr(entry->d_name, '.');
+        char oldPath[600], newPath[600];
 
         sprintf(oldPath, "%s/%s", directoryPath, entry->d_name);
 
-        // Documents
-        if (ext &&
-            (strcmp(ext, ".txt") == 0 ||
-             strcmp(ext, ".pdf") == 0 ||
-             strcmp(ext, ".docx") == 0)) {
+        // Category comes from the generated ext_rules.conf hash
+        switch (ext_classify(entry->d_name)) {
+            case EXT_CAT_DOCUMENTS:
+                sprintf(newPath, "%s/%s", documents, entry->d_name);
+                rename(oldPath, newPath);
+                strcpy(docs[d++], entry->d_name);
+                break;
 
-            sprintf(newPath, "%s/%s", documents, entry->d_name);
-            rename(oldPath, newPath);
-            strcpy(docs[d++], entry->d_name);
-        }
-        // Images
-        else if (ext &&
-                (strcmp(ext, ".jpg") == 0 ||
-                 strcmp(ext, ".jpeg") == 0 ||
-                 strcmp(ext, ".png") == 0)) {
-
-            sprintf(newPath, "%s/%s", images, entry->d_name);
-            rename(oldPath, newPath);
-            strcpy(imgs[i++], entry->d_name);
-        }
-        // Audio
-        else if (ext &&
-                (strcmp(ext, ".mp3") == 0 ||
-                 strcmp(ext, ".wav") == 0 ||
-                 strcmp(ext, ".aac") == 0)) {
-
-            sprintf(newPath, "%s/%s", audio, entry->d_name);
-            rename(oldPath, newPath);
-            strcpy(auds[a++], entry->d_name);
-        }
-        // Videos
-        else if (ext &&
-                (strcmp(ext, ".mp4") == 0 ||
-                 strcmp(ext, ".mkv") == 0 ||
-                 strcmp(ext, ".avi") == 0)) {
-
-            sprintf(newPath, "%s/%s", videos, entry->d_name);
-            rename(oldPath, newPath);
-            strcpy(vids[v++], entry->d_name);
-        }
-        // Others
-        else {
-            sprintf(newPath, "%s/%s", others, entry->d_name);
-            rename(oldPath, newPath);
-            strcpy(oth[o++], entry->d_name);
+            case EXT_CAT_IMAGES:
+                sprintf(newPath, "%s/%s", images, entry->d_name);
+                rename(oldPath, newPath);
+                strcpy(imgs[i++], entry->d_name);
+                break;
+
+            case EXT_CAT_AUDIO:
+                sprintf(newPath, "%s/%s", audio, entry->d_name);
+                rename(oldPath, newPath);
+                strcpy(auds[a++], entry->d_name);
+                break;
+
+            case EXT_CAT_VIDEOS:
+                sprintf(newPath, "%s/%s", videos, entry->d_name);
+                rename(oldPath, newPath);
+                strcpy(vids[v++], entry->d_name);
+                break;
+
+            default:
+                sprintf(newPath, "%s/%s", others, entry->d_name);
+                rename(oldPath, newPath);
+                strcpy(oth[o++], entry->d_name);
+                break;
         }
     }
 
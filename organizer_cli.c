@@ -2,355 +2,11444 @@
  * CLI for File Organizer - outputs JSON for use by Next.js API.
  * Usage:
  *   organizer_cli create-dir <workspace> <dirName> <file1> [file2 ...]
- *   organizer_cli organize <workspace> [subpath]
+ *   organizer_cli organize <workspace> [subpath] [assets_path] [--recursive] [--jobs N]
+ *                          [--rules <file>] [--sniff] [--sniff-jobs N] [--no-journal]
+ *   organizer_cli watch <workspace> [subpath] [assets_path] [--rules <file>] [--sniff]
+ *                       [--debounce MS] [--no-journal]
+ *   organizer_cli undo <workspace> [batch-id]
+ *   organizer_cli copy <workspace> <src> <dst> [<src> <dst> ...] [--jobs N]
+ *   organizer_cli dedupe <workspace> [subpath] [--jobs N] [--link hard|reflink]
+ *   organizer_cli du <workspace> [subpath] [--jobs N]
+ *   organizer_cli index <workspace> [--watch]
+ *   organizer_cli query <workspace> list|stat|du [path] | search <text> [--limit N]
+ *   organizer_cli search <workspace> <text> [--limit N]
+ *   organizer_cli meta <workspace> [--stdin] get|list|set|del|rm|mv ... [...]
+ *   organizer_cli vindex <workspace> add|rm|mv|search|train|stats ... [--k N] [--probe N]
+ *   organizer_cli ftindex <workspace> [query <expr> [--limit N] | text <path> ... [--max N]] [--jobs N]
+ *   organizer_cli move <workspace> <from> <to> [<from> <to> ...] [--stdin]
+ *   organizer_cli bin <workspace> trash|restore|purge|list|import ... [--stdin] [--jobs N] [--background]
+ *   organizer_cli archive <workspace> [subpath] [--jobs N] [--level 0-9]   (ZIP on stdout)
+ *   organizer_cli serve [--socket <path>] [--workers N]
+ *   any mode: [--output json|ndjson] [--io sync|uring] [--io-depth N] [--profile]
+ *
+ * serve keeps one process alive and reads newline-delimited JSON requests
+ * ({"id":1,"argv":["organize","<workspace>","","<assets>"]}) from a Unix
+ * socket, or from stdin when no socket is given. Each request is handled on
+ * a worker thread and answered with the same payload the one-shot modes
+ * print, plus "id" and "latencyUs".
+ *
+ * Every op carries startNs/durNs (and bytes for copies), and the result
+ * ends with per-syscall latency histograms; --profile adds rusage.
+ *
+ * organize and watch journal their moves per workspace (see JOURNAL); an
+ * interrupted batch is finished by the next one, and undo reverts one.
  */
 
-#define _POSIX_C_SOURCE 200809L
+#define _GNU_SOURCE  /* renameat2, RENAME_NOREPLACE, DT_* */
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <dirent.h>
 #include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <errno.h>
 #include <time.h>
 #include <strings.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <limits.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/file.h>
+#include <sys/resource.h>
+#include <poll.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#include <linux/fs.h>           /* FICLONE */
+#include <linux/io_uring.h>
+#include <sys/inotify.h>
+#endif
 
-#define MAX_OPS 256
-#define MAX_PATH 512
-#define MAX_FILES 64
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>      /* AVX2/AVX-512 kernels, built per function with target() */
+#endif
+#include <zlib.h>            /* PDF streams, archive export */
+#include "ext_hash.h"
+
+/* ---- PER-RUN ARENA ----
+ * Everything a run records (op log, interned paths, result names) is bump-
+ * allocated from blocks that are freed together when the run ends, so
+ * memory tracks the real amount of data and there is nothing to free
+ * piecemeal. Blocks grow geometrically; oversized requests get their own. */
+#define ARENA_MIN_BLOCK (64 * 1024)
+
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t used, cap;
+    char data[];
+} ArenaBlock;
+
+typedef struct {
+    ArenaBlock *head;
+    size_t next_cap;
+} Arena;
+
+static void *arena_alloc(Arena *a, size_t n) {
+    n = (n + 7) & ~(size_t)7;
+    ArenaBlock *b = a->head;
+    if (!b || b->cap - b->used < n) {
+        size_t cap = a->next_cap ? a->next_cap : ARENA_MIN_BLOCK;
+        if (cap < n) cap = n;
+        b = malloc(sizeof(ArenaBlock) + cap);
+        if (!b) return NULL;
+        b->used = 0;
+        b->cap = cap;
+        b->next = a->head;
+        a->head = b;
+        if (a->next_cap < 8 * 1024 * 1024) a->next_cap = cap * 2;
+    }
+    void *p = b->data + b->used;
+    b->used += n;
+    return p;
+}
+
+static char *arena_strdup(Arena *a, const char *s) {
+    size_t n = strlen(s) + 1;
+    char *p = arena_alloc(a, n);
+    if (p) memcpy(p, s, n);
+    return p;
+}
+
+/* "dir/name", or a copy of dir when name is empty. */
+static char *arena_join(Arena *a, const char *dir, const char *name) {
+    size_t dl = strlen(dir), nl = name ? strlen(name) : 0;
+    char *p = arena_alloc(a, dl + nl + 2);
+    if (!p) return NULL;
+    memcpy(p, dir, dl);
+    if (nl) {
+        p[dl] = '/';
+        memcpy(p + dl + 1, name, nl + 1);
+    } else {
+        p[dl] = '\0';
+    }
+    return p;
+}
+
+/* Moves all of src's blocks into dst; used when worker runs are merged. */
+static void arena_adopt(Arena *dst, Arena *src) {
+    ArenaBlock *b = src->head;
+    while (b) {
+        ArenaBlock *next = b->next;
+        b->next = dst->head;
+        dst->head = b;
+        b = next;
+    }
+    src->head = NULL;
+}
+
+static void arena_free(Arena *a) {
+    ArenaBlock *b = a->head;
+    while (b) {
+        ArenaBlock *next = b->next;
+        free(b);
+        b = next;
+    }
+    a->head = NULL;
+    a->next_cap = 0;
+}
+
+/* One recorded operation. op/description/syscall are always string
+ * literals. A path is stored as an interned directory plus an optional
+ * entry name, so the thousands of renames out of one folder share a single
+ * copy of that folder's path and each file name is stored once. */
+typedef struct {
+    const char *op;
+    const char *description;
+    const char *syscall;
+    const char *dir, *name;
+    const char *dir2, *name2;
+    const char *error;
+    int success;
+    uint64_t start_ns;      /* since the run started */
+    uint64_t dur_ns;
+    uint64_t bytes;         /* copies: bytes written */
+} OpRec;
+
+#define OPS_PER_CHUNK 1024
+
+typedef struct OpChunk {
+    struct OpChunk *next;
+    int count;
+    OpRec recs[OPS_PER_CHUNK];
+} OpChunk;
+
+/* ---- PRNG ----
+ * xoshiro256** seeded through splitmix64: fast, well distributed, and one
+ * independent stream per Run, so worker threads never share state. */
+typedef struct {
+    uint64_t s[4];
+} Rng;
+
+static uint64_t splitmix64(uint64_t *x) {
+    uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static void rng_seed(Rng *r, uint64_t seed) {
+    for (int i = 0; i < 4; i++) r->s[i] = splitmix64(&seed);
+}
+
+static inline uint64_t rotl64(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+static uint64_t rng_next(Rng *r) {
+    uint64_t *s = r->s;
+    uint64_t result = rotl64(s[1] * 5, 7) * 9, t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl64(s[3], 45);
+    return result;
+}
+
+/* Uniform in [0, n) without a modulo (Lemire's multiply-shift). */
+static uint64_t rng_below(Rng *r, uint64_t n) {
+    return (uint64_t)(((unsigned __int128)rng_next(r) * n) >> 64);
+}
+
+/* ---- OUTPUT ----
+ * All output goes through a Writer: a growable buffer in front of a Sink
+ * (an fd, plus the connection lock in serve mode). In the default JSON
+ * mode the buffer is just drained whenever it fills. With --output ndjson
+ * every op is written as its own line the moment it is recorded, and lines
+ * are pushed out whole every few milliseconds, so several writers (the
+ * workers of a recursive organize, or concurrent serve requests) can share
+ * one sink without interleaving. Serve replies in JSON mode use a Writer
+ * with no sink and are sent in one piece when the request completes. */
+#define OUT_FLUSH_BYTES (32 * 1024)
+#define OUT_FLUSH_US 10000.0
+
+typedef struct {
+    int fd;
+    pthread_mutex_t *lock;  /* serve mode: the connection's write lock */
+    long next_op_id;        /* ndjson op ids, shared by every writer */
+} Sink;
+
+typedef struct {
+    Sink *sink;             /* NULL: keep everything in memory */
+    char *buf;
+    size_t len, cap;
+    int whole_lines;        /* only hand complete lines to the sink */
+    double last_flush;
+} Writer;
+
+/* Everything one request touches. The one-shot CLI uses a single Run on
+ * stdout; serve mode gives each request its own so workers never share. */
+typedef struct {
+    Arena arena;
+    OpChunk *ops_head, *ops_tail;
+    long nops;
+    Writer out;
+    Sink *line_sink;        /* where --output ndjson lines go */
+    int ndjson;
+    Rng rng;                /* demo-content picks */
+    const char *req_id;     /* serve mode: raw JSON id echoed in the reply */
+    double t_recv;          /* serve mode: when the request line arrived */
+    int io_mode;            /* --io: IO_SYNC or IO_URING */
+    unsigned io_depth;      /* --io-depth: calls in flight with IO_URING */
+    uint64_t t0_ns;         /* run start; op start times are relative to it */
+    uint64_t op_t0, op_bytes;   /* the op about to be recorded (op_begin) */
+    struct LatTable *lat;   /* per-syscall latency histograms, lazily made */
+    int profile;            /* --profile: add rusage to the result */
+} Run;
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static int write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static void out_flush(Writer *w) {
+    if (!w->sink || w->len == 0) return;
+    if (w->sink->lock) pthread_mutex_lock(w->sink->lock);
+    write_all(w->sink->fd, w->buf, w->len);
+    if (w->sink->lock) pthread_mutex_unlock(w->sink->lock);
+    w->len = 0;
+    w->last_flush = now_us();
+}
+
+/* Makes room for n more bytes, draining to the sink when that is allowed
+ * mid-line and growing the buffer otherwise. */
+static int out_reserve(Writer *w, size_t n) {
+    if (w->len + n <= w->cap) return 0;
+    if (w->sink && !w->whole_lines) {
+        out_flush(w);
+        if (n <= w->cap) return 0;
+    }
+    size_t cap = w->cap ? w->cap : 64 * 1024;
+    while (cap < w->len + n) cap *= 2;
+    char *grown = realloc(w->buf, cap);
+    if (!grown) return -1;
+    w->buf = grown;
+    w->cap = cap;
+    return 0;
+}
+
+static void out_write(Run *run, const char *s, size_t n) {
+    Writer *w = &run->out;
+    if (out_reserve(w, n) != 0) return;
+    memcpy(w->buf + w->len, s, n);
+    w->len += n;
+}
+
+static void out_puts(Run *run, const char *s) {
+    out_write(run, s, strlen(s));
+}
+
+static void out_printf(Run *run, const char *fmt, ...) {
+    Writer *w = &run->out;
+    char small[256];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(small, sizeof(small), fmt, ap);
+    va_end(ap);
+    if (n < 0) return;
+    if ((size_t)n < sizeof(small)) { out_write(run, small, (size_t)n); return; }
+    if (out_reserve(w, (size_t)n + 1) != 0) return;
+    va_start(ap, fmt);
+    vsnprintf(w->buf + w->len, (size_t)n + 1, fmt, ap);
+    va_end(ap);
+    w->len += (size_t)n;
+}
+
+/* Writes s as the body of a JSON string (no quotes). */
+static void out_json(Run *run, const char *s) {
+    const char *run_start = s;
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c != '"' && c != '\\' && c >= 0x20) continue;
+        out_write(run, run_start, (size_t)(s - run_start));
+        if (c == '"' || c == '\\') { char esc[2] = { '\\', (char)c }; out_write(run, esc, 2); }
+        else if (c == '\n') out_puts(run, "\\n");
+        else out_printf(run, "\\u%04x", c);
+        run_start = s + 1;
+    }
+    out_write(run, run_start, (size_t)(s - run_start));
+}
+
+static void out_path(Run *run, const char *dir, const char *name) {
+    if (dir) out_json(run, dir);
+    if (name) {
+        if (dir) out_write(run, "/", 1);
+        out_json(run, name);
+    }
+}
+
+/* Ends an ndjson line and pushes buffered lines out once enough bytes or
+ * time have accumulated. */
+static void out_end_line(Run *run) {
+    Writer *w = &run->out;
+    out_write(run, "\n", 1);
+    if (w->len >= OUT_FLUSH_BYTES || now_us() - w->last_flush >= OUT_FLUSH_US)
+        out_flush(w);
+}
+
+/* Switches a run to ndjson output on its line sink. */
+static void run_set_ndjson(Run *run) {
+    run->ndjson = 1;
+    run->out.sink = run->line_sink;
+    run->out.whole_lines = 1;
+    run->out.last_flush = now_us();
+}
+
+/* ---- OP TIMING ----
+ * Every recorded op carries its start and duration on CLOCK_MONOTONIC. A
+ * call site marks the start with op_begin() just before its syscall;
+ * completions of queued I/O pass the time the call was queued, so under
+ * io_uring a duration includes the wait in the ring. An op recorded with
+ * no mark (a failure caught before any call) gets a zero duration and is
+ * left out of the histograms.
+ *
+ * Durations are also counted per syscall label in log-linear buckets,
+ * eight per power of two (values within 12.5%), as HdrHistogram does.
+ * Every worker thread records into its own Run, so this takes no locks or
+ * atomics; run_join_child folds a worker's table into its parent's. */
+#define LAT_SUB_BITS 3
+#define LAT_BUCKETS (64 << LAT_SUB_BITS)
+#define LAT_LABELS 32
+
+typedef struct {
+    const char *label;      /* an op's syscall string */
+    uint64_t count, sum_ns, max_ns;
+    uint32_t buckets[LAT_BUCKETS];
+} LatHist;
+
+typedef struct LatTable {
+    int n;
+    LatHist h[LAT_LABELS];
+} LatTable;
+
+/* Marks the start of the op the next add_*op() records. */
+static void op_begin(Run *run) {
+    run->op_t0 = now_ns();
+}
+
+static void op_begin_at(Run *run, uint64_t t_ns) {
+    run->op_t0 = t_ns;
+}
+
+static void op_set_bytes(Run *run, uint64_t bytes) {
+    run->op_bytes = bytes;
+}
+
+static unsigned lat_bucket(uint64_t ns) {
+    if (ns < (1u << LAT_SUB_BITS)) return (unsigned)ns;
+    int msb = 63 - __builtin_clzll(ns);
+    return (unsigned)(msb - LAT_SUB_BITS + 1) << LAT_SUB_BITS |
+           ((unsigned)(ns >> (msb - LAT_SUB_BITS)) & ((1u << LAT_SUB_BITS) - 1));
+}
+
+/* The largest value that falls in bucket b. */
+static uint64_t lat_bucket_max(unsigned b) {
+    if (b < (1u << LAT_SUB_BITS)) return b;
+    int shift = (int)(b >> LAT_SUB_BITS) - 1;
+    uint64_t lo = (uint64_t)((1u << LAT_SUB_BITS) | (b & ((1u << LAT_SUB_BITS) - 1))) << shift;
+    return lo + ((uint64_t)1 << shift) - 1;
+}
+
+/* The histogram for label, made on first use. Labels are string literals,
+ * so a pointer compare almost always finds it. */
+static LatHist *lat_hist(Run *run, const char *label) {
+    LatTable *t = run->lat;
+    if (!t) {
+        if (!(t = arena_alloc(&run->arena, sizeof(LatTable)))) return NULL;
+        memset(t, 0, sizeof(*t));
+        run->lat = t;
+    }
+    for (int i = 0; i < t->n; i++)
+        if (t->h[i].label == label) return &t->h[i];
+    for (int i = 0; i < t->n; i++)
+        if (strcmp(t->h[i].label, label) == 0) return &t->h[i];
+    if (t->n == LAT_LABELS) return NULL;
+    t->h[t->n].label = label;
+    return &t->h[t->n++];
+}
+
+static void lat_record(Run *run, const char *label, uint64_t ns) {
+    LatHist *h = lat_hist(run, label);
+    if (!h) return;
+    h->count++;
+    h->sum_ns += ns;
+    if (ns > h->max_ns) h->max_ns = ns;
+    h->buckets[lat_bucket(ns)]++;
+}
+
+static void lat_merge(Run *dst, const Run *src) {
+    if (!src->lat) return;
+    for (int i = 0; i < src->lat->n; i++) {
+        const LatHist *s = &src->lat->h[i];
+        LatHist *d = lat_hist(dst, s->label);
+        if (!d) continue;
+        d->count += s->count;
+        d->sum_ns += s->sum_ns;
+        if (s->max_ns > d->max_ns) d->max_ns = s->max_ns;
+        for (int b = 0; b < LAT_BUCKETS; b++) d->buckets[b] += s->buckets[b];
+    }
+}
+
+/* Nearest-rank percentile, reported as its bucket's upper bound. */
+static uint64_t lat_percentile(const LatHist *h, unsigned pct) {
+    uint64_t rank = (h->count * pct + 99) / 100, seen = 0;
+    for (unsigned b = 0; b < LAT_BUCKETS; b++) {
+        seen += h->buckets[b];
+        if (seen >= rank && seen) {
+            uint64_t v = lat_bucket_max(b);
+            return v < h->max_ns ? v : h->max_ns;
+        }
+    }
+    return h->max_ns;
+}
+
+/* ,"latency":{"<syscall>":{count, totalNs, p50Ns, p90Ns, p99Ns, maxNs}} */
+static void lat_print(Run *run) {
+    const LatTable *t = run->lat;
+    if (!t || !t->n) return;
+    out_puts(run, ",\"latency\":{");
+    for (int i = 0; i < t->n; i++) {
+        const LatHist *h = &t->h[i];
+        out_printf(run, "%s\"", i ? "," : "");
+        out_json(run, h->label);
+        out_printf(run, "\":{\"count\":%llu,\"totalNs\":%llu,\"p50Ns\":%llu,\"p90Ns\":%llu,\"p99Ns\":%llu,\"maxNs\":%llu}",
+                   (unsigned long long)h->count, (unsigned long long)h->sum_ns,
+                   (unsigned long long)lat_percentile(h, 50), (unsigned long long)lat_percentile(h, 90),
+                   (unsigned long long)lat_percentile(h, 99), (unsigned long long)h->max_ns);
+    }
+    out_puts(run, "}");
+}
+
+/* --profile: CPU time, peak RSS, page faults and context switches from
+ * getrusage(). In serve mode they are the server process's totals. */
+static void profile_print(Run *run) {
+    struct rusage ru;
+    if (!run->profile || getrusage(RUSAGE_SELF, &ru) != 0) return;
+    out_printf(run, ",\"profile\":{\"wallMs\":%.3f,\"userMs\":%.3f,\"sysMs\":%.3f,\"maxRssKb\":%ld,"
+               "\"minorFaults\":%ld,\"majorFaults\":%ld,\"blockIn\":%ld,\"blockOut\":%ld,"
+               "\"volCtxSw\":%ld,\"invCtxSw\":%ld}",
+               (now_ns() - run->t0_ns) / 1e6, ru.ru_utime.tv_sec * 1e3 + ru.ru_utime.tv_usec / 1e3,
+               ru.ru_stime.tv_sec * 1e3 + ru.ru_stime.tv_usec / 1e3, ru.ru_maxrss, ru.ru_minflt, ru.ru_majflt,
+               ru.ru_inblock, ru.ru_oublock, ru.ru_nvcsw, ru.ru_nivcsw);
+}
+
+static void out_op_timing(Run *run, const OpRec *r) {
+    out_printf(run, ",\"startNs\":%llu,\"durNs\":%llu", (unsigned long long)r->start_ns,
+               (unsigned long long)r->dur_ns);
+    if (r->bytes) out_printf(run, ",\"bytes\":%llu", (unsigned long long)r->bytes);
+}
+
+static void emit_op_line(Run *run, const OpRec *r, const char *rel, const char *category) {
+    long id = __atomic_add_fetch(&run->line_sink->next_op_id, 1, __ATOMIC_RELAXED);
+    out_printf(run, "{\"type\":\"op\",\"id\":%ld,\"op\":\"%s\",\"description\":\"%s\",\"syscall\":\"%s\",\"path\":\"",
+               id, r->op, r->description, r->syscall);
+    out_path(run, r->dir, r->name);
+    out_puts(run, "\",\"path2\":\"");
+    out_path(run, r->dir2, r->name2);
+    out_printf(run, "\",\"success\":%s,\"error\":\"", r->success ? "true" : "false");
+    if (r->error) out_json(run, r->error);
+    out_puts(run, "\"");
+    out_op_timing(run, r);
+    if (category) {
+        out_printf(run, ",\"category\":\"%s\",\"entry\":\"", category);
+        out_path(run, rel, r->name);
+        out_puts(run, "\"");
+    }
+    if (run->req_id) out_printf(run, ",\"requestId\":%s", run->req_id);
+    out_puts(run, "}");
+    out_end_line(run);
+}
+
+static OpRec *new_op(Run *run) {
+    OpChunk *c = run->ops_tail;
+    if (!c || c->count == OPS_PER_CHUNK) {
+        c = arena_alloc(&run->arena, sizeof(OpChunk));
+        if (!c) return NULL;
+        c->next = NULL;
+        c->count = 0;
+        if (run->ops_tail) run->ops_tail->next = c; else run->ops_head = c;
+        run->ops_tail = c;
+    }
+    run->nops++;
+    return &c->recs[c->count++];
+}
+
+/* Records an op on already-interned paths (dir + optional name each).
+ * In ndjson mode nothing is kept: the op is written out immediately, and
+ * category/rel (set for organize moves) are added to its line. */
+static void add_move_op(Run *run, const char *op, const char *desc, const char *syscall,
+                        const char *dir, const char *name, const char *dir2, const char *name2,
+                        int success, const char *err, const char *rel, const char *category) {
+    OpRec tmp, *r = run->ndjson ? &tmp : new_op(run);
+    if (!r) return;
+    r->op = op;
+    r->description = desc;
+    r->syscall = syscall;
+    r->dir = dir;
+    r->name = name;
+    r->dir2 = dir2;
+    r->name2 = name2;
+    r->success = success;
+    uint64_t end = now_ns();
+    r->start_ns = (run->op_t0 ? run->op_t0 : end) - run->t0_ns;
+    r->dur_ns = run->op_t0 ? end - run->op_t0 : 0;
+    r->bytes = run->op_bytes;
+    if (run->op_t0) lat_record(run, syscall, r->dur_ns);
+    run->op_t0 = run->op_bytes = 0;
+    if (run->ndjson) {
+        r->error = err;
+        emit_op_line(run, r, rel, category);
+        return;
+    }
+    r->error = err ? arena_strdup(&run->arena, err) : NULL;
+}
+
+static void add_op_ref(Run *run, const char *op, const char *desc, const char *syscall,
+                       const char *dir, const char *name, const char *dir2, const char *name2,
+                       int success, const char *err) {
+    add_move_op(run, op, desc, syscall, dir, name, dir2, name2, success, err, NULL, NULL);
+}
+
+static void add_op(Run *run, const char *op, const char *desc, const char *syscall,
+                   const char *path, const char *path2, int success, const char *err) {
+    if (run->ndjson) {
+        add_op_ref(run, op, desc, syscall, path, NULL, path2, NULL, success, err);
+        return;
+    }
+    add_op_ref(run, op, desc, syscall,
+               path ? arena_strdup(&run->arena, path) : NULL, NULL,
+               path2 ? arena_strdup(&run->arena, path2) : NULL, NULL, success, err);
+}
+
+/* Appends src's op log to dst's and hands over the memory backing it. */
+static void run_adopt(Run *dst, Run *src) {
+    if (src->ops_head) {
+        if (dst->ops_tail) dst->ops_tail->next = src->ops_head; else dst->ops_head = src->ops_head;
+        dst->ops_tail = src->ops_tail;
+        dst->nops += src->nops;
+    }
+    src->ops_head = src->ops_tail = NULL;
+    src->nops = 0;
+    arena_adopt(&dst->arena, &src->arena);
+}
+
+/* A Run for a helper thread: the request's output settings with its own
+ * arena and op log. run_join_child merges it back once the thread is done. */
+static Run *run_child(Run *run, unsigned k) {
+    Run *c = calloc(1, sizeof(Run));
+    if (!c) return NULL;
+    rng_seed(&c->rng, rng_next(&run->rng) + k);
+    c->line_sink = run->line_sink;
+    c->req_id = run->req_id;
+    c->io_mode = run->io_mode;
+    c->io_depth = run->io_depth;
+    c->t0_ns = run->t0_ns;
+    if (run->ndjson) run_set_ndjson(c);
+    return c;
+}
+
+static void run_join_child(Run *run, Run *child) {
+    out_flush(&child->out);
+    free(child->out.buf);
+    lat_merge(run, child);
+    run_adopt(run, child);
+    free(child);
+}
+
+/* Opens the top-level object: the recorded ops in JSON mode, or the
+ * summary line's prefix in ndjson mode (the ops are already out). */
+static void print_ops(Run *run) {
+    if (run->ndjson) {
+        out_puts(run, "{\"type\":\"result\",\"ops\":");
+        out_printf(run, "%ld", run->line_sink->next_op_id);
+        return;
+    }
+    long id = 0;
+    out_puts(run, "{\"operations\":[");
+    for (OpChunk *c = run->ops_head; c; c = c->next) {
+        for (int i = 0; i < c->count; i++) {
+            OpRec *r = &c->recs[i];
+            out_printf(run, "%s{\"id\":%ld,\"op\":\"%s\",\"description\":\"%s\",\"syscall\":\"%s\",\"path\":\"",
+                       id ? "," : "", id + 1, r->op, r->description, r->syscall);
+            out_path(run, r->dir, r->name);
+            out_puts(run, "\",\"path2\":\"");
+            out_path(run, r->dir2, r->name2);
+            out_printf(run, "\",\"success\":%s,\"error\":\"", r->success ? "true" : "false");
+            if (r->error) out_json(run, r->error);
+            out_puts(run, "\"");
+            out_op_timing(run, r);
+            out_puts(run, "}");
+            id++;
+        }
+    }
+    out_puts(run, "]");
+}
+
+/* Closes the top-level object; in serve mode this is where the request id
+ * and latency are appended so every payload shape gets them, followed by
+ * the per-syscall histograms and, with --profile, the rusage counters. */
+static void finish_json(Run *run) {
+    if (run->req_id)
+        out_printf(run, ",\"%s\":%s,\"latencyUs\":%.0f", run->ndjson ? "requestId" : "id",
+                   run->req_id, now_us() - run->t_recv);
+    lat_print(run);
+    profile_print(run);
+    out_puts(run, "}\n");
+    out_flush(&run->out);
+}
+
+/* ---- I/O BACKEND ----
+ * The metadata calls a run makes in bulk (mkdirat, openat, renameat, statx,
+ * close) go through a small backend so they can be batched. IO_SYNC runs
+ * each call on the spot; IO_URING queues them as io_uring submissions (raw
+ * syscalls, no liburing) and lets the kernel work on up to `depth` of them at
+ * once, which is what helps on slow or network-backed disks. Either way the
+ * caller's IoReq.done gets the result (-errno on failure) once per call, so
+ * one code path serves both. Completion callbacks must not queue new I/O. */
+enum { IO_SYNC, IO_URING };
+#define IO_DEFAULT_DEPTH 64
+
+typedef struct IoReq IoReq;
+struct IoReq {
+    void (*done)(IoReq *req, int res);
+    uint64_t t_ns;          /* when the call was issued, for op timing */
+};
+
+#if defined(__linux__) && defined(SYS_io_uring_setup)
+#define IO_HAVE_URING 1
+#endif
+
+typedef struct {
+    int mode;
+    unsigned depth;
+    int link;               /* sync: next call depends on the previous one */
+    int last_res;           /* sync: result of the previous call */
+#ifdef IO_HAVE_URING
+    int ring_fd;
+    unsigned *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes, *last_sqe;
+    struct io_uring_cqe *cqes;
+    void *sq_map, *cq_map;
+    size_t sq_map_len, cq_map_len, sqes_len;
+    unsigned queued, inflight;
+#endif
+} Io;
+
+#ifdef RENAME_NOREPLACE
+#define IO_RENAME_NOREPLACE RENAME_NOREPLACE
+#else
+#define IO_RENAME_NOREPLACE 1   /* the sync path reports EINVAL; callers fall back */
+#endif
+
+/* IO_LINK: run the next call only if this one succeeds. The ring does not
+ * treat a failed mkdirat/renameat as breaking the link, so callers must
+ * still check both results. */
+#define IO_LINK 1
+#define IO_HARDLINK 2       /* run the next call after this one, whatever happened */
+
+#ifdef IO_HAVE_URING
+/* True when the kernel implements every opcode the backend uses. */
+static int io_probe(int ring_fd) {
+    static const int needed[] = { IORING_OP_OPENAT, IORING_OP_CLOSE, IORING_OP_STATX,
+                                  IORING_OP_RENAMEAT, IORING_OP_MKDIRAT };
+    size_t len = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *p = calloc(1, len);
+    if (!p) return 0;
+    int ok = syscall(SYS_io_uring_register, ring_fd, IORING_REGISTER_PROBE, p, 256) == 0;
+    for (size_t i = 0; ok && i < sizeof(needed) / sizeof(needed[0]); i++)
+        ok = needed[i] <= p->last_op && (p->ops[needed[i]].flags & IO_URING_OP_SUPPORTED);
+    free(p);
+    return ok;
+}
+
+static int io_ring_setup(Io *io) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    io->ring_fd = syscall(SYS_io_uring_setup, io->depth, &p);
+    if (io->ring_fd < 0) return -1;
+    if (!io_probe(io->ring_fd)) { close(io->ring_fd); return -1; }
+    io->depth = p.sq_entries;
+    io->sq_map_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    io->cq_map_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (io->cq_map_len > io->sq_map_len) io->sq_map_len = io->cq_map_len;
+        io->cq_map_len = io->sq_map_len;
+    }
+    io->sq_map = mmap(NULL, io->sq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      io->ring_fd, IORING_OFF_SQ_RING);
+    io->cq_map = io->sq_map;
+    if (io->sq_map != MAP_FAILED && !(p.features & IORING_FEAT_SINGLE_MMAP))
+        io->cq_map = mmap(NULL, io->cq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          io->ring_fd, IORING_OFF_CQ_RING);
+    io->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    io->sqes = mmap(NULL, io->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    io->ring_fd, IORING_OFF_SQES);
+    if (io->sq_map == MAP_FAILED || io->cq_map == MAP_FAILED || io->sqes == MAP_FAILED) {
+        if (io->sqes != MAP_FAILED) munmap(io->sqes, io->sqes_len);
+        if (io->cq_map != MAP_FAILED && io->cq_map != io->sq_map) munmap(io->cq_map, io->cq_map_len);
+        if (io->sq_map != MAP_FAILED) munmap(io->sq_map, io->sq_map_len);
+        close(io->ring_fd);
+        return -1;
+    }
+    char *sq = io->sq_map, *cq = io->cq_map;
+    io->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    io->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    io->sq_array = (unsigned *)(sq + p.sq_off.array);
+    io->cq_head = (unsigned *)(cq + p.cq_off.head);
+    io->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    io->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    io->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    io->queued = io->inflight = 0;
+    io->last_sqe = NULL;
+    return 0;
+}
+
+/* Runs the callbacks of every completion already posted. */
+static void io_reap(Io *io) {
+    unsigned head = *io->cq_head;
+    while (head != __atomic_load_n(io->cq_tail, __ATOMIC_ACQUIRE)) {
+        struct io_uring_cqe *cqe = &io->cqes[head & *io->cq_mask];
+        IoReq *req = (IoReq *)(uintptr_t)cqe->user_data;
+        int res = cqe->res;
+        __atomic_store_n(io->cq_head, ++head, __ATOMIC_RELEASE);
+        io->inflight--;
+        req->done(req, res);
+    }
+}
+
+/* Submits what is queued and waits until at least `want` completions have
+ * been handled (fewer if less is in flight). */
+static void io_submit_wait(Io *io, unsigned want) {
+    while (io->queued || want) {
+        if (want > io->inflight + io->queued) want = io->inflight + io->queued;
+        int n = syscall(SYS_io_uring_enter, io->ring_fd, io->queued, want,
+                        want ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if (n < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            fprintf(stderr, "io_uring_enter: %s\n", strerror(errno));
+            abort();
+        }
+        if (n > 0) {
+            io->queued -= n;
+            io->inflight += n;
+        }
+        unsigned before = io->inflight;
+        io_reap(io);
+        unsigned got = before - io->inflight;
+        want = got >= want ? 0 : want - got;
+        io->last_sqe = NULL;
+    }
+}
+
+/* Makes room for n more submissions, waiting for completions if needed. */
+static void io_reserve(Io *io, unsigned n) {
+    if (io->mode != IO_URING) return;
+    while (io->queued + io->inflight + n > io->depth) io_submit_wait(io, 1);
+}
+
+static struct io_uring_sqe *io_sqe(Io *io, IoReq *req, int op, int fd) {
+    io_reserve(io, 1);
+    unsigned tail = *io->sq_tail, idx = tail & *io->sq_mask;
+    struct io_uring_sqe *sqe = &io->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = op;
+    sqe->fd = fd;
+    sqe->user_data = (uint64_t)(uintptr_t)req;
+    io->sq_array[idx] = idx;
+    __atomic_store_n(io->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    io->queued++;
+    io->last_sqe = sqe;
+    return sqe;
+}
+#endif
+
+/* IO_URING falls back to IO_SYNC when the kernel has no usable io_uring
+ * (too old, disabled by sysctl, or seccomp-filtered). */
+static void io_init(Io *io, int mode, unsigned depth) {
+    memset(io, 0, sizeof(*io));
+    io->mode = IO_SYNC;
+    io->depth = depth ? depth : IO_DEFAULT_DEPTH;
+    if (io->depth < 2) io->depth = 2;   /* a linked pair must fit */
+#ifdef IO_HAVE_URING
+    if (mode == IO_URING && io_ring_setup(io) == 0) io->mode = IO_URING;
+#else
+    (void)mode;
+#endif
+}
+
+/* Waits for at least one outstanding call to complete. */
+static void io_wait(Io *io) {
+#ifdef IO_HAVE_URING
+    if (io->mode == IO_URING) io_submit_wait(io, 1);
+#else
+    (void)io;
+#endif
+}
+
+/* Waits for every queued call to complete. */
+static void io_drain(Io *io) {
+#ifdef IO_HAVE_URING
+    if (io->mode == IO_URING) io_submit_wait(io, io->queued + io->inflight);
+#else
+    (void)io;
+#endif
+}
+
+static void io_destroy(Io *io) {
+    io_drain(io);
+#ifdef IO_HAVE_URING
+    if (io->mode == IO_URING) {
+        munmap(io->sqes, io->sqes_len);
+        if (io->cq_map != io->sq_map) munmap(io->cq_map, io->cq_map_len);
+        munmap(io->sq_map, io->sq_map_len);
+        close(io->ring_fd);
+    }
+#endif
+}
+
+/* Chains the next call to the last one (IO_LINK or IO_HARDLINK). Reserve
+ * room for the whole chain first so it goes to the kernel in one batch. */
+static void io_link(Io *io, int how) {
+#ifdef IO_HAVE_URING
+    if (io->mode == IO_URING) {
+        if (io->last_sqe) io->last_sqe->flags |= how == IO_LINK ? IOSQE_IO_LINK : IOSQE_IO_HARDLINK;
+        return;
+    }
+#endif
+    io->link = how;
+}
+
+/* Sync mode: a call linked to a failed one completes with -ECANCELED, as
+ * it would on the ring. */
+static int io_sync_cancelled(Io *io, IoReq *req) {
+    int skip = io->link == IO_LINK && io->last_res < 0;
+    io->link = 0;
+    if (skip) {
+        io->last_res = -ECANCELED;
+        req->done(req, -ECANCELED);
+    }
+    return skip;
+}
+
+static void io_sync_done(Io *io, IoReq *req, int res) {
+    if (res < 0) res = -errno;
+    io->last_res = res;
+    req->done(req, res);
+}
+
+static void io_mkdirat(Io *io, IoReq *req, int dfd, const char *path, mode_t mode) {
+    req->t_ns = now_ns();
+#ifdef IO_HAVE_URING
+    if (io->mode == IO_URING) {
+        struct io_uring_sqe *sqe = io_sqe(io, req, IORING_OP_MKDIRAT, dfd);
+        sqe->addr = (uint64_t)(uintptr_t)path;
+        sqe->len = mode;
+        return;
+    }
+#endif
+    if (!io_sync_cancelled(io, req)) io_sync_done(io, req, mkdirat(dfd, path, mode));
+}
+
+static void io_openat(Io *io, IoReq *req, int dfd, const char *path, int flags, mode_t mode) {
+    req->t_ns = now_ns();
+#ifdef IO_HAVE_URING
+    if (io->mode == IO_URING) {
+        struct io_uring_sqe *sqe = io_sqe(io, req, IORING_OP_OPENAT, dfd);
+        sqe->addr = (uint64_t)(uintptr_t)path;
+        sqe->len = mode;
+        sqe->open_flags = flags;
+        return;
+    }
+#endif
+    if (!io_sync_cancelled(io, req)) io_sync_done(io, req, openat(dfd, path, flags, mode));
+}
+
+static void io_renameat(Io *io, IoReq *req, int old_dfd, const char *old_path,
+                        int new_dfd, const char *new_path, unsigned flags) {
+    req->t_ns = now_ns();
+#ifdef IO_HAVE_URING
+    if (io->mode == IO_URING) {
+        struct io_uring_sqe *sqe = io_sqe(io, req, IORING_OP_RENAMEAT, old_dfd);
+        sqe->addr = (uint64_t)(uintptr_t)old_path;
+        sqe->len = new_dfd;
+        sqe->off = (uint64_t)(uintptr_t)new_path;
+        sqe->rename_flags = flags;
+        return;
+    }
+#endif
+    if (io_sync_cancelled(io, req)) return;
+#ifdef RENAME_NOREPLACE
+    io_sync_done(io, req, renameat2(old_dfd, old_path, new_dfd, new_path, flags));
+#else
+    if (flags) { errno = EINVAL; io_sync_done(io, req, -1); }
+    else io_sync_done(io, req, renameat(old_dfd, old_path, new_dfd, new_path));
+#endif
+}
+
+#ifdef STATX_SIZE
+static void io_statx(Io *io, IoReq *req, int dfd, const char *path, int flags,
+                     unsigned mask, struct statx *stx) {
+    req->t_ns = now_ns();
+#ifdef IO_HAVE_URING
+    if (io->mode == IO_URING) {
+        struct io_uring_sqe *sqe = io_sqe(io, req, IORING_OP_STATX, dfd);
+        sqe->addr = (uint64_t)(uintptr_t)path;
+        sqe->len = mask;
+        sqe->off = (uint64_t)(uintptr_t)stx;
+        sqe->statx_flags = flags;
+        return;
+    }
+#endif
+    if (!io_sync_cancelled(io, req)) io_sync_done(io, req, statx(dfd, path, flags, mask, stx));
+}
+#endif
+
+static void io_close(Io *io, IoReq *req, int fd) {
+    req->t_ns = now_ns();
+#ifdef IO_HAVE_URING
+    if (io->mode == IO_URING) {
+        io_sqe(io, req, IORING_OP_CLOSE, fd);
+        return;
+    }
+#endif
+    if (!io_sync_cancelled(io, req)) io_sync_done(io, req, close(fd));
+}
+
+/* Op-log label for a call: the plain syscall, or the ring opcode. */
+static const char *io_label(const Io *io, const char *sync_name, const char *ring_name) {
+    return io->mode == IO_URING ? ring_name : sync_name;
+}
+
+/* One file of create-dir: openat(O_CREAT), then close once every open has
+ * completed (completions may not queue further I/O). */
+typedef struct {
+    IoReq open, close;
+    Run *run;
+    const Io *io;
+    const char *dir_path, *name;
+    int fd;
+} CreateReq;
+
+static void create_open_done(IoReq *req, int res) {
+    CreateReq *c = (CreateReq *)((char *)req - offsetof(CreateReq, open));
+    c->fd = res;
+    op_begin_at(c->run, req->t_ns);
+    add_op_ref(c->run, "writeFile", "Create file", io_label(c->io, "openat(2)/close(2)", "io_uring OPENAT/CLOSE"),
+               c->dir_path, c->name, NULL, NULL, res >= 0, res >= 0 ? NULL : strerror(-res));
+}
+
+static void create_close_done(IoReq *req, int res) {
+    (void)req;
+    (void)res;
+}
+
+static int create_dir_and_files(Run *run, const char *workspace, const char *dir_name, char *files[], int nfiles) {
+    const char *dir_path = arena_join(&run->arena, workspace, dir_name);
+    if (!dir_path) return -1;
+
+    op_begin(run);
+    if (mkdir(dir_path, 0777) == 0) {
+        add_op_ref(run, "mkdir", "Create directory", "mkdir(2)", dir_path, NULL, NULL, NULL, 1, NULL);
+    } else {
+        add_op_ref(run, "mkdir", "Create directory", "mkdir(2)", dir_path, NULL, NULL, NULL, 0, strerror(errno));
+        if (errno != EEXIST) return -1;
+    }
+
+    Io io;
+    io_init(&io, run->io_mode, run->io_depth);
+    int dfd = open(dir_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    int dir_err = errno;
+    CreateReq *reqs = arena_alloc(&run->arena, (nfiles ? nfiles : 1) * sizeof(CreateReq));
+    if (!reqs) { if (dfd >= 0) close(dfd); io_destroy(&io); return -1; }
+    for (int i = 0; i < nfiles; i++) {
+        CreateReq *c = &reqs[i];
+        c->open.done = create_open_done;
+        c->close.done = create_close_done;
+        c->run = run;
+        c->io = &io;
+        c->dir_path = dir_path;
+        c->name = files[i];
+        if (dfd >= 0) io_openat(&io, &c->open, dfd, files[i], O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+        else c->open.done(&c->open, -dir_err);
+    }
+    io_drain(&io);
+    for (int i = 0; i < nfiles; i++)
+        if (reqs[i].fd >= 0) io_close(&io, &reqs[i].close, reqs[i].fd);
+    io_destroy(&io);
+    if (dfd >= 0) close(dfd);
+
+    print_ops(run);
+    out_puts(run, ",\"result\":{\"dirPath\":\"");
+    out_json(run, dir_path);
+    out_printf(run, "\",\"created\":%d}", nfiles);
+    finish_json(run);
+    return 0;
+}
+
+/* ---- CLASSIFIER ----
+ * Built-in extension rules come from ext_rules.conf via the generated
+ * ext_hash.h perfect hash. --rules <file> layers user categories on top:
+ *
+ *     Category: ext ext ...
+ *     Category -> Folder/Path: ext ext ...
+ *
+ * A built-in category name adds extensions to it (and may move its
+ * folder); any other name becomes a new category placed before Others.
+ * User extensions sit in a small open-addressing table keyed by the same
+ * packed 64-bit keys, consulted before the built-in hash. */
+typedef struct {
+    int ncats;              /* the last one is always Others */
+    const char **names;     /* result keys */
+    const char **dests;     /* folders, relative to the organized directory */
+    uint64_t *keys;         /* user rules; 0 marks an empty slot */
+    int *key_cats;
+    unsigned mask;          /* table size - 1, or 0 with no user rules */
+} Classifier;
+
+static const Classifier builtin_classifier = {
+    EXT_NUM_CATS, (const char **)ext_cat_names, (const char **)ext_cat_names, NULL, NULL, 0
+};
+
+static int classify(const Classifier *cl, const char *name) {
+    const char *dot = strrchr(name, '.');
+    if (!dot) return cl->ncats - 1;
+    uint64_t key = ext_key(dot + 1);
+    if (cl->mask && key) {
+        unsigned slot = (unsigned)((key * EXT_HASH_MULT) >> 32) & cl->mask;
+        for (; cl->keys[slot]; slot = (slot + 1) & cl->mask)
+            if (cl->keys[slot] == key) return cl->key_cats[slot];
+    }
+    int cat = ext_lookup(key);
+    return cat == EXT_CAT_OTHERS ? cl->ncats - 1 : cat;
+}
+
+static int is_img(const char *ext) { return ext_lookup(ext_key(ext + 1)) == EXT_CAT_IMAGES; }
+static int is_aud(const char *ext) { return ext_lookup(ext_key(ext + 1)) == EXT_CAT_AUDIO; }
+static int is_vid(const char *ext) { return ext_lookup(ext_key(ext + 1)) == EXT_CAT_VIDEOS; }
+
+static char *trim(char *s) {
+    while (*s == ' ' || *s == '\t') s++;
+    char *e = s + strlen(s);
+    while (e > s && (e[-1] == ' ' || e[-1] == '\t' || e[-1] == '\r' || e[-1] == '\n')) *--e = '\0';
+    return s;
+}
+
+/* Loads a --rules file into a classifier allocated from the run arena.
+ * Prints the problem and returns NULL on a malformed file. */
+static const Classifier *load_rules(Run *run, const char *path) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        fprintf(stderr, "rules: %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+    Arena *a = &run->arena;
+    int cap_cats = EXT_NUM_CATS + 8, nuser = 0, cap_exts = 64, nexts = 0;
+    const char **names = malloc(cap_cats * sizeof(char *));
+    const char **dests = malloc(cap_cats * sizeof(char *));
+    uint64_t *ext_keys = malloc(cap_exts * sizeof(uint64_t));
+    int *ext_cats = malloc(cap_exts * sizeof(int));
+    Classifier *cl = arena_alloc(a, sizeof(Classifier));
+    int ok = names && dests && ext_keys && ext_cats && cl;
+    for (int c = 0; ok && c < EXT_NUM_CATS - 1; c++) names[c] = dests[c] = ext_cat_names[c];
+
+    const char *others_dest = NULL;
+    char line[4096];
+    int lineno = 0;
+    while (ok && fgets(line, sizeof(line), fp)) {
+        lineno++;
+        char *hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+        char *head = trim(line);
+        if (!*head) continue;
+        char *colon = strchr(head, ':');
+        if (!colon) {
+            fprintf(stderr, "rules: %s:%d: expected 'Category[ -> Folder]: ext ...'\n", path, lineno);
+            ok = 0;
+            break;
+        }
+        *colon = '\0';
+        char *dest = NULL, *arrow = strstr(head, "->");
+        if (arrow) {
+            *arrow = '\0';
+            dest = trim(arrow + 2);
+        }
+        char *name = trim(head);
+        int cat = -1;
+        if (strcmp(name, ext_cat_names[EXT_CAT_OTHERS]) == 0) {
+            /* Others stays last; its index is only known once all lines are read. */
+            cat = INT_MAX;
+            if (dest && *dest) others_dest = arena_strdup(a, dest);
+        }
+        for (int c = 0; cat < 0 && c < EXT_NUM_CATS - 1 + nuser; c++)
+            if (strcmp(names[c], name) == 0) cat = c;
+        if (cat < 0) {
+            if (EXT_NUM_CATS + nuser == cap_cats) {
+                cap_cats *= 2;
+                const char **gn = realloc(names, cap_cats * sizeof(char *));
+                if (gn) names = gn;
+                const char **gd = realloc(dests, cap_cats * sizeof(char *));
+                if (gd) dests = gd;
+                if (!gn || !gd) { ok = 0; break; }
+            }
+            cat = EXT_NUM_CATS - 1 + nuser++;
+            names[cat] = dests[cat] = arena_strdup(a, name);
+        }
+        if (dest && *dest && cat != INT_MAX) dests[cat] = arena_strdup(a, dest);
+
+        char *save = NULL;
+        for (char *tok = strtok_r(colon + 1, " \t\r\n,", &save); tok; tok = strtok_r(NULL, " \t\r\n,", &save)) {
+            uint64_t key = ext_key(*tok == '.' ? tok + 1 : tok);
+            if (!key) {
+                fprintf(stderr, "rules: %s:%d: extension '%s' must be 1-8 characters\n", path, lineno, tok);
+                ok = 0;
+                break;
+            }
+            if (nexts == cap_exts) {
+                cap_exts *= 2;
+                uint64_t *gk = realloc(ext_keys, cap_exts * sizeof(uint64_t));
+                if (gk) ext_keys = gk;
+                int *gc = realloc(ext_cats, cap_exts * sizeof(int));
+                if (gc) ext_cats = gc;
+                if (!gk || !gc) { ok = 0; break; }
+            }
+            ext_keys[nexts] = key;
+            ext_cats[nexts] = cat;
+            nexts++;
+        }
+    }
+    fclose(fp);
+
+    if (ok) {
+        int ncats = EXT_NUM_CATS + nuser;
+        names[ncats - 1] = dests[ncats - 1] = ext_cat_names[EXT_CAT_OTHERS];
+        if (others_dest) dests[ncats - 1] = others_dest;
+        for (int i = 0; i < nexts; i++)
+            if (ext_cats[i] == INT_MAX) ext_cats[i] = ncats - 1;
+        cl->ncats = ncats;
+        cl->names = arena_alloc(a, ncats * sizeof(char *));
+        cl->dests = arena_alloc(a, ncats * sizeof(char *));
+        unsigned size = 16;
+        while (size < 2u * (unsigned)nexts) size *= 2;
+        cl->keys = arena_alloc(a, size * sizeof(uint64_t));
+        cl->key_cats = arena_alloc(a, size * sizeof(int));
+        ok = cl->names && cl->dests && cl->keys && cl->key_cats;
+        if (ok) {
+            memcpy(cl->names, names, ncats * sizeof(char *));
+            memcpy(cl->dests, dests, ncats * sizeof(char *));
+            memset(cl->keys, 0, size * sizeof(uint64_t));
+            cl->mask = size - 1;
+            /* Later lines win over earlier ones for the same extension. */
+            for (int i = 0; i < nexts; i++) {
+                unsigned slot = (unsigned)((ext_keys[i] * EXT_HASH_MULT) >> 32) & cl->mask;
+                while (cl->keys[slot] && cl->keys[slot] != ext_keys[i]) slot = (slot + 1) & cl->mask;
+                cl->keys[slot] = ext_keys[i];
+                cl->key_cats[slot] = ext_cats[i];
+            }
+        }
+    }
+    free(names);
+    free(dests);
+    free(ext_keys);
+    free(ext_cats);
+    return ok ? cl : NULL;
+}
+
+/* ---- TEXT TEMPLATES FOR .txt FILES ---- */
+static const char *text_templates[] = {
+    "Meeting Notes - Q4 Planning\n\nDate: 2024-11-15\nAttendees: Alice, Bob, Charlie\n\nAgenda:\n1. Budget review for next quarter\n2. New product roadmap discussion\n3. Team restructuring proposals\n\nKey Decisions:\n- Approved 15% budget increase for R&D\n- Launch date set for March 2025\n- Two new hires approved for engineering team\n\nAction Items:\n- Alice: Prepare detailed budget breakdown by Friday\n- Bob: Draft product requirements document\n- Charlie: Schedule interviews for new positions\n",
+    "Project Status Report\n\nProject: Smart File Organizer v2.0\nStatus: On Track\nSprint: 14 of 20\n\nCompleted This Week:\n- Implemented file categorization algorithm\n- Added support for 15+ file extensions\n- Integrated with cloud storage API\n- Fixed 3 critical bugs from QA testing\n\nPlanned Next Week:\n- User acceptance testing begins\n- Performance optimization for large directories\n- Documentation updates\n\nRisks:\n- Third-party API rate limiting may affect sync speed\n- Need additional testing on Windows platform\n",
+    "Dear Team,\n\nI hope this message finds you well. I wanted to share some exciting updates about our upcoming product launch.\n\nAfter months of hard work, we are pleased to announce that the Smart File Organizer will be released on March 15, 2025. This tool will revolutionize how users manage their digital files.\n\nKey Features:\n- Automatic file categorization by type\n- Smart duplicate detection\n- Cloud backup integration\n- Cross-platform compatibility\n\nPlease review the attached documentation and provide your feedback by end of week.\n\nBest regards,\nThe Development Team\n",
+    "Recipe: Classic Chocolate Chip Cookies\n\nPrep Time: 15 minutes\nCook Time: 12 minutes\nServings: 48 cookies\n\nIngredients:\n- 2 1/4 cups all-purpose flour\n- 1 tsp baking soda\n- 1 tsp salt\n- 1 cup butter, softened\n- 3/4 cup granulated sugar\n- 3/4 cup packed brown sugar\n- 2 large eggs\n- 2 tsp vanilla extract\n- 2 cups chocolate chips\n\nInstructions:\n1. Preheat oven to 375 degrees F\n2. Mix flour, baking soda and salt in a bowl\n3. Beat butter, sugars, eggs and vanilla until creamy\n4. Gradually blend in flour mixture\n5. Stir in chocolate chips\n6. Drop onto ungreased baking sheets\n7. Bake for 9 to 11 minutes or until golden brown\n",
+    "Daily Journal Entry\n\nDate: Wednesday, November 20, 2024\nWeather: Partly cloudy, 18 degrees C\nMood: Productive and optimistic\n\nToday was a remarkably productive day. I managed to complete the file organization module that I have been working on for the past week. The algorithm now correctly identifies and sorts files into their respective categories.\n\nI also had a great meeting with the team where we discussed the roadmap for the next quarter. Everyone seems excited about the new features we are planning to implement.\n\nIn the evening, I went for a run in the park. The autumn leaves are beautiful this time of year. It is amazing how a bit of exercise can clear your mind and boost creativity.\n\nTomorrow, I plan to start working on the user interface improvements and write some unit tests for the sorting algorithm.\n\nGratitude list:\n- Supportive team members\n- Good health\n- Beautiful weather for running\n"
+};
+#define NUM_TEMPLATES 5
+
+/* ---- COPY ENGINE ----
+ * Cheapest method first. A FICLONE reflink shares the source's extents, so
+ * no data moves at all on btrfs/XFS. Otherwise the data extents (found with
+ * SEEK_DATA/SEEK_HOLE, so holes stay holes) go through copy_file_range,
+ * which never leaves the kernel and can be offloaded to the filesystem or
+ * NFS server; then sendfile; then a 1 MB pread/pwrite loop. */
+#define COPY_BUF (1 << 20)
+
+enum { COPY_CLONE, COPY_RANGE, COPY_SENDFILE, COPY_RW };
+static const char *const copy_how[] = {
+    "ioctl(FICLONE)", "copy_file_range(2)", "sendfile(2)", "read(2)/write(2)"
+};
+
+static int pwrite_all(int fd, const char *buf, size_t len, off_t off) {
+    while (len > 0) {
+        ssize_t n = pwrite(fd, buf, len, off);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        buf += n;
+        len -= n;
+        off += n;
+    }
+    return 0;
+}
+
+/* Copies [off, off + len) from in to out at the same offset. *method only
+ * ever moves down the list, once a method turns out to be unsupported. */
+static int copy_extent(int in, int out, off_t off, off_t len, int *method, char **buf) {
+    while (len > 0) {
+        ssize_t n;
+#ifdef __linux__
+        if (*method == COPY_RANGE) {
+            off_t in_off = off, out_off = off;
+            n = copy_file_range(in, &in_off, out, &out_off, (size_t)len, 0);
+            if (n < 0 && (errno == EXDEV || errno == ENOSYS || errno == EOPNOTSUPP || errno == EINVAL)) {
+                *method = COPY_SENDFILE;
+                continue;
+            }
+        } else if (*method == COPY_SENDFILE) {
+            off_t in_off = off;
+            if (lseek(out, off, SEEK_SET) < 0) return -1;
+            n = sendfile(out, in, &in_off, len > 0x7ffff000 ? 0x7ffff000 : (size_t)len);
+            if (n < 0 && (errno == EINVAL || errno == ENOSYS)) {
+                *method = COPY_RW;
+                continue;
+            }
+        } else
+#endif
+        {
+            *method = COPY_RW;
+            if (!*buf && !(*buf = malloc(COPY_BUF))) return -1;
+            n = pread(in, *buf, len < COPY_BUF ? (size_t)len : COPY_BUF, off);
+            if (n > 0 && pwrite_all(out, *buf, n, off) != 0) return -1;
+        }
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (n == 0) break;  /* the source shrank while we copied */
+        off += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* Copies size bytes of in into the empty file out. *how names the method. */
+static int copy_fd(int in, int out, off_t size, const char **how) {
+#ifdef FICLONE
+    if (ioctl(out, FICLONE, in) == 0) {
+        *how = copy_how[COPY_CLONE];
+        return 0;
+    }
+#endif
+#ifdef __linux__
+    int method = COPY_RANGE;
+#else
+    int method = COPY_RW;
+#endif
+    char *buf = NULL;
+    int rc = 0;
+    for (off_t off = 0; off < size;) {
+        off_t data = lseek(in, off, SEEK_DATA), hole;
+        if (data < 0 && errno == ENXIO) break;  /* nothing but a hole is left */
+        if (data < 0) {
+            data = off;                         /* no SEEK_DATA: copy it all */
+            hole = size;
+        } else {
+            hole = lseek(in, data, SEEK_HOLE);
+            if (hole < 0 || hole > size) hole = size;
+        }
+        if (copy_extent(in, out, data, hole - data, &method, &buf) != 0) { rc = -1; break; }
+        off = hole;
+    }
+    free(buf);
+    /* Sets the length even when the file ends in a hole. */
+    if (rc == 0 && ftruncate(out, size) != 0) rc = -1;
+    *how = copy_how[method];
+    return rc;
+}
+
+/* Copies src over dst (created with src's permissions). *bytes gets the
+ * size copied and *how the method used, for the op log. */
+static int copy_binary_file(const char *src, const char *dst, const char **how, off_t *bytes) {
+    *how = copy_how[COPY_RW];
+    int in = open(src, O_RDONLY | O_CLOEXEC);
+    if (in < 0) return -1;
+    struct stat st;
+    if (fstat(in, &st) != 0) { close(in); return -1; }
+    int out = open(dst, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, st.st_mode & 0777);
+    if (out < 0) { close(in); return -1; }
+    int rc = copy_fd(in, out, st.st_size, how);
+    int err = errno;
+    if (close(out) != 0 && rc == 0) { rc = -1; err = errno; }
+    close(in);
+    if (bytes) *bytes = st.st_size;
+    errno = err;
+    return rc;
+}
+
+/* ---- ASSET CATALOGUE ----
+ * Every moved empty file picks a demo asset of its type. Each asset folder
+ * is indexed once into a catalogue: names grouped by packed extension key
+ * (ext_key() from ext_hash.h), so a pick is a lookup of at most a few
+ * groups plus one random index, however many assets there are.
+ *
+ * The catalogue is one flat, pointer-free blob so it can be written out as
+ * is and mmap'd back: $ORGANIZER_CACHE_DIR (default ~/.cache/organizer_cli)
+ * holds one file per folder, named by device and inode and valid while the
+ * folder's mtime matches. In serve mode the catalogues also stay in memory
+ * across requests, and a folder's mtime is re-checked at most once a
+ * second. */
+#define ASSET_MAGIC "OASSET01"
+#define ASSET_RECHECK_US 1000000.0
+
+typedef struct {
+    char magic[8];
+    uint64_t dev, ino;
+    int64_t mtime_sec, mtime_nsec;
+    uint32_t ngroups, nnames, pool_len, pad;
+} AssetHdr;
+
+typedef struct {
+    uint64_t key;           /* ext_key() of the extension, lower-cased */
+    uint32_t first, count;  /* slice of the name table */
+} AssetGroup;
+
+/* Blob layout: AssetHdr, AssetGroup[ngroups] sorted by key,
+ * uint32_t name_off[nnames] grouped by key, then the NUL-terminated names. */
+typedef struct AssetDir {
+    char *path;
+    AssetHdr *blob;
+    size_t blob_len;
+    int mapped;             /* blob is an mmap of the index file */
+    double checked_us;      /* last time the folder's mtime was compared */
+    struct AssetDir *next;
+} AssetDir;
+
+static AssetDir *asset_cache;
+static pthread_mutex_t asset_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const AssetGroup *asset_groups(const AssetHdr *h) {
+    return (const AssetGroup *)(h + 1);
+}
+
+static const uint32_t *asset_offsets(const AssetHdr *h) {
+    return (const uint32_t *)(asset_groups(h) + h->ngroups);
+}
+
+static const char *asset_pool(const AssetHdr *h) {
+    return (const char *)(asset_offsets(h) + h->nnames);
+}
+
+static int asset_blob_ok(const AssetHdr *h, size_t len, const struct stat *st) {
+    if (len < sizeof(*h) || memcmp(h->magic, ASSET_MAGIC, 8) != 0) return 0;
+    size_t need = sizeof(*h) + (size_t)h->ngroups * sizeof(AssetGroup)
+                + (size_t)h->nnames * sizeof(uint32_t) + h->pool_len;
+    return need == len && h->dev == (uint64_t)st->st_dev && h->ino == (uint64_t)st->st_ino &&
+           h->mtime_sec == (int64_t)st->st_mtim.tv_sec && h->mtime_nsec == (int64_t)st->st_mtim.tv_nsec;
+}
+
+/* Where the kind index for the directory st lives, or 0 when there is no
+ * cache dir. Shared by every index the CLI persists. */
+static int cache_path(const char *kind, const struct stat *st, char *out, size_t sz) {
+    const char *dir = getenv("ORGANIZER_CACHE_DIR");
+    const char *home = getenv("HOME");
+    char base[PATH_MAX];
+    if (dir && *dir) snprintf(base, sizeof(base), "%s", dir);
+    else if (getenv("XDG_CACHE_HOME")) snprintf(base, sizeof(base), "%s/organizer_cli", getenv("XDG_CACHE_HOME"));
+    else if (home) snprintf(base, sizeof(base), "%s/.cache/organizer_cli", home);
+    else return 0;
+    for (char *p = strchr(base + 1, '/'); p; p = strchr(p + 1, '/')) {
+        *p = '\0';
+        mkdir(base, 0700);
+        *p = '/';
+    }
+    mkdir(base, 0700);
+    return snprintf(out, sz, "%s/%s-%llx-%llx.idx", base, kind, (unsigned long long)st->st_dev,
+                    (unsigned long long)st->st_ino) < (int)sz;
+}
+
+typedef struct {
+    uint64_t key;
+    uint32_t off;
+} AssetName;
+
+static int asset_name_cmp(const void *a, const void *b) {
+    const AssetName *x = a, *y = b;
+    if (x->key != y->key) return x->key < y->key ? -1 : 1;
+    return x->off < y->off ? -1 : x->off > y->off;
+}
+
+/* Lists path and builds its catalogue blob on the heap. */
+static AssetHdr *asset_build(const char *path, const struct stat *st, size_t *len_out) {
+    DIR *dp = opendir(path);
+    if (!dp) return NULL;
+    AssetName *names = NULL;
+    char *pool = NULL;
+    size_t nnames = 0, cap = 0, pool_len = 0, pool_cap = 0;
+    struct dirent *e;
+    int ok = 1;
+    while (ok && (e = readdir(dp)) != NULL) {
+        const char *dot = strrchr(e->d_name, '.');
+        uint64_t key = dot ? ext_key(dot + 1) : 0;
+        if (e->d_name[0] == '.' || !key) continue;
+        size_t len = strlen(e->d_name) + 1;
+        if (nnames == cap) {
+            cap = cap ? cap * 2 : 64;
+            AssetName *g = realloc(names, cap * sizeof(*names));
+            if (!g) { ok = 0; break; }
+            names = g;
+        }
+        if (pool_len + len > pool_cap) {
+            pool_cap = pool_cap ? pool_cap * 2 : 4096;
+            while (pool_len + len > pool_cap) pool_cap *= 2;
+            char *g = realloc(pool, pool_cap);
+            if (!g) { ok = 0; break; }
+            pool = g;
+        }
+        memcpy(pool + pool_len, e->d_name, len);
+        names[nnames].key = key;
+        names[nnames].off = (uint32_t)pool_len;
+        nnames++;
+        pool_len += len;
+    }
+    closedir(dp);
+
+    AssetHdr *h = NULL;
+    if (ok) {
+        if (nnames) qsort(names, nnames, sizeof(*names), asset_name_cmp);
+        size_t ngroups = 0;
+        for (size_t i = 0; i < nnames; i++)
+            if (i == 0 || names[i].key != names[i - 1].key) ngroups++;
+        size_t len = sizeof(AssetHdr) + ngroups * sizeof(AssetGroup) + nnames * sizeof(uint32_t) + pool_len;
+        h = calloc(1, len);
+        if (h) {
+            memcpy(h->magic, ASSET_MAGIC, 8);
+            h->dev = st->st_dev;
+            h->ino = st->st_ino;
+            h->mtime_sec = st->st_mtim.tv_sec;
+            h->mtime_nsec = st->st_mtim.tv_nsec;
+            h->ngroups = (uint32_t)ngroups;
+            h->nnames = (uint32_t)nnames;
+            h->pool_len = (uint32_t)pool_len;
+            AssetGroup *g = (AssetGroup *)asset_groups(h);
+            uint32_t *offs = (uint32_t *)asset_offsets(h);
+            for (size_t i = 0, gi = 0; i < nnames; i++) {
+                if (i == 0 || names[i].key != names[i - 1].key) {
+                    g[gi].key = names[i].key;
+                    g[gi].first = (uint32_t)i;
+                    gi++;
+                }
+                g[gi - 1].count++;
+                offs[i] = names[i].off;
+            }
+            if (pool_len) memcpy((char *)asset_pool(h), pool, pool_len);
+            *len_out = len;
+        }
+    }
+    free(names);
+    free(pool);
+    return h;
+}
+
+/* Maps the persisted index if it still describes the folder. */
+static AssetHdr *asset_map(const char *index, const struct stat *st, size_t *len_out) {
+    int fd = open(index, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+    struct stat ist;
+    void *p = MAP_FAILED;
+    if (fstat(fd, &ist) == 0 && ist.st_size >= (off_t)sizeof(AssetHdr))
+        p = mmap(NULL, ist.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return NULL;
+    if (!asset_blob_ok(p, ist.st_size, st)) {
+        munmap(p, ist.st_size);
+        return NULL;
+    }
+    *len_out = ist.st_size;
+    return p;
+}
+
+/* Best effort: a missing or read-only cache dir only costs a rebuild. */
+static void asset_save(const char *index, const AssetHdr *h, size_t len) {
+    char tmp[PATH_MAX + 16];
+    snprintf(tmp, sizeof(tmp), "%s.%ld", index, (long)getpid());
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) return;
+    int ok = pwrite_all(fd, (const char *)h, len, 0) == 0;
+    if (close(fd) != 0) ok = 0;
+    if (!ok || rename(tmp, index) != 0) unlink(tmp);
+}
+
+static void asset_release(AssetDir *ad) {
+    if (!ad->blob) return;
+    if (ad->mapped) munmap(ad->blob, ad->blob_len);
+    else free(ad->blob);
+    ad->blob = NULL;
+}
+
+/* Brings ad's catalogue up to date. Called with asset_lock held. */
+static void asset_refresh(AssetDir *ad) {
+    double now = now_us();
+    if (ad->blob && now - ad->checked_us < ASSET_RECHECK_US) return;
+    ad->checked_us = now;
+    struct stat st;
+    if (stat(ad->path, &st) != 0) { asset_release(ad); return; }
+    if (ad->blob && asset_blob_ok(ad->blob, ad->blob_len, &st)) return;
+    asset_release(ad);
+
+    char index[PATH_MAX];
+    int have_index = cache_path("assets", &st, index, sizeof(index));
+    if (have_index && (ad->blob = asset_map(index, &st, &ad->blob_len)) != NULL) {
+        ad->mapped = 1;
+        return;
+    }
+    ad->mapped = 0;
+    ad->blob = asset_build(ad->path, &st, &ad->blob_len);
+    if (ad->blob && have_index) asset_save(index, ad->blob, ad->blob_len);
+}
+
+static const AssetGroup *asset_group(const AssetHdr *h, uint64_t key) {
+    const AssetGroup *g = asset_groups(h);
+    uint32_t lo = 0, hi = h->ngroups;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (g[mid].key < key) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo < h->ngroups && g[lo].key == key ? &g[lo] : NULL;
+}
+
+/* ---- PICK RANDOM ASSET FROM DIRECTORY BY EXTENSION ---- */
+static int pick_random_asset(Run *run, const char *dir, const char *ext[], int num_exts,
+                             char *out_path, size_t out_sz) {
+    pthread_mutex_lock(&asset_lock);
+    AssetDir *ad = asset_cache;
+    while (ad && strcmp(ad->path, dir) != 0) ad = ad->next;
+    if (!ad) {
+        ad = calloc(1, sizeof(*ad));
+        if (!ad || !(ad->path = strdup(dir))) { free(ad); pthread_mutex_unlock(&asset_lock); return -1; }
+        ad->next = asset_cache;
+        asset_cache = ad;
+    }
+    asset_refresh(ad);
+
+    int rc = -1;
+    if (ad->blob) {
+        const AssetGroup *groups[8];
+        uint64_t total = 0;
+        int n = 0;
+        for (int i = 0; i < num_exts && n < 8; i++) {
+            const AssetGroup *g = asset_group(ad->blob, ext_key(ext[i] + 1));
+            if (g) { groups[n++] = g; total += g->count; }
+        }
+        if (total > 0) {
+            uint64_t idx = rng_below(&run->rng, total);
+            int i = 0;
+            while (idx >= groups[i]->count) idx -= groups[i++]->count;
+            const char *name = asset_pool(ad->blob) + asset_offsets(ad->blob)[groups[i]->first + idx];
+            snprintf(out_path, out_sz, "%s/%s", dir, name);
+            rc = 0;
+        }
+    }
+    pthread_mutex_unlock(&asset_lock);
+    return rc;
+}
+
+/* ---- FILL AN EMPTY FILE WITH CONTENT ---- */
+/* Copies an asset over file_path and records it; 0 on success. */
+static int fill_copy(Run *run, const char *src, const char *file_path, const char *desc) {
+    const char *how;
+    off_t bytes = 0;
+    op_begin(run);
+    if (copy_binary_file(src, file_path, &how, &bytes) != 0) {
+        run->op_t0 = 0;
+        return -1;
+    }
+    op_set_bytes(run, (uint64_t)bytes);
+    add_op(run, "copyFile", desc, how, src, file_path, 1, NULL);
+    return 0;
+}
+
+/* file_path is known to be empty (0 bytes). */
+static void fill_empty_file(Run *run, const char *file_path, const char *ext,
+                            const char *assets_path) {
+    if (!ext || !assets_path || assets_path[0] == '\0') return;
+
+    int success = 0;
+
+    if (strcasecmp(ext, ".txt") == 0) {
+        char asset_dir[PATH_MAX], src[PATH_MAX];
+        snprintf(asset_dir, sizeof(asset_dir), "%s/documents", assets_path);
+        const char *exts[] = { ".txt" };
+        if (pick_random_asset(run, asset_dir, exts, 1, src, sizeof(src)) == 0) {
+            success = fill_copy(run, src, file_path, "Fill txt with demo content") == 0;
+        }
+        if (!success) {
+            op_begin(run);
+            FILE *fp = fopen(file_path, "w");
+            if (fp) {
+                fputs(text_templates[rng_below(&run->rng, NUM_TEMPLATES)], fp);
+                fclose(fp);
+                add_op(run, "writeFile", "Fill file with demo text",
+                       "open(2)/write(2)/close(2)", file_path, NULL, 1, NULL);
+            } else {
+                run->op_t0 = 0;
+            }
+        }
+    }
+    else if (strcasecmp(ext, ".pdf") == 0) {
+        char asset_dir[PATH_MAX], src[PATH_MAX];
+        snprintf(asset_dir, sizeof(asset_dir), "%s/documents", assets_path);
+        const char *exts[] = { ".pdf" };
+        if (pick_random_asset(run, asset_dir, exts, 1, src, sizeof(src)) == 0) {
+            fill_copy(run, src, file_path, "Fill pdf with demo content");
+        }
+    }
+    else if (is_img(ext)) {
+        char asset_dir[PATH_MAX], src[PATH_MAX];
+        snprintf(asset_dir, sizeof(asset_dir), "%s/images", assets_path);
+        const char *exts[] = { ".jpg", ".jpeg", ".png" };
+        if (pick_random_asset(run, asset_dir, exts, 3, src, sizeof(src)) == 0) {
+            fill_copy(run, src, file_path, "Fill image with demo content");
+        }
+    }
+    else if (is_aud(ext)) {
+        char asset_dir[PATH_MAX], src[PATH_MAX];
+        snprintf(asset_dir, sizeof(asset_dir), "%s/audio", assets_path);
+        const char *exts[] = { ".mp3" };
+        if (pick_random_asset(run, asset_dir, exts, 1, src, sizeof(src)) == 0) {
+            fill_copy(run, src, file_path, "Fill audio with demo content");
+        }
+    }
+    else if (is_vid(ext)) {
+        char asset_dir[PATH_MAX], src[PATH_MAX];
+        snprintf(asset_dir, sizeof(asset_dir), "%s/videos", assets_path);
+        const char *exts[] = { ".mp4" };
+        if (pick_random_asset(run, asset_dir, exts, 1, src, sizeof(src)) == 0) {
+            fill_copy(run, src, file_path, "Fill video with demo content");
+        }
+    }
+}
+
+static void fill_with_demo_content(Run *run, const char *file_path, const char *ext,
+                                   const char *assets_path) {
+    /* Only fill if file is empty (0 bytes) */
+    struct stat st;
+    if (stat(file_path, &st) != 0 || st.st_size > 0) return;
+    fill_empty_file(run, file_path, ext, assets_path);
+}
+
+/* ---- CONTENT SNIFFING ----
+ * organize --sniff reads the first SNIFF_BYTES of every file with one
+ * pread() and matches them against a table of signatures, so files with no
+ * extension, or the wrong one, still land in the right folder. A match only
+ * names a representative extension; the run's classifier (including
+ * --rules) decides its category, and content only ever moves a file into a
+ * real category, never to Others.
+ *
+ * Every signature sits in the first 16 bytes, so each is compiled once to a
+ * 16-byte value and mask and a file's head is tested against all of them
+ * with one SSE2 compare per signature (two 64-bit compares elsewhere).
+ * Reads are batched per directory and spread over a small thread pool so a
+ * slow disk keeps several requests in flight. */
+#define SNIFF_BYTES 4096
+#define SNIFF_BATCH 256
+#define SNIFF_DEFAULT_JOBS 8
+
+typedef struct {
+    const char *bytes, *mask;   /* mask NULL: every byte must match */
+    unsigned char len;
+    const char *ext;
+} SigDef;
+
+/* First match wins, so specific ftyp brands and RIFF forms come first. */
+static const SigDef sig_defs[] = {
+    { "%PDF-", NULL, 5, ".pdf" },
+    { "\x89PNG\r\n\x1a\n", NULL, 8, ".png" },
+    { "\xff\xd8\xff", NULL, 3, ".jpg" },
+    { "GIF8", NULL, 4, ".gif" },
+    { "BM\0\0\0\0\0\0\0\0", "\xff\xff\0\0\0\0\xff\xff\xff\xff", 10, ".bmp" },
+    { "II*\0", NULL, 4, ".tiff" },
+    { "MM\0*", NULL, 4, ".tiff" },
+    { "RIFF\0\0\0\0WEBP", "\xff\xff\xff\xff\0\0\0\0\xff\xff\xff\xff", 12, ".webp" },
+    { "RIFF\0\0\0\0WAVE", "\xff\xff\xff\xff\0\0\0\0\xff\xff\xff\xff", 12, ".wav" },
+    { "RIFF\0\0\0\0AVI ", "\xff\xff\xff\xff\0\0\0\0\xff\xff\xff\xff", 12, ".avi" },
+    { "\0\0\0\0ftypM4A", "\0\0\0\0\xff\xff\xff\xff\xff\xff\xff", 11, ".m4a" },
+    { "\0\0\0\0ftypqt", "\0\0\0\0\xff\xff\xff\xff\xff\xff", 10, ".mov" },
+    { "\0\0\0\0ftyphei", "\0\0\0\0\xff\xff\xff\xff\xff\xff\xff", 11, ".heic" },
+    { "\0\0\0\0ftypmif1", "\0\0\0\0\xff\xff\xff\xff\xff\xff\xff\xff", 12, ".heic" },
+    { "\0\0\0\0ftypavif", "\0\0\0\0\xff\xff\xff\xff\xff\xff\xff\xff", 12, ".avif" },
+    { "\0\0\0\0ftypavis", "\0\0\0\0\xff\xff\xff\xff\xff\xff\xff\xff", 12, ".avif" },
+    { "\0\0\0\0ftyp", "\0\0\0\0\xff\xff\xff\xff", 8, ".mp4" },
+    { "\x1a\x45\xdf\xa3", NULL, 4, ".mkv" },
+    { "\x30\x26\xb2\x75\x8e\x66\xcf\x11", NULL, 8, ".wmv" },
+    { "FLV\x01", NULL, 4, ".flv" },
+    { "ID3", NULL, 3, ".mp3" },
+    { "\xff\xf0", "\xff\xf6", 2, ".aac" },  /* ADTS: sync word, layer 0 */
+    { "\xff\xe2", "\xff\xe6", 2, ".mp3" },  /* MPEG audio frame sync, layer III */
+    { "fLaC", NULL, 4, ".flac" },
+    { "OggS", NULL, 4, ".ogg" },
+    { "MThd", NULL, 4, ".mid" },
+    { "PK\x03\x04", NULL, 4, ".zip" },
+    { "\xd0\xcf\x11\xe0\xa1\xb1\x1a\xe1", NULL, 8, ".doc" },
+    { "{\\rtf", NULL, 5, ".rtf" },
+    { "\x1f\x8b", NULL, 2, ".gz" },
+    { "7z\xbc\xaf\x27\x1c", NULL, 6, ".7z" },
+    { "Rar!\x1a\x07", NULL, 6, ".rar" },
+};
+#define NUM_SIGS (sizeof(sig_defs) / sizeof(sig_defs[0]))
+
+typedef struct {
+    unsigned char v[16], m[16];
+} SigVec;
+
+static SigVec sig_vecs[NUM_SIGS];
+static pthread_once_t sig_once = PTHREAD_ONCE_INIT;
+
+static void sig_compile(void) {
+    for (size_t i = 0; i < NUM_SIGS; i++) {
+        for (int b = 0; b < sig_defs[i].len; b++) {
+            unsigned char m = sig_defs[i].mask ? (unsigned char)sig_defs[i].mask[b] : 0xff;
+            sig_vecs[i].m[b] = m;
+            sig_vecs[i].v[b] = (unsigned char)sig_defs[i].bytes[b] & m;
+        }
+    }
+}
+
+/* Index of the first signature matching head (16 bytes, zero padded past
+ * n), or -1. */
+static int sig_match(const unsigned char *head, size_t n) {
+#ifdef __SSE2__
+    __m128i h = _mm_loadu_si128((const __m128i *)head);
+    for (size_t i = 0; i < NUM_SIGS; i++) {
+        __m128i v = _mm_loadu_si128((const __m128i *)sig_vecs[i].v);
+        __m128i m = _mm_loadu_si128((const __m128i *)sig_vecs[i].m);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(h, m), v)) == 0xffff && n >= sig_defs[i].len)
+            return (int)i;
+    }
+#else
+    uint64_t h0, h1;
+    memcpy(&h0, head, 8);
+    memcpy(&h1, head + 8, 8);
+    for (size_t i = 0; i < NUM_SIGS; i++) {
+        uint64_t v0, v1, m0, m1;
+        memcpy(&v0, sig_vecs[i].v, 8);
+        memcpy(&v1, sig_vecs[i].v + 8, 8);
+        memcpy(&m0, sig_vecs[i].m, 8);
+        memcpy(&m1, sig_vecs[i].m + 8, 8);
+        if ((h0 & m0) == v0 && (h1 & m1) == v1 && n >= sig_defs[i].len) return (int)i;
+    }
+#endif
+    return -1;
+}
+
+/* Names the type of buf[0..n), or returns NULL. Zip containers are told
+ * apart by the member names near the start; text counts only when the
+ * caller has no extension to go on. */
+static const char *sniff_type(const unsigned char *buf, size_t n, int want_text) {
+    unsigned char head[16] = { 0 };
+    memcpy(head, buf, n < 16 ? n : 16);
+    int i = n ? sig_match(head, n) : -1;
+    if (i >= 0) {
+        const char *ext = sig_defs[i].ext;
+        if (strcmp(ext, ".zip") == 0) {
+            if (memmem(buf, n, "mimetypeapplication/epub+zip", 28)) return ".epub";
+            if (memmem(buf, n, "mimetypeapplication/vnd.oasis.opendocument.text", 47)) return ".odt";
+            if (memmem(buf, n, "word/", 5)) return ".docx";
+            if (memmem(buf, n, "xl/", 3)) return ".xlsx";
+            if (memmem(buf, n, "ppt/", 4)) return ".pptx";
+        }
+        return ext;
+    }
+    if (!want_text || n == 0) return NULL;
+    /* Text: no NULs and almost no other control bytes (UTF-8 passes). */
+    size_t odd = 0;
+    for (size_t k = 0; k < n; k++) {
+        unsigned char c = buf[k];
+        if (c == 0) return NULL;
+        if (c < 0x20 && c != '\n' && c != '\r' && c != '\t' && c != '\f' && c != 0x1b) odd++;
+    }
+    return odd * 100 <= n ? ".txt" : NULL;
+}
+
+typedef struct {
+    char name[NAME_MAX + 1];
+    struct DirCtx *dir;     /* organize: the directory it is in */
+    uint64_t ino;           /* for the journal */
+    int cat;                /* in: from the extension; out: final */
+    int sniffed;            /* the content changed the category */
+    int matched;            /* some signature (or text) was recognised */
+    long ns;                /* open + read + match */
+} SniffItem;
+
+typedef struct SniffBatch {
+    const Classifier *cls;
+    int dfd, n, next, done;
+    SniffItem *items;
+    struct SniffBatch *qnext;
+} SniffBatch;
+
+/* Batches with unclaimed items wait on a queue; pool threads and the
+ * submitting worker claim items one at a time, so a directory's reads run
+ * in parallel whatever the number of organize workers. */
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t wake, finished;
+    SniffBatch *head, *tail;
+    int stop, nthreads;
+    pthread_t *tids;
+} SniffPool;
+
+typedef struct {
+    long files, matched, reclassified;
+    long long ns;
+} SniffStats;
+
+static void sniff_item(const SniffBatch *b, SniffItem *it) {
+    double t0 = now_us();
+    unsigned char buf[SNIFF_BYTES];
+    ssize_t n = -1;
+    int flags = O_RDONLY | O_CLOEXEC | O_NOFOLLOW | O_NONBLOCK;
+#ifdef O_NOATIME
+    /* Reading must not dirty the inode with an atime update. */
+    int fd = openat(b->dfd, it->name, flags | O_NOATIME);
+    if (fd < 0 && errno == EPERM) fd = openat(b->dfd, it->name, flags);
+#else
+    int fd = openat(b->dfd, it->name, flags);
+#endif
+    if (fd >= 0) {
+        struct stat st;
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+            while ((n = pread(fd, buf, sizeof(buf), 0)) < 0 && errno == EINTR) {}
+        close(fd);
+    }
+    it->matched = it->sniffed = 0;
+    const char *ext = n > 0 ? sniff_type(buf, (size_t)n, strchr(it->name, '.') == NULL) : NULL;
+    if (ext) {
+        int cat = classify(b->cls, ext);
+        it->matched = 1;
+        if (cat != b->cls->ncats - 1 && cat != it->cat) {
+            it->cat = cat;
+            it->sniffed = 1;
+        }
+    }
+    it->ns = (long)((now_us() - t0) * 1000);
+}
+
+/* Claims and sniffs one item of the queue's first batch; 0 when idle.
+ * Called and returns with p->lock held. */
+static int sniff_claim(SniffPool *p, SniffBatch *only) {
+    SniffBatch *b = only ? only : p->head;
+    if (!b || b->next >= b->n) return 0;
+    SniffItem *it = &b->items[b->next++];
+    if (b->next == b->n) {
+        SniffBatch **pp = &p->head;
+        while (*pp != b) pp = &(*pp)->qnext;
+        *pp = b->qnext;
+        if (p->tail == b) {
+            p->tail = NULL;
+            for (SniffBatch *q = p->head; q; q = q->qnext) p->tail = q;
+        }
+    }
+    pthread_mutex_unlock(&p->lock);
+    sniff_item(b, it);
+    pthread_mutex_lock(&p->lock);
+    if (++b->done == b->n) pthread_cond_broadcast(&p->finished);
+    return 1;
+}
+
+static void *sniff_thread(void *arg) {
+    SniffPool *p = arg;
+    pthread_mutex_lock(&p->lock);
+    while (!p->stop) {
+        if (!sniff_claim(p, NULL)) pthread_cond_wait(&p->wake, &p->lock);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+static void sniff_pool_start(SniffPool *p, int nthreads) {
+    memset(p, 0, sizeof(*p));
+    pthread_once(&sig_once, sig_compile);
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->wake, NULL);
+    pthread_cond_init(&p->finished, NULL);
+    p->tids = nthreads > 0 ? calloc(nthreads, sizeof(pthread_t)) : NULL;
+    for (int k = 0; p->tids && k < nthreads; k++, p->nthreads++)
+        if (pthread_create(&p->tids[k], NULL, sniff_thread, p) != 0) break;
+}
+
+static void sniff_pool_stop(SniffPool *p) {
+    pthread_mutex_lock(&p->lock);
+    p->stop = 1;
+    pthread_cond_broadcast(&p->wake);
+    pthread_mutex_unlock(&p->lock);
+    for (int k = 0; k < p->nthreads; k++) pthread_join(p->tids[k], NULL);
+    free(p->tids);
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->wake);
+    pthread_cond_destroy(&p->finished);
+}
+
+/* Sniffs items[0..n) of directory dfd, helping with the work, and returns
+ * once all of them are done. */
+static void sniff_batch(SniffPool *p, const Classifier *cls, int dfd, SniffItem *items, int n,
+                        SniffStats *stats) {
+    SniffBatch b = { cls, dfd, n, 0, 0, items, NULL };
+    pthread_mutex_lock(&p->lock);
+    if (p->tail) p->tail->qnext = &b;
+    else p->head = &b;
+    p->tail = &b;
+    pthread_cond_broadcast(&p->wake);
+    while (sniff_claim(p, &b)) {}
+    while (b.done < b.n) pthread_cond_wait(&p->finished, &p->lock);
+    pthread_mutex_unlock(&p->lock);
+    for (int i = 0; i < n; i++) {
+        stats->files++;
+        stats->matched += items[i].matched;
+        stats->reclassified += items[i].sniffed;
+        stats->ns += items[i].ns;
+    }
+}
+
+/* ---- JOURNAL ----
+ * organize and watch are write-ahead journaled, so a crash never leaves a
+ * folder half organized for good and any batch can be undone. Each
+ * workspace has one append-only journal in the cache dir: an 8-byte magic,
+ * then records of JrnHdr + payload, 8-byte aligned, each carrying the
+ * CRC-32C of everything after its crc field.
+ *
+ * A batch is BEGIN (kind, subpath of the workspace it works in), a MOVE
+ * intent per file (inode, from, to; relative to that folder), MKDIR for
+ * category folders it created, FIXUP when a move landed on a "name (n)"
+ * instead, and COMMIT. Intents go out JRN_CHUNK files at a time and are
+ * made durable before any rename of the chunk is issued; workers that
+ * finish a chunk together share one fdatasync (group commit), and FIXUP
+ * and MKDIR records just ride along with the next chunk. A lock file
+ * serializes batches, so a batch without COMMIT seen under the lock was
+ * interrupted: the next command on the workspace finishes it (see JOURNAL
+ * REPLAY AND UNDO). A torn record at the end of the file ends the log and
+ * is cut off. */
+#define JRN_MAGIC "OJRNL001"
+#define JRN_CHUNK 4096
+#define JRN_PARK_DIRS 64        /* small directories sharing one chunk */
+#define JRN_MAX_BYTES (64u << 20)   /* older batches are dropped past this */
+
+enum { JRN_BEGIN = 1, JRN_MOVE, JRN_MKDIR, JRN_FIXUP, JRN_COMMIT };
+enum { JRN_ORGANIZE = 1, JRN_UNDO };
+
+typedef struct {
+    uint32_t crc;           /* CRC-32C of the rest of the record */
+    uint32_t len;           /* whole record, padding included */
+    uint32_t type, batch;
+} JrnHdr;
+
+typedef struct {
+    int64_t time;
+    uint32_t kind, undoes;  /* JRN_UNDO: the batch it reverts */
+} JrnBegin;                 /* + subpath */
+
+typedef struct {
+    uint64_t ino;
+} JrnMove;                  /* + from + to; FIXUP: the to actually used */
+
+typedef struct {
+    uint64_t moved;
+} JrnCommit;
+
+/* What a scan learned about one batch. */
+typedef struct {
+    uint32_t id, kind, undoes;
+    int committed;
+    uint64_t begin;         /* offset of its BEGIN record */
+    uint64_t moved;
+    int64_t time;
+} JrnBatch;
+
+typedef struct {
+    const char *workspace;
+    int fd, lock_fd;        /* fd is -1 until the first jrn_lock */
+    char path[PATH_MAX];
+    pthread_mutex_t lock;   /* appends and the group commit */
+    pthread_cond_t synced_cv;
+    uint64_t written, synced;
+    int syncing, err;
+    long syncs;
+    uint64_t scanned;       /* records up to here are in batches */
+    JrnBatch *batches;
+    long nbatches, cap;
+    uint32_t batch;         /* the batch being written, 0 for none */
+    long moves;             /* intents written for it */
+    long recovered;         /* interrupted batches finished */
+} Journal;
+
+typedef struct {
+    char *buf;
+    size_t len, cap;
+} JrnBuf;
+
+static uint32_t crc32c_table[256];
+
+static void crc32c_init(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) c = c & 1 ? (c >> 1) ^ 0x82f63b78u : c >> 1;
+        crc32c_table[i] = c;
+    }
+}
+
+static uint32_t crc32c_sw(uint32_t crc, const unsigned char *p, size_t n) {
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    pthread_once(&once, crc32c_init);
+    while (n--) crc = crc32c_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    return crc;
+}
+
+/* SSE4.2 has a CRC-32C instruction; it is used when the CPU has it. */
+#if defined(__x86_64__) && defined(__GNUC__)
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hw(uint32_t crc, const unsigned char *p, size_t n) {
+    uint64_t c = crc;
+    for (; n >= 8; n -= 8, p += 8) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        c = __builtin_ia32_crc32di(c, v);
+    }
+    crc = (uint32_t)c;
+    while (n--) crc = __builtin_ia32_crc32qi(crc, *p++);
+    return crc;
+}
+#endif
+
+static uint32_t crc32c(const void *data, size_t n) {
+#if defined(__x86_64__) && defined(__GNUC__)
+    if (__builtin_cpu_supports("sse4.2")) return ~crc32c_hw(~0u, data, n);
+#endif
+    return ~crc32c_sw(~0u, data, n);
+}
+
+/* Appends one record; s1 and s2 (either may be NULL) follow the fixed
+ * part as NUL-terminated strings. */
+static int jrn_put(JrnBuf *b, uint32_t type, uint32_t batch, const void *fixed, size_t flen,
+                   const char *s1, const char *s2) {
+    size_t l1 = s1 ? strlen(s1) + 1 : 0, l2 = s2 ? strlen(s2) + 1 : 0;
+    size_t len = (sizeof(JrnHdr) + flen + l1 + l2 + 7) & ~(size_t)7;
+    if (b->len + len > b->cap) {
+        size_t cap = b->cap ? b->cap : 64 * 1024;
+        while (cap < b->len + len) cap *= 2;
+        char *grown = realloc(b->buf, cap);
+        if (!grown) return -1;
+        b->buf = grown;
+        b->cap = cap;
+    }
+    char *r = b->buf + b->len;
+    JrnHdr h = { 0, (uint32_t)len, type, batch };
+    memcpy(r, &h, sizeof(h));
+    char *p = r + sizeof(h);
+    if (flen) memcpy(p, fixed, flen);
+    p += flen;
+    if (l1) memcpy(p, s1, l1);
+    p += l1;
+    if (l2) memcpy(p, s2, l2);
+    p += l2;
+    memset(p, 0, r + len - p);
+    uint32_t crc = crc32c(r + 4, len - 4);
+    memcpy(r, &crc, 4);
+    b->len += len;
+    return 0;
+}
+
+/* A MOVE or FIXUP record. */
+static void jrn_move(JrnBuf *b, uint32_t type, uint32_t batch, uint64_t ino, const char *from, const char *to) {
+    JrnMove m = { ino };
+    jrn_put(b, type, batch, &m, sizeof(m), from, to);
+}
+
+/* rel/mid/name with the empty or NULL parts left out. */
+static void jrn_path(char *out, size_t sz, const char *rel, const char *mid, const char *name) {
+    snprintf(out, sz, "%s%s%s%s%s", rel ? rel : "", rel && rel[0] && (mid || name) ? "/" : "",
+             mid ? mid : "", mid && name ? "/" : "", name ? name : "");
+}
+
+/* Appends a worker's buffered records; returns the journal offset they end
+ * at, for jrn_sync. */
+static uint64_t jrn_write(Journal *j, JrnBuf *b) {
+    pthread_mutex_lock(&j->lock);
+    if (b->len && !j->err) {
+        if (write_all(j->fd, b->buf, b->len) == 0) j->written += b->len;
+        else j->err = errno;
+    }
+    uint64_t end = j->written;
+    pthread_mutex_unlock(&j->lock);
+    b->len = 0;
+    return end;
+}
+
+/* Makes the journal durable up to end. Whoever finds no fdatasync running
+ * starts one covering everything written so far; the others wait for it. */
+static int jrn_sync(Journal *j, uint64_t end) {
+    pthread_mutex_lock(&j->lock);
+    while (j->synced < end && !j->err) {
+        if (j->syncing) {
+            pthread_cond_wait(&j->synced_cv, &j->lock);
+            continue;
+        }
+        j->syncing = 1;
+        uint64_t upto = j->written;
+        pthread_mutex_unlock(&j->lock);
+        int rc = fdatasync(j->fd);
+        int err = errno;
+        pthread_mutex_lock(&j->lock);
+        j->syncing = 0;
+        j->syncs++;
+        if (rc == 0) j->synced = upto;
+        else j->err = err;
+        pthread_cond_broadcast(&j->synced_cv);
+    }
+    int err = j->err;
+    pthread_mutex_unlock(&j->lock);
+    if (err) errno = err;
+    return err ? -1 : 0;
+}
+
+/* A new, zeroed entry at the end of the batch table. */
+static JrnBatch *jrn_new_batch(Journal *j) {
+    if (j->nbatches == j->cap) {
+        long cap = j->cap ? j->cap * 2 : 64;
+        JrnBatch *grown = realloc(j->batches, cap * sizeof(JrnBatch));
+        if (!grown) return NULL;
+        j->batches = grown;
+        j->cap = cap;
+    }
+    JrnBatch *bt = &j->batches[j->nbatches++];
+    memset(bt, 0, sizeof(*bt));
+    return bt;
+}
+
+/* Starts a batch under the journal lock. Its BEGIN is written (but not
+ * synced) right away so every worker's records land after it. */
+static int jrn_begin(Journal *j, uint32_t kind, uint32_t undoes, const char *sub) {
+    uint32_t id = j->nbatches ? j->batches[j->nbatches - 1].id + 1 : 1;
+    JrnBatch *bt = jrn_new_batch(j);
+    if (!bt) return -1;
+    bt->id = id;
+    bt->kind = kind;
+    bt->undoes = undoes;
+    bt->begin = j->written;
+    bt->time = (int64_t)time(NULL);
+    JrnBegin r = { bt->time, kind, undoes };
+    JrnBuf b = { NULL, 0, 0 };
+    jrn_put(&b, JRN_BEGIN, bt->id, &r, sizeof(r), sub ? sub : "", NULL);
+    jrn_write(j, &b);
+    free(b.buf);
+    if (j->err) {
+        j->nbatches--;
+        return -1;
+    }
+    j->batch = bt->id;
+    j->moves = 0;
+    return 0;
+}
+
+static void vx_follow(Journal *j, const JrnBatch *bt);
+
+/* Ends the batch with b's leftover records and a COMMIT, synced. A batch
+ * that never wrote an intent is cut back off the journal instead. */
+static int jrn_commit(Journal *j, JrnBuf *b, uint64_t moved) {
+    if (!j->batch) return 0;
+    JrnBatch *bt = &j->batches[j->nbatches - 1];
+    int rc;
+    if (!j->moves && !j->err) {
+        b->len = 0;
+        rc = ftruncate(j->fd, bt->begin);
+        j->written = bt->begin;
+        if (j->synced > j->written) j->synced = j->written;
+        j->nbatches--;
+        j->batch = 0;
+    } else {
+        JrnCommit c = { moved };
+        jrn_put(b, JRN_COMMIT, j->batch, &c, sizeof(c), NULL, NULL);
+        rc = jrn_sync(j, jrn_write(j, b));
+        bt->committed = rc == 0;
+        bt->moved = moved;
+        if (bt->committed && moved) vx_follow(j, bt);
+    }
+    j->scanned = j->written;
+    return rc;
+}
+
+/* ,"journal":{...} after a journaled command's result. */
+static void print_journal_stats(Run *run, const Journal *j) {
+    const JrnBatch *bt = j->batch ? &j->batches[j->nbatches - 1] : NULL;
+    out_puts(run, ",\"journal\":{\"batch\":");
+    if (bt) out_printf(run, "%u", bt->id);
+    else out_puts(run, "null");
+    out_printf(run, ",\"syncs\":%ld,\"recovered\":%ld,\"bytes\":%llu", j->syncs, j->recovered,
+               (unsigned long long)(bt ? j->written - bt->begin : 0));
+    if (j->err) out_printf(run, ",\"error\":\"%s\"", strerror(j->err));
+    out_puts(run, "}");
+}
+
+/* ---- ORGANIZE ----
+ * One directory level is organized by organize_one(). With --recursive,
+ * every directory below the base becomes a work item: each worker owns a
+ * deque, pushes subdirectories it finds onto the bottom and pops from the
+ * bottom (depth-first, warm dentries), and idle workers steal from the top
+ * of someone else's deque, which tends to hand them a large untouched
+ * subtree. Each worker keeps its own op log and category lists; they are
+ * merged once all work is done. */
+
+/* A category's result entries: the file's directory relative to the base
+ * (NULL at the top level) and its name, both pointing into the run arena. */
+typedef struct {
+    const char *rel, *name;
+} NameRef;
+
+typedef struct {
+    NameRef *items;
+    size_t count, cap;
+} NameList;
+
+static void namelist_push(NameList *l, const char *rel, const char *name) {
+    if (!name) return;
+    if (l->count == l->cap) {
+        size_t cap = l->cap ? l->cap * 2 : 64;
+        NameRef *grown = realloc(l->items, cap * sizeof(NameRef));
+        if (!grown) return;
+        l->items = grown;
+        l->cap = cap;
+    }
+    l->items[l->count].rel = rel;
+    l->items[l->count].name = name;
+    l->count++;
+}
+
+static void namelist_free(NameList *l) {
+    free(l->items);
+    l->items = NULL;
+    l->count = l->cap = 0;
+}
+
+/* True when name is the top folder of some category's destination. */
+static int is_category_dir(const Classifier *cl, const char *name) {
+    size_t n = strlen(name);
+    for (int c = 0; c < cl->ncats; c++)
+        if (strncmp(cl->dests[c], name, n) == 0 && (cl->dests[c][n] == '\0' || cl->dests[c][n] == '/'))
+            return 1;
+    return 0;
+}
+
+/* Creates the missing parent folders of path (relative to dfd). */
+static int mkdir_parents(int dfd, const char *path) {
+    char tmp[PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s", path);
+    for (char *p = strchr(tmp, '/'); p; p = strchr(p + 1, '/')) {
+        *p = '\0';
+        if (mkdirat(dfd, tmp, 0777) != 0 && errno != EEXIST) return -1;
+        *p = '/';
+    }
+    return 0;
+}
+
+/* Creates a category folder (and any missing parents of a nested --rules
+ * destination) below dfd and returns an open handle to it, or -1. *made is
+ * set when the folder itself did not exist before. */
+static int open_category_dir(int dfd, const char *dest, int *made) {
+    *made = 0;
+    if (mkdir_parents(dfd, dest) != 0) return -1;
+    if (mkdirat(dfd, dest, 0777) == 0) *made = 1;
+    else if (errno != EEXIST) return -1;
+    return openat(dfd, dest, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+}
+
+/* ---- DIRECTORY SCAN ----
+ * Entries come straight from getdents64 into a large per-worker buffer, so a
+ * flat directory of 100k files costs a few dozen syscalls to list, and d_type
+ * tells files from directories without a stat per entry. Other systems read
+ * through fdopendir(). */
+#define DENTS_BUF (256 * 1024)
+
+typedef struct {
+    int fd;
+    uint64_t ino;           /* of the entry scan_next last returned */
+#ifdef SYS_getdents64
+    char *buf;
+    long len, pos;
+#else
+    DIR *dp;
+#endif
+} DirScan;
+
+#ifdef SYS_getdents64
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+#endif
+
+static int scan_open(DirScan *ds, int fd, char *buf) {
+    ds->fd = fd;
+#ifdef SYS_getdents64
+    ds->buf = buf;
+    ds->len = ds->pos = 0;
+    return 0;
+#else
+    (void)buf;
+    int dup_fd = dup(fd);
+    ds->dp = dup_fd < 0 ? NULL : fdopendir(dup_fd);
+    if (!ds->dp && dup_fd >= 0) close(dup_fd);
+    return ds->dp ? 0 : -1;
+#endif
+}
+
+/* Next entry other than "." and "..", or NULL at the end (or on error). */
+static const char *scan_next(DirScan *ds, unsigned char *type) {
+    for (;;) {
+#ifdef SYS_getdents64
+        if (ds->pos >= ds->len) {
+            ds->len = syscall(SYS_getdents64, ds->fd, ds->buf, DENTS_BUF);
+            ds->pos = 0;
+            if (ds->len <= 0) return NULL;
+        }
+        struct linux_dirent64 *d = (struct linux_dirent64 *)(ds->buf + ds->pos);
+        ds->pos += d->d_reclen;
+        const char *name = d->d_name;
+        *type = d->d_type;
+        ds->ino = d->d_ino;
+#else
+        struct dirent *d = readdir(ds->dp);
+        if (!d) return NULL;
+        const char *name = d->d_name;
+        *type = d->d_type;
+        ds->ino = d->d_ino;
+#endif
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+        return name;
+    }
+}
+
+static void scan_close(DirScan *ds) {
+#ifndef SYS_getdents64
+    if (ds->dp) closedir(ds->dp);
+#else
+    (void)ds;
+#endif
+}
+
+/* Moves from_fd/from to to_fd/to without ever replacing an existing file.
+ * Falls back to a check-then-rename where the filesystem has no
+ * RENAME_NOREPLACE. */
+static int move_noreplace(int from_fd, const char *from, int to_fd, const char *to) {
+#ifdef RENAME_NOREPLACE
+    if (renameat2(from_fd, from, to_fd, to, RENAME_NOREPLACE) == 0) return 0;
+    if (errno != EINVAL && errno != ENOSYS) return -1;
+#endif
+    if (faccessat(to_fd, to, F_OK, AT_SYMLINK_NOFOLLOW) == 0) {
+        errno = EEXIST;
+        return -1;
+    }
+    return renameat(from_fd, from, to_fd, to);
+}
+
+/* Moves from to to_fd/to, switching to "stem (1).ext", "stem (2).ext", ...
+ * when that name is taken. The path actually used is left in out. */
+static int move_unique(int from_fd, const char *from, int to_fd, const char *to, char *out, size_t outsz) {
+    snprintf(out, outsz, "%s", to);
+    if (move_noreplace(from_fd, from, to_fd, to) == 0) return 0;
+    if (errno != EEXIST) return -1;
+    const char *slash = strrchr(to, '/'), *leaf = slash ? slash + 1 : to;
+    const char *dot = strrchr(leaf, '.');
+    if (!dot || dot == leaf) dot = leaf + strlen(leaf);
+    int stem = (int)(dot - to);
+    for (int n = 1; n < 10000; n++) {
+        if ((size_t)snprintf(out, outsz, "%.*s (%d)%s", stem, to, n, dot) >= outsz) {
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+        if (move_noreplace(from_fd, from, to_fd, out) == 0) return 0;
+        if (errno != EEXIST) return -1;
+    }
+    return -1;
+}
+
+typedef struct {
+    pthread_mutex_t lock;
+    char **items;           /* live range is [head, tail) */
+    int head, tail, cap;
+} Deque;
+
+static void deque_push(Deque *dq, char *rel) {
+    pthread_mutex_lock(&dq->lock);
+    if (dq->tail == dq->cap) {
+        if (dq->head > 0) {
+            memmove(dq->items, dq->items + dq->head, (dq->tail - dq->head) * sizeof(char *));
+            dq->tail -= dq->head;
+            dq->head = 0;
+        }
+        if (dq->tail == dq->cap) {
+            int cap = dq->cap ? dq->cap * 2 : 64;
+            char **grown = realloc(dq->items, cap * sizeof(char *));
+            if (!grown) { pthread_mutex_unlock(&dq->lock); free(rel); return; }
+            dq->items = grown;
+            dq->cap = cap;
+        }
+    }
+    dq->items[dq->tail++] = rel;
+    pthread_mutex_unlock(&dq->lock);
+}
+
+static char *deque_pop(Deque *dq) {
+    char *rel = NULL;
+    pthread_mutex_lock(&dq->lock);
+    if (dq->tail > dq->head) rel = dq->items[--dq->tail];
+    pthread_mutex_unlock(&dq->lock);
+    return rel;
+}
+
+static char *deque_steal(Deque *dq) {
+    char *rel = NULL;
+    if (pthread_mutex_trylock(&dq->lock) != 0) return NULL;
+    if (dq->tail > dq->head) rel = dq->items[dq->head++];
+    pthread_mutex_unlock(&dq->lock);
+    return rel;
+}
+
+struct Scheduler;
+struct Worker;
+struct DirCtx;
+
+/* One file move in flight: the rename and, when demo content is on, a
+ * statx of the result linked behind it. */
+typedef struct MoveSlot {
+    IoReq mv, st;
+    struct Worker *w;
+    struct DirCtx *dir;
+    int cat, refs, want_fill, stat_queued, sniffed;
+    int mv_res, st_res;     /* results of the first rename and the statx */
+    uint64_t ino;
+#ifdef STATX_SIZE
+    struct statx stx;
+#endif
+    char name[NAME_MAX + 1];
+    struct MoveSlot *next;
+} MoveSlot;
+
+typedef struct Worker {
+    struct Scheduler *sched;
+    int idx;
+    Run *run;
+    NameList *cats;         /* one list per category */
+    long *counts;           /* ndjson mode reports counts, not names */
+    Deque dq;
+    char *dents;            /* getdents64 buffer, reused across directories */
+    Io io;                  /* rings are per thread */
+    MoveSlot *slots, *free_slots;
+    SniffItem *sniff_items; /* the directory's pending batch (--sniff, journal) */
+    int nsniff;
+    JrnBuf jrn;             /* records waiting for the next journal write */
+    struct DirCtx *parked[JRN_PARK_DIRS];
+    int nparked;
+    SniffStats sniff_stats;
+    pthread_t tid;
+} Worker;
+
+typedef struct Scheduler {
+    const char *base_path;
+    const char *assets_path;
+    const Classifier *cls;
+    int recursive;
+    int base_fd;            /* open handle on base_path once it is scanned */
+    Worker *workers;
+    int nworkers;
+    long pending;           /* directories queued or in progress */
+    int base_errno;         /* set when the base directory cannot be read */
+    SniffPool *sniff;       /* NULL unless --sniff */
+    Journal *jrn;           /* NULL with --no-journal or no cache dir */
+} Scheduler;
+
+/* The directory organize_one is working on; in-flight moves point at it,
+ * so it is drained before organize_one returns. */
+typedef struct DirCtx {
+    int dfd;
+    const char *dir_path, *rel;
+    const char **cat_path;  /* NULL until the category is first needed */
+    int *cat_fd;
+    int parked;             /* scanned; its files wait for the next chunk */
+} DirCtx;
+
+/* Creating a category folder: mkdirat, then (hard-linked, so it runs even
+ * on EEXIST) openat to get the handle the moves are made against. */
+typedef struct {
+    IoReq mk, op;
+    Worker *w;
+    DirCtx *dir;
+    int cat, mk_res;
+} CatReq;
+
+/* Notes a category folder the batch created, for undo to remove. */
+static void jrn_mkdir(Worker *w, DirCtx *d, int cat) {
+    Journal *j = w->sched->jrn;
+    if (!j) return;
+    char path[PATH_MAX];
+    jrn_path(path, sizeof(path), d->rel, w->sched->cls->dests[cat], NULL);
+    jrn_put(&w->jrn, JRN_MKDIR, j->batch, NULL, 0, path, NULL);
+}
+
+static void cat_mkdir_done(IoReq *req, int res) {
+    CatReq *c = (CatReq *)((char *)req - offsetof(CatReq, mk));
+    c->mk_res = res;
+}
+
+static void cat_open_done(IoReq *req, int res) {
+    CatReq *c = (CatReq *)((char *)req - offsetof(CatReq, op));
+    DirCtx *d = c->dir;
+    int err = c->mk_res < 0 && c->mk_res != -EEXIST ? -c->mk_res : -res;
+    d->cat_fd[c->cat] = res >= 0 ? res : -1;
+    if (c->mk_res == 0) jrn_mkdir(c->w, d, c->cat);
+    op_begin_at(c->w->run, c->mk.t_ns);
+    add_op_ref(c->w->run, "mkdir", "Create category folder", io_label(&c->w->io, "mkdirat(2)", "io_uring MKDIRAT"),
+               d->cat_path[c->cat], NULL, NULL, NULL, res >= 0, res >= 0 ? NULL : strerror(err));
+}
+
+/* Creates and opens categories [first, last) of d, waiting until done. */
+static void open_categories(Worker *w, DirCtx *d, int first, int last) {
+    Run *run = w->run;
+    const Classifier *cl = w->sched->cls;
+    CatReq *reqs = arena_alloc(&run->arena, (last - first) * sizeof(CatReq));
+    for (int c = first; c < last; c++) {
+        d->cat_path[c] = arena_join(&run->arena, d->dir_path, cl->dests[c]);
+        if (!reqs || strchr(cl->dests[c], '/')) {
+            /* Nested --rules folders need their parents made in order. */
+            int made;
+            op_begin(run);
+            d->cat_fd[c] = open_category_dir(d->dfd, cl->dests[c], &made);
+            if (made) jrn_mkdir(w, d, c);
+            add_op_ref(run, "mkdir", "Create category folder", "mkdirat(2)", d->cat_path[c], NULL, NULL, NULL,
+                       d->cat_fd[c] >= 0, d->cat_fd[c] >= 0 ? NULL : strerror(errno));
+            continue;
+        }
+        CatReq *r = &reqs[c - first];
+        r->mk.done = cat_mkdir_done;
+        r->op.done = cat_open_done;
+        r->w = w;
+        r->dir = d;
+        r->cat = c;
+        io_reserve(&w->io, 2);
+        io_mkdirat(&w->io, &r->mk, d->dfd, cl->dests[c], 0777);
+        io_link(&w->io, IO_HARDLINK);
+        io_openat(&w->io, &r->op, d->dfd, cl->dests[c], O_RDONLY | O_DIRECTORY | O_CLOEXEC, 0);
+    }
+    io_drain(&w->io);
+}
+
+static MoveSlot *slot_get(Worker *w) {
+    while (!w->free_slots) io_wait(&w->io);
+    MoveSlot *m = w->free_slots;
+    w->free_slots = m->next;
+    return m;
+}
+
+/* Drops one reference; the last one fills the moved file if the statx saw
+ * it empty. That is decided here rather than by the link because a failed
+ * ring rename does not cancel the ops linked behind it. */
+static void slot_put(Worker *w, MoveSlot *m) {
+    if (--m->refs) return;
+#ifdef STATX_SIZE
+    if (m->stat_queued && m->mv_res == 0 && m->st_res == 0 && m->stx.stx_size == 0) {
+        char new_path[PATH_MAX];
+        snprintf(new_path, sizeof(new_path), "%s/%s", m->dir->cat_path[m->cat], m->name);
+        fill_empty_file(w->run, new_path, strrchr(m->name, '.'), w->sched->assets_path);
+    }
+#endif
+    m->next = w->free_slots;
+    w->free_slots = m;
+}
+
+/* Records a finished move. A file that had to be renamed with a suffix is
+ * filled here; otherwise the statx queued behind the rename decides. */
+static void move_done(IoReq *req, int res) {
+    MoveSlot *m = (MoveSlot *)((char *)req - offsetof(MoveSlot, mv));
+    Worker *w = m->w;
+    Run *run = w->run;
+    DirCtx *d = m->dir;
+    const Classifier *cl = w->sched->cls;
+    int cat = m->cat, fill_now = m->want_fill && !m->stat_queued;
+    char dst[NAME_MAX + 16];
+    snprintf(dst, sizeof(dst), "%s", m->name);
+    m->mv_res = res;
+    op_begin_at(run, req->t_ns);
+    /* The name is taken, or this filesystem has no RENAME_NOREPLACE: retry
+     * synchronously with a "name (n).ext" suffix. */
+    if (res == -EEXIST || res == -EINVAL) {
+        res = move_unique(d->dfd, m->name, d->cat_fd[cat], m->name, dst, sizeof(dst)) == 0 ? 0 : -errno;
+        fill_now = m->want_fill;
+        if (res == 0 && w->sched->jrn && strcmp(dst, m->name) != 0) {
+            char from[PATH_MAX], to[PATH_MAX];
+            jrn_path(from, sizeof(from), d->rel, NULL, m->name);
+            jrn_path(to, sizeof(to), d->rel, cl->dests[cat], dst);
+            jrn_move(&w->jrn, JRN_FIXUP, w->sched->jrn->batch, m->ino, from, to);
+        }
+    }
+
+    /* One copy of the name serves the op log and the result list;
+     * streamed runs keep neither, so they need no copy at all. */
+    const char *src_i = run->ndjson ? m->name : arena_strdup(&run->arena, m->name);
+    const char *label = io_label(&w->io, "renameat2(2)", "io_uring RENAMEAT");
+    const char *desc = m->sniffed ? "Move file to category (detected from content)" : "Move file to category";
+    if (res == 0) {
+        const char *dst_i = strcmp(dst, m->name) == 0 ? src_i
+                          : run->ndjson ? dst : arena_strdup(&run->arena, dst);
+        add_move_op(run, "rename", desc, label, d->dir_path, src_i,
+                    d->cat_path[cat], dst_i, 1, NULL, d->rel, cl->names[cat]);
+        if (fill_now) {
+            char new_path[PATH_MAX];
+            snprintf(new_path, sizeof(new_path), "%s/%s", d->cat_path[cat], dst);
+            fill_with_demo_content(run, new_path, strrchr(dst, '.'), w->sched->assets_path);
+        }
+        if (run->ndjson) w->counts[cat]++;
+        else namelist_push(&w->cats[cat], d->rel, dst_i);
+    } else {
+        add_op_ref(run, "rename", desc, label, d->dir_path, src_i,
+                   d->cat_path[cat], src_i, 0, strerror(-res));
+    }
+    slot_put(w, m);
+}
+
+#ifdef STATX_SIZE
+static void move_stat_done(IoReq *req, int res) {
+    MoveSlot *m = (MoveSlot *)((char *)req - offsetof(MoveSlot, st));
+    m->st_res = res;
+    slot_put(m->w, m);
+}
+#endif
+
+/* Queues the move of d/name into category cat. */
+static void organize_file(Worker *w, DirCtx *d, const char *name, uint64_t ino, int cat, int sniffed) {
+    Scheduler *s = w->sched;
+    Run *run = w->run;
+    if (!d->cat_path[cat]) open_categories(w, d, cat, cat + 1);
+    if (d->cat_fd[cat] < 0) {
+        const char *name_i = run->ndjson ? name : arena_strdup(&run->arena, name);
+        add_op_ref(run, "rename", "Move file to category", io_label(&w->io, "renameat2(2)", "io_uring RENAMEAT"),
+                   d->dir_path, name_i, d->cat_path[cat], name_i, 0, strerror(ENOENT));
+        return;
+    }
+
+    MoveSlot *m = slot_get(w);
+    m->dir = d;
+    m->cat = cat;
+    m->sniffed = sniffed;
+    m->ino = ino;
+    snprintf(m->name, sizeof(m->name), "%s", name);
+    m->want_fill = s->assets_path && s->assets_path[0] && strrchr(name, '.');
+    m->stat_queued = 0;
+#ifdef STATX_SIZE
+    m->stat_queued = m->want_fill;
+#endif
+    m->refs = 1 + m->stat_queued;
+    io_reserve(&w->io, 2);
+    io_renameat(&w->io, &m->mv, d->dfd, m->name, d->cat_fd[cat], m->name, IO_RENAME_NOREPLACE);
+#ifdef STATX_SIZE
+    if (m->stat_queued) {
+        io_link(&w->io, IO_LINK);
+        io_statx(&w->io, &m->st, d->cat_fd[cat], m->name, AT_SYMLINK_NOFOLLOW, STATX_SIZE, &m->stx);
+    }
+#endif
+}
+
+/* Files a batch holds before it is moved: a journal chunk, or enough
+ * sniffs to keep the readers busy. */
+static int organize_batch_cap(const Scheduler *s) {
+    return s->jrn ? JRN_CHUNK : SNIFF_BATCH;
+}
+
+/* Closes what organize_one opened for d; the base stays open as base_fd. */
+static void dir_close(Worker *w, DirCtx *d) {
+    for (int c = 0; c < w->sched->cls->ncats; c++)
+        if (d->cat_fd[c] >= 0) close(d->cat_fd[c]);
+    if (d->rel) close(d->dfd);
+    d->parked = 0;
+}
+
+/* Moves the worker's pending batch: sniffs it with --sniff (all of it is
+ * in d then), makes its intents durable when journaled, then issues the
+ * moves. Parked directories are closed as their files are done. When the
+ * journal cannot be written the files stay where they are. */
+static void organize_batch(Worker *w, DirCtx *d) {
+    Scheduler *s = w->sched;
+    Run *run = w->run;
+    SniffItem *items = w->sniff_items;
+    int n = w->nsniff;
+    w->nsniff = 0;
+    for (int i = 0; s->sniff && i < n; i += SNIFF_BATCH)
+        sniff_batch(s->sniff, s->cls, d->dfd, items + i, n - i < SNIFF_BATCH ? n - i : SNIFF_BATCH, &w->sniff_stats);
+    if (s->jrn) {
+        char from[PATH_MAX], to[PATH_MAX];
+        for (int i = 0; i < n; i++) {
+            jrn_path(from, sizeof(from), items[i].dir->rel, NULL, items[i].name);
+            jrn_path(to, sizeof(to), items[i].dir->rel, s->cls->dests[items[i].cat], items[i].name);
+            jrn_move(&w->jrn, JRN_MOVE, s->jrn->batch, items[i].ino, from, to);
+        }
+        __atomic_add_fetch(&s->jrn->moves, n, __ATOMIC_RELAXED);
+        op_begin(run);
+        int ok = jrn_sync(s->jrn, jrn_write(s->jrn, &w->jrn)) == 0;
+        add_op_ref(run, "journal", "Commit move intents", "fdatasync(2)", s->jrn->path, NULL, NULL, NULL,
+                   ok, ok ? NULL : strerror(errno));
+        if (!ok) n = 0;
+    }
+    for (int i = 0; i < n; i++) {
+        DirCtx *prev = i ? items[i - 1].dir : NULL;
+        if (prev && prev != items[i].dir && prev->parked) {
+            io_drain(&w->io);
+            dir_close(w, prev);
+        }
+        organize_file(w, items[i].dir, items[i].name, items[i].ino, items[i].cat, items[i].sniffed);
+    }
+    if (w->nparked) io_drain(&w->io);
+    for (int k = 0; k < w->nparked; k++)
+        if (w->parked[k]->parked) dir_close(w, w->parked[k]);
+    w->nparked = 0;
+}
+
+/* Moves whatever the worker still holds, parked directories included. */
+static void organize_flush(Worker *w) {
+    if (w->nsniff) organize_batch(w, NULL);
+    io_drain(&w->io);
+}
+
+/* Queues d/name for category cat. Sniffing and the journal work a batch
+ * at a time; otherwise the move is issued right away. */
+static void organize_queue(Worker *w, DirCtx *d, const char *name, uint64_t ino, int cat) {
+    Scheduler *s = w->sched;
+    if (!s->sniff && !s->jrn) {
+        organize_file(w, d, name, ino, cat, 0);
+        return;
+    }
+    SniffItem *it = &w->sniff_items[w->nsniff++];
+    snprintf(it->name, sizeof(it->name), "%s", name);
+    it->dir = d;
+    it->ino = ino;
+    it->cat = cat;
+    it->sniffed = 0;
+    if (w->nsniff == organize_batch_cap(s)) organize_batch(w, d);
+}
+
+/* Organizes the files directly inside base_path/rel. Subdirectories other
+ * than the category folders are queued when the run is recursive. Everything
+ * below the base is reached through directory handles, so a move is one
+ * renameat2() on two open fds rather than two full path walks; with
+ * --io uring up to --io-depth of them are in flight at once. */
+static void organize_one(Worker *w, const char *rel) {
+    Scheduler *s = w->sched;
+    Run *run = w->run;
+    DirCtx *d = arena_alloc(&run->arena, sizeof(DirCtx));
+    if (!d) return;
+    d->dir_path = arena_join(&run->arena, s->base_path, rel);
+    d->rel = rel[0] ? arena_strdup(&run->arena, rel) : NULL;
+    d->parked = 0;
+    if (!d->dir_path) return;
+    if (!w->dents && !(w->dents = malloc(DENTS_BUF))) return;
+    if ((s->sniff || s->jrn) && !w->sniff_items &&
+        !(w->sniff_items = malloc(organize_batch_cap(s) * sizeof(SniffItem)))) return;
+
+    op_begin(run);
+    d->dfd = rel[0] ? openat(s->base_fd, rel, O_RDONLY | O_DIRECTORY | O_CLOEXEC)
+                    : open(d->dir_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    DirScan ds;
+    if (d->dfd < 0 || scan_open(&ds, d->dfd, w->dents) != 0) {
+        int err = errno;
+        add_op_ref(run, "readdir", "Read directory entries", "openat(2)/getdents64(2)", d->dir_path, NULL, NULL, NULL, 0, strerror(err));
+        if (d->dfd >= 0) close(d->dfd);
+        if (!rel[0]) s->base_errno = err;
+        return;
+    }
+    if (!rel[0]) s->base_fd = d->dfd;
+    add_op_ref(run, "readdir", "Read directory entries", "openat(2)/getdents64(2)", d->dir_path, NULL, NULL, NULL, 1, NULL);
+
+    /* The base always gets every category folder; nested directories only
+     * get the ones they actually need. Handles stay open for the scan. */
+    const Classifier *cl = s->cls;
+    d->cat_path = arena_alloc(&run->arena, cl->ncats * sizeof(char *));
+    d->cat_fd = arena_alloc(&run->arena, cl->ncats * sizeof(int));
+    if (!d->cat_path || !d->cat_fd) { scan_close(&ds); if (rel[0]) close(d->dfd); return; }
+    for (int c = 0; c < cl->ncats; c++) {
+        d->cat_path[c] = NULL;
+        d->cat_fd[c] = -1;
+    }
+    if (!rel[0]) open_categories(w, d, 0, cl->ncats);
+
+    const char *name;
+    unsigned char type;
+    while ((name = scan_next(&ds, &type)) != NULL) {
+        struct stat st;
+        uint64_t ino = ds.ino;
+        if (type == DT_UNKNOWN) {
+            if (fstatat(d->dfd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) continue;
+            ino = st.st_ino;
+            type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISLNK(st.st_mode) ? DT_LNK : DT_REG;
+        }
+        /* A symlink to a directory is left alone and never followed. */
+        if (type == DT_LNK && fstatat(d->dfd, name, &st, 0) == 0 && S_ISDIR(st.st_mode)) continue;
+        if (type == DT_DIR) {
+            if (s->recursive && !is_category_dir(cl, name)) {
+                const char *child = rel[0] ? arena_join(&run->arena, rel, name) : name;
+                char *copy = child ? strdup(child) : NULL;
+                if (copy) {
+                    __atomic_add_fetch(&s->pending, 1, __ATOMIC_ACQ_REL);
+                    deque_push(&w->dq, copy);
+                }
+            }
+            continue;
+        }
+
+        organize_queue(w, d, name, ino, classify(cl, name));
+    }
+    scan_close(&ds);
+    /* Journaled, a directory's last few files wait (with its handle kept
+     * open) to share a chunk, and its fdatasync, with the next ones. */
+    if (w->nsniff && s->jrn && !s->sniff && w->nparked < JRN_PARK_DIRS) {
+        d->parked = 1;
+        w->parked[w->nparked++] = d;
+        return;
+    }
+    if (w->nsniff) organize_batch(w, d);
+    io_drain(&w->io);
+    dir_close(w, d);
+}
+
+static char *steal_work(Worker *w) {
+    Scheduler *s = w->sched;
+    for (int k = 1; k < s->nworkers; k++) {
+        char *rel = deque_steal(&s->workers[(w->idx + k) % s->nworkers].dq);
+        if (rel) return rel;
+    }
+    return NULL;
+}
+
+/* Sets up a worker's I/O backend and move slots on the calling thread. */
+static int worker_io_start(Worker *w) {
+    io_init(&w->io, w->run->io_mode, w->run->io_depth);
+    /* Every busy slot holds a ring entry, so depth slots never run dry
+     * while the ring has room; sync moves complete before the next. */
+    unsigned nslots = w->io.mode == IO_URING ? w->io.depth : 1;
+    w->slots = calloc(nslots, sizeof(MoveSlot));
+    if (!w->slots) { io_destroy(&w->io); return -1; }
+    for (unsigned i = 0; i < nslots; i++) {
+        w->slots[i].mv.done = move_done;
+#ifdef STATX_SIZE
+        w->slots[i].st.done = move_stat_done;
+#endif
+        w->slots[i].w = w;
+        w->slots[i].next = i + 1 < nslots ? &w->slots[i + 1] : NULL;
+    }
+    w->free_slots = w->slots;
+    return 0;
+}
+
+static void worker_io_stop(Worker *w) {
+    io_destroy(&w->io);
+    free(w->slots);
+    w->slots = w->free_slots = NULL;
+}
+
+static void *organize_worker(void *arg) {
+    Worker *w = arg;
+    Scheduler *s = w->sched;
+    int idle = 0;
+    if (worker_io_start(w) != 0) return NULL;
+    for (;;) {
+        char *rel = deque_pop(&w->dq);
+        if (!rel && w->nparked) organize_flush(w);
+        if (!rel) rel = steal_work(w);
+        if (!rel) {
+            if (__atomic_load_n(&s->pending, __ATOMIC_ACQUIRE) == 0) break;
+            if (++idle < 64) sched_yield();
+            else { struct timespec ts = { 0, 50000 }; nanosleep(&ts, NULL); }
+            continue;
+        }
+        idle = 0;
+        organize_one(w, rel);
+        free(rel);
+        __atomic_sub_fetch(&s->pending, 1, __ATOMIC_ACQ_REL);
+    }
+    organize_flush(w);
+    worker_io_stop(w);
+    return NULL;
+}
+
+/* "sniff": what content sniffing cost, next to the result. */
+static void print_sniff_stats(Run *run, const SniffStats *st, int threads) {
+    out_printf(run, ",\"sniff\":{\"files\":%ld,\"matched\":%ld,\"reclassified\":%ld,\"threads\":%d,"
+               "\"usPerFile\":%.2f}", st->files, st->matched, st->reclassified, threads,
+               st->files ? st->ns / 1000.0 / st->files : 0.0);
+}
+
+/* Everything but the closing brace of organize's payload: the ops, then
+ * each category's moved files (their counts in ndjson mode). */
+static void print_organize_result(Run *run, const Scheduler *s) {
+    const Classifier *cls = s->cls;
+    print_ops(run);
+    out_puts(run, ",\"result\":{");
+    for (int c = 0; c < cls->ncats; c++) {
+        out_puts(run, c ? ",\"" : "\"");
+        out_json(run, cls->names[c]);
+        if (run->ndjson) {
+            long n = 0;
+            for (int k = 0; k < s->nworkers; k++) if (s->workers[k].counts) n += s->workers[k].counts[c];
+            out_printf(run, "\":%ld", n);
+            continue;
+        }
+        out_puts(run, "\":[");
+        int first = 1;
+        for (int k = 0; k < s->nworkers; k++) {
+            if (!s->workers[k].cats) continue;
+            NameList *l = &s->workers[k].cats[c];
+            for (size_t x = 0; x < l->count; x++) {
+                out_puts(run, first ? "\"" : ",\"");
+                out_path(run, l->items[x].rel, l->items[x].name);
+                out_puts(run, "\"");
+                first = 0;
+            }
+        }
+        out_puts(run, "]");
+    }
+    out_puts(run, "}");
+}
+
+/* Files the workers moved, as the result will list them. */
+static long organize_moved(const Scheduler *s) {
+    long n = 0;
+    for (int k = 0; k < s->nworkers; k++)
+        for (int c = 0; c < s->cls->ncats; c++) {
+            if (s->workers[k].counts) n += s->workers[k].counts[c];
+            if (s->workers[k].cats) n += (long)s->workers[k].cats[c].count;
+        }
+    return n;
+}
+
+/* Writes what the workers still hold and commits the batch. */
+static void organize_commit(Scheduler *s) {
+    if (!s->jrn) return;
+    for (int k = 1; k < s->nworkers; k++) jrn_write(s->jrn, &s->workers[k].jrn);
+    jrn_commit(s->jrn, &s->workers[0].jrn, organize_moved(s));
+}
+
+/* jrn is the workspace's journal, locked, and sub the folder's path in the
+ * workspace; a NULL jrn organizes without one. */
+static int organize_directory(Run *run, const char *base_path, const char *assets_path,
+                              const Classifier *cls, int recursive, int jobs, int sniff_jobs,
+                              Journal *jrn, const char *sub) {
+    if (!recursive || jobs < 1) jobs = 1;
+    Scheduler s = { base_path, assets_path, cls, recursive, -1, NULL, jobs, 0, 0, NULL, jrn };
+    s.workers = calloc(jobs, sizeof(Worker));
+    if (!s.workers) return -1;
+    if (jrn && jrn_begin(jrn, JRN_ORGANIZE, 0, sub) != 0) s.jrn = NULL;
+    SniffPool pool;
+    if (sniff_jobs >= 0) {
+        sniff_pool_start(&pool, sniff_jobs);
+        s.sniff = &pool;
+    }
+    for (int k = 0; k < jobs; k++) {
+        Worker *w = &s.workers[k];
+        w->sched = &s;
+        w->idx = k;
+        w->cats = calloc(cls->ncats, sizeof(NameList));
+        w->counts = calloc(cls->ncats, sizeof(long));
+        pthread_mutex_init(&w->dq.lock, NULL);
+        w->run = k ? run_child(run, (unsigned)k) : run;
+    }
+
+    s.pending = 1;
+    deque_push(&s.workers[0].dq, strdup(""));
+    int started = 1;
+    for (int k = 1; k < jobs && s.workers[k].run; k++, started++)
+        if (pthread_create(&s.workers[k].tid, NULL, organize_worker, &s.workers[k]) != 0) break;
+    organize_worker(&s.workers[0]);
+    for (int k = 1; k < started; k++) pthread_join(s.workers[k].tid, NULL);
+    organize_commit(&s);
+    SniffStats sniffed = { 0, 0, 0, 0 };
+    if (s.sniff) {
+        sniff_pool_stop(&pool);
+        for (int k = 0; k < jobs; k++) {
+            sniffed.files += s.workers[k].sniff_stats.files;
+            sniffed.matched += s.workers[k].sniff_stats.matched;
+            sniffed.reclassified += s.workers[k].sniff_stats.reclassified;
+            sniffed.ns += s.workers[k].sniff_stats.ns;
+        }
+    }
+
+    /* Merge worker logs into the request's run; ids are assigned on print. */
+    for (int k = 1; k < jobs; k++)
+        if (s.workers[k].run) run_join_child(run, s.workers[k].run);
+
+    if (s.base_errno) {
+        if (run->ndjson) out_puts(run, "{\"type\":\"result\"");
+        else out_puts(run, "{\"operations\":[]");
+        out_printf(run, ",\"result\":null,\"error\":\"%s\"", strerror(s.base_errno));
+        finish_json(run);
+    } else {
+        print_organize_result(run, &s);
+        if (s.sniff) print_sniff_stats(run, &sniffed, pool.nthreads);
+        if (jrn) print_journal_stats(run, jrn);
+        finish_json(run);
+    }
+
+    for (int k = 0; k < jobs; k++) {
+        for (int c = 0; c < cls->ncats && s.workers[k].cats; c++) namelist_free(&s.workers[k].cats[c]);
+        free(s.workers[k].cats);
+        free(s.workers[k].counts);
+        free(s.workers[k].dq.items);
+        free(s.workers[k].dents);
+        free(s.workers[k].sniff_items);
+        free(s.workers[k].jrn.buf);
+        pthread_mutex_destroy(&s.workers[k].dq.lock);
+    }
+    free(s.workers);
+    if (s.base_fd >= 0) close(s.base_fd);
+    return s.base_errno ? -1 : 0;
+}
+
+/* ---- COPY ----
+ * copy <workspace> <src> <dst> [<src> <dst> ...] [--jobs N]
+ * Directories are copied as trees. The tree is planned on the calling
+ * thread (mkdir and symlinks happen there) and the file copies are then
+ * shared out to at most N threads, each logging into its own Run. */
+#define COPY_DEFAULT_JOBS 4
+
+typedef struct {
+    const char *src, *dst;
+} CopyJob;
+
+typedef struct {
+    Run *run;
+    CopyJob *jobs;
+    long njobs;
+    long *next;             /* shared cursor into jobs */
+    long copied, failed;
+    long long bytes;
+    pthread_t tid;
+} CopyWorker;
+
+static int copy_plan_push(Run *run, CopyJob **jobs, long *n, long *cap, const char *src, const char *dst) {
+    if (*n == *cap) {
+        long nc = *cap ? *cap * 2 : 64;
+        CopyJob *g = realloc(*jobs, nc * sizeof(CopyJob));
+        if (!g) return -1;
+        *jobs = g;
+        *cap = nc;
+    }
+    (*jobs)[*n].src = arena_strdup(&run->arena, src);
+    (*jobs)[*n].dst = arena_strdup(&run->arena, dst);
+    (*n)++;
+    return 0;
+}
+
+/* Walks src, recreating directories and symlinks under dst and queueing
+ * every regular file. Entries that fail here are counted in *failed. */
+static int copy_plan(Run *run, const char *src, const char *dst, CopyJob **jobs, long *n, long *cap,
+                     long *failed) {
+    struct stat st;
+    if (lstat(src, &st) != 0) {
+        add_op(run, "copyFile", "Copy file", "lstat(2)", src, dst, 0, strerror(errno));
+        (*failed)++;
+        return 0;
+    }
+    if (S_ISLNK(st.st_mode)) {
+        char target[PATH_MAX];
+        op_begin(run);
+        ssize_t len = readlink(src, target, sizeof(target) - 1);
+        int ok = len >= 0;
+        if (ok) {
+            target[len] = '\0';
+            ok = symlink(target, dst) == 0;
+        }
+        add_op(run, "symlink", "Copy symbolic link", "readlink(2)/symlink(2)", src, dst, ok, ok ? NULL : strerror(errno));
+        if (!ok) (*failed)++;
+        return 0;
+    }
+    if (!S_ISDIR(st.st_mode)) return copy_plan_push(run, jobs, n, cap, src, dst);
+
+    op_begin(run);
+    int ok = mkdir(dst, st.st_mode & 0777) == 0 || errno == EEXIST;
+    add_op(run, "mkdir", "Create directory", "mkdir(2)", dst, NULL, ok, ok ? NULL : strerror(errno));
+    if (!ok) { (*failed)++; return 0; }
+    DIR *dp = opendir(src);
+    if (!dp) {
+        add_op(run, "readdir", "Read directory entries", "opendir(3)/readdir(3)", src, NULL, 0, strerror(errno));
+        (*failed)++;
+        return 0;
+    }
+    struct dirent *e;
+    int rc = 0;
+    while (rc == 0 && (e = readdir(dp)) != NULL) {
+        if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) continue;
+        char s2[PATH_MAX], d2[PATH_MAX];
+        snprintf(s2, sizeof(s2), "%s/%s", src, e->d_name);
+        snprintf(d2, sizeof(d2), "%s/%s", dst, e->d_name);
+        rc = copy_plan(run, s2, d2, jobs, n, cap, failed);
+    }
+    closedir(dp);
+    return rc;
+}
+
+/* mkdir -p for the directory that will hold path. */
+static void make_parent_dirs(const char *path) {
+    char tmp[PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s", path);
+    for (char *p = strchr(tmp + 1, '/'); p; p = strchr(p + 1, '/')) {
+        *p = '\0';
+        mkdir(tmp, 0777);
+        *p = '/';
+    }
+}
+
+static void *copy_worker(void *arg) {
+    CopyWorker *w = arg;
+    long i;
+    while ((i = __atomic_fetch_add(w->next, 1, __ATOMIC_RELAXED)) < w->njobs) {
+        const CopyJob *j = &w->jobs[i];
+        const char *how;
+        off_t bytes = 0;
+        op_begin(w->run);
+        if (copy_binary_file(j->src, j->dst, &how, &bytes) == 0) {
+            op_set_bytes(w->run, (uint64_t)bytes);
+            add_op_ref(w->run, "copyFile", "Copy file", how, j->src, NULL, j->dst, NULL, 1, NULL);
+            w->copied++;
+            w->bytes += bytes;
+        } else {
+            add_op_ref(w->run, "copyFile", "Copy file", how, j->src, NULL, j->dst, NULL, 0, strerror(errno));
+            w->failed++;
+        }
+    }
+    return NULL;
+}
+
+static int copy_files(Run *run, const char *workspace, char *pairs[], int npairs, int jobs) {
+    CopyJob *list = NULL;
+    long n = 0, cap = 0, failed = 0;
+    for (int i = 0; i + 1 < npairs; i += 2) {
+        const char *src = arena_join(&run->arena, workspace, pairs[i]);
+        const char *dst = arena_join(&run->arena, workspace, pairs[i + 1]);
+        if (!src || !dst) break;
+        make_parent_dirs(dst);
+        if (copy_plan(run, src, dst, &list, &n, &cap, &failed) != 0) break;
+    }
+
+    if (jobs < 1) jobs = COPY_DEFAULT_JOBS;
+    if (jobs > n) jobs = n ? (int)n : 1;
+    CopyWorker *workers = calloc(jobs, sizeof(CopyWorker));
+    if (!workers) { free(list); return -1; }
+    long next = 0;
+    for (int k = 0; k < jobs; k++) {
+        workers[k].run = k ? run_child(run, k) : run;
+        workers[k].jobs = list;
+        workers[k].njobs = n;
+        workers[k].next = &next;
+    }
+    int started = 1;
+    for (int k = 1; k < jobs && workers[k].run; k++, started++)
+        if (pthread_create(&workers[k].tid, NULL, copy_worker, &workers[k]) != 0) break;
+    copy_worker(&workers[0]);
+    long copied = 0;
+    long long bytes = 0;
+    for (int k = 0; k < jobs; k++) {
+        if (k && k < started) pthread_join(workers[k].tid, NULL);
+        if (k && workers[k].run) run_join_child(run, workers[k].run);
+        copied += workers[k].copied;
+        failed += workers[k].failed;
+        bytes += workers[k].bytes;
+    }
+    free(workers);
+    free(list);
+
+    print_ops(run);
+    out_printf(run, ",\"result\":{\"copied\":%ld,\"failed\":%ld,\"bytes\":%lld}", copied, failed, bytes);
+    finish_json(run);
+    return failed ? -1 : 0;
+}
+
+/* ---- CONTENT HASH ----
+ * A 128-bit hash in the XXH3 mould: eight 64-bit lanes, each 64-byte stripe
+ * folded in with one 32x32->64 multiply per lane, the lanes scrambled after
+ * every 1 KB block and merged at the end. With SSE2 a stripe is four
+ * _mm_mul_epu32 plus adds and shuffles; the scalar path computes the same
+ * values. It is not byte-compatible with xxhash, only with itself. */
+#define HASH_STRIPE 64
+#define HASH_SECRET 192
+#define HASH_STRIPES ((HASH_SECRET - HASH_STRIPE) / 8)
+#define HASH_BLOCK (HASH_STRIPE * HASH_STRIPES)
+
+typedef struct {
+    uint64_t lo, hi;
+} Hash128;
+
+typedef struct {
+    uint64_t acc[8];
+    unsigned char buf[HASH_BLOCK];
+    size_t nbuf;
+    uint64_t total;
+} Hasher;
+
+static unsigned char hash_secret[HASH_SECRET];
+static pthread_once_t hash_once = PTHREAD_ONCE_INIT;
+
+static void hash_make_secret(void) {
+    uint64_t x = 0x243f6a8885a308d3ULL;
+    for (int i = 0; i < HASH_SECRET; i += 8) {
+        uint64_t v = splitmix64(&x);
+        memcpy(hash_secret + i, &v, 8);
+    }
+}
+
+static uint64_t read64(const unsigned char *p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static void hash_stripes(uint64_t acc[8], const unsigned char *p, size_t n, const unsigned char *key) {
+#ifdef __SSE2__
+    __m128i a[4];
+    for (int i = 0; i < 4; i++) a[i] = _mm_loadu_si128((const __m128i *)acc + i);
+    for (size_t s = 0; s < n; s++, p += HASH_STRIPE, key += 8) {
+        for (int i = 0; i < 4; i++) {
+            __m128i d = _mm_loadu_si128((const __m128i *)p + i);
+            __m128i dk = _mm_xor_si128(d, _mm_loadu_si128((const __m128i *)key + i));
+            __m128i prod = _mm_mul_epu32(dk, _mm_shuffle_epi32(dk, _MM_SHUFFLE(0, 3, 0, 1)));
+            __m128i swap = _mm_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2));
+            a[i] = _mm_add_epi64(a[i], _mm_add_epi64(prod, swap));
+        }
+    }
+    for (int i = 0; i < 4; i++) _mm_storeu_si128((__m128i *)acc + i, a[i]);
+#else
+    for (size_t s = 0; s < n; s++, p += HASH_STRIPE, key += 8) {
+        for (int i = 0; i < 8; i++) {
+            uint64_t d = read64(p + 8 * i), dk = d ^ read64(key + 8 * i);
+            acc[i ^ 1] += d;
+            acc[i] += (dk & 0xffffffffULL) * (dk >> 32);
+        }
+    }
+#endif
+}
+
+static void hash_scramble(uint64_t acc[8]) {
+    const unsigned char *key = hash_secret + HASH_SECRET - HASH_STRIPE;
+    for (int i = 0; i < 8; i++) {
+        uint64_t a = acc[i];
+        a ^= a >> 47;
+        a ^= read64(key + 8 * i);
+        acc[i] = a * 0x9e3779b1ULL;
+    }
+}
+
+static void hash_init(Hasher *h) {
+    static const uint64_t init[8] = {
+        0xc2b2ae3dULL, 0x9e3779b185ebca87ULL, 0xc2b2ae3d27d4eb4fULL, 0x165667b19e3779f9ULL,
+        0x85ebca77c2b2ae63ULL, 0x85ebca77ULL, 0x27d4eb2f165667c5ULL, 0x9e3779b1ULL,
+    };
+    pthread_once(&hash_once, hash_make_secret);
+    memcpy(h->acc, init, sizeof(init));
+    h->nbuf = 0;
+    h->total = 0;
+}
+
+static void hash_update(Hasher *h, const void *data, size_t len) {
+    const unsigned char *p = data;
+    h->total += len;
+    if (h->nbuf) {
+        size_t take = HASH_BLOCK - h->nbuf < len ? HASH_BLOCK - h->nbuf : len;
+        memcpy(h->buf + h->nbuf, p, take);
+        h->nbuf += take;
+        p += take;
+        len -= take;
+        if (h->nbuf < HASH_BLOCK) return;
+        hash_stripes(h->acc, h->buf, HASH_STRIPES, hash_secret);
+        hash_scramble(h->acc);
+        h->nbuf = 0;
+    }
+    for (; len >= HASH_BLOCK; p += HASH_BLOCK, len -= HASH_BLOCK) {
+        hash_stripes(h->acc, p, HASH_STRIPES, hash_secret);
+        hash_scramble(h->acc);
+    }
+    memcpy(h->buf, p, len);
+    h->nbuf = len;
+}
+
+static uint64_t hash_mix(uint64_t a, uint64_t b) {
+    unsigned __int128 m = (unsigned __int128)a * b;
+    return (uint64_t)m ^ (uint64_t)(m >> 64);
+}
+
+static uint64_t hash_merge(const uint64_t acc[8], const unsigned char *key, uint64_t start) {
+    uint64_t r = start;
+    for (int i = 0; i < 4; i++)
+        r += hash_mix(acc[2 * i] ^ read64(key + 16 * i), acc[2 * i + 1] ^ read64(key + 16 * i + 8));
+    r ^= r >> 37;
+    r *= 0x165667919e3779f9ULL;
+    return r ^ (r >> 32);
+}
+
+/* The tail is zero padded to a stripe; the length is merged in, so that
+ * padding cannot collide with real zero bytes. */
+static Hash128 hash_final(const Hasher *h) {
+    uint64_t acc[8];
+    memcpy(acc, h->acc, sizeof(acc));
+    size_t full = h->nbuf / HASH_STRIPE, rem = h->nbuf % HASH_STRIPE;
+    hash_stripes(acc, h->buf, full, hash_secret);
+    if (rem) {
+        unsigned char last[HASH_STRIPE] = { 0 };
+        memcpy(last, h->buf + full * HASH_STRIPE, rem);
+        hash_stripes(acc, last, 1, hash_secret + 8 * full);
+    }
+    Hash128 out;
+    out.lo = hash_merge(acc, hash_secret + 11, h->total * 0x9e3779b185ebca87ULL);
+    out.hi = hash_merge(acc, hash_secret + 117, ~(h->total * 0xc2b2ae3d27d4eb4fULL));
+    return out;
+}
+
+/* ---- DEDUPE ----
+ * Finds files with identical content below a directory while reading as
+ * little as possible:
+ *   1. a parallel walk (the organize deques again) records every regular
+ *      file's size and inode; sizes seen once cannot have a duplicate, and
+ *      extra hard links to one inode are already shared;
+ *   2. files left in a size bucket get their first and last 64 KB hashed,
+ *      which is the whole file when it is at most 128 KB;
+ *   3. only larger files still colliding after that are hashed in full,
+ *      through an mmap window, on a thread pool.
+ * Groups are reported as one "duplicate" op per extra copy, pointing at
+ * the copy that is kept (the first path in sort order). --link hard|reflink
+ * then replaces each extra copy, after a byte-for-byte check, with a hard
+ * link or a reflink of the kept one. */
+#define DUP_EDGE (64 * 1024)
+#define DUP_WINDOW (16 * 1024 * 1024)
+#define DUP_DEFAULT_JOBS 4
+
+enum { DUP_LINK_NONE, DUP_LINK_HARD, DUP_LINK_REFLINK };
+
+typedef struct {
+    const char *path;       /* absolute, in a worker arena */
+    off_t size;
+    dev_t dev;
+    ino_t ino;
+    mode_t mode;
+    Hash128 edge, full;     /* full is only set when it differs from edge */
+    int err;                /* errno when the file could not be read */
+} DupFile;
+
+typedef struct DupWalker {
+    struct DupWalk *walk;
+    int idx;
+    Run *run;
+    Deque dq;
+    char *dents;
+    DupFile *files;
+    long n, cap;
+    pthread_t tid;
+} DupWalker;
+
+typedef struct DupWalk {
+    const char *base;
+    int base_fd;
+    DupWalker *workers;
+    int nworkers;
+    long pending;
+} DupWalk;
+
+/* Queues rel/name for a walker; pending counts only what was queued. */
+static void dup_push(DupWalker *w, const char *rel, const char *name) {
+    const char *child = rel[0] ? arena_join(&w->run->arena, rel, name) : name;
+    char *copy = child ? strdup(child) : NULL;
+    if (!copy) return;
+    __atomic_add_fetch(&w->walk->pending, 1, __ATOMIC_ACQ_REL);
+    deque_push(&w->dq, copy);
+}
+
+static void dup_scan_dir(DupWalker *w, const char *rel) {
+    DupWalk *k = w->walk;
+    Run *run = w->run;
+    const char *dir_path = arena_join(&run->arena, k->base, rel);
+    int dfd = rel[0] ? openat(k->base_fd, rel, O_RDONLY | O_DIRECTORY | O_CLOEXEC) : dup(k->base_fd);
+    DirScan ds;
+    if (!dir_path || dfd < 0 || scan_open(&ds, dfd, w->dents) != 0) {
+        add_op_ref(run, "readdir", "Read directory entries", "openat(2)/getdents64(2)", dir_path, NULL, NULL, NULL,
+                   0, strerror(errno));
+        if (dfd >= 0) close(dfd);
+        return;
+    }
+    const char *name;
+    unsigned char type;
+    while ((name = scan_next(&ds, &type)) != NULL) {
+        if (type == DT_DIR) {
+            dup_push(w, rel, name);
+            continue;
+        }
+        if (type != DT_REG && type != DT_UNKNOWN) continue;
+        struct stat st;
+        if (fstatat(dfd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) continue;
+        if (S_ISDIR(st.st_mode)) {
+            dup_push(w, rel, name);
+            continue;
+        }
+        if (!S_ISREG(st.st_mode) || st.st_size == 0) continue;
+        if (w->n == w->cap) {
+            long cap = w->cap ? w->cap * 2 : 1024;
+            DupFile *grown = realloc(w->files, cap * sizeof(DupFile));
+            if (!grown) break;
+            w->files = grown;
+            w->cap = cap;
+        }
+        DupFile *f = &w->files[w->n];
+        memset(f, 0, sizeof(*f));
+        if (!(f->path = arena_join(&run->arena, dir_path, name))) break;
+        f->size = st.st_size;
+        f->dev = st.st_dev;
+        f->ino = st.st_ino;
+        f->mode = st.st_mode;
+        w->n++;
+    }
+    scan_close(&ds);
+    close(dfd);
+}
+
+static void *dup_walk_worker(void *arg) {
+    DupWalker *w = arg;
+    DupWalk *k = w->walk;
+    int idle = 0;
+    for (;;) {
+        char *rel = deque_pop(&w->dq);
+        for (int j = 1; !rel && j < k->nworkers; j++)
+            rel = deque_steal(&k->workers[(w->idx + j) % k->nworkers].dq);
+        if (!rel) {
+            if (__atomic_load_n(&k->pending, __ATOMIC_ACQUIRE) == 0) break;
+            if (++idle < 64) sched_yield();
+            else { struct timespec ts = { 0, 50000 }; nanosleep(&ts, NULL); }
+            continue;
+        }
+        idle = 0;
+        dup_scan_dir(w, rel);
+        free(rel);
+        __atomic_sub_fetch(&k->pending, 1, __ATOMIC_ACQ_REL);
+    }
+    return NULL;
+}
+
+typedef struct {
+    Run *run;
+    DupFile **files;
+    long n, *next;
+    int full;               /* stage 3 rather than stage 2 */
+    unsigned char *buf;     /* 2 * DUP_EDGE */
+    long long bytes;
+    pthread_t tid;
+} DupHasher;
+
+static ssize_t pread_full(int fd, unsigned char *buf, size_t len, off_t off) {
+    size_t got = 0;
+    while (got < len) {
+        ssize_t n = pread(fd, buf + got, len - got, off + got);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return n < 0 ? -1 : (ssize_t)got;
+        got += n;
+    }
+    return got;
+}
+
+/* Stage 2: the first and last DUP_EDGE bytes, or the whole small file. */
+static int dup_hash_edges(DupHasher *h, DupFile *f, int fd) {
+    Hasher st;
+    hash_init(&st);
+    size_t head = f->size > 2 * DUP_EDGE ? DUP_EDGE : (size_t)f->size;
+    if (pread_full(fd, h->buf, head, 0) != (ssize_t)head) return -1;
+    hash_update(&st, h->buf, head);
+    h->bytes += head;
+    if (f->size > 2 * DUP_EDGE) {
+        if (pread_full(fd, h->buf, DUP_EDGE, f->size - DUP_EDGE) != DUP_EDGE) return -1;
+        hash_update(&st, h->buf, DUP_EDGE);
+        h->bytes += DUP_EDGE;
+    }
+    f->edge = hash_final(&st);
+    return 0;
+}
+
+/* Stage 3: everything, one mmap window at a time; pread where mmap fails. */
+static int dup_hash_full(DupHasher *h, DupFile *f, int fd) {
+    Hasher st;
+    hash_init(&st);
+    for (off_t off = 0; off < f->size;) {
+        size_t len = f->size - off < DUP_WINDOW ? (size_t)(f->size - off) : DUP_WINDOW;
+        void *p = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, off);
+        if (p != MAP_FAILED) {
+            madvise(p, len, MADV_SEQUENTIAL);
+            hash_update(&st, p, len);
+            munmap(p, len);
+        } else {
+            if (len > 2 * DUP_EDGE) len = 2 * DUP_EDGE;
+            if (pread_full(fd, h->buf, len, off) != (ssize_t)len) return -1;
+            hash_update(&st, h->buf, len);
+        }
+        off += len;
+        h->bytes += len;
+    }
+    f->full = hash_final(&st);
+    return 0;
+}
+
+static void *dup_hash_worker(void *arg) {
+    DupHasher *h = arg;
+    long i;
+    while ((i = __atomic_fetch_add(h->next, 1, __ATOMIC_RELAXED)) < h->n) {
+        DupFile *f = h->files[i];
+        errno = 0;
+        int fd = open(f->path, O_RDONLY | O_CLOEXEC);
+        int rc = fd < 0 ? -1 : h->full ? dup_hash_full(h, f, fd) : dup_hash_edges(h, f, fd);
+        if (rc != 0) {
+            f->err = errno ? errno : EIO;
+            add_op_ref(h->run, "read", "Hash file content", h->full ? "mmap(2)" : "pread(2)", f->path, NULL,
+                       NULL, NULL, 0, strerror(f->err));
+        }
+        if (fd >= 0) close(fd);
+    }
+    return NULL;
+}
+
+/* Runs one hashing stage over files[0..n) on up to jobs threads. */
+static long long dup_hash_stage(Run *run, DupFile **files, long n, int full, int jobs) {
+    if (jobs > n) jobs = n ? (int)n : 1;
+    DupHasher *hs = calloc(jobs, sizeof(DupHasher));
+    if (!hs) return 0;
+    long next = 0;
+    for (int k = 0; k < jobs; k++) {
+        hs[k].run = k ? run_child(run, k) : run;
+        hs[k].files = files;
+        hs[k].n = n;
+        hs[k].next = &next;
+        hs[k].full = full;
+        hs[k].buf = malloc(2 * DUP_EDGE);
+    }
+    int started = 1;
+    for (int k = 1; k < jobs && hs[k].run && hs[k].buf; k++, started++)
+        if (pthread_create(&hs[k].tid, NULL, dup_hash_worker, &hs[k]) != 0) break;
+    if (hs[0].buf) dup_hash_worker(&hs[0]);
+    long long bytes = 0;
+    for (int k = 0; k < jobs; k++) {
+        if (k && k < started) pthread_join(hs[k].tid, NULL);
+        if (k && hs[k].run) run_join_child(run, hs[k].run);
+        bytes += hs[k].bytes;
+        free(hs[k].buf);
+    }
+    free(hs);
+    return bytes;
+}
+
+static int dup_cmp_inode(const void *a, const void *b) {
+    const DupFile *x = *(DupFile *const *)a, *y = *(DupFile *const *)b;
+    if (x->size != y->size) return x->size < y->size ? -1 : 1;
+    if (x->dev != y->dev) return x->dev < y->dev ? -1 : 1;
+    if (x->ino != y->ino) return x->ino < y->ino ? -1 : 1;
+    return strcmp(x->path, y->path);
+}
+
+static int dup_cmp_edge(const void *a, const void *b) {
+    const DupFile *x = *(DupFile *const *)a, *y = *(DupFile *const *)b;
+    if (x->size != y->size) return x->size < y->size ? -1 : 1;
+    if (x->edge.lo != y->edge.lo) return x->edge.lo < y->edge.lo ? -1 : 1;
+    if (x->edge.hi != y->edge.hi) return x->edge.hi < y->edge.hi ? -1 : 1;
+    if (x->full.lo != y->full.lo) return x->full.lo < y->full.lo ? -1 : 1;
+    if (x->full.hi != y->full.hi) return x->full.hi < y->full.hi ? -1 : 1;
+    return strcmp(x->path, y->path);
+}
+
+static int dup_same(const DupFile *x, const DupFile *y) {
+    return x->size == y->size && x->edge.lo == y->edge.lo && x->edge.hi == y->edge.hi &&
+           x->full.lo == y->full.lo && x->full.hi == y->full.hi;
+}
+
+/* Keeps the files whose key (per same) matches a neighbour's: the array
+ * is sorted, so that is a run of two or more. Returns the new count. */
+static long dup_keep_runs(DupFile **files, long n, int (*same)(const DupFile *, const DupFile *)) {
+    long out = 0;
+    for (long i = 0; i < n;) {
+        long j = i + 1;
+        while (j < n && same(files[i], files[j])) j++;
+        if (j - i > 1)
+            for (long k = i; k < j; k++) files[out++] = files[k];
+        i = j;
+    }
+    return out;
+}
+
+/* Drops the files that could not be read. Returns the new count. */
+static long dup_drop_failed(DupFile **files, long n) {
+    long out = 0;
+    for (long i = 0; i < n; i++)
+        if (!files[i]->err) files[out++] = files[i];
+    return out;
+}
+
+static int dup_same_size(const DupFile *x, const DupFile *y) {
+    return x->size == y->size;
+}
+
+/* Byte-for-byte check before a copy is replaced; hashes only ever say
+ * "almost certainly". */
+static int dup_files_equal(const char *a, const char *b, off_t size) {
+    int fa = open(a, O_RDONLY | O_CLOEXEC), fb = open(b, O_RDONLY | O_CLOEXEC);
+    unsigned char *ba = malloc(COPY_BUF), *bb = malloc(COPY_BUF);
+    int equal = fa >= 0 && fb >= 0 && ba && bb;
+    for (off_t off = 0; equal && off < size; off += COPY_BUF) {
+        size_t len = size - off < COPY_BUF ? (size_t)(size - off) : COPY_BUF;
+        equal = pread_full(fa, ba, len, off) == (ssize_t)len && pread_full(fb, bb, len, off) == (ssize_t)len &&
+                memcmp(ba, bb, len) == 0;
+    }
+    if (fa >= 0) close(fa);
+    if (fb >= 0) close(fb);
+    free(ba);
+    free(bb);
+    return equal;
+}
+
+/* Replaces dup with a hard link or reflink of keep, atomically: the new
+ * name is made beside dup and renamed over it. */
+static int dup_replace(const DupFile *keep, const DupFile *dup, int how) {
+    if (keep->dev != dup->dev) { errno = EXDEV; return -1; }
+    if (!dup_files_equal(keep->path, dup->path, dup->size)) { errno = EILSEQ; return -1; }
+    char tmp[PATH_MAX];
+    const char *slash = strrchr(dup->path, '/');
+    int dirlen = slash ? (int)(slash - dup->path) : 0;
+    if (snprintf(tmp, sizeof(tmp), "%.*s/.organizer-dedupe-%ld", dirlen, dup->path, (long)getpid()) >= (int)sizeof(tmp)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    if (how == DUP_LINK_HARD) {
+        if (link(keep->path, tmp) != 0) return -1;
+    } else {
+#ifdef FICLONE
+        int src = open(keep->path, O_RDONLY | O_CLOEXEC);
+        int dst = src < 0 ? -1 : open(tmp, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, dup->mode & 07777);
+        int rc = dst < 0 ? -1 : ioctl(dst, FICLONE, src);
+        int err = errno;
+        if (src >= 0) close(src);
+        if (dst >= 0) close(dst);
+        if (rc != 0) {
+            if (dst >= 0) unlink(tmp);
+            errno = err;
+            return -1;
+        }
+#else
+        errno = EOPNOTSUPP;
+        return -1;
+#endif
+    }
+    if (rename(tmp, dup->path) != 0) {
+        int err = errno;
+        unlink(tmp);
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+static void out_rel(Run *run, const char *base, const char *path) {
+    size_t bl = strlen(base);
+    out_json(run, strncmp(path, base, bl) == 0 && path[bl] == '/' ? path + bl + 1 : path);
+}
+
+static int dedupe(Run *run, const char *base, int jobs, int link_how) {
+    if (jobs < 1) jobs = DUP_DEFAULT_JOBS;
+    DupWalk k = { base, open(base, O_RDONLY | O_DIRECTORY | O_CLOEXEC), NULL, jobs, 1 };
+    if (k.base_fd < 0) {
+        int err = errno;
+        out_puts(run, run->ndjson ? "{\"type\":\"result\"" : "{\"operations\":[]");
+        out_printf(run, ",\"result\":null,\"error\":\"%s\"", strerror(err));
+        finish_json(run);
+        return -1;
+    }
+    k.workers = calloc(jobs, sizeof(DupWalker));
+    if (!k.workers) { close(k.base_fd); return -1; }
+    for (int i = 0; i < jobs; i++) {
+        DupWalker *w = &k.workers[i];
+        w->walk = &k;
+        w->idx = i;
+        w->run = i ? run_child(run, i) : run;
+        w->dents = malloc(DENTS_BUF);
+        pthread_mutex_init(&w->dq.lock, NULL);
+    }
+    deque_push(&k.workers[0].dq, strdup(""));
+    int started = 1;
+    for (int i = 1; i < jobs && k.workers[i].run && k.workers[i].dents; i++, started++)
+        if (pthread_create(&k.workers[i].tid, NULL, dup_walk_worker, &k.workers[i]) != 0) break;
+    if (k.workers[0].dents) dup_walk_worker(&k.workers[0]);
+
+    long nfiles = 0;
+    for (int i = 0; i < jobs; i++) {
+        if (i && i < started) pthread_join(k.workers[i].tid, NULL);
+        if (i && k.workers[i].run) run_join_child(run, k.workers[i].run);
+        nfiles += k.workers[i].n;
+    }
+    DupFile **files = malloc((nfiles ? nfiles : 1) * sizeof(DupFile *));
+    long n = 0;
+    for (int i = 0; files && i < jobs; i++)
+        for (long j = 0; j < k.workers[i].n; j++) files[n++] = &k.workers[i].files[j];
+
+    /* Stage 1: sizes. Hard links to one inode count once. */
+    long linked = 0;
+    if (files) {
+        qsort(files, n, sizeof(*files), dup_cmp_inode);
+        long out = 0;
+        for (long i = 0; i < n; i++) {
+            if (out && files[out - 1]->dev == files[i]->dev && files[out - 1]->ino == files[i]->ino) { linked++; continue; }
+            files[out++] = files[i];
+        }
+        n = dup_keep_runs(files, out, dup_same_size);
+    }
+    long candidates = n;
+
+    /* Stage 2: edges; stage 3: full hashes where the edges did not cover
+     * the whole file. */
+    long long bytes = dup_hash_stage(run, files, n, 0, jobs);
+    n = dup_drop_failed(files, n);
+    qsort(files, n, sizeof(*files), dup_cmp_edge);
+    n = dup_keep_runs(files, n, dup_same);
+    long nbig = 0;
+    DupFile **big = malloc((n ? n : 1) * sizeof(DupFile *));
+    for (long i = 0; big && i < n; i++)
+        if (files[i]->size > 2 * DUP_EDGE) big[nbig++] = files[i];
+    if (big) bytes += dup_hash_stage(run, big, nbig, 1, jobs);
+    free(big);
+    n = dup_drop_failed(files, n);
+    qsort(files, n, sizeof(*files), dup_cmp_edge);
+    n = dup_keep_runs(files, n, dup_same);
+
+    /* Report, and replace copies when asked; the first of each group stays. */
+    long groups = 0, dups = 0, replaced = 0;
+    long long wasted = 0;
+    for (long i = 0; i < n;) {
+        long j = i + 1;
+        while (j < n && dup_same(files[i], files[j])) j++;
+        groups++;
+        for (long d = i + 1; d < j; d++) {
+            dups++;
+            wasted += files[d]->size;
+            add_op_ref(run, "duplicate", "Same content as the kept copy", files[d]->size > 2 * DUP_EDGE ? "mmap(2)" : "pread(2)",
+                       files[d]->path, NULL, files[i]->path, NULL, 1, NULL);
+            if (link_how == DUP_LINK_NONE) continue;
+            op_begin(run);
+            int ok = dup_replace(files[i], files[d], link_how) == 0;
+            replaced += ok;
+            if (link_how == DUP_LINK_HARD)
+                add_op_ref(run, "link", "Replace duplicate with a hard link", "linkat(2)/renameat(2)",
+                           files[d]->path, NULL, files[i]->path, NULL, ok, ok ? NULL : strerror(errno));
+            else
+                add_op_ref(run, "link", "Replace duplicate with a reflink", "ioctl(FICLONE)/renameat(2)",
+                           files[d]->path, NULL, files[i]->path, NULL, ok, ok ? NULL : strerror(errno));
+        }
+        i = j;
+    }
+
+    print_ops(run);
+    out_puts(run, ",\"result\":{");
+    if (run->ndjson) {
+        out_printf(run, "\"groups\":%ld,", groups);
+    } else {
+        out_puts(run, "\"groups\":[");
+        for (long i = 0, g = 0; i < n; g++) {
+            long j = i + 1;
+            while (j < n && dup_same(files[i], files[j])) j++;
+            const Hash128 *h = files[i]->size > 2 * DUP_EDGE ? &files[i]->full : &files[i]->edge;
+            out_printf(run, "%s{\"size\":%lld,\"hash\":\"%016llx%016llx\",\"files\":[", g ? "," : "",
+                       (long long)files[i]->size, (unsigned long long)h->hi, (unsigned long long)h->lo);
+            for (long f = i; f < j; f++) {
+                out_puts(run, f > i ? ",\"" : "\"");
+                out_rel(run, base, files[f]->path);
+                out_puts(run, "\"");
+            }
+            out_puts(run, "]}");
+            i = j;
+        }
+        out_puts(run, "],");
+    }
+    out_printf(run, "\"files\":%ld,\"candidates\":%ld,\"hardLinked\":%ld,\"duplicates\":%ld,\"wastedBytes\":%lld,"
+               "\"bytesRead\":%lld,\"replaced\":%ld}", nfiles, candidates, linked, dups, wasted, bytes, replaced);
+    finish_json(run);
+
+    for (int i = 0; i < jobs; i++) {
+        free(k.workers[i].files);
+        free(k.workers[i].dents);
+        free(k.workers[i].dq.items);
+        pthread_mutex_destroy(&k.workers[i].dq.lock);
+    }
+    free(k.workers);
+    free(files);
+    close(k.base_fd);
+    return 0;
+}
+
+/* ---- WORKSPACE INDEX ----
+ * A persistent index of everything below a workspace, so list/stat/du/
+ * search queries need no tree walk. The file is struct-of-arrays: one array
+ * per field, entries in depth-first order with every directory's children
+ * sorted by name. A subtree is then a contiguous range [i, end[i]), which
+ * du scans as a couple of dense arrays, and the next sibling of i is
+ * end[i]. Names sit in one NUL-separated pool, next to a lower-cased copy
+ * that search scans with a single memmem pass.
+ *
+ * The file lives in the cache dir (see cache_path) and is replaced
+ * atomically, so readers just mmap whatever is current. Rebuilding reuses
+ * the previous index: a directory whose mtime is unchanged keeps its
+ * entries without being listed again, so a refresh costs one open+fstat
+ * per directory. `index --watch` goes further and trusts inotify: only the
+ * directories events point at are looked at, everything else is copied
+ * from the previous index. Dot entries are skipped, as the file manager
+ * hides them too. */
+#define WS_MAGIC "OWSIDX02"
+#define WS_DEBOUNCE_MS 100
+#define WS_SEARCH_LIMIT 100
+#define WS_TRI_BITS 18
+#define WS_TRI_BUCKETS (1u << WS_TRI_BITS)
+#define WS_INI_BUCKETS (1u << 16)
+
+enum { WS_FILE, WS_DIR, WS_LINK };
+
+typedef struct {
+    char magic[8];
+    uint64_t dev, ino;          /* the workspace root */
+    uint32_t count, pool_len;
+    uint64_t off_name, off_parent, off_end, off_files, off_kind, off_size, off_mtime, off_pool, off_lpool;
+    uint64_t off_tri_offs, off_tri_ids, off_ini_off, off_ini_pool, off_ini_offs, off_ini_ids;
+    uint64_t tri_total, ini_len, ini_total;
+    uint64_t file_len;
+} WsHdr;
+
+/* A read-only view of an index, mapped or freshly built. */
+typedef struct {
+    void *map;
+    size_t map_len;
+    uint32_t count, pool_len;
+    const uint32_t *name, *parent, *end, *files;
+    const uint8_t *kind;        /* WS_* | category << 2 */
+    const uint64_t *size;       /* directories: whole subtree */
+    const int64_t *mtime;       /* nanoseconds */
+    const char *pool, *lpool;
+    const uint32_t *tri_offs;   /* WS_TRI_BUCKETS + 1 posting list bounds */
+    const uint32_t *tri_ids;    /* entry ids, ascending within a list */
+    const uint32_t *ini_off;    /* per entry, into ini_pool */
+    const char *ini_pool;
+    const uint32_t *ini_offs;   /* WS_INI_BUCKETS + 1, by initials byte pair */
+    const uint32_t *ini_ids;
+    uint64_t tri_total, ini_len, ini_total;
+} WsIndex;
+
+static void ws_close(WsIndex *ix) {
+    if (ix->map) munmap(ix->map, ix->map_len);
+    memset(ix, 0, sizeof(*ix));
+}
+
+static int ws_open(WsIndex *ix, const char *path, const struct stat *root) {
+    memset(ix, 0, sizeof(*ix));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    struct stat st;
+    void *p = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(WsHdr))
+        p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return -1;
+    const WsHdr *h = p;
+    uint64_t n = h->count, len = st.st_size;
+    int ok = memcmp(h->magic, WS_MAGIC, 8) == 0 && h->file_len == len && n > 0 &&
+             h->dev == (uint64_t)root->st_dev && h->ino == (uint64_t)root->st_ino && h->pool_len > 0;
+    const uint64_t offs[] = { h->off_name, h->off_parent, h->off_end, h->off_files, h->off_kind,
+                              h->off_size, h->off_mtime, h->off_pool, h->off_lpool,
+                              h->off_tri_offs, h->off_tri_ids, h->off_ini_off, h->off_ini_pool,
+                              h->off_ini_offs, h->off_ini_ids };
+    const uint64_t sizes[] = { 4 * n, 4 * n, 4 * n, 4 * n, n, 8 * n, 8 * n, h->pool_len, h->pool_len,
+                               4 * (WS_TRI_BUCKETS + 1ULL), 4 * h->tri_total, 4 * n, h->ini_len,
+                               4 * (WS_INI_BUCKETS + 1ULL), 4 * h->ini_total };
+    ok = ok && h->tri_total < len && h->ini_total < len && h->ini_len > 0 && h->ini_len < len;
+    for (int i = 0; ok && i < 15; i++) ok = offs[i] % 8 == 0 && offs[i] <= len && sizes[i] <= len - offs[i];
+    if (!ok || ((const char *)p)[h->off_pool + h->pool_len - 1] != '\0' ||
+        ((const char *)p)[h->off_ini_pool + h->ini_len - 1] != '\0') {
+        munmap(p, st.st_size);
+        return -1;
+    }
+    ix->map = p;
+    ix->map_len = st.st_size;
+    ix->count = h->count;
+    ix->pool_len = h->pool_len;
+    ix->name = (const uint32_t *)((char *)p + h->off_name);
+    ix->parent = (const uint32_t *)((char *)p + h->off_parent);
+    ix->end = (const uint32_t *)((char *)p + h->off_end);
+    ix->files = (const uint32_t *)((char *)p + h->off_files);
+    ix->kind = (const uint8_t *)p + h->off_kind;
+    ix->size = (const uint64_t *)((char *)p + h->off_size);
+    ix->mtime = (const int64_t *)((char *)p + h->off_mtime);
+    ix->pool = (const char *)p + h->off_pool;
+    ix->lpool = (const char *)p + h->off_lpool;
+    ix->tri_offs = (const uint32_t *)((char *)p + h->off_tri_offs);
+    ix->tri_ids = (const uint32_t *)((char *)p + h->off_tri_ids);
+    ix->ini_off = (const uint32_t *)((char *)p + h->off_ini_off);
+    ix->ini_pool = (const char *)p + h->off_ini_pool;
+    ix->ini_offs = (const uint32_t *)((char *)p + h->off_ini_offs);
+    ix->ini_ids = (const uint32_t *)((char *)p + h->off_ini_ids);
+    ix->tri_total = h->tri_total;
+    ix->ini_len = h->ini_len;
+    ix->ini_total = h->ini_total;
+    return 0;
+}
+
+/* Accessors clamp, so a damaged file gives wrong answers, not crashes. */
+static const char *ws_name(const WsIndex *ix, uint32_t i) {
+    return ix->pool + (ix->name[i] < ix->pool_len ? ix->name[i] : ix->pool_len - 1);
+}
+
+static uint32_t ws_end(const WsIndex *ix, uint32_t i) {
+    uint32_t e = ix->end[i];
+    return e > i && e <= ix->count ? e : i + 1;
+}
+
+/* Entry for a workspace-relative path ("" is the root), or -1. */
+static long ws_lookup(const WsIndex *ix, const char *rel) {
+    uint32_t i = 0;
+    while (*rel == '/') rel++;
+    while (*rel) {
+        const char *slash = strchr(rel, '/');
+        size_t len = slash ? (size_t)(slash - rel) : strlen(rel);
+        uint32_t c = i + 1, end = ws_end(ix, i);
+        for (; c < end; c = ws_end(ix, c)) {
+            const char *nm = ws_name(ix, c);
+            int cmp = strncmp(nm, rel, len);
+            if (cmp == 0 && nm[len] == '\0') break;
+            if (cmp > 0) return -1;
+        }
+        if (c >= end) return -1;
+        i = c;
+        rel += len;
+        while (*rel == '/') rel++;
+    }
+    return i;
+}
+
+/* Workspace-relative path of entry i, built from the parent chain. */
+static const char *ws_path(const WsIndex *ix, uint32_t i, char *buf, size_t sz) {
+    char *p = buf + sz - 1;
+    *p = '\0';
+    while (i != 0 && i < ix->count) {
+        const char *nm = ws_name(ix, i);
+        size_t len = strlen(nm);
+        if ((size_t)(p - buf) < len + 1) break;
+        if (*p) *--p = '/';
+        p -= len;
+        memcpy(p, nm, len);
+        i = ix->parent[i];
+    }
+    return p;
+}
+
+/* A set of workspace-relative paths with flags, for the watcher. */
+enum { WS_RESCAN = 1, WS_RESTAT = 2, WS_ANCESTOR = 4 };
+
+typedef struct {
+    char **keys;
+    int *flags;
+    size_t cap, n;
+} StrSet;
+
+static uint64_t str_hash(const char *s) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    while (*s) h = (h ^ (unsigned char)*s++) * 0x100000001b3ULL;
+    return h;
+}
+
+static int strset_get(const StrSet *ss, const char *key) {
+    if (!ss || !ss->n) return 0;
+    for (size_t i = str_hash(key) & (ss->cap - 1);; i = (i + 1) & (ss->cap - 1)) {
+        if (!ss->keys[i]) return 0;
+        if (strcmp(ss->keys[i], key) == 0) return ss->flags[i];
+    }
+}
+
+static void strset_add(StrSet *ss, const char *key, int flags) {
+    if (2 * (ss->n + 1) > ss->cap) {
+        StrSet g = { NULL, NULL, ss->cap ? ss->cap * 2 : 64, 0 };
+        g.keys = calloc(g.cap, sizeof(char *));
+        g.flags = calloc(g.cap, sizeof(int));
+        if (!g.keys || !g.flags) { free(g.keys); free(g.flags); return; }
+        for (size_t i = 0; i < ss->cap; i++) {
+            if (!ss->keys[i]) continue;
+            size_t j = str_hash(ss->keys[i]) & (g.cap - 1);
+            while (g.keys[j]) j = (j + 1) & (g.cap - 1);
+            g.keys[j] = ss->keys[i];
+            g.flags[j] = ss->flags[i];
+        }
+        free(ss->keys);
+        free(ss->flags);
+        g.n = ss->n;
+        *ss = g;
+    }
+    size_t i = str_hash(key) & (ss->cap - 1);
+    for (; ss->keys[i]; i = (i + 1) & (ss->cap - 1))
+        if (strcmp(ss->keys[i], key) == 0) { ss->flags[i] |= flags; return; }
+    if (!(ss->keys[i] = strdup(key))) return;
+    ss->flags[i] = flags;
+    ss->n++;
+}
+
+/* Removes key; later entries of its probe run move up into the gap. */
+static void strset_del(StrSet *ss, const char *key) {
+    if (!ss->n) return;
+    size_t mask = ss->cap - 1, i = str_hash(key) & mask;
+    while (ss->keys[i] && strcmp(ss->keys[i], key) != 0) i = (i + 1) & mask;
+    if (!ss->keys[i]) return;
+    free(ss->keys[i]);
+    ss->keys[i] = NULL;
+    ss->n--;
+    for (size_t j = (i + 1) & mask; ss->keys[j]; j = (j + 1) & mask) {
+        size_t home = str_hash(ss->keys[j]) & mask;
+        /* The entry at j may fill i unless its home lies in (i, j]. */
+        if (i < j ? home > i && home <= j : home > i || home <= j) continue;
+        ss->keys[i] = ss->keys[j];
+        ss->flags[i] = ss->flags[j];
+        ss->keys[j] = NULL;
+        i = j;
+    }
+}
+
+static void strset_clear(StrSet *ss) {
+    for (size_t i = 0; i < ss->cap; i++) free(ss->keys[i]);
+    free(ss->keys);
+    free(ss->flags);
+    memset(ss, 0, sizeof(*ss));
+}
+
+/* Marks rel with flags and every directory above it as an ancestor. */
+static void strset_mark(StrSet *ss, const char *rel, int flags) {
+    char buf[PATH_MAX];
+    snprintf(buf, sizeof(buf), "%s", rel);
+    strset_add(ss, buf, flags);
+    for (char *slash = strrchr(buf, '/'); slash; slash = strrchr(buf, '/')) {
+        *slash = '\0';
+        strset_add(ss, buf, WS_ANCESTOR);
+    }
+    if (buf[0]) strset_add(ss, "", WS_ANCESTOR);
+}
+
+/* Growing arrays of the index being built. */
+typedef struct {
+    uint32_t *name, *parent, *end, *files;
+    uint8_t *kind;
+    uint64_t *size;
+    int64_t *mtime;
+    char *pool;
+    size_t n, cap, pool_len, pool_cap;
+    const WsIndex *old;         /* previous index, or one with count 0 */
+    const StrSet *dirty;        /* watcher events; NULL means check mtimes */
+    void (*on_dir)(void *ctx, const char *rel, int dfd);
+    void *ctx;
+    long rescanned, restatted, copied;
+    char rel[PATH_MAX];
+} WsBuild;
+
+static int64_t stat_mtime_ns(const struct stat *st) {
+    return (int64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+}
+
+static long ws_push(WsBuild *b, const char *name, uint32_t parent, int kind, uint64_t size, int64_t mtime) {
+    size_t len = strlen(name) + 1;
+    if (b->n == b->cap) {
+        size_t cap = b->cap ? b->cap * 2 : 4096;
+        void *p[7] = { realloc(b->name, cap * 4), realloc(b->parent, cap * 4), realloc(b->end, cap * 4),
+                       realloc(b->files, cap * 4), realloc(b->kind, cap), realloc(b->size, cap * 8),
+                       realloc(b->mtime, cap * 8) };
+        if (p[0]) b->name = p[0];
+        if (p[1]) b->parent = p[1];
+        if (p[2]) b->end = p[2];
+        if (p[3]) b->files = p[3];
+        if (p[4]) b->kind = p[4];
+        if (p[5]) b->size = p[5];
+        if (p[6]) b->mtime = p[6];
+        for (int i = 0; i < 7; i++) if (!p[i]) return -1;
+        b->cap = cap;
+    }
+    if (b->pool_len + len > b->pool_cap) {
+        size_t cap = b->pool_cap ? b->pool_cap * 2 : 65536;
+        while (cap < b->pool_len + len) cap *= 2;
+        char *g = realloc(b->pool, cap);
+        if (!g) return -1;
+        b->pool = g;
+        b->pool_cap = cap;
+    }
+    memcpy(b->pool + b->pool_len, name, len);
+    size_t i = b->n++;
+    b->name[i] = (uint32_t)b->pool_len;
+    b->pool_len += len;
+    b->parent[i] = parent;
+    b->end[i] = (uint32_t)b->n;
+    b->files[i] = kind == WS_DIR ? 0 : 1;
+    b->kind[i] = (uint8_t)kind;
+    if (kind != WS_DIR) b->kind[i] |= (uint8_t)(classify(&builtin_classifier, name) << 2);
+    b->size[i] = size;
+    b->mtime[i] = mtime;
+    return (long)i;
+}
+
+/* Copies the old subtree at oi under parent, untouched. */
+static long ws_copy_subtree(WsBuild *b, uint32_t oi, uint32_t parent) {
+    const WsIndex *o = b->old;
+    uint32_t end = ws_end(o, oi);
+    long base = (long)b->n;
+    for (uint32_t j = oi; j < end; j++) {
+        uint32_t p = j == oi ? parent : (uint32_t)(o->parent[j] - oi + base);
+        long i = ws_push(b, ws_name(o, j), p, WS_DIR, o->size[j], o->mtime[j]);
+        if (i < 0) return -1;
+        b->kind[i] = o->kind[j];
+        b->files[i] = o->files[j];
+        b->end[i] = (uint32_t)(ws_end(o, j) - oi + base);
+    }
+    b->copied += end - oi;
+    return base;
+}
+
+typedef struct {
+    const char *name;
+    int kind;
+    uint64_t size;
+    int64_t mtime;
+    long old;                   /* same entry in the previous index, or -1 */
+} WsChild;
+
+static int ws_child_cmp(const void *a, const void *b) {
+    return strcmp(((const WsChild *)a)->name, ((const WsChild *)b)->name);
+}
+
+static int ws_kind_of(mode_t mode) {
+    return S_ISDIR(mode) ? WS_DIR : S_ISLNK(mode) ? WS_LINK : WS_FILE;
+}
+
+static long ws_dir(WsBuild *b, int dfd, const struct stat *dst, const char *name, uint32_t parent, long oi);
+
+/* Adds one child of the directory being built; b->rel is that directory. */
+static int ws_child(WsBuild *b, int dfd, const WsChild *c, uint32_t me, size_t rel_len) {
+    if (c->kind != WS_DIR) return ws_push(b, c->name, me, c->kind, c->size, c->mtime) < 0 ? -1 : 0;
+    if (rel_len + strlen(c->name) + 2 >= sizeof(b->rel)) return 0;
+    if (rel_len) b->rel[rel_len] = '/';
+    strcpy(b->rel + rel_len + (rel_len ? 1 : 0), c->name);
+    long r = 0;
+    if (b->dirty && c->old >= 0 && !strset_get(b->dirty, b->rel)) {
+        r = ws_copy_subtree(b, (uint32_t)c->old, me);
+    } else {
+        int cfd = openat(dfd, c->name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        struct stat st;
+        if (cfd >= 0 && fstat(cfd, &st) == 0) r = ws_dir(b, cfd, &st, c->name, me, c->old);
+        if (cfd >= 0) close(cfd);
+    }
+    b->rel[rel_len] = '\0';
+    return r < 0 ? -1 : 0;
+}
+
+/* Adds directory dfd and everything below it. oi is its entry in the old
+ * index (-1 if new); b->rel is its workspace-relative path. */
+static long ws_dir(WsBuild *b, int dfd, const struct stat *dst, const char *name, uint32_t parent, long oi) {
+    const WsIndex *o = b->old;
+    int64_t mtime = stat_mtime_ns(dst);
+    long me = ws_push(b, name, parent, WS_DIR, 0, mtime);
+    if (me < 0) return -1;
+    if (b->on_dir) b->on_dir(b->ctx, b->rel, dfd);
+    size_t rel_len = strlen(b->rel);
+    int flags = strset_get(b->dirty, b->rel);
+    int rc = 0;
+
+    if (oi >= 0 && o->mtime[oi] == mtime && !(flags & WS_RESCAN)) {
+        /* Same listing as last time: walk the old children, re-reading only
+         * what the watcher says changed in place. */
+        for (uint32_t c = (uint32_t)oi + 1, end = ws_end(o, (uint32_t)oi); rc == 0 && c < end; c = ws_end(o, c)) {
+            WsChild ch = { ws_name(o, c), o->kind[c] & 3, o->size[c], o->mtime[c], c };
+            if (ch.kind != WS_DIR && (flags & WS_ANCESTOR)) {
+                char key[PATH_MAX];
+                int kl = snprintf(key, sizeof(key), "%s%s%s", b->rel, rel_len ? "/" : "", ch.name);
+                struct stat st;
+                /* A path too long for a key is simply re-read. */
+                if (kl < 0 || (size_t)kl >= sizeof(key) || (strset_get(b->dirty, key) & WS_RESTAT)) {
+                    b->restatted++;
+                    if (fstatat(dfd, ch.name, &st, AT_SYMLINK_NOFOLLOW) != 0) continue;
+                    ch.kind = ws_kind_of(st.st_mode);
+                    ch.size = st.st_size;
+                    ch.mtime = stat_mtime_ns(&st);
+                    if (ch.kind == WS_DIR) ch.old = -1;
+                }
+            }
+            rc = ws_child(b, dfd, &ch, (uint32_t)me, rel_len);
+        }
+    } else {
+        b->rescanned++;
+        char *dents = malloc(DENTS_BUF);
+        WsChild *kids = NULL;
+        size_t nk = 0, ck = 0;
+        Arena names = { NULL, 0 };
+        DirScan ds;
+        if (dents && scan_open(&ds, dfd, dents) == 0) {
+            const char *nm;
+            unsigned char type;
+            while ((nm = scan_next(&ds, &type)) != NULL) {
+                if (nm[0] == '.') continue;
+                struct stat st;
+                if (fstatat(dfd, nm, &st, AT_SYMLINK_NOFOLLOW) != 0) continue;
+                if (nk == ck) {
+                    ck = ck ? ck * 2 : 64;
+                    WsChild *g = realloc(kids, ck * sizeof(WsChild));
+                    if (!g) break;
+                    kids = g;
+                }
+                WsChild *k = &kids[nk];
+                if (!(k->name = arena_strdup(&names, nm))) break;
+                k->kind = ws_kind_of(st.st_mode);
+                k->size = k->kind == WS_DIR ? 0 : (uint64_t)st.st_size;
+                k->mtime = stat_mtime_ns(&st);
+                k->old = -1;
+                nk++;
+            }
+            scan_close(&ds);
+        }
+        if (nk) qsort(kids, nk, sizeof(WsChild), ws_child_cmp);
+        /* Both listings are sorted: one merge pairs new subdirectories with
+         * their old entries. */
+        uint32_t c = oi >= 0 ? (uint32_t)oi + 1 : 0, end = oi >= 0 ? ws_end(o, (uint32_t)oi) : 0;
+        for (size_t k = 0; k < nk; k++) {
+            int cmp = 1;
+            while (c < end && (cmp = strcmp(ws_name(o, c), kids[k].name)) < 0) c = ws_end(o, c);
+            if (c < end && cmp == 0 && kids[k].kind == WS_DIR && (o->kind[c] & 3) == WS_DIR) kids[k].old = c;
+        }
+        for (size_t k = 0; rc == 0 && k < nk; k++) rc = ws_child(b, dfd, &kids[k], (uint32_t)me, rel_len);
+        free(kids);
+        free(dents);
+        arena_free(&names);
+    }
+
+    /* Roll the subtree up into the directory's own entry. */
+    uint64_t bytes = 0;
+    uint32_t files = 0;
+    for (uint32_t c = (uint32_t)me + 1; c < b->n; c = b->end[c]) {
+        bytes += b->size[c];
+        files += b->files[c];
+    }
+    b->size[me] = bytes;
+    b->files[me] = files;
+    b->end[me] = (uint32_t)b->n;
+    return rc < 0 ? -1 : me;
+}
+
+static void ws_build_free(WsBuild *b) {
+    free(b->name);
+    free(b->parent);
+    free(b->end);
+    free(b->files);
+    free(b->kind);
+    free(b->size);
+    free(b->mtime);
+    free(b->pool);
+}
+
+/* ---- FILENAME SEARCH ----
+ * `query search` (and `search`) is answered from two indexes stored with
+ * the workspace index. Every lower-cased name is cut into byte trigrams,
+ * hashed into WS_TRI_BUCKETS posting lists of entry ids; a query walks the
+ * list of its rarest trigram and keeps ids present in all the others, then
+ * checks each survivor with an SSE2 substring kernel, since hashing and
+ * trigram order both let false candidates through. The initials of every
+ * name ("Quarterly sales report.pdf" -> "qsrp") are indexed the same way
+ * by byte pairs, for acronym queries. Both are regenerated from the
+ * in-memory arrays each time the index is written, so renames and moves
+ * the watcher folds in are searchable on its next update, without another
+ * walk. */
+typedef struct {
+    uint32_t *offs, *ids;       /* nbuckets + 1 list bounds; entry ids */
+    uint64_t total;
+} Postings;
+
+typedef struct {
+    char *lower;                /* lower-cased name pool */
+    Postings tri, ini;
+    uint32_t *ini_off;
+    char *ini_pool;
+    size_t ini_len;
+} WsSearchBuild;
+
+typedef struct {
+    const char *pool;
+    const uint32_t *off;
+    int gram;
+    size_t lo, hi;
+    uint32_t *counts;           /* per bucket: this range's count, then its cursor */
+    uint32_t *ids;
+    int pass;
+    pthread_t tid;
+} GramJob;
+
+static inline uint32_t gram_bucket(const unsigned char *p, int gram) {
+    if (gram == 2) return (uint32_t)p[0] << 8 | p[1];
+    uint32_t t = (uint32_t)p[0] << 16 | (uint32_t)p[1] << 8 | p[2];
+    return (t * 0x9e3779b1u) >> (32 - WS_TRI_BITS);
+}
+
+static inline int lower_alnum(unsigned c) {
+    return c - 'a' < 26u || c - '0' < 10u;
+}
+
+static void *gram_worker(void *arg) {
+    GramJob *j = arg;
+    for (size_t i = j->lo; i < j->hi; i++) {
+        const unsigned char *s = (const unsigned char *)j->pool + j->off[i];
+        for (; s[0] && s[1] && (j->gram == 2 || s[2]); s++) {
+            uint32_t k = gram_bucket(s, j->gram);
+            if (j->pass == 0) j->counts[k]++;
+            else j->ids[j->counts[k]++] = (uint32_t)i;
+        }
+    }
+    return NULL;
+}
+
+/* Posting lists are built by disjoint entry ranges in parallel: each range
+ * counts its grams per bucket, a prefix sum over (bucket, range) gives
+ * every range its own slice of each list, and a second pass scatters ids
+ * into them. Ranges are in entry order, so lists come out sorted. */
+static int gram_index(const char *pool, const uint32_t *off, size_t n, int gram, uint32_t nbuckets,
+                      Postings *out) {
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    int nt = n < 65536 || ncpu < 2 ? 1 : ncpu > 8 ? 8 : (int)ncpu;
+    GramJob jobs[8];
+    memset(jobs, 0, sizeof(jobs));
+    int ok = (out->offs = malloc(4 * (nbuckets + 1ULL))) != NULL;
+    for (int t = 0; t < nt; t++) {
+        jobs[t].pool = pool;
+        jobs[t].off = off;
+        jobs[t].gram = gram;
+        jobs[t].lo = n * t / nt;
+        jobs[t].hi = n * (t + 1) / nt;
+        if (!(jobs[t].counts = calloc(nbuckets, 4))) ok = 0;
+    }
+    for (int pass = 0; ok && pass < 2; pass++) {
+        if (pass == 1) {
+            uint64_t total = 0;
+            for (uint32_t k = 0; k < nbuckets; k++) {
+                out->offs[k] = (uint32_t)total;
+                for (int t = 0; t < nt; t++) {
+                    uint32_t c = jobs[t].counts[k];
+                    jobs[t].counts[k] = (uint32_t)total;
+                    total += c;
+                }
+            }
+            out->offs[nbuckets] = (uint32_t)total;
+            out->total = total;
+            if (total > UINT32_MAX || !(out->ids = malloc(4 * (total ? total : 1)))) {
+                ok = 0;
+                break;
+            }
+        }
+        for (int t = 0; t < nt; t++) {
+            jobs[t].pass = pass;
+            jobs[t].ids = out->ids;
+        }
+        int started = 1;
+        for (; started < nt; started++)
+            if (pthread_create(&jobs[started].tid, NULL, gram_worker, &jobs[started]) != 0) break;
+        gram_worker(&jobs[0]);
+        /* Ranges whose thread did not start run here. */
+        for (int t = started; t < nt; t++) gram_worker(&jobs[t]);
+        for (int t = 1; t < started; t++) pthread_join(jobs[t].tid, NULL);
+    }
+    for (int t = 0; t < nt; t++) free(jobs[t].counts);
+    return ok ? 0 : -1;
+}
+
+static void ws_search_free(WsSearchBuild *s) {
+    free(s->lower);
+    free(s->tri.offs);
+    free(s->tri.ids);
+    free(s->ini.offs);
+    free(s->ini.ids);
+    free(s->ini_off);
+    free(s->ini_pool);
+}
+
+static int ws_search_build(const WsBuild *b, WsSearchBuild *s) {
+    memset(s, 0, sizeof(*s));
+    size_t n = b->n;
+    s->lower = malloc(b->pool_len ? b->pool_len : 1);
+    s->ini_off = malloc(4 * (n ? n : 1));
+    s->ini_pool = malloc(b->pool_len + 1);
+    if (!s->lower || !s->ini_off || !s->ini_pool) goto fail;
+    for (size_t i = 0; i < b->pool_len; i++) {
+        unsigned c = (unsigned char)b->pool[i];
+        s->lower[i] = (char)(c - 'A' < 26u ? c | 0x20 : c);
+    }
+    /* Initials: the first character of every run of [a-z0-9]. */
+    size_t il = 0;
+    for (size_t i = 0; i < n; i++) {
+        s->ini_off[i] = (uint32_t)il;
+        unsigned prev = 0;
+        for (const unsigned char *p = (const unsigned char *)s->lower + b->name[i]; *p; prev = *p++)
+            if (lower_alnum(*p) && !lower_alnum(prev)) s->ini_pool[il++] = (char)*p;
+        s->ini_pool[il++] = '\0';
+    }
+    s->ini_len = il;
+    if (gram_index(s->lower, b->name, n, 3, WS_TRI_BUCKETS, &s->tri) == 0 &&
+        gram_index(s->ini_pool, s->ini_off, n, 2, WS_INI_BUCKETS, &s->ini) == 0)
+        return 0;
+fail:
+    ws_search_free(s);
+    errno = ENOMEM;
+    return -1;
+}
+
+/* Writes the built arrays as an index file, atomically. */
+static int ws_write(const WsBuild *b, const char *path, const struct stat *root) {
+    WsSearchBuild sb;
+    if (ws_search_build(b, &sb) != 0) return -1;
+    WsHdr h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, WS_MAGIC, 8);
+    h.dev = root->st_dev;
+    h.ino = root->st_ino;
+    h.count = (uint32_t)b->n;
+    h.pool_len = (uint32_t)b->pool_len;
+    h.tri_total = sb.tri.total;
+    h.ini_len = sb.ini_len;
+    h.ini_total = sb.ini.total;
+    uint64_t off = (sizeof(h) + 7) & ~7ULL, n = b->n;
+#define WS_PLACE(field, bytes) (h.field = off, off = (off + (bytes) + 7) & ~7ULL)
+    WS_PLACE(off_name, 4 * n);
+    WS_PLACE(off_parent, 4 * n);
+    WS_PLACE(off_end, 4 * n);
+    WS_PLACE(off_files, 4 * n);
+    WS_PLACE(off_kind, n);
+    WS_PLACE(off_size, 8 * n);
+    WS_PLACE(off_mtime, 8 * n);
+    WS_PLACE(off_pool, b->pool_len);
+    WS_PLACE(off_lpool, b->pool_len);
+    WS_PLACE(off_tri_offs, 4 * (WS_TRI_BUCKETS + 1ULL));
+    WS_PLACE(off_tri_ids, 4 * sb.tri.total);
+    WS_PLACE(off_ini_off, 4 * n);
+    WS_PLACE(off_ini_pool, sb.ini_len);
+    WS_PLACE(off_ini_offs, 4 * (WS_INI_BUCKETS + 1ULL));
+    WS_PLACE(off_ini_ids, 4 * sb.ini.total);
+#undef WS_PLACE
+    h.file_len = off;
+
+    char tmp[PATH_MAX + 16];
+    snprintf(tmp, sizeof(tmp), "%s.%ld", path, (long)getpid());
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    int ok = fd >= 0 && ftruncate(fd, (off_t)off) == 0 &&
+             pwrite_all(fd, (const char *)&h, sizeof(h), 0) == 0 &&
+             pwrite_all(fd, (const char *)b->name, 4 * n, h.off_name) == 0 &&
+             pwrite_all(fd, (const char *)b->parent, 4 * n, h.off_parent) == 0 &&
+             pwrite_all(fd, (const char *)b->end, 4 * n, h.off_end) == 0 &&
+             pwrite_all(fd, (const char *)b->files, 4 * n, h.off_files) == 0 &&
+             pwrite_all(fd, (const char *)b->kind, n, h.off_kind) == 0 &&
+             pwrite_all(fd, (const char *)b->size, 8 * n, h.off_size) == 0 &&
+             pwrite_all(fd, (const char *)b->mtime, 8 * n, h.off_mtime) == 0 &&
+             pwrite_all(fd, b->pool, b->pool_len, h.off_pool) == 0 &&
+             pwrite_all(fd, sb.lower, b->pool_len, h.off_lpool) == 0 &&
+             pwrite_all(fd, (const char *)sb.tri.offs, 4 * (WS_TRI_BUCKETS + 1ULL), h.off_tri_offs) == 0 &&
+             pwrite_all(fd, (const char *)sb.tri.ids, 4 * sb.tri.total, h.off_tri_ids) == 0 &&
+             pwrite_all(fd, (const char *)sb.ini_off, 4 * n, h.off_ini_off) == 0 &&
+             pwrite_all(fd, sb.ini_pool, sb.ini_len, h.off_ini_pool) == 0 &&
+             pwrite_all(fd, (const char *)sb.ini.offs, 4 * (WS_INI_BUCKETS + 1ULL), h.off_ini_offs) == 0 &&
+             pwrite_all(fd, (const char *)sb.ini.ids, 4 * sb.ini.total, h.off_ini_ids) == 0;
+    ws_search_free(&sb);
+    if (fd >= 0 && close(fd) != 0) ok = 0;
+    if (!ok || rename(tmp, path) != 0) {
+        int err = errno;
+        unlink(tmp);
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+typedef struct {
+    long entries, rescanned, restatted, copied;
+    int written;
+    double ms;
+} WsStats;
+
+/* Brings the index of the workspace at root_fd up to date: against
+ * directory mtimes, or, with dirty, against the watcher's events only.
+ * On success ix holds the current index. */
+static int ws_update(int root_fd, const struct stat *root, const char *path, WsIndex *ix,
+                     const StrSet *dirty, void (*on_dir)(void *, const char *, int), void *ctx,
+                     WsStats *stats) {
+    double t0 = now_us();
+    WsBuild b;
+    memset(&b, 0, sizeof(b));
+    b.old = ix;
+    b.dirty = dirty;
+    b.on_dir = on_dir;
+    b.ctx = ctx;
+    long rc = ws_dir(&b, root_fd, root, "", UINT32_MAX, ix->count ? 0 : -1);
+    int changed = ix->count == 0 || b.rescanned || b.restatted || b.n != ix->count;
+    memset(stats, 0, sizeof(*stats));
+    if (rc >= 0 && changed) {
+        rc = ws_write(&b, path, root);
+        stats->written = rc == 0;
+    }
+    stats->entries = (long)b.n;
+    stats->rescanned = b.rescanned;
+    stats->restatted = b.restatted;
+    stats->copied = b.copied;
+    ws_build_free(&b);
+    if (rc >= 0 && changed) {
+        ws_close(ix);
+        rc = ws_open(ix, path, root);
+    }
+    stats->ms = (now_us() - t0) / 1000;
+    return rc < 0 ? -1 : 0;
+}
+
+static void out_iso_time(Run *run, int64_t ns) {
+    time_t sec = (time_t)(ns / 1000000000);
+    struct tm tm;
+    char buf[32];
+    gmtime_r(&sec, &tm);
+    strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", &tm);
+    out_printf(run, "\"%s.%03dZ\"", buf, (int)(ns / 1000000 % 1000));
+}
+
+static const char *ws_type_name(int kind) {
+    return (kind & 3) == WS_DIR ? "directory" : (kind & 3) == WS_LINK ? "link" : "file";
+}
+
+/* One entry as the file-manager routes describe it. */
+static void ws_print_entry(Run *run, const WsIndex *ix, uint32_t i) {
+    char buf[PATH_MAX];
+    out_puts(run, "{\"name\":\"");
+    out_json(run, ws_name(ix, i));
+    out_puts(run, "\",\"path\":\"");
+    out_json(run, ws_path(ix, i, buf, sizeof(buf)));
+    out_printf(run, "\",\"type\":\"%s\",\"sizeBytes\":%llu,\"modified\":", ws_type_name(ix->kind[i]),
+               (unsigned long long)ix->size[i]);
+    out_iso_time(run, ix->mtime[i]);
+    if ((ix->kind[i] & 3) == WS_DIR) {
+        long kids = 0;
+        for (uint32_t c = i + 1, end = ws_end(ix, i); c < end; c = ws_end(ix, c)) kids++;
+        out_printf(run, ",\"childrenCount\":%ld,\"files\":%u", kids, ix->files[i]);
+    } else {
+        out_puts(run, ",\"category\":\"");
+        out_json(run, builtin_classifier.names[(ix->kind[i] >> 2) % builtin_classifier.ncats]);
+        out_puts(run, "\"");
+    }
+    out_puts(run, "}");
+}
+
+/* Holds an exclusive lock on path.lock for as long as fd stays open; a
+ * query that can take a shared lock knows no watcher keeps the index.
+ * Returns the fd, -1 when there is no lock file, -2 when it is held. */
+static int ws_lock(const char *path, int exclusive) {
+    char lock[PATH_MAX + 8];
+    snprintf(lock, sizeof(lock), "%s.lock", path);
+    int fd = open(lock, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) return -1;
+    if (flock(fd, (exclusive ? LOCK_EX : LOCK_SH) | LOCK_NB) != 0) {
+        close(fd);
+        return -2;
+    }
+    return fd;
+}
+
+#ifdef __linux__
+typedef struct {
+    int fd;
+    char **paths;               /* workspace-relative path per watch descriptor */
+    int npaths;
+} WsWatch;
+
+static void ws_watch_dir(void *ctx, const char *rel, int dfd) {
+    WsWatch *w = ctx;
+    char proc[64];
+    /* Watch through the open handle: no second path walk, no race with a
+     * rename of the directory in between. */
+    snprintf(proc, sizeof(proc), "/proc/self/fd/%d", dfd);
+    int wd = inotify_add_watch(w->fd, proc, IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                               IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_ONLYDIR | IN_EXCL_UNLINK);
+    if (wd < 0) return;
+    if (wd >= w->npaths) {
+        int n = wd * 2 + 64;
+        char **g = realloc(w->paths, n * sizeof(char *));
+        if (!g) return;
+        memset(g + w->npaths, 0, (n - w->npaths) * sizeof(char *));
+        w->paths = g;
+        w->npaths = n;
+    }
+    free(w->paths[wd]);
+    w->paths[wd] = strdup(rel);
+}
+
+/* Turns queued inotify events into dirty marks; 1 on queue overflow. */
+static int ws_watch_read(WsWatch *w, StrSet *dirty) {
+    char buf[64 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t len;
+    int overflow = 0;
+    while ((len = read(w->fd, buf, sizeof(buf))) > 0) {
+        for (char *p = buf; p < buf + len;) {
+            struct inotify_event *ev = (struct inotify_event *)p;
+            p += sizeof(*ev) + ev->len;
+            if (ev->mask & IN_Q_OVERFLOW) { overflow = 1; continue; }
+            if (ev->wd < 0 || ev->wd >= w->npaths || !w->paths[ev->wd]) continue;
+            const char *dir = w->paths[ev->wd];
+            if (ev->mask & IN_IGNORED) {
+                free(w->paths[ev->wd]);
+                w->paths[ev->wd] = NULL;
+                continue;
+            }
+            if (!ev->len || ev->name[0] == '.') continue;
+            if (ev->mask & (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)) {
+                strset_mark(dirty, dir, WS_RESCAN);
+            } else if (!(ev->mask & IN_ISDIR)) {
+                char key[PATH_MAX];
+                snprintf(key, sizeof(key), "%s%s%s", dir, dir[0] ? "/" : "", ev->name);
+                strset_mark(dirty, key, WS_RESTAT);
+            }
+        }
+    }
+    return overflow;
+}
+#endif
+
+static void ws_print_stats(Run *run, const WsStats *st, const char *path) {
+    out_printf(run, "\"entries\":%ld,\"rescanned\":%ld,\"restatted\":%ld,\"copied\":%ld,\"written\":%s,\"ms\":%.1f,"
+               "\"index\":\"", st->entries, st->rescanned, st->restatted, st->copied,
+               st->written ? "true" : "false", st->ms);
+    out_json(run, path);
+    out_puts(run, "\"");
+}
+
+/* organizer_cli index <workspace> [--watch]; --watch is refused in serve mode. */
+static int ws_index(Run *run, const char *base, int watch) {
+    /* --watch never returns, so in serve mode it would hold a worker and
+     * its reply would never be sent. */
+    int root_fd = watch && run->req_id ? -1 : open(base, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    struct stat root;
+    char path[PATH_MAX];
+    if (root_fd < 0 || fstat(root_fd, &root) != 0 || !cache_path("workspace", &root, path, sizeof(path))) {
+        int err = watch && run->req_id ? EOPNOTSUPP : root_fd < 0 || errno ? errno : ENOENT;
+        if (root_fd >= 0) close(root_fd);
+        out_puts(run, run->ndjson ? "{\"type\":\"result\"" : "{\"operations\":[]");
+        out_printf(run, ",\"result\":null,\"error\":\"%s\"", strerror(err));
+        finish_json(run);
+        return -1;
+    }
+    WsIndex ix;
+    if (ws_open(&ix, path, &root) != 0) memset(&ix, 0, sizeof(ix));
+    int lock_fd = watch ? ws_lock(path, 1) : -1;
+#ifdef __linux__
+    WsWatch w = { -1, NULL, 0 };
+    if (watch && lock_fd >= 0) w.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+    WsStats st;
+    int rc;
+    op_begin(run);
+#ifdef __linux__
+    /* The first pass checks every directory's mtime; it also places the
+     * watches, so nothing that changes from here on is missed. */
+    rc = ws_update(root_fd, &root, path, &ix, NULL, w.fd >= 0 ? ws_watch_dir : NULL, &w, &st);
+#else
+    rc = ws_update(root_fd, &root, path, &ix, NULL, NULL, NULL, &st);
+#endif
+    add_op_ref(run, "index", "Build workspace index", "getdents64(2)/fstatat(2)", path, NULL, NULL, NULL,
+               rc == 0, rc == 0 ? NULL : strerror(errno));
+    print_ops(run);
+    out_puts(run, ",\"result\":{");
+    ws_print_stats(run, &st, path);
+    out_puts(run, "}");
+    if (lock_fd == -2) out_puts(run, ",\"error\":\"another watcher keeps this index\"");
+    finish_json(run);
+
+#ifdef __linux__
+    if (w.fd >= 0) {
+        StrSet dirty = { NULL, NULL, 0, 0 };
+        for (;;) {
+            struct pollfd pfd = { w.fd, POLLIN, 0 };
+            if (poll(&pfd, 1, -1) < 0 && errno != EINTR) break;
+            /* Let a burst settle (an unzip, a bulk move) before rebuilding. */
+            int overflow = ws_watch_read(&w, &dirty);
+            double start = now_us();
+            while (poll(&pfd, 1, WS_DEBOUNCE_MS) > 0 && now_us() - start < 10 * WS_DEBOUNCE_MS * 1000.0)
+                overflow |= ws_watch_read(&w, &dirty);
+            if (!dirty.n && !overflow) continue;
+            /* After an overflow nothing can be trusted: recheck mtimes. */
+            rc = ws_update(root_fd, &root, path, &ix, overflow ? NULL : &dirty, ws_watch_dir, &w, &st);
+            strset_clear(&dirty);
+            out_puts(run, "{\"type\":\"update\",");
+            ws_print_stats(run, &st, path);
+            if (rc != 0) out_printf(run, ",\"error\":\"%s\"", strerror(errno));
+            out_puts(run, "}\n");
+            out_flush(&run->out);
+        }
+        for (int i = 0; i < w.npaths; i++) free(w.paths[i]);
+        free(w.paths);
+        close(w.fd);
+    }
+#endif
+    if (lock_fd >= 0) close(lock_fd);
+    ws_close(&ix);
+    close(root_fd);
+    return rc;
+}
+
+/* Leftmost occurrence of n in h, or -1. Sixteen start positions are
+ * tested at a time by comparing the needle's first and last bytes; only
+ * positions where both agree reach memcmp. */
+static long find_sub(const char *h, size_t hn, const char *n, size_t nn) {
+    if (nn == 0) return 0;
+    if (nn > hn) return -1;
+    size_t i = 0;
+#ifdef __SSE2__
+    if (nn >= 2) {
+        const __m128i first = _mm_set1_epi8(n[0]), last = _mm_set1_epi8(n[nn - 1]);
+        for (; i + nn - 1 + 16 <= hn; i += 16) {
+            __m128i f = _mm_cmpeq_epi8(first, _mm_loadu_si128((const __m128i *)(h + i)));
+            __m128i l = _mm_cmpeq_epi8(last, _mm_loadu_si128((const __m128i *)(h + i + nn - 1)));
+            unsigned mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(f, l));
+            for (; mask; mask &= mask - 1) {
+                unsigned bit = (unsigned)__builtin_ctz(mask);
+                if (memcmp(h + i + bit + 1, n + 1, nn - 2) == 0) return (long)(i + bit);
+            }
+        }
+    }
+#endif
+    for (; i + nn <= hn; i++)
+        if (h[i] == n[0] && memcmp(h + i, n, nn) == 0) return (long)i;
+    return -1;
+}
+
+typedef struct {
+    uint64_t key;               /* rank << 32 | ~id: larger is better */
+} WsHit;
+
+enum { WS_RANK_INITIALS_IN = 1, WS_RANK_INITIALS, WS_RANK_SUBSTRING, WS_RANK_WORD, WS_RANK_PREFIX, WS_RANK_EXACT };
+
+/* Keeps the best `cap` hits in a min-heap. */
+typedef struct {
+    WsHit *h;
+    size_t n, cap;
+    long matches;
+} WsTopK;
+
+static void topk_push(WsTopK *t, int rank, size_t name_len, uint32_t id) {
+    /* Within a rank, shorter names first, then index order. */
+    uint32_t len = name_len > 0xfff ? 0xfff : (uint32_t)name_len;
+    uint64_t key = (uint64_t)rank << 44 | (uint64_t)(0xfff - len) << 32 | (uint32_t)~id;
+    t->matches++;
+    if (t->cap == 0) return;
+    size_t i;
+    if (t->n < t->cap) {
+        i = t->n++;
+        while (i > 0 && t->h[(i - 1) / 2].key > key) {
+            t->h[i] = t->h[(i - 1) / 2];
+            i = (i - 1) / 2;
+        }
+    } else {
+        if (key <= t->h[0].key) return;
+        i = 0;
+        for (;;) {
+            size_t c = 2 * i + 1;
+            if (c >= t->n) break;
+            if (c + 1 < t->n && t->h[c + 1].key < t->h[c].key) c++;
+            if (t->h[c].key >= key) break;
+            t->h[i] = t->h[c];
+            i = c;
+        }
+    }
+    t->h[i].key = key;
+}
+
+static int hit_cmp_desc(const void *a, const void *b) {
+    uint64_t x = ((const WsHit *)a)->key, y = ((const WsHit *)b)->key;
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+/* Lower-cased name of entry i; its length comes from the next name. */
+static const char *ws_lname(const WsIndex *ix, uint32_t i, size_t *len) {
+    uint32_t a = ix->name[i] < ix->pool_len ? ix->name[i] : ix->pool_len - 1;
+    uint32_t b = i + 1 < ix->count && ix->name[i + 1] > a && ix->name[i + 1] <= ix->pool_len
+                     ? ix->name[i + 1] - 1 : a + (uint32_t)strlen(ix->lpool + a);
+    *len = b - a;
+    return ix->lpool + a;
+}
+
+static int name_rank(const char *nm, size_t len, const char *q, size_t qn) {
+    long pos = find_sub(nm, len, q, qn);
+    if (pos < 0) return 0;
+    if (pos == 0) return len == qn ? WS_RANK_EXACT : WS_RANK_PREFIX;
+    /* A later occurrence may start a word even if the first does not. */
+    for (long p = pos; p >= 0; ) {
+        if (!lower_alnum((unsigned char)nm[p - 1])) return WS_RANK_WORD;
+        long next = find_sub(nm + p + 1, len - p - 1, q, qn);
+        p = next < 0 ? -1 : p + 1 + next;
+    }
+    return WS_RANK_SUBSTRING;
+}
+
+/* Smallest index >= *at in list[..n) holding a value >= id, by galloping. */
+static size_t gallop(const uint32_t *list, size_t n, size_t at, uint32_t id) {
+    size_t step = 1, lo = at, hi = at;
+    while (hi < n && list[hi] < id) {
+        lo = hi + 1;
+        hi += step;
+        step <<= 1;
+    }
+    if (hi > n) hi = n;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (list[mid] < id) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+typedef struct {
+    const uint32_t *ids;
+    size_t n, at;
+} GramList;
+
+static int gram_list_cmp(const void *a, const void *b) {
+    size_t x = ((const GramList *)a)->n, y = ((const GramList *)b)->n;
+    return x < y ? -1 : x > y;
+}
+
+/* Entries in the posting list of every gram of q, ascending, in a malloc'd
+ * array; NULL with *n 0 when there are none. */
+static uint32_t *gram_intersect(const uint32_t *offs, const uint32_t *ids, uint64_t total, int gram,
+                                const char *q, size_t qn, uint32_t count, size_t *n) {
+    GramList lists[NAME_MAX];
+    size_t nl = 0;
+    *n = 0;
+    for (size_t k = 0; k + gram <= qn; k++) {
+        uint32_t b = gram_bucket((const unsigned char *)q + k, gram);
+        uint32_t lo = offs[b], hi = offs[b + 1];
+        if (hi > total) hi = (uint32_t)total;
+        if (lo > hi) lo = hi;
+        int dup = 0;
+        for (size_t j = 0; j < nl; j++) dup |= lists[j].ids == ids + lo;
+        if (dup) continue;
+        lists[nl].ids = ids + lo;
+        lists[nl].n = hi - lo;
+        lists[nl++].at = 0;
+    }
+    if (nl == 0) return NULL;
+    qsort(lists, nl, sizeof(*lists), gram_list_cmp);
+    const GramList *rare = &lists[0];
+    uint32_t *out = malloc(4 * (rare->n ? rare->n : 1)), last = UINT32_MAX;
+    if (!out) return NULL;
+    for (size_t k = 0; k < rare->n; k++) {
+        uint32_t id = rare->ids[k];
+        if (id == last || id == 0 || id >= count) continue;
+        last = id;
+        size_t j = 1;
+        for (; j < nl; j++) {
+            GramList *l = &lists[j];
+            if (l->at < l->n && l->ids[l->at] < id) l->at = gallop(l->ids, l->n, l->at, id);
+            if (l->at >= l->n || l->ids[l->at] != id) break;
+        }
+        if (j == nl) out[(*n)++] = id;
+    }
+    return out;
+}
+
+/* Name matches: trigram candidates for queries of three bytes or more,
+ * otherwise a memmem pass over the whole lower-cased pool. */
+static void ws_search_names(const WsIndex *ix, const char *q, size_t qn, WsTopK *top) {
+    if (qn < 3) {
+        const char *p = ix->lpool, *end = ix->lpool + ix->pool_len;
+        while ((p = memmem(p, end - p, q, qn)) != NULL) {
+            uint32_t off = (uint32_t)(p - ix->lpool), lo = 1, hi = ix->count;
+            while (lo + 1 < hi) {
+                uint32_t mid = lo + (hi - lo) / 2;
+                if (ix->name[mid] <= off) lo = mid;
+                else hi = mid;
+            }
+            size_t len;
+            const char *nm = ws_lname(ix, lo, &len);
+            int r = name_rank(nm, len, q, qn);
+            if (r) topk_push(top, r, len, lo);
+            p = nm + len + 1;
+            if (p >= end) break;
+        }
+        return;
+    }
+    size_t n;
+    uint32_t *ids = gram_intersect(ix->tri_offs, ix->tri_ids, ix->tri_total, 3, q, qn, ix->count, &n);
+    for (size_t k = 0; k < n; k++) {
+        size_t len;
+        const char *nm = ws_lname(ix, ids[k], &len);
+        int r = name_rank(nm, len, q, qn);
+        if (r) topk_push(top, r, len, ids[k]);
+    }
+    free(ids);
+}
+
+/* Acronym matches, from byte-pair candidates over the initials, for names
+ * the query is not a substring of (those were ranked higher already). A
+ * single character is always in the name too, so it needs no pass. */
+static void ws_search_initials(const WsIndex *ix, const char *q, size_t qn, WsTopK *top) {
+    for (size_t i = 0; i < qn; i++)
+        if (!lower_alnum((unsigned char)q[i])) return;
+    size_t n;
+    uint32_t *ids = qn < 2 ? NULL
+                           : gram_intersect(ix->ini_offs, ix->ini_ids, ix->ini_total, 2, q, qn, ix->count, &n);
+    for (size_t k = 0; ids && k < n; k++) {
+        uint32_t o = ix->ini_off[ids[k]];
+        const char *ini = ix->ini_pool + (o < ix->ini_len ? o : ix->ini_len - 1);
+        size_t len, il = strlen(ini);
+        const char *nm = ws_lname(ix, ids[k], &len);
+        if (find_sub(ini, il, q, qn) < 0 || find_sub(nm, len, q, qn) >= 0) continue;
+        topk_push(top, il == qn ? WS_RANK_INITIALS : WS_RANK_INITIALS_IN, len, ids[k]);
+    }
+    free(ids);
+}
+
+/* Search: names containing the text, best first (whole name, prefix, word
+ * start, anywhere), then names whose initials match it. */
+static void ws_search(Run *run, const WsIndex *ix, const char *q, long limit) {
+    char lq[NAME_MAX + 1];
+    size_t qn = 0;
+    for (; q[qn] && qn < NAME_MAX; qn++) {
+        unsigned c = (unsigned char)q[qn];
+        lq[qn] = (char)(c - 'A' < 26u ? c | 0x20 : c);
+    }
+    lq[qn] = '\0';
+    WsTopK top = { NULL, 0, limit > 0 ? (size_t)limit : 0, 0 };
+    if (top.cap && !(top.h = malloc(top.cap * sizeof(*top.h)))) top.cap = 0;
+    if (qn) {
+        ws_search_names(ix, lq, qn, &top);
+        ws_search_initials(ix, lq, qn, &top);
+    }
+    qsort(top.h, top.n, sizeof(*top.h), hit_cmp_desc);
+    out_puts(run, "\"items\":[");
+    for (size_t k = 0; k < top.n; k++) {
+        if (k) out_puts(run, ",");
+        ws_print_entry(run, ix, ~(uint32_t)top.h[k].key);
+    }
+    out_printf(run, "],\"count\":%zu,\"matches\":%ld", top.n, top.matches);
+    free(top.h);
+}
+
+/* du: one pass over the subtree's range of the kind and size arrays. */
+static void ws_du(Run *run, const WsIndex *ix, uint32_t i) {
+    uint64_t bytes[64] = { 0 }, files[64] = { 0 }, dirs = 0;
+    int ncats = builtin_classifier.ncats;
+    for (uint32_t j = i, end = ws_end(ix, i); j < end; j++) {
+        int k = ix->kind[j];
+        if ((k & 3) == WS_DIR) { dirs++; continue; }
+        bytes[(k >> 2) % ncats] += ix->size[j];
+        files[(k >> 2) % ncats]++;
+    }
+    out_printf(run, "\"sizeBytes\":%llu,\"files\":%u,\"dirs\":%llu,\"categories\":{",
+               (unsigned long long)ix->size[i], ix->files[i], (unsigned long long)(dirs ? dirs - 1 : 0));
+    for (int c = 0; c < ncats; c++) {
+        out_printf(run, "%s\"", c ? "," : "");
+        out_json(run, builtin_classifier.names[c]);
+        out_printf(run, "\":{\"files\":%llu,\"bytes\":%llu}", (unsigned long long)files[c],
+                   (unsigned long long)bytes[c]);
+    }
+    out_puts(run, "}");
+}
+
+/* organizer_cli query <workspace> list|stat|du|search [arg]. Without a
+ * running watcher the index is first refreshed against directory mtimes. */
+/* Opens the workspace index at path for a query. While a watcher holds
+ * the lock it is current already; otherwise it is refreshed against
+ * directory mtimes first. Returns 0 or an errno. */
+static int ws_current(int root_fd, const struct stat *root, const char *path, WsIndex *ix) {
+    int err = 0;
+    int lock_fd = ws_lock(path, 0);
+    int opened = ws_open(ix, path, root) == 0;
+    if (lock_fd != -2 || !opened) {
+        WsStats st;
+        if (ws_update(root_fd, root, path, ix, NULL, NULL, NULL, &st) != 0) err = errno ? errno : EIO;
+    }
+    if (lock_fd >= 0) close(lock_fd);
+    return err;
+}
+
+static int ws_query(Run *run, const char *base, const char *what, const char *arg, long limit) {
+    op_begin(run);
+    int root_fd = open(base, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    struct stat root;
+    char path[PATH_MAX];
+    int err = 0;
+    WsIndex ix;
+    memset(&ix, 0, sizeof(ix));
+    if (root_fd < 0 || fstat(root_fd, &root) != 0 || !cache_path("workspace", &root, path, sizeof(path)))
+        err = root_fd < 0 || errno ? errno : ENOENT;
+    else
+        err = ws_current(root_fd, &root, path, &ix);
+    if (root_fd >= 0) close(root_fd);
+
+    long i = err ? -1 : ws_lookup(&ix, strcmp(what, "search") == 0 ? "" : arg);
+    if (!err && i < 0) err = ENOENT;
+    if (!err && strcmp(what, "list") == 0 && (ix.kind[i] & 3) != WS_DIR) err = ENOTDIR;
+    if (err) {
+        out_puts(run, run->ndjson ? "{\"type\":\"result\"" : "{\"operations\":[]");
+        out_printf(run, ",\"result\":null,\"error\":\"%s\"", strerror(err));
+        finish_json(run);
+        ws_close(&ix);
+        return -1;
+    }
+    add_op_ref(run, "query", "Answer from workspace index", "mmap(2)", path, NULL, NULL, NULL, 1, NULL);
+    print_ops(run);
+    out_puts(run, ",\"result\":{");
+    if (strcmp(what, "list") == 0) {
+        out_puts(run, "\"items\":[");
+        for (uint32_t c = (uint32_t)i + 1, end = ws_end(&ix, (uint32_t)i), n = 0; c < end; c = ws_end(&ix, c), n++) {
+            if (n) out_puts(run, ",");
+            ws_print_entry(run, &ix, c);
+        }
+        out_puts(run, "]");
+    } else if (strcmp(what, "stat") == 0) {
+        out_puts(run, "\"item\":");
+        ws_print_entry(run, &ix, (uint32_t)i);
+    } else if (strcmp(what, "du") == 0) {
+        ws_du(run, &ix, (uint32_t)i);
+    } else {
+        ws_search(run, &ix, arg, limit);
+    }
+    out_puts(run, "}");
+    finish_json(run);
+    ws_close(&ix);
+    return 0;
+}
+
+/* ---- DISK USAGE ----
+ * organizer_cli du <workspace> [subpath] [--jobs N] sums the tree's sizes
+ * for the storage quota. The walk runs on the dedupe deques, with one
+ * fstatat per file. Every directory leaves a record of its own files'
+ * counts and bytes per category, its allocated blocks, the names of its
+ * subdirectories, and its multiply-linked files. The records are saved
+ * in the cache directory. The next run fstats each directory and, when
+ * mtime and inode still match, takes the record instead of listing the
+ * directory. Only directories whose entries changed are read again. A
+ * file rewritten in place keeps its recorded size until its directory
+ * changes; the index has the same caveat. Hard links are counted once,
+ * after the walk, by (dev, ino) over all records. */
+#define DU_MAGIC "ODUSUM01"
+#define DU_DEFAULT_JOBS 4
+#define DU_MAX_CATS 64
+
+typedef struct {
+    uint64_t dev, ino, size, blocks;
+    uint32_t cat, pad;
+} DuLink;
+
+/* Followed by files[ncats], bytes[ncats], links[nlinks], the path and the
+ * NUL-terminated subdirectory names, padded to 8 bytes. */
+typedef struct {
+    uint32_t rec_len, path_len, subs_len, nlinks;
+    uint32_t path_off, pad;
+    uint64_t ino;
+    int64_t mtime;
+    uint64_t blocks;            /* 512-byte blocks of the files */
+} DuRec;
+
+typedef struct {
+    char magic[8];
+    uint64_t dev, ino;          /* the walk root */
+    uint32_t ncats, count;
+    uint64_t len;               /* bytes of records after the header */
+} DuHdr;
+
+typedef struct DuWorker {
+    struct DuWalk *walk;
+    int idx;
+    Run *run;
+    Deque dq;
+    char *dents;
+    char *recs;                 /* this worker's records, back to back */
+    size_t len, cap;
+    DuLink *links;
+    size_t nlinks, links_cap;
+    char *subs;
+    size_t subs_len, subs_cap;
+    long rescanned, cached;
+    pthread_t tid;
+} DuWorker;
+
+typedef struct DuWalk {
+    const char *base;
+    int base_fd, ncats;
+    DuWorker *workers;
+    int nworkers;
+    long pending;
+    const DuRec **old;          /* the cached records, by path */
+    long nold;
+} DuWalk;
+
+static inline uint64_t *du_files(const DuRec *r) { return (uint64_t *)(r + 1); }
+static inline DuLink *du_links(const DuRec *r, int ncats) { return (DuLink *)(du_files(r) + 2 * ncats); }
+static inline const char *du_path(const DuRec *r) { return (const char *)r + r->path_off; }
+
+static size_t du_rec_len(int ncats, size_t nlinks, size_t path_len, size_t subs_len) {
+    return (sizeof(DuRec) + 16 * ncats + sizeof(DuLink) * nlinks + path_len + 1 + subs_len + 7) & ~(size_t)7;
+}
+
+/* Room for len more bytes in a worker's record buffer, or NULL. */
+static char *du_reserve(DuWorker *w, size_t len) {
+    if (w->len + len > w->cap) {
+        size_t cap = w->cap ? w->cap * 2 : 65536;
+        while (cap < w->len + len) cap *= 2;
+        char *g = realloc(w->recs, cap);
+        if (!g) return NULL;
+        w->recs = g;
+        w->cap = cap;
+    }
+    return w->recs + w->len;
+}
+
+static int du_grow(void **p, size_t *cap, size_t need, size_t elem) {
+    if (need <= *cap) return 0;
+    size_t n = *cap ? *cap * 2 : 64;
+    while (n < need) n *= 2;
+    void *g = realloc(*p, n * elem);
+    if (!g) return -1;
+    *p = g;
+    *cap = n;
+    return 0;
+}
+
+static const DuRec *du_find(const DuWalk *k, const char *rel) {
+    long lo = 0, hi = k->nold;
+    while (lo < hi) {
+        long mid = lo + (hi - lo) / 2;
+        int c = strcmp(du_path(k->old[mid]), rel);
+        if (c == 0) return k->old[mid];
+        if (c < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return NULL;
+}
+
+static void du_push_child(DuWorker *w, const char *rel, const char *name) {
+    char *child = rel[0] ? arena_join(&w->run->arena, rel, name) : (char *)name;
+    if (!child) return;
+    __atomic_add_fetch(&w->walk->pending, 1, __ATOMIC_ACQ_REL);
+    deque_push(&w->dq, strdup(child));
+}
+
+static void du_scan_dir(DuWorker *w, const char *rel) {
+    DuWalk *k = w->walk;
+    Run *run = w->run;
+    int ncats = k->ncats;
+    int dfd = rel[0] ? openat(k->base_fd, rel, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC) : dup(k->base_fd);
+    struct stat dst;
+    if (dfd < 0 || fstat(dfd, &dst) != 0) {
+        add_op_ref(run, "readdir", "Read directory entries", "openat(2)", arena_join(&run->arena, k->base, rel),
+                   NULL, NULL, NULL, 0, strerror(errno));
+        if (dfd >= 0) close(dfd);
+        return;
+    }
+    int64_t mtime = stat_mtime_ns(&dst);
+    const DuRec *old = du_find(k, rel);
+    if (old && old->ino == (uint64_t)dst.st_ino && old->mtime == mtime) {
+        char *p = du_reserve(w, old->rec_len);
+        if (p) {
+            memcpy(p, old, old->rec_len);
+            w->len += old->rec_len;
+            w->cached++;
+            const char *s = du_path(old) + old->path_len + 1, *end = s + old->subs_len;
+            for (; s < end; s += strlen(s) + 1) du_push_child(w, rel, s);
+        }
+        close(dfd);
+        return;
+    }
+
+    uint64_t files[DU_MAX_CATS] = { 0 }, bytes[DU_MAX_CATS] = { 0 }, blocks = 0;
+    w->nlinks = w->subs_len = 0;
+    DirScan ds;
+    if (scan_open(&ds, dfd, w->dents) != 0) {
+        add_op_ref(run, "readdir", "Read directory entries", "getdents64(2)", arena_join(&run->arena, k->base, rel),
+                   NULL, NULL, NULL, 0, strerror(errno));
+        close(dfd);
+        return;
+    }
+    const char *name;
+    unsigned char type;
+    while ((name = scan_next(&ds, &type)) != NULL) {
+        struct stat st;
+        int is_dir = type == DT_DIR;
+        if (!is_dir) {
+            if (fstatat(dfd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) continue;
+            is_dir = S_ISDIR(st.st_mode);
+        }
+        if (is_dir) {
+            size_t len = strlen(name) + 1;
+            if (du_grow((void **)&w->subs, &w->subs_cap, w->subs_len + len, 1) != 0) continue;
+            memcpy(w->subs + w->subs_len, name, len);
+            w->subs_len += len;
+            du_push_child(w, rel, name);
+            continue;
+        }
+        int cat = classify(&builtin_classifier, name) % ncats;
+        files[cat]++;
+        bytes[cat] += (uint64_t)st.st_size;
+        blocks += (uint64_t)st.st_blocks;
+        if (S_ISREG(st.st_mode) && st.st_nlink > 1 &&
+            du_grow((void **)&w->links, &w->links_cap, w->nlinks + 1, sizeof(DuLink)) == 0)
+            w->links[w->nlinks++] = (DuLink){ (uint64_t)st.st_dev, (uint64_t)st.st_ino, (uint64_t)st.st_size,
+                                              (uint64_t)st.st_blocks, (uint32_t)cat, 0 };
+    }
+    scan_close(&ds);
+    close(dfd);
+    w->rescanned++;
+
+    size_t path_len = strlen(rel), len = du_rec_len(ncats, w->nlinks, path_len, w->subs_len);
+    DuRec *r = (DuRec *)du_reserve(w, len);
+    if (!r) return;
+    memset(r, 0, len);
+    r->rec_len = (uint32_t)len;
+    r->path_len = (uint32_t)path_len;
+    r->subs_len = (uint32_t)w->subs_len;
+    r->nlinks = (uint32_t)w->nlinks;
+    r->path_off = (uint32_t)((char *)(du_links(r, ncats) + w->nlinks) - (char *)r);
+    r->ino = (uint64_t)dst.st_ino;
+    r->mtime = mtime;
+    r->blocks = blocks;
+    memcpy(du_files(r), files, 8 * ncats);
+    memcpy(du_files(r) + ncats, bytes, 8 * ncats);
+    memcpy(du_links(r, ncats), w->links, sizeof(DuLink) * w->nlinks);
+    char *p = (char *)r + r->path_off;
+    memcpy(p, rel, path_len + 1);
+    memcpy(p + path_len + 1, w->subs, w->subs_len);
+    w->len += len;
+}
+
+static void *du_walk_worker(void *arg) {
+    DuWorker *w = arg;
+    DuWalk *k = w->walk;
+    int idle = 0;
+    for (;;) {
+        char *rel = deque_pop(&w->dq);
+        for (int j = 1; !rel && j < k->nworkers; j++)
+            rel = deque_steal(&k->workers[(w->idx + j) % k->nworkers].dq);
+        if (!rel) {
+            if (__atomic_load_n(&k->pending, __ATOMIC_ACQUIRE) == 0) break;
+            if (++idle < 64) sched_yield();
+            else { struct timespec ts = { 0, 50000 }; nanosleep(&ts, NULL); }
+            continue;
+        }
+        idle = 0;
+        du_scan_dir(w, rel);
+        free(rel);
+        __atomic_sub_fetch(&k->pending, 1, __ATOMIC_ACQ_REL);
+    }
+    return NULL;
+}
+
+/* Splits a record blob into a path-sorted array; NULL if it is damaged. */
+static const DuRec **du_index_recs(const char *buf, size_t len, int ncats, long count) {
+    const DuRec **recs = malloc((count ? count : 1) * sizeof(*recs));
+    size_t off = 0;
+    for (long i = 0; recs && i < count; i++) {
+        const DuRec *r = (const DuRec *)(buf + off);
+        if (len - off < sizeof(DuRec) || r->rec_len % 8 || r->rec_len > len - off ||
+            r->rec_len != du_rec_len(ncats, r->nlinks, r->path_len, r->subs_len) ||
+            r->path_off != sizeof(DuRec) + 16 * ncats + sizeof(DuLink) * r->nlinks ||
+            du_path(r)[r->path_len] != '\0' || (r->subs_len && du_path(r)[r->path_len + r->subs_len] != '\0') ||
+            (i && strcmp(du_path(recs[i - 1]), du_path(r)) >= 0)) {
+            free(recs);
+            return NULL;
+        }
+        recs[i] = r;
+        off += r->rec_len;
+    }
+    return recs;
+}
+
+static int du_rec_cmp(const void *a, const void *b) {
+    return strcmp(du_path(*(const DuRec *const *)a), du_path(*(const DuRec *const *)b));
+}
+
+static int du_link_cmp(const void *a, const void *b) {
+    const DuLink *x = *(const DuLink *const *)a, *y = *(const DuLink *const *)b;
+    if (x->dev != y->dev) return x->dev < y->dev ? -1 : 1;
+    return x->ino < y->ino ? -1 : x->ino > y->ino;
+}
+
+/* The cached records for root, sorted by path, backed by *buf; NULL when
+ * there is no usable cache. */
+static const DuRec **du_load(const char *path, const struct stat *root, int ncats, char **buf, long *count) {
+    *buf = NULL;
+    *count = 0;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+    struct stat st;
+    DuHdr h;
+    const DuRec **recs = NULL;
+    if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(h) &&
+        pread_full(fd, (unsigned char *)&h, sizeof(h), 0) == (ssize_t)sizeof(h) &&
+        memcmp(h.magic, DU_MAGIC, 8) == 0 && h.dev == (uint64_t)root->st_dev && h.ino == (uint64_t)root->st_ino &&
+        h.ncats == (uint32_t)ncats && h.len == (uint64_t)st.st_size - sizeof(h) && h.count <= h.len / sizeof(DuRec) &&
+        (*buf = malloc(h.len ? h.len : 1)) != NULL &&
+        pread_full(fd, (unsigned char *)*buf, h.len, sizeof(h)) == (ssize_t)h.len)
+        recs = du_index_recs(*buf, h.len, ncats, h.count);
+    close(fd);
+    if (!recs) {
+        free(*buf);
+        *buf = NULL;
+        return NULL;
+    }
+    *count = h.count;
+    return recs;
+}
+
+/* Writes the records as the new cache, atomically. */
+static int du_save(const char *path, const struct stat *root, int ncats, const DuRec **recs, long n) {
+    DuHdr h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, DU_MAGIC, 8);
+    h.dev = root->st_dev;
+    h.ino = root->st_ino;
+    h.ncats = (uint32_t)ncats;
+    h.count = (uint32_t)n;
+    for (long i = 0; i < n; i++) h.len += recs[i]->rec_len;
+    char *blob = malloc(h.len ? h.len : 1);
+    if (!blob) return -1;
+    for (long i = 0, off = 0; i < n; off += recs[i]->rec_len, i++) memcpy(blob + off, recs[i], recs[i]->rec_len);
+    char tmp[PATH_MAX + 16];
+    snprintf(tmp, sizeof(tmp), "%s.%ld", path, (long)getpid());
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    int ok = fd >= 0 && pwrite_all(fd, (const char *)&h, sizeof(h), 0) == 0 &&
+             pwrite_all(fd, blob, h.len, sizeof(h)) == 0;
+    free(blob);
+    if (fd >= 0 && close(fd) != 0) ok = 0;
+    if (!ok || rename(tmp, path) != 0) {
+        int err = errno;
+        unlink(tmp);
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+static int disk_usage(Run *run, const char *base, int jobs) {
+    double t0 = now_us();
+    uint64_t t0_ns = now_ns();
+    if (jobs < 1) jobs = DU_DEFAULT_JOBS;
+    int ncats = builtin_classifier.ncats < DU_MAX_CATS ? builtin_classifier.ncats : DU_MAX_CATS;
+    DuWalk k;
+    memset(&k, 0, sizeof(k));
+    k.base = base;
+    k.ncats = ncats;
+    k.nworkers = jobs;
+    k.pending = 1;
+    k.base_fd = open(base, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    struct stat root;
+    if (k.base_fd < 0 || fstat(k.base_fd, &root) != 0) {
+        int err = errno;
+        if (k.base_fd >= 0) close(k.base_fd);
+        out_puts(run, run->ndjson ? "{\"type\":\"result\"" : "{\"operations\":[]");
+        out_printf(run, ",\"result\":null,\"error\":\"%s\"", strerror(err));
+        finish_json(run);
+        return -1;
+    }
+    char path[PATH_MAX], *oldbuf = NULL;
+    int have_path = cache_path("du", &root, path, sizeof(path));
+    if (have_path) k.old = du_load(path, &root, ncats, &oldbuf, &k.nold);
+
+    k.workers = calloc(jobs, sizeof(DuWorker));
+    if (!k.workers) { close(k.base_fd); return -1; }
+    for (int i = 0; i < jobs; i++) {
+        DuWorker *w = &k.workers[i];
+        w->walk = &k;
+        w->idx = i;
+        w->run = i ? run_child(run, i) : run;
+        w->dents = malloc(DENTS_BUF);
+        pthread_mutex_init(&w->dq.lock, NULL);
+    }
+    deque_push(&k.workers[0].dq, strdup(""));
+    int started = 1;
+    for (int i = 1; i < jobs && k.workers[i].run && k.workers[i].dents; i++, started++)
+        if (pthread_create(&k.workers[i].tid, NULL, du_walk_worker, &k.workers[i]) != 0) break;
+    if (k.workers[0].dents) du_walk_worker(&k.workers[0]);
+
+    long n = 0, rescanned = 0, cached = 0;
+    for (int i = 0; i < jobs; i++) {
+        DuWorker *w = &k.workers[i];
+        if (i && i < started) pthread_join(w->tid, NULL);
+        if (i && w->run) run_join_child(run, w->run);
+        for (size_t off = 0; off < w->len; off += ((const DuRec *)(w->recs + off))->rec_len) n++;
+        rescanned += w->rescanned;
+        cached += w->cached;
+    }
+    const DuRec **recs = malloc((n ? n : 1) * sizeof(*recs));
+    uint64_t files[DU_MAX_CATS] = { 0 }, bytes[DU_MAX_CATS] = { 0 }, blocks = 0;
+    long nlinks = 0, linked = 0, m = 0;
+    for (int i = 0; recs && i < jobs; i++) {
+        DuWorker *w = &k.workers[i];
+        for (size_t off = 0; off < w->len; off += recs[m++]->rec_len) {
+            recs[m] = (const DuRec *)(w->recs + off);
+            nlinks += recs[m]->nlinks;
+        }
+    }
+    n = m;
+
+    /* Sum the records, then take back every extra link to one inode. */
+    const DuLink **links = malloc((nlinks ? nlinks : 1) * sizeof(*links));
+    long nl = 0;
+    for (long i = 0; i < n; i++) {
+        const uint64_t *f = du_files(recs[i]);
+        for (int c = 0; c < ncats; c++) {
+            files[c] += f[c];
+            bytes[c] += f[ncats + c];
+        }
+        blocks += recs[i]->blocks;
+        for (uint32_t j = 0; links && j < recs[i]->nlinks; j++) links[nl++] = &du_links(recs[i], ncats)[j];
+    }
+    if (links) qsort(links, nl, sizeof(*links), du_link_cmp);
+    for (long i = 1; i < nl; i++) {
+        if (du_link_cmp(&links[i - 1], &links[i]) != 0) continue;
+        files[links[i]->cat % ncats]--;
+        bytes[links[i]->cat % ncats] -= links[i]->size;
+        blocks -= links[i]->blocks;
+        linked++;
+    }
+    free(links);
+
+    int saved = 0;
+    if (recs && have_path) {
+        qsort(recs, n, sizeof(*recs), du_rec_cmp);
+        saved = du_save(path, &root, ncats, recs, n) == 0;
+    }
+    op_begin_at(run, t0_ns);
+    add_op(run, "du", "Sum disk usage", "getdents64(2)/fstatat(2)", base, have_path ? path : NULL, saved,
+           saved ? NULL : have_path ? strerror(errno) : "no cache directory");
+    print_ops(run);
+    uint64_t total_files = 0, total_bytes = 0;
+    for (int c = 0; c < ncats; c++) {
+        total_files += files[c];
+        total_bytes += bytes[c];
+    }
+    out_printf(run, ",\"result\":{\"sizeBytes\":%llu,\"allocatedBytes\":%llu,\"files\":%llu,\"dirs\":%ld,"
+               "\"hardLinked\":%ld,\"categories\":{", (unsigned long long)total_bytes,
+               (unsigned long long)blocks * 512, (unsigned long long)total_files, n ? n - 1 : 0, linked);
+    for (int c = 0; c < ncats; c++) {
+        out_printf(run, "%s\"", c ? "," : "");
+        out_json(run, builtin_classifier.names[c]);
+        out_printf(run, "\":{\"files\":%llu,\"bytes\":%llu}", (unsigned long long)files[c],
+                   (unsigned long long)bytes[c]);
+    }
+    out_printf(run, "},\"rescanned\":%ld,\"cached\":%ld,\"ms\":%.1f}", rescanned, cached, (now_us() - t0) / 1000);
+    finish_json(run);
+
+    for (int i = 0; i < jobs; i++) {
+        free(k.workers[i].recs);
+        free(k.workers[i].links);
+        free(k.workers[i].subs);
+        free(k.workers[i].dents);
+        free(k.workers[i].dq.items);
+        pthread_mutex_destroy(&k.workers[i].dq.lock);
+    }
+    free(k.workers);
+    free(recs);
+    free(k.old);
+    free(oldbuf);
+    close(k.base_fd);
+    return 0;
+}
+
+/* ---- JOURNAL REPLAY AND UNDO ----
+ * undo <workspace> [batch-id]
+ * Commands that move files take the workspace's journal lock first. Under
+ * it, records other processes appended are scanned, and a batch a crash
+ * left without COMMIT is rolled forward: every intent whose file is still
+ * at its source is carried out, so the folder ends up as the batch meant.
+ * undo reverts a committed batch (by default the newest organize not yet
+ * undone) as a batch of its own, so an interrupted undo is finished the
+ * same way. A file is only moved back while its destination still holds
+ * the inode the batch moved there, and the category folders the batch
+ * created are removed once they are empty again. When the journal outgrows
+ * JRN_MAX_BYTES it is rewritten without its older half. */
+
+typedef struct {
+    uint64_t ino;
+    const char *from, *to;  /* point into the loaded records */
+} JrnItem;
+
+/* One batch's records, FIXUPs applied. */
+typedef struct {
+    char *buf;
+    const char *sub;
+    JrnItem *moves;
+    long nmoves;
+    const char **dirs;      /* MKDIR paths */
+    long ndirs;
+} JrnLoad;
+
+/* Makes a new file in the cache dir durable along with its contents. */
+static void jrn_sync_dir(const char *path) {
+    char dir[PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s", path);
+    char *slash = strrchr(dir, '/');
+    if (!slash) return;
+    *slash = '\0';
+    int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+}
+
+/* Finds the journal of workspace and its lock file. Returns -1 when there
+ * is no cache dir to keep one in. */
+static int jrn_open(Journal *j, const char *workspace) {
+    memset(j, 0, sizeof(*j));
+    j->workspace = workspace;
+    j->fd = j->lock_fd = -1;
+    struct stat st;
+    char lock[PATH_MAX + 8];
+    if (stat(workspace, &st) != 0 || !S_ISDIR(st.st_mode) || !cache_path("journal", &st, j->path, sizeof(j->path)))
+        return -1;
+    snprintf(lock, sizeof(lock), "%s.lock", j->path);
+    if ((j->lock_fd = open(lock, O_RDWR | O_CREAT | O_CLOEXEC, 0600)) < 0) return -1;
+    pthread_mutex_init(&j->lock, NULL);
+    pthread_cond_init(&j->synced_cv, NULL);
+    return 0;
+}
+
+static void jrn_close(Journal *j) {
+    if (j->fd >= 0) close(j->fd);
+    close(j->lock_fd);
+    free(j->batches);
+    pthread_mutex_destroy(&j->lock);
+    pthread_cond_destroy(&j->synced_cv);
+}
+
+/* Reads the records past j->scanned into the batch table. The first
+ * record that is cut short or fails its checksum ends the log, and it and
+ * everything after it are truncated away. */
+static int jrn_scan(Journal *j) {
+    struct stat st;
+    if (fstat(j->fd, &st) != 0) return -1;
+    uint64_t size = (uint64_t)st.st_size;
+    if (j->scanned == 0) {
+        char magic[8];
+        if (size < 8 || pread_full(j->fd, (unsigned char *)magic, 8, 0) != 8 || memcmp(magic, JRN_MAGIC, 8) != 0) {
+            /* New, or not a journal at all: start it over. */
+            if (ftruncate(j->fd, 0) != 0 || write_all(j->fd, JRN_MAGIC, 8) != 0 || fdatasync(j->fd) != 0) return -1;
+            jrn_sync_dir(j->path);
+            size = 8;
+        }
+        j->scanned = 8;
+    }
+    uint64_t len = size > j->scanned ? size - j->scanned : 0, off = 0;
+    char *buf = malloc(len ? len : 1);
+    if (!buf || (len && pread_full(j->fd, (unsigned char *)buf, len, j->scanned) != (ssize_t)len)) {
+        free(buf);
+        return -1;
+    }
+    while (off + sizeof(JrnHdr) <= len) {
+        const JrnHdr *h = (const JrnHdr *)(buf + off);
+        if (h->len < sizeof(JrnHdr) || h->len % 8 || h->len > len - off || crc32c(buf + off + 4, h->len - 4) != h->crc)
+            break;
+        size_t plen = h->len - sizeof(JrnHdr);
+        const char *p = (const char *)(h + 1);
+        if (h->type == JRN_BEGIN && plen >= sizeof(JrnBegin)) {
+            JrnBegin r;
+            memcpy(&r, p, sizeof(r));
+            JrnBatch *bt = jrn_new_batch(j);
+            if (!bt) break;
+            bt->id = h->batch;
+            bt->kind = r.kind;
+            bt->undoes = r.undoes;
+            bt->time = r.time;
+            bt->begin = j->scanned + off;
+        } else if (h->type == JRN_COMMIT && plen >= sizeof(JrnCommit) && j->nbatches &&
+                   j->batches[j->nbatches - 1].id == h->batch) {
+            JrnCommit c;
+            memcpy(&c, p, sizeof(c));
+            j->batches[j->nbatches - 1].committed = 1;
+            j->batches[j->nbatches - 1].moved = c.moved;
+        }
+        off += h->len;
+    }
+    free(buf);
+    if (off < len && ftruncate(j->fd, j->scanned + off) != 0) return -1;
+    j->scanned += off;
+    j->written = j->synced = j->scanned;
+    return 0;
+}
+
+/* The next NUL-terminated string of a record, or NULL past its end. */
+static const char *jrn_str(const char **p, const char *end) {
+    const char *s = *p, *nul = s < end ? memchr(s, '\0', end - s) : NULL;
+    if (!nul) return NULL;
+    *p = nul + 1;
+    return s;
+}
+
+static void jrn_load_free(JrnLoad *l) {
+    free(l->buf);
+    free(l->moves);
+    free(l->dirs);
+}
+
+/* Loads batch bt's records. A FIXUP replaces the destination of the MOVE
+ * with the same source. */
+static int jrn_load(Journal *j, const JrnBatch *bt, JrnLoad *l) {
+    memset(l, 0, sizeof(*l));
+    uint64_t len = j->written - bt->begin;
+    long cap = 0, dcap = 0;
+    StrSet at = { NULL, NULL, 0, 0 };   /* source -> index + 1, once needed */
+    int fixups = 0;
+    if (!(l->buf = malloc(len ? len : 1)) || pread_full(j->fd, (unsigned char *)l->buf, len, bt->begin) != (ssize_t)len)
+        return -1;
+    for (uint64_t off = 0; off + sizeof(JrnHdr) <= len;) {
+        const JrnHdr *h = (const JrnHdr *)(l->buf + off);
+        if (h->len < sizeof(JrnHdr)) break;
+        off += h->len;
+        if (h->batch != bt->id) continue;
+        const char *p = (const char *)(h + 1), *end = (const char *)h + h->len;
+        if (h->type == JRN_BEGIN) {
+            p += sizeof(JrnBegin);
+            l->sub = jrn_str(&p, end);
+        } else if (h->type == JRN_MKDIR) {
+            const char *dir = jrn_str(&p, end);
+            if (!dir) continue;
+            if (l->ndirs == dcap) {
+                dcap = dcap ? dcap * 2 : 16;
+                const char **grown = realloc(l->dirs, dcap * sizeof(char *));
+                if (!grown) break;
+                l->dirs = grown;
+            }
+            l->dirs[l->ndirs++] = dir;
+        } else if (h->type == JRN_MOVE || h->type == JRN_FIXUP) {
+            JrnItem it;
+            memcpy(&it.ino, p, sizeof(it.ino));
+            p += sizeof(JrnMove);
+            if (!(it.from = jrn_str(&p, end)) || !(it.to = jrn_str(&p, end))) continue;
+            if (h->type == JRN_FIXUP) {
+                if (!fixups++)
+                    for (long i = 0; i < l->nmoves; i++) strset_add(&at, l->moves[i].from, (int)i + 1);
+                int i = strset_get(&at, it.from);
+                if (i) l->moves[i - 1].to = it.to;
+                continue;
+            }
+            if (l->nmoves == cap) {
+                cap = cap ? cap * 2 : 256;
+                JrnItem *grown = realloc(l->moves, cap * sizeof(JrnItem));
+                if (!grown) break;
+                l->moves = grown;
+            }
+            if (fixups) strset_add(&at, it.from, (int)l->nmoves + 1);
+            l->moves[l->nmoves++] = it;
+        }
+    }
+    strset_clear(&at);
+    return l->sub ? 0 : -1;
+}
+
+/* A rename op on two paths below base. Paths too long to join are
+ * recorded as given, relative to base, and as a failure. */
+static void jrn_op(Run *run, const char *base, const char *desc, const char *from, const char *to, int ok,
+                   const char *err) {
+    char a[PATH_MAX], b[PATH_MAX];
+    int la = snprintf(a, sizeof(a), "%s/%s", base, from);
+    int lb = snprintf(b, sizeof(b), "%s/%s", base, to);
+    if (la < 0 || (size_t)la >= sizeof(a) || lb < 0 || (size_t)lb >= sizeof(b)) {
+        add_op(run, "rename", desc, "renameat2(2)", from, to, 0, strerror(ENAMETOOLONG));
+        return;
+    }
+    add_op(run, "rename", desc, "renameat2(2)", a, b, ok, err);
+}
+
+/* Where a move that found its name taken ended up: the entry with its
+ * inode in the destination folder. */
+static int jrn_find_moved(int dfd, const JrnItem *m, char *out, size_t sz) {
+    const char *slash = strrchr(m->to, '/');
+    char dir[PATH_MAX];
+    snprintf(dir, sizeof(dir), "%.*s", slash ? (int)(slash - m->to) : 1, slash ? m->to : ".");
+    int fd = openat(dfd, dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    char *buf = fd >= 0 ? malloc(DENTS_BUF) : NULL;
+    DirScan ds;
+    int found = 0;
+    if (buf && scan_open(&ds, fd, buf) == 0) {
+        const char *name;
+        unsigned char type;
+        while (!found && (name = scan_next(&ds, &type)) != NULL)
+            if (ds.ino == m->ino) found = (size_t)snprintf(out, sz, "%s/%s", dir, name) < sz;
+        scan_close(&ds);
+    }
+    free(buf);
+    if (fd >= 0) close(fd);
+    return found;
+}
+
+/* Rolls an interrupted batch forward and commits it. A batch whose folder
+ * is gone is committed as it stands. */
+static int jrn_recover(Run *run, Journal *j, JrnBatch *bt) {
+    JrnLoad l;
+    uint32_t id = bt->id;
+    if (jrn_load(j, bt, &l) != 0) {
+        jrn_load_free(&l);
+        return -1;
+    }
+    const char *base = arena_join(&run->arena, j->workspace, l.sub);
+    int dfd = base ? open(base, O_RDONLY | O_DIRECTORY | O_CLOEXEC) : -1;
+    JrnBuf b = { NULL, 0, 0 };
+    uint64_t moved = 0;
+    for (long i = 0; dfd >= 0 && i < l.nmoves; i++) {
+        const JrnItem *m = &l.moves[i];
+        struct stat st;
+        char to[PATH_MAX];
+        if (fstatat(dfd, m->from, &st, AT_SYMLINK_NOFOLLOW) == 0 && (uint64_t)st.st_ino == m->ino) {
+            op_begin(run);
+            int ok = mkdir_parents(dfd, m->to) == 0 && move_unique(dfd, m->from, dfd, m->to, to, sizeof(to)) == 0;
+            jrn_op(run, base, "Finish interrupted move", m->from, ok ? to : m->to, ok, ok ? NULL : strerror(errno));
+            if (!ok) continue;
+            moved++;
+            if (strcmp(to, m->to) != 0) jrn_move(&b, JRN_FIXUP, id, m->ino, m->from, to);
+        } else if (fstatat(dfd, m->to, &st, AT_SYMLINK_NOFOLLOW) == 0 && (uint64_t)st.st_ino == m->ino) {
+            moved++;
+        } else if (jrn_find_moved(dfd, m, to, sizeof(to))) {
+            moved++;
+            jrn_move(&b, JRN_FIXUP, id, m->ino, m->from, to);
+        }
+    }
+    if (dfd >= 0) close(dfd);
+    jrn_load_free(&l);
+    JrnCommit c = { moved };
+    jrn_put(&b, JRN_COMMIT, id, &c, sizeof(c), NULL, NULL);
+    int rc = jrn_sync(j, jrn_write(j, &b));
+    free(b.buf);
+    if (rc != 0) return -1;
+    bt->committed = 1;
+    bt->moved = moved;
+    j->scanned = j->written;
+    j->recovered++;
+    if (moved) vx_follow(j, bt);
+    return 0;
+}
+
+/* Takes the workspace's journal lock, catches up with what other
+ * processes wrote, and finishes a batch one of them left interrupted. */
+static int jrn_lock(Run *run, Journal *j) {
+    if (flock(j->lock_fd, LOCK_EX) != 0) return -1;
+    /* A compaction by someone else replaced the file. */
+    struct stat a, b;
+    if (j->fd >= 0 && (fstat(j->fd, &a) != 0 || stat(j->path, &b) != 0 || a.st_ino != b.st_ino)) {
+        close(j->fd);
+        j->fd = -1;
+    }
+    if (j->fd < 0) {
+        j->fd = open(j->path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+        j->scanned = 0;
+        j->nbatches = 0;
+    }
+    j->err = 0;
+    j->batch = 0;
+    j->syncs = j->recovered = 0;
+    if (j->fd < 0 || jrn_scan(j) != 0 ||
+        (j->nbatches && !j->batches[j->nbatches - 1].committed &&
+         jrn_recover(run, j, &j->batches[j->nbatches - 1]) != 0)) {
+        int err = errno;
+        flock(j->lock_fd, LOCK_UN);
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+/* Rewrites the journal without the batches that began before its newest
+ * JRN_MAX_BYTES / 2 (keeping at least the last batch). */
+static void jrn_compact(Journal *j) {
+    uint64_t keep = j->nbatches ? j->batches[j->nbatches - 1].begin : j->written;
+    for (long i = j->nbatches - 1; i >= 0 && j->batches[i].begin + JRN_MAX_BYTES / 2 >= j->written; i--)
+        keep = j->batches[i].begin;
+    if (keep <= 8) return;
+    char tmp[PATH_MAX + 16];
+    snprintf(tmp, sizeof(tmp), "%s.%ld", j->path, (long)getpid());
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    unsigned char *buf = fd >= 0 ? malloc(1 << 20) : NULL;
+    int ok = buf && write_all(fd, JRN_MAGIC, 8) == 0;
+    for (uint64_t off = keep; ok && off < j->written;) {
+        size_t n = j->written - off < (1u << 20) ? (size_t)(j->written - off) : 1u << 20;
+        ok = pread_full(j->fd, buf, n, off) == (ssize_t)n && write_all(fd, (const char *)buf, n) == 0;
+        off += n;
+    }
+    free(buf);
+    if (fd >= 0 && (fdatasync(fd) != 0 || close(fd) != 0)) ok = 0;
+    if (!ok || rename(tmp, j->path) != 0) {
+        unlink(tmp);
+        return;
+    }
+    jrn_sync_dir(j->path);
+    /* Batch offsets all moved; the next jrn_lock reads the new file. */
+    close(j->fd);
+    j->fd = -1;
+}
+
+static void jrn_unlock(Journal *j) {
+    if (j->fd >= 0 && j->written > JRN_MAX_BYTES) jrn_compact(j);
+    flock(j->lock_fd, LOCK_UN);
+}
+
+static void jrn_error(Run *run, const char *err) {
+    out_puts(run, run->ndjson ? "{\"type\":\"result\"" : "{\"operations\":[]");
+    out_puts(run, ",\"result\":null,\"error\":\"");
+    out_json(run, err);
+    out_puts(run, "\"");
+    finish_json(run);
+}
+
+static int jrn_undone(const Journal *j, uint32_t id) {
+    for (long i = 0; i < j->nbatches; i++)
+        if (j->batches[i].kind == JRN_UNDO && j->batches[i].undoes == id && j->batches[i].committed) return 1;
+    return 0;
+}
+
+/* Reverts batch id (0: the newest organize batch that moved something and
+ * is not undone yet), newest move first. */
+static int undo_batch(Run *run, Journal *j, long id) {
+    const JrnBatch *bt = NULL;
+    for (long i = j->nbatches - 1; i >= 0 && !bt; i--) {
+        const JrnBatch *c = &j->batches[i];
+        if (id ? c->id == (uint32_t)id : c->kind == JRN_ORGANIZE && c->moved && !jrn_undone(j, c->id)) bt = c;
+    }
+    if (!bt) {
+        jrn_error(run, id ? "no such batch in the journal" : "nothing to undo");
+        return -1;
+    }
+    if (jrn_undone(j, bt->id)) {
+        jrn_error(run, "batch already undone");
+        return -1;
+    }
+    uint32_t undid = bt->id;
+    JrnLoad l;
+    const char *base = NULL;
+    int dfd = -1;
+    if (jrn_load(j, bt, &l) == 0 && (base = arena_join(&run->arena, j->workspace, l.sub)))
+        dfd = open(base, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dfd < 0 || jrn_begin(j, JRN_UNDO, undid, l.sub) != 0) {
+        jrn_error(run, strerror(errno));
+        if (dfd >= 0) close(dfd);
+        jrn_load_free(&l);
+        return -1;
+    }
+
+    JrnBuf b = { NULL, 0, 0 };
+    long restored = 0, failed = 0, removed = 0;
+    for (long hi = l.nmoves; hi > 0; hi -= JRN_CHUNK) {
+        long lo = hi > JRN_CHUNK ? hi - JRN_CHUNK : 0;
+        for (long i = hi - 1; i >= lo; i--) jrn_move(&b, JRN_MOVE, j->batch, l.moves[i].ino, l.moves[i].to, l.moves[i].from);
+        j->moves += hi - lo;
+        op_begin(run);
+        int ok = jrn_sync(j, jrn_write(j, &b)) == 0;
+        add_op_ref(run, "journal", "Commit move intents", "fdatasync(2)", j->path, NULL, NULL, NULL,
+                   ok, ok ? NULL : strerror(errno));
+        if (!ok) {
+            failed += hi;
+            break;
+        }
+        for (long i = hi - 1; i >= lo; i--) {
+            const JrnItem *m = &l.moves[i];
+            struct stat st;
+            char to[PATH_MAX];
+            op_begin(run);
+            int gone = fstatat(dfd, m->to, &st, AT_SYMLINK_NOFOLLOW) != 0;
+            if (gone || (uint64_t)st.st_ino != m->ino) {
+                jrn_op(run, base, "Move file back", m->to, m->from, 0, gone ? strerror(errno) : "replaced since the batch");
+                failed++;
+                continue;
+            }
+            ok = mkdir_parents(dfd, m->from) == 0 && move_unique(dfd, m->to, dfd, m->from, to, sizeof(to)) == 0;
+            jrn_op(run, base, "Move file back", m->to, ok ? to : m->from, ok, ok ? NULL : strerror(errno));
+            if (!ok) {
+                failed++;
+                continue;
+            }
+            restored++;
+            if (strcmp(to, m->from) != 0) jrn_move(&b, JRN_FIXUP, j->batch, m->ino, m->to, to);
+        }
+    }
+
+    /* Newest first, so nested --rules folders go before their parents. */
+    for (long i = l.ndirs - 1; i >= 0; i--) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/%s", base, l.dirs[i]);
+        op_begin(run);
+        if (unlinkat(dfd, l.dirs[i], AT_REMOVEDIR) == 0) {
+            removed++;
+            add_op(run, "rmdir", "Remove category folder", "unlinkat(2)", path, NULL, 1, NULL);
+        } else if (errno != ENOTEMPTY && errno != EEXIST && errno != ENOENT) {
+            add_op(run, "rmdir", "Remove category folder", "unlinkat(2)", path, NULL, 0, strerror(errno));
+        } else {
+            run->op_t0 = 0;
+        }
+    }
+    jrn_commit(j, &b, restored);
+    free(b.buf);
+    close(dfd);
+    jrn_load_free(&l);
+
+    print_ops(run);
+    out_printf(run, ",\"result\":{\"undid\":%u,\"restored\":%ld,\"failed\":%ld,\"foldersRemoved\":%ld}", undid,
+               restored, failed, removed);
+    print_journal_stats(run, j);
+    finish_json(run);
+    return 0;
+}
+
+/* ---- WATCH ----
+ * watch <workspace> [subpath] [assets_path] [--rules <file>] [--sniff]
+ *       [--debounce MS]
+ * Keeps a folder organized. After one ordinary organize pass it sleeps in
+ * poll() on inotify until files finish being written (IN_CLOSE_WRITE) or
+ * are moved in (IN_MOVED_TO). Events are gathered until the folder has
+ * been quiet for the debounce window, or for at most ten windows so a
+ * steady stream still gets moved, and then only the names that arrived are
+ * classified and moved, through the same worker, category handles and op
+ * log as organize. Each batch prints organize's payload plus a "watch"
+ * object. When the kernel's event queue overflows, that batch is a full
+ * organize pass of the folder instead. */
+#define WATCH_DEBOUNCE_MS 100
+
+typedef struct {
+    StrSet seen;            /* names already in this batch */
+    char **names;           /* in order of arrival */
+    long n, cap;
+    long events;
+    int overflow;           /* the event queue overflowed */
+    int gone;               /* the folder itself was deleted or unmounted */
+} WatchBatch;
+
+static void watch_batch_add(WatchBatch *b, const char *name) {
+    if (strset_get(&b->seen, name)) return;
+    strset_add(&b->seen, name, 1);
+    if (b->n == b->cap) {
+        long cap = b->cap ? b->cap * 2 : 256;
+        char **grown = realloc(b->names, cap * sizeof(char *));
+        if (!grown) return;
+        b->names = grown;
+        b->cap = cap;
+    }
+    if ((b->names[b->n] = strdup(name))) b->n++;
+}
+
+static void watch_batch_clear(WatchBatch *b) {
+    for (long i = 0; i < b->n; i++) free(b->names[i]);
+    b->n = b->events = 0;
+    b->overflow = 0;
+    strset_clear(&b->seen);
+}
+
+/* The watcher holds the folder open, so removing it raises no event on the
+ * folder itself until that handle closes; its parent is watched instead,
+ * for the folder (leaf) being deleted or renamed away. */
+static void watch_read(int fd, int parent_wd, const char *leaf, WatchBatch *b) {
+    char buf[64 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t len;
+    while ((len = read(fd, buf, sizeof(buf))) > 0) {
+        for (char *p = buf; p < buf + len;) {
+            struct inotify_event *ev = (struct inotify_event *)p;
+            p += sizeof(*ev) + ev->len;
+            b->events++;
+            if (ev->mask & IN_Q_OVERFLOW) b->overflow = 1;
+            else if (ev->wd == parent_wd) { if (ev->len && strcmp(ev->name, leaf) == 0) b->gone = 1; }
+            else if (ev->mask & (IN_DELETE_SELF | IN_IGNORED | IN_UNMOUNT)) b->gone = 1;
+            else if (ev->len && !(ev->mask & IN_ISDIR)) watch_batch_add(b, ev->name);
+        }
+    }
+}
+
+/* A full pass over the folder, as organize makes it. organize_one opens a
+ * handle of its own on the base and leaves it in base_fd. */
+static void watch_full_pass(Worker *w, int dfd) {
+    Scheduler *s = w->sched;
+    organize_one(w, "");
+    organize_flush(w);
+    if (s->base_fd >= 0 && s->base_fd != dfd) close(s->base_fd);
+    s->base_fd = dfd;
+}
+
+/* Moves the batch's files. A name that is gone by now (renamed again,
+ * deleted) or is a directory is skipped without an op. */
+static void watch_organize(Worker *w, const WatchBatch *b) {
+    Scheduler *s = w->sched;
+    Run *run = w->run;
+    const Classifier *cl = s->cls;
+    if ((s->sniff || s->jrn) && !w->sniff_items &&
+        !(w->sniff_items = malloc(organize_batch_cap(s) * sizeof(SniffItem)))) return;
+    DirCtx d;
+    d.dfd = s->base_fd;
+    d.dir_path = s->base_path;
+    d.rel = NULL;
+    d.cat_path = arena_alloc(&run->arena, cl->ncats * sizeof(char *));
+    d.cat_fd = arena_alloc(&run->arena, cl->ncats * sizeof(int));
+    if (!d.cat_path || !d.cat_fd) return;
+    for (int c = 0; c < cl->ncats; c++) {
+        d.cat_path[c] = NULL;
+        d.cat_fd[c] = -1;
+    }
+    for (long i = 0; i < b->n; i++) {
+        const char *name = b->names[i];
+        struct stat st;
+        if (fstatat(d.dfd, name, &st, AT_SYMLINK_NOFOLLOW) != 0 || S_ISDIR(st.st_mode)) continue;
+        uint64_t ino = st.st_ino;
+        if (S_ISLNK(st.st_mode) && fstatat(d.dfd, name, &st, 0) == 0 && S_ISDIR(st.st_mode)) continue;
+        organize_queue(w, &d, name, ino, classify(cl, name));
+    }
+    if (w->nsniff) organize_batch(w, &d);
+    io_drain(&w->io);
+    for (int c = 0; c < cl->ncats; c++)
+        if (d.cat_fd[c] >= 0) close(d.cat_fd[c]);
+}
+
+/* Organizes one batch (seq 0 is the initial full pass) on a Run of its
+ * own, prints it if anything was done, and frees it, so a watcher's memory
+ * does not grow with the number of files it has moved. */
+static void watch_run_batch(Run *run, Worker *w, const WatchBatch *b, long seq, int dfd, Journal *jrn,
+                            const char *sub) {
+    Scheduler *s = w->sched;
+    double t0 = now_us();
+    Run *batch = run_child(run, (unsigned)seq);
+    if (!batch) return;
+    if (!run->ndjson) batch->out.sink = run->out.sink;
+    batch->profile = run->profile;
+    long streamed = run->line_sink->next_op_id;
+    w->run = batch;
+    memset(&w->sniff_stats, 0, sizeof(w->sniff_stats));
+    /* Each batch is a journal batch of its own; the lock is not held
+     * while the watcher sleeps. */
+    s->jrn = jrn && jrn_lock(batch, jrn) == 0 ? jrn : NULL;
+    if (s->jrn && jrn_begin(jrn, JRN_ORGANIZE, 0, sub) != 0) {
+        jrn_unlock(jrn);
+        s->jrn = NULL;
+    }
+    if (seq == 0 || b->overflow) watch_full_pass(w, dfd);
+    else watch_organize(w, b);
+    w->run = run;
+    organize_commit(s);
+
+    if (batch->nops || run->line_sink->next_op_id != streamed) {
+        print_organize_result(batch, s);
+        if (s->sniff) print_sniff_stats(batch, &w->sniff_stats, s->sniff->nthreads);
+        if (jrn) print_journal_stats(batch, jrn);
+        out_printf(batch, ",\"watch\":{\"batch\":%ld,\"events\":%ld,\"files\":%ld,\"overflow\":%s,\"ms\":%.1f}",
+                   seq, b->events, b->n, b->overflow ? "true" : "false", (now_us() - t0) / 1000.0);
+        finish_json(batch);
+    }
+    if (s->jrn) jrn_unlock(jrn);
+    s->jrn = NULL;
+    for (int c = 0; c < s->cls->ncats; c++) {
+        namelist_free(&w->cats[c]);
+        w->counts[c] = 0;
+    }
+    free(batch->out.buf);
+    arena_free(&batch->arena);
+    free(batch);
+}
+
+static void watch_error(Run *run, int err) {
+    out_puts(run, run->ndjson ? "{\"type\":\"result\"" : "{\"operations\":[]");
+    out_printf(run, ",\"result\":null,\"error\":\"%s\"", strerror(err));
+    finish_json(run);
+}
+
+/* Runs until the folder goes away (exit status 1) or the process is
+ * killed. Not available in serve mode, where it would hold a worker. jrn
+ * and sub are as for organize_directory, but the journal is unlocked. */
+static int watch_directory(Run *run, const char *base_path, const char *assets_path,
+                           const Classifier *cls, int sniff_jobs, int debounce_ms, Journal *jrn, const char *sub) {
+    if (run->req_id) {
+        watch_error(run, EOPNOTSUPP);
+        return -1;
+    }
+    int dfd = open(base_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    int fd = dfd >= 0 ? inotify_init1(IN_NONBLOCK | IN_CLOEXEC) : -1;
+    char proc[64];
+    snprintf(proc, sizeof(proc), "/proc/self/fd/%d", dfd);
+    /* Watch before the first pass so no file slips in between. */
+    if (fd < 0 || inotify_add_watch(fd, proc, IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE_SELF |
+                                    IN_ONLYDIR | IN_EXCL_UNLINK) < 0) {
+        int err = errno;
+        if (fd >= 0) close(fd);
+        if (dfd >= 0) close(dfd);
+        watch_error(run, err);
+        return -1;
+    }
+    char leaf[NAME_MAX + 1];
+    size_t len = strlen(base_path);
+    while (len > 1 && base_path[len - 1] == '/') len--;
+    const char *slash = memrchr(base_path, '/', len), *start = slash ? slash + 1 : base_path;
+    snprintf(leaf, sizeof(leaf), "%.*s", (int)(base_path + len - start), start);
+    int parent_fd = openat(dfd, "..", O_RDONLY | O_DIRECTORY | O_CLOEXEC), parent_wd = -1;
+    if (parent_fd >= 0) {
+        snprintf(proc, sizeof(proc), "/proc/self/fd/%d", parent_fd);
+        parent_wd = inotify_add_watch(fd, proc, IN_DELETE | IN_MOVED_FROM | IN_ONLYDIR);
+        close(parent_fd);
+    }
+
+    Scheduler s = { base_path, assets_path, cls, 0, dfd, NULL, 1, 0, 0, NULL, NULL };
+    Worker w;
+    memset(&w, 0, sizeof(w));
+    w.sched = &s;
+    w.run = run;
+    w.cats = calloc(cls->ncats, sizeof(NameList));
+    w.counts = calloc(cls->ncats, sizeof(long));
+    /* Sized for a journal chunk, since the journal may come and go. */
+    if (jrn || sniff_jobs >= 0) w.sniff_items = malloc(JRN_CHUNK * sizeof(SniffItem));
+    s.workers = &w;
+    SniffPool pool;
+    if (sniff_jobs >= 0) {
+        sniff_pool_start(&pool, sniff_jobs);
+        s.sniff = &pool;
+    }
+    WatchBatch b;
+    memset(&b, 0, sizeof(b));
+    int rc = w.cats && w.counts && (w.sniff_items || !(jrn || sniff_jobs >= 0)) && worker_io_start(&w) == 0 ? 0 : -1;
+    if (rc == 0) {
+        watch_run_batch(run, &w, &b, 0, dfd, jrn, sub);
+        if (s.base_errno) {
+            watch_error(run, s.base_errno);
+            rc = -1;
+        }
+    }
+    for (long seq = 1; rc == 0;) {
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        if (poll(&pfd, 1, -1) < 0) {
+            if (errno == EINTR) continue;
+            rc = -1;
+            break;
+        }
+        watch_read(fd, parent_wd, leaf, &b);
+        double first = now_us();
+        while (!b.gone && now_us() - first < 10 * debounce_ms * 1000.0 && poll(&pfd, 1, debounce_ms) > 0)
+            watch_read(fd, parent_wd, leaf, &b);
+        if (b.n || b.overflow) watch_run_batch(run, &w, &b, seq++, dfd, jrn, sub);
+        watch_batch_clear(&b);
+        if (b.gone) {
+            watch_error(run, ENOENT);
+            rc = -1;
+        }
+    }
+
+    if (w.slots) worker_io_stop(&w);
+    if (s.sniff) sniff_pool_stop(&pool);
+    watch_batch_clear(&b);
+    free(b.names);
+    free(w.cats);
+    free(w.counts);
+    free(w.dents);
+    free(w.sniff_items);
+    free(w.jrn.buf);
+    close(fd);
+    close(dfd);
+    return rc;
+}
+
+/* ---- METADATA STORE ----
+ * meta <workspace> [--stdin] <op> [<op> ...] keeps the file manager's
+ * per-path metadata (tags, colours, comments, recents, share links) for a
+ * workspace. Any number of ops per call, applied in order:
+ *   get <path>                 the path's fields
+ *   list <path>                every path at or below it with its fields
+ *   set <path> <field> <json>  set one field to a JSON value
+ *   del <path> <field>         drop one field
+ *   rm <path>                  drop the path and everything below it
+ *   mv <from> <to>             move the path's subtree to a new path
+ * With --stdin more ops follow on standard input, one per line, words
+ * separated by tabs.
+ *
+ * Paths live in a tree with one node per path component and a hash table
+ * of children per node, so rm and mv unlink or relink a single node
+ * however much lies below it. Every node counts the fields in its subtree.
+ * The tree is rebuilt from an append-only log in the cache directory:
+ * journal-framed, CRC-32C-checked SET, DEL, RMTREE and MVTREE records,
+ * each call's records closed by a COMMIT and made durable with one
+ * fdatasync. Replay applies whole groups only, and a group torn by a crash
+ * is cut off. A lock file serializes processes, and each call first
+ * replays whatever others appended since it last looked; in serve mode
+ * the trees stay in memory between requests. Once the log holds more dead
+ * records than live fields, and at least META_COMPACT_MIN bytes, it is
+ * rewritten as one SET per live field. The snapshot is taken under the
+ * lock and written out without it; records appended meanwhile are copied
+ * over before the rename. Serve mode compacts on a background thread, the
+ * one-shot CLI after its reply has gone out. */
+#define META_MAGIC "OMETA001"
+#define META_COMPACT_MIN (1u << 20)
+
+enum { META_SET = 1, META_DEL, META_RMTREE, META_MVTREE, META_COMMIT };
+enum { META_GET, META_LIST, META_OP_SET, META_OP_DEL, META_RM, META_MV };
+
+static const struct {
+    const char *name;
+    int nargs;
+} meta_ops[] = {
+    { "get", 1 }, { "list", 1 }, { "set", 3 }, { "del", 2 }, { "rm", 1 }, { "mv", 2 },
+};
+
+typedef struct MetaField {
+    struct MetaField *next;
+    char *value;            /* JSON text */
+    char key[];
+} MetaField;
+
+typedef struct MetaNode {
+    struct MetaNode *parent;
+    struct MetaNode **kids; /* open addressing on the name's hash */
+    uint32_t nkids, kcap;
+    MetaField *fields;
+    long total;             /* fields here and below */
+    char *name;
+} MetaNode;
+
+typedef struct MetaStore {
+    char path[PATH_MAX];
+    int fd, lock_fd;        /* fd is -1 until the first replay */
+    uint64_t size;          /* log bytes applied to the tree */
+    long records;           /* non-COMMIT records in the log */
+    MetaNode *root;
+    int compacting;
+    pthread_mutex_t lock;
+    struct MetaStore *next;
+} MetaStore;
+
+typedef struct {
+    int kind;
+    char *arg[3];
+} MetaOp;
+
+static MetaStore *meta_cache;
+static pthread_mutex_t meta_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint32_t meta_hash(const char *s, size_t n) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    while (n--) h = (h ^ (unsigned char)*s++) * 0x100000001b3ULL;
+    return (uint32_t)(h ^ (h >> 32));
+}
+
+/* Where child name sits in n's table, or the empty slot it would take. */
+static uint32_t meta_slot(const MetaNode *n, const char *name, size_t len) {
+    uint32_t mask = n->kcap - 1, i = meta_hash(name, len) & mask;
+    for (; n->kids[i]; i = (i + 1) & mask)
+        if (strncmp(n->kids[i]->name, name, len) == 0 && n->kids[i]->name[len] == '\0') break;
+    return i;
+}
+
+static MetaNode *meta_child(const MetaNode *n, const char *name, size_t len) {
+    return n->kcap ? n->kids[meta_slot(n, name, len)] : NULL;
+}
+
+static MetaNode *meta_node(const char *name, size_t len) {
+    MetaNode *n = calloc(1, sizeof(*n));
+    if (n && !(n->name = strndup(name, len))) {
+        free(n);
+        return NULL;
+    }
+    return n;
+}
+
+static int meta_link(MetaNode *n, MetaNode *kid) {
+    if (2 * (n->nkids + 1) > n->kcap) {
+        uint32_t cap = n->kcap ? n->kcap * 2 : 4, ocap = n->kcap;
+        MetaNode **old = n->kids, **grown = calloc(cap, sizeof(MetaNode *));
+        if (!grown) return -1;
+        n->kids = grown;
+        n->kcap = cap;
+        for (uint32_t i = 0; i < ocap; i++)
+            if (old[i]) n->kids[meta_slot(n, old[i]->name, strlen(old[i]->name))] = old[i];
+        free(old);
+    }
+    n->kids[meta_slot(n, kid->name, strlen(kid->name))] = kid;
+    n->nkids++;
+    kid->parent = n;
+    return 0;
+}
+
+/* Takes kid out of its parent's table. Later entries of the probe run
+ * that hash at or before the hole are shifted back into it, so lookups
+ * never stop early. */
+static void meta_unlink(MetaNode *kid) {
+    MetaNode *n = kid->parent;
+    uint32_t mask = n->kcap - 1, i = meta_slot(n, kid->name, strlen(kid->name));
+    n->kids[i] = NULL;
+    for (uint32_t j = (i + 1) & mask; n->kids[j]; j = (j + 1) & mask) {
+        uint32_t home = meta_hash(n->kids[j]->name, strlen(n->kids[j]->name)) & mask;
+        int stays = i <= j ? i < home && home <= j : i < home || home <= j;
+        if (stays) continue;
+        n->kids[i] = n->kids[j];
+        n->kids[j] = NULL;
+        i = j;
+    }
+    n->nkids--;
+    kid->parent = NULL;
+}
+
+static void meta_free(MetaNode *n) {
+    for (uint32_t i = 0; i < n->kcap; i++)
+        if (n->kids[i]) meta_free(n->kids[i]);
+    for (MetaField *f = n->fields, *next; f; f = next) {
+        next = f->next;
+        free(f->value);
+        free(f);
+    }
+    free(n->kids);
+    free(n->name);
+    free(n);
+}
+
+static void meta_count(MetaNode *n, long delta) {
+    for (; n; n = n->parent) n->total += delta;
+}
+
+/* Frees n and every parent left with neither fields nor children. */
+static void meta_prune(MetaStore *s, MetaNode *n) {
+    while (n && n != s->root && !n->fields && !n->nkids) {
+        MetaNode *parent = n->parent;
+        meta_unlink(n);
+        meta_free(n);
+        n = parent;
+    }
+}
+
+/* Writes path as "a/b/c": no empty or "." components, no leading or
+ * trailing slash. Returns -1 for ".." or an overlong path. */
+static int meta_norm(const char *path, char *out, size_t sz) {
+    size_t len = 0;
+    for (const char *p = path; *p;) {
+        size_t n = strcspn(p, "/");
+        if (n == 2 && p[0] == '.' && p[1] == '.') return -1;
+        if (n && !(n == 1 && *p == '.')) {
+            if (len + n + 2 > sz) return -1;
+            if (len) out[len++] = '/';
+            memcpy(out + len, p, n);
+            len += n;
+        }
+        p += n;
+        if (*p) p++;
+    }
+    out[len] = '\0';
+    return 0;
+}
+
+/* The node of a normalized path, made along with its parents when create
+ * is set. */
+static MetaNode *meta_find(MetaStore *s, const char *path, int create) {
+    MetaNode *n = s->root;
+    for (const char *p = path; n && *p;) {
+        size_t len = strcspn(p, "/");
+        MetaNode *kid = meta_child(n, p, len);
+        if (!kid && create && (kid = meta_node(p, len)) && meta_link(n, kid) != 0) {
+            meta_free(kid);
+            kid = NULL;
+        }
+        if (!kid) meta_prune(s, n);
+        n = kid;
+        p += len;
+        if (*p) p++;
+    }
+    return n;
+}
+
+static int meta_set(MetaStore *s, const char *path, const char *key, const char *value) {
+    MetaNode *n = meta_find(s, path, 1);
+    if (!n) return -1;
+    MetaField **at = &n->fields;
+    while (*at && strcmp((*at)->key, key) != 0) at = &(*at)->next;
+    char *v = strdup(value);
+    if (v && *at) {
+        free((*at)->value);
+        (*at)->value = v;
+        return 0;
+    }
+    size_t kl = strlen(key) + 1;
+    MetaField *f = v ? malloc(sizeof(*f) + kl) : NULL;
+    if (!f) {
+        free(v);
+        meta_prune(s, n);
+        return -1;
+    }
+    memcpy(f->key, key, kl);
+    f->value = v;
+    f->next = NULL;
+    *at = f;
+    meta_count(n, 1);
+    return 0;
+}
+
+static int meta_del(MetaStore *s, const char *path, const char *key) {
+    MetaNode *n = meta_find(s, path, 0);
+    MetaField **at = n ? &n->fields : NULL;
+    while (at && *at && strcmp((*at)->key, key) != 0) at = &(*at)->next;
+    if (!at || !*at) return 0;
+    MetaField *f = *at;
+    *at = f->next;
+    free(f->value);
+    free(f);
+    meta_count(n, -1);
+    meta_prune(s, n);
+    return 1;
+}
+
+/* Drops path's subtree; returns the fields it held. */
+static long meta_rmtree(MetaStore *s, const char *path) {
+    MetaNode *n = meta_find(s, path, 0);
+    if (!n) return 0;
+    long k = n->total;
+    if (n == s->root) {
+        MetaNode *fresh = meta_node("", 0);
+        if (!fresh) return -1;
+        meta_free(n);
+        s->root = fresh;
+        return k;
+    }
+    MetaNode *parent = n->parent;
+    meta_count(parent, -k);
+    meta_unlink(n);
+    meta_free(n);
+    meta_prune(s, parent);
+    return k;
+}
+
+/* Moves from's subtree to to, replacing whatever was there, as rename(2)
+ * would. Returns the fields moved; a path cannot move into or over one of
+ * its own ancestors or descendants. */
+static long meta_mvtree(MetaStore *s, const char *from, const char *to) {
+    size_t fl = strlen(from), tl = strlen(to);
+    if (strcmp(from, to) == 0) return 0;
+    if (!fl || !tl || (tl > fl && strncmp(to, from, fl) == 0 && to[fl] == '/') ||
+        (fl > tl && strncmp(from, to, tl) == 0 && from[tl] == '/')) {
+        errno = EINVAL;
+        return -1;
+    }
+    MetaNode *n = meta_find(s, from, 0);
+    if (!n) return 0;
+    const char *slash = strrchr(to, '/');
+    char *name = strdup(slash ? slash + 1 : to), dir[PATH_MAX];
+    snprintf(dir, sizeof(dir), "%.*s", slash ? (int)(slash - to) : 0, to);
+    MetaNode *dst = NULL;
+    if (!name || meta_rmtree(s, to) < 0 || !(dst = meta_find(s, dir, 1))) {
+        free(name);
+        return -1;
+    }
+    long k = n->total;
+    MetaNode *old = n->parent;
+    meta_count(old, -k);
+    meta_unlink(n);
+    free(n->name);
+    n->name = name;
+    if (meta_link(dst, n) != 0) {
+        meta_free(n);
+        meta_prune(s, dst);
+        meta_prune(s, old);
+        return -1;
+    }
+    meta_count(dst, k);
+    meta_prune(s, old);
+    return k;
+}
+
+/* One log record: up to three NUL-terminated strings. */
+static int meta_put(JrnBuf *b, uint32_t type, const char *s1, const char *s2, const char *s3) {
+    return jrn_put(b, type, 0, s1, s1 ? strlen(s1) + 1 : 0, s2, s3);
+}
+
+static void meta_apply(MetaStore *s, const JrnHdr *h) {
+    const char *p = (const char *)(h + 1), *end = (const char *)h + h->len;
+    const char *a = jrn_str(&p, end), *b = a ? jrn_str(&p, end) : NULL, *c = b ? jrn_str(&p, end) : NULL;
+    if (!a) return;
+    if (h->type == META_SET && c) meta_set(s, a, b, c);
+    else if (h->type == META_DEL && b) meta_del(s, a, b);
+    else if (h->type == META_RMTREE) meta_rmtree(s, a);
+    else if (h->type == META_MVTREE && b) meta_mvtree(s, a, b);
+}
+
+static void meta_reset(MetaStore *s) {
+    if (s->root) meta_free(s->root);
+    s->root = meta_node("", 0);
+    s->size = 0;
+    s->records = 0;
+}
+
+/* Applies what was appended past s->size, by this process or another, and
+ * cuts off a group torn at the end. Called under the lock file. A log that
+ * was replaced (compacted) since is read again from the start. */
+static int meta_replay(MetaStore *s, long *replayed) {
+    struct stat a, b;
+    if (s->fd >= 0 && (fstat(s->fd, &a) != 0 || stat(s->path, &b) != 0 || a.st_ino != b.st_ino)) {
+        close(s->fd);
+        s->fd = -1;
+    }
+    if (s->fd < 0) {
+        if ((s->fd = open(s->path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600)) < 0) return -1;
+        meta_reset(s);
+    }
+    if (!s->root || fstat(s->fd, &a) != 0) return -1;
+    uint64_t size = (uint64_t)a.st_size;
+    if (size < s->size) meta_reset(s);
+    if (s->size == 0) {
+        char magic[8];
+        if (size < 8 || pread_full(s->fd, (unsigned char *)magic, 8, 0) != 8 || memcmp(magic, META_MAGIC, 8) != 0) {
+            if (ftruncate(s->fd, 0) != 0 || write_all(s->fd, META_MAGIC, 8) != 0 || fdatasync(s->fd) != 0) return -1;
+            jrn_sync_dir(s->path);
+            size = 8;
+        }
+        s->size = 8;
+    }
+    uint64_t len = size - s->size, off = 0, done = 0;
+    char *buf = malloc(len ? len : 1);
+    if (!buf || (len && pread_full(s->fd, (unsigned char *)buf, len, s->size) != (ssize_t)len)) {
+        free(buf);
+        return -1;
+    }
+    while (off + sizeof(JrnHdr) <= len) {
+        const JrnHdr *h = (const JrnHdr *)(buf + off);
+        if (h->len < sizeof(JrnHdr) || h->len % 8 || h->len > len - off || crc32c(buf + off + 4, h->len - 4) != h->crc)
+            break;
+        off += h->len;
+        if (h->type != META_COMMIT) continue;
+        for (uint64_t at = done; at < off - h->len; at += ((const JrnHdr *)(buf + at))->len) {
+            meta_apply(s, (const JrnHdr *)(buf + at));
+            s->records++;
+            (*replayed)++;
+        }
+        done = off;
+    }
+    free(buf);
+    if (done < len && ftruncate(s->fd, s->size + done) != 0) return -1;
+    s->size += done;
+    return 0;
+}
+
+/* Calls fn for every node at or below n that has fields; path holds n's
+ * path (len bytes) and is extended in place. */
+static void meta_walk(const MetaNode *n, char *path, size_t len,
+                      void (*fn)(void *ctx, const char *path, const MetaNode *n), void *ctx) {
+    if (n->fields) fn(ctx, path, n);
+    for (uint32_t i = 0; i < n->kcap; i++) {
+        const MetaNode *kid = n->kids[i];
+        if (!kid || !kid->total) continue;
+        size_t nl = strlen(kid->name);
+        if (len + nl + 2 > PATH_MAX) continue;
+        if (len) path[len] = '/';
+        memcpy(path + len + (len ? 1 : 0), kid->name, nl + 1);
+        meta_walk(kid, path, len + (len ? 1 : 0) + nl, fn, ctx);
+        path[len] = '\0';
+    }
+}
+
+static void meta_snapshot_node(void *ctx, const char *path, const MetaNode *n) {
+    for (const MetaField *f = n->fields; f; f = f->next) meta_put(ctx, META_SET, path, f->key, f->value);
+}
+
+/* Rewrites the log as one SET per live field plus whatever is appended
+ * while that is being written. */
+static void meta_compact(MetaStore *s) {
+    JrnBuf b = { NULL, 0, 0 };
+    char path[PATH_MAX], tmp[PATH_MAX + 16];
+    struct stat st;
+    long replayed = 0;
+    pthread_mutex_lock(&s->lock);
+    int ok = flock(s->lock_fd, LOCK_EX) == 0;
+    ok = ok && meta_replay(s, &replayed) == 0 && fstat(s->fd, &st) == 0;
+    uint64_t upto = s->size;
+    long records = s->records, live = ok ? s->root->total : 0;
+    if (ok) {
+        path[0] = '\0';
+        meta_walk(s->root, path, 0, meta_snapshot_node, &b);
+        ok = jrn_put(&b, META_COMMIT, 0, NULL, 0, NULL, NULL) == 0;
+    }
+    flock(s->lock_fd, LOCK_UN);
+    pthread_mutex_unlock(&s->lock);
+
+    snprintf(tmp, sizeof(tmp), "%s.%ld", s->path, (long)getpid());
+    int fd = ok ? open(tmp, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600) : -1;
+    ok = fd >= 0 && write_all(fd, META_MAGIC, 8) == 0 && write_all(fd, b.buf, b.len) == 0;
+    uint64_t snap = 8 + b.len;
+    free(b.buf);
+
+    pthread_mutex_lock(&s->lock);
+    flock(s->lock_fd, LOCK_EX);
+    struct stat now;
+    /* Another process compacted meanwhile: keep theirs. */
+    ok = ok && meta_replay(s, &replayed) == 0 && fstat(s->fd, &now) == 0 && now.st_ino == st.st_ino;
+    unsigned char *copy = ok && s->size > upto ? malloc(s->size - upto) : NULL;
+    if (s->size > upto)
+        ok = ok && copy && pread_full(s->fd, copy, s->size - upto, upto) == (ssize_t)(s->size - upto) &&
+             write_all(fd, (const char *)copy, s->size - upto) == 0;
+    free(copy);
+    if (fd >= 0 && (fdatasync(fd) != 0 || close(fd) != 0)) ok = 0;
+    if (ok && rename(tmp, s->path) == 0) {
+        jrn_sync_dir(s->path);
+        close(s->fd);
+        s->fd = open(s->path, O_RDWR | O_APPEND | O_CLOEXEC);
+        s->size = snap + (s->size - upto);
+        s->records = live + (s->records - records);
+        if (s->fd < 0) s->size = 0;
+    } else {
+        unlink(tmp);
+    }
+    s->compacting = 0;
+    flock(s->lock_fd, LOCK_UN);
+    pthread_mutex_unlock(&s->lock);
+}
+
+static void *meta_compact_thread(void *arg) {
+    meta_compact(arg);
+    return NULL;
+}
+
+/* The store of workspace, from the process-wide cache. */
+static MetaStore *meta_store(const char *workspace) {
+    struct stat st;
+    char path[PATH_MAX], lock[PATH_MAX + 8];
+    if (stat(workspace, &st) != 0) return NULL;
+    if (!S_ISDIR(st.st_mode)) {
+        errno = ENOTDIR;
+        return NULL;
+    }
+    if (!cache_path("meta", &st, path, sizeof(path))) {
+        errno = ENOENT;
+        return NULL;
+    }
+    pthread_mutex_lock(&meta_cache_lock);
+    MetaStore *s = meta_cache;
+    while (s && strcmp(s->path, path) != 0) s = s->next;
+    if (!s && (s = calloc(1, sizeof(*s)))) {
+        snprintf(s->path, sizeof(s->path), "%s", path);
+        snprintf(lock, sizeof(lock), "%s.lock", path);
+        s->fd = -1;
+        if ((s->lock_fd = open(lock, O_RDWR | O_CREAT | O_CLOEXEC, 0600)) < 0) {
+            free(s);
+            s = NULL;
+        } else {
+            pthread_mutex_init(&s->lock, NULL);
+            s->next = meta_cache;
+            meta_cache = s;
+        }
+    }
+    pthread_mutex_unlock(&meta_cache_lock);
+    return s;
+}
+
+/* The end of the JSON value at p, leading blanks skipped, or NULL when
+ * there is none. */
+static const char *json_skip(const char *p, int depth) {
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') p++;
+    if (*p == '{' || *p == '[') {
+        char close = *p == '{' ? '}' : ']';
+        if (depth > 64) return NULL;
+        for (p++;;) {
+            while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') p++;
+            if (*p == close) return p + 1;
+            if (close == '}') {
+                if (*p != '"' || !(p = json_skip(p, depth + 1))) return NULL;
+                while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') p++;
+                if (*p++ != ':') return NULL;
+            }
+            if (!(p = json_skip(p, depth + 1))) return NULL;
+            while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') p++;
+            if (*p == ',') p++;
+            else if (*p != close) return NULL;
+        }
+    }
+    if (*p == '"') {
+        for (p++; *p != '"'; p++) {
+            if ((unsigned char)*p < 0x20) return NULL;
+            if (*p == '\\' && (unsigned char)*++p < 0x20) return NULL;
+        }
+        return p + 1;
+    }
+    if (strncmp(p, "true", 4) == 0 || strncmp(p, "null", 4) == 0) return p + 4;
+    if (strncmp(p, "false", 5) == 0) return p + 5;
+    if (*p == '-') p++;
+    if (*p < '0' || *p > '9') return NULL;
+    while (*p >= '0' && *p <= '9') p++;
+    if (*p == '.') {
+        if (*++p < '0' || *p > '9') return NULL;
+        while (*p >= '0' && *p <= '9') p++;
+    }
+    if (*p == 'e' || *p == 'E') {
+        if (*++p == '+' || *p == '-') p++;
+        if (*p < '0' || *p > '9') return NULL;
+        while (*p >= '0' && *p <= '9') p++;
+    }
+    return p;
+}
+
+static int json_valid(const char *s) {
+    const char *p = json_skip(s, 0);
+    if (!p) return 0;
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') p++;
+    return *p == '\0';
+}
+
+static void meta_print_fields(Run *run, const MetaNode *n) {
+    out_puts(run, "{");
+    for (const MetaField *f = n->fields; f; f = f->next) {
+        out_puts(run, f == n->fields ? "\"" : ",\"");
+        out_json(run, f->key);
+        out_puts(run, "\":");
+        out_puts(run, f->value);
+    }
+    out_puts(run, "}");
+}
+
+typedef struct {
+    Run *run;
+    long n;
+} MetaList;
+
+static void meta_list_node(void *ctx, const char *path, const MetaNode *n) {
+    MetaList *l = ctx;
+    out_puts(l->run, l->n++ ? ",{\"path\":\"" : "{\"path\":\"");
+    out_json(l->run, path);
+    out_puts(l->run, "\",\"fields\":");
+    meta_print_fields(l->run, n);
+    out_puts(l->run, "}");
+}
+
+/* Runs one op against the tree, queueing its log record in b, and writes
+ * its entry of the result's "results" array. */
+static void meta_exec(Run *run, MetaStore *s, const MetaOp *op, JrnBuf *b, long *writes) {
+    char path[PATH_MAX], to[PATH_MAX];
+    const char *err = NULL;
+    out_printf(run, "{\"op\":\"%s\",\"path\":\"", meta_ops[op->kind].name);
+    if (meta_norm(op->arg[0], path, sizeof(path)) != 0 ||
+        (op->kind == META_MV && meta_norm(op->arg[1], to, sizeof(to)) != 0)) {
+        out_json(run, op->arg[0]);
+        out_puts(run, "\",\"error\":\"invalid path\"}");
+        return;
+    }
+    out_json(run, path);
+    out_puts(run, "\"");
+    switch (op->kind) {
+    case META_GET: {
+        MetaNode *n = meta_find(s, path, 0);
+        out_puts(run, ",\"fields\":");
+        if (n && n->fields) meta_print_fields(run, n);
+        else out_puts(run, "null");
+        break;
+    }
+    case META_LIST: {
+        MetaNode *n = meta_find(s, path, 0);
+        MetaList l = { run, 0 };
+        char buf[PATH_MAX];
+        snprintf(buf, sizeof(buf), "%s", path);
+        out_puts(run, ",\"items\":[");
+        if (n) meta_walk(n, buf, strlen(buf), meta_list_node, &l);
+        out_puts(run, "]");
+        break;
+    }
+    case META_OP_SET:
+        if (!op->arg[1][0]) err = "empty field name";
+        else if (!json_valid(op->arg[2])) err = "value is not JSON";
+        else if (meta_set(s, path, op->arg[1], op->arg[2]) != 0) err = strerror(errno);
+        else {
+            meta_put(b, META_SET, path, op->arg[1], op->arg[2]);
+            (*writes)++;
+        }
+        break;
+    case META_OP_DEL: {
+        int removed = meta_del(s, path, op->arg[1]);
+        if (removed) {
+            meta_put(b, META_DEL, path, op->arg[1], NULL);
+            (*writes)++;
+        }
+        out_printf(run, ",\"removed\":%d", removed);
+        break;
+    }
+    case META_RM: {
+        long removed = meta_rmtree(s, path);
+        if (removed < 0) err = strerror(errno);
+        else if (removed) {
+            meta_put(b, META_RMTREE, path, NULL, NULL);
+            (*writes)++;
+        }
+        if (removed >= 0) out_printf(run, ",\"removed\":%ld", removed);
+        break;
+    }
+    case META_MV: {
+        long moved = meta_mvtree(s, path, to);
+        out_puts(run, ",\"to\":\"");
+        out_json(run, to);
+        out_puts(run, "\"");
+        if (moved < 0) err = strerror(errno);
+        else if (moved) {
+            meta_put(b, META_MVTREE, path, to, NULL);
+            (*writes)++;
+        }
+        if (moved >= 0) out_printf(run, ",\"moved\":%ld", moved);
+        break;
+    }
+    }
+    if (err) {
+        out_puts(run, ",\"error\":\"");
+        out_json(run, err);
+        out_puts(run, "\"");
+    }
+    out_puts(run, "}");
+}
+
+/* organizer_cli meta <workspace> <op> ...: replays the log, runs the ops,
+ * then appends and syncs their records as one group. */
+static int meta_run(Run *run, const char *workspace, const MetaOp *ops, long nops) {
+    MetaStore *s = meta_store(workspace);
+    if (!s) {
+        jrn_error(run, strerror(errno));
+        return -1;
+    }
+    pthread_mutex_lock(&s->lock);
+    long replayed = 0;
+    op_begin(run);
+    if (flock(s->lock_fd, LOCK_EX) != 0 || meta_replay(s, &replayed) != 0) {
+        int err = errno;
+        flock(s->lock_fd, LOCK_UN);
+        pthread_mutex_unlock(&s->lock);
+        jrn_error(run, strerror(err));
+        return -1;
+    }
+    if (replayed)
+        add_op_ref(run, "meta", "Replay metadata log", "pread(2)", s->path, NULL, NULL, NULL, 1, NULL);
+    else
+        run->op_t0 = 0;
+
+    /* Results are built aside: the ops list has to come first. */
+    Writer saved = run->out;
+    memset(&run->out, 0, sizeof(run->out));
+    JrnBuf b = { NULL, 0, 0 };
+    long writes = 0;
+    out_puts(run, ",\"result\":{\"results\":[");
+    for (long i = 0; i < nops; i++) {
+        if (i) out_puts(run, ",");
+        meta_exec(run, s, &ops[i], &b, &writes);
+    }
+    out_puts(run, "]}");
+    Writer results = run->out;
+    run->out = saved;
+
+    int ok = 1;
+    if (writes) {
+        uint64_t bytes = b.len;
+        op_begin(run);
+        op_set_bytes(run, bytes);
+        ok = jrn_put(&b, META_COMMIT, 0, NULL, 0, NULL, NULL) == 0 && write_all(s->fd, b.buf, b.len) == 0;
+        add_op_ref(run, "meta", "Append metadata records", "write(2)", s->path, NULL, NULL, NULL, ok,
+                   ok ? NULL : strerror(errno));
+        if (ok) {
+            op_begin(run);
+            ok = fdatasync(s->fd) == 0;
+            add_op_ref(run, "meta", "Commit metadata records", "fdatasync(2)", s->path, NULL, NULL, NULL, ok,
+                       ok ? NULL : strerror(errno));
+        }
+        if (ok) {
+            s->size += b.len;
+            s->records += writes;
+        } else {
+            /* The tree is ahead of the log now; the next call rereads it. */
+            if (ftruncate(s->fd, s->size) != 0) s->size = 0;
+            close(s->fd);
+            s->fd = -1;
+        }
+    }
+    free(b.buf);
+    int compact = ok && !s->compacting && s->size >= META_COMPACT_MIN && s->records - s->root->total > s->root->total;
+    if (compact) s->compacting = 1;
+    long fields = s->root->total, records = s->records;
+    uint64_t size = s->size;
+    flock(s->lock_fd, LOCK_UN);
+    pthread_mutex_unlock(&s->lock);
+
+    print_ops(run);
+    if (ok) out_write(run, results.buf, results.len);
+    else out_puts(run, ",\"result\":null,\"error\":\"could not write the metadata log\"");
+    free(results.buf);
+    out_printf(run, ",\"store\":{\"fields\":%ld,\"records\":%ld,\"bytes\":%llu,\"replayed\":%ld,\"compacting\":%s}",
+               fields, records, (unsigned long long)size, replayed, compact ? "true" : "false");
+    finish_json(run);
+
+    if (compact) {
+        pthread_t t;
+        if (run->req_id && pthread_create(&t, NULL, meta_compact_thread, s) == 0) pthread_detach(t);
+        else meta_compact(s);
+    }
+    return ok ? 0 : -1;
+}
+
+/* Turns words into ops, appended to *ops. */
+static int meta_parse(char **words, long n, MetaOp **ops, long *nops, long *cap) {
+    const int nkinds = (int)(sizeof(meta_ops) / sizeof(meta_ops[0]));
+    for (long i = 0; i < n;) {
+        int k = 0;
+        while (k < nkinds && strcmp(words[i], meta_ops[k].name) != 0) k++;
+        if (k == nkinds || i + meta_ops[k].nargs >= n) return -1;
+        if (*nops == *cap) {
+            long grow = *cap ? *cap * 2 : 16;
+            MetaOp *grown = realloc(*ops, grow * sizeof(MetaOp));
+            if (!grown) return -1;
+            *ops = grown;
+            *cap = grow;
+        }
+        MetaOp *op = &(*ops)[(*nops)++];
+        op->kind = k;
+        for (int a = 0; a < 3; a++) op->arg[a] = a < meta_ops[k].nargs ? words[i + 1 + a] : NULL;
+        i += 1 + meta_ops[k].nargs;
+    }
+    return 0;
+}
+
+/* All of standard input, NUL-terminated; NULL when out of memory. */
+static char *read_stdin(void) {
+    size_t len = 0, bcap = 64 * 1024;
+    char *b = malloc(bcap);
+    for (ssize_t n; b; len += (size_t)n) {
+        if (len + 1 >= bcap) {
+            char *grown = realloc(b, bcap *= 2);
+            if (!grown) {
+                free(b);
+                return NULL;
+            }
+            b = grown;
+        }
+        n = read(STDIN_FILENO, b + len, bcap - len - 1);
+        if (n < 0 && errno == EINTR) n = 0;
+        else if (n <= 0) break;
+    }
+    if (b) b[len] = '\0';
+    return b;
+}
+
+/* Reads --stdin ops: one per line, words separated by tabs. The words
+ * point into *buf. */
+static int meta_read_ops(char **buf, MetaOp **ops, long *nops, long *cap) {
+    char *b = read_stdin();
+    if (!(*buf = b)) return -1;
+    char *words[4];
+    for (char *line = b, *next; *line; line = next) {
+        size_t ll = strcspn(line, "\n");
+        next = line + ll + (line[ll] ? 1 : 0);
+        line[ll] = '\0';
+        if (ll && line[ll - 1] == '\r') line[ll - 1] = '\0';
+        if (!*line) continue;
+        long nw = 0;
+        for (char *w = line; w && nw < 4; nw++) {
+            words[nw] = w;
+            if ((w = strchr(w, '\t'))) *w++ = '\0';
+        }
+        if (meta_parse(words, nw, ops, nops, cap) != 0) return -1;
+    }
+    return 0;
+}
+
+/* ---- VECTOR INDEX ----
+ * vindex <workspace> <op> keeps one embedding per workspace path for
+ * semantic search. The caller computes the vectors; nothing here needs
+ * the network. Ops:
+ *   add <path> <vector>     store or replace a path's vector; add --stdin
+ *                           reads "path<TAB>vector" lines instead
+ *   rm <path> [<path> ...]  drop paths and everything below them
+ *   mv <from> <to>          move a subtree's vectors to a new path
+ *   search <vector> [--k N] [--probe N] [--exact]
+ *                           the k paths most similar to the vector (cosine)
+ *   train [--lists N]       cluster the vectors for IVF search
+ *   stats
+ * A vector is a list of numbers, "[0.1,-0.2,...]" or "0.1,-0.2,...". The
+ * first add fixes the dimension; --int8 on it stores one byte per
+ * component and a scale per vector instead of float32.
+ *
+ * Vectors are normalized on the way in, so similarity is a dot product.
+ * They live in the cache dir in one file mapped into memory: a header
+ * page, the IVF list table and centroids, then one 64-byte aligned slot
+ * per vector. Which path each slot belongs to is kept in a side log of
+ * journal-framed ADD, DEL and MV records, replayed into a hash table on
+ * open and rewritten once it is mostly dead records; in serve mode both
+ * stay loaded between requests. A lock file serializes processes.
+ * Neither file is synced: the index is a cache the caller can refill.
+ *
+ * search splits the slots between threads (--jobs), each keeping its own
+ * top k, and scores with AVX-512 or AVX2/FMA kernels when the CPU has
+ * them. train runs spherical k-means on up to VX_TRAIN_SAMPLE vectors per
+ * list (sqrt(n) lists by default) and rewrites the file with the slots
+ * grouped by nearest centroid. search then scans only the --probe lists
+ * nearest the query, plus the slots added since, which sit unsorted after
+ * the grouped ones until the next train; --exact scans everything.
+ * organize, watch and undo carry the vectors of the files they move along
+ * (see vx_follow). */
+#define VX_MAGIC "OVECIX01"
+#define VX_KEYS_MAGIC "OVKEYS01"
+#define VX_PAGE 4096
+#define VX_ALIGN 64
+#define VX_MAX_DIM 8192
+#define VX_GROW 1024            /* slots the file grows by, at least */
+#define VX_SCAN_MIN 4096        /* slots per search thread, at least */
+#define VX_MAX_THREADS 64
+#define VX_K_DEFAULT 10
+#define VX_K_MAX 1000
+#define VX_PROBE_DEFAULT 8
+#define VX_TRAIN_SAMPLE 32
+#define VX_TRAIN_ITERS 8
+#define VX_KEYS_COMPACT (1u << 20)
+
+enum { VX_F32, VX_I8 };
+enum { VX_GEN = 1, VX_ADD, VX_DEL, VX_MV };
+enum { VX_OP_ADD, VX_OP_RM, VX_OP_MV, VX_OP_SEARCH, VX_OP_TRAIN, VX_OP_STATS };
+
+static const char *const vx_ops[] = { "add", "rm", "mv", "search", "train", "stats" };
+
+typedef struct {
+    char magic[8];
+    uint32_t dim, quant;
+    uint32_t stride;        /* bytes per slot, a multiple of VX_ALIGN */
+    uint32_t nlists;        /* IVF lists; 0 until train */
+    uint64_t gen;           /* new whenever the slots are renumbered */
+    uint64_t cap, count;    /* slots in the file, slots handed out */
+    uint64_t grouped;       /* slots below this are sorted by list */
+    uint64_t data;          /* offset of slot 0 */
+} VxHdr;                    /* at VX_PAGE: nlists + 1 list starts, then the centroids */
+
+typedef struct VIndex {
+    char path[PATH_MAX], keys_path[PATH_MAX + 8];
+    int fd, kfd, lock_fd;   /* fd and kfd are -1 until the first load */
+    unsigned char *map;     /* the whole vector file, NULL while it is empty */
+    size_t map_len;
+    uint64_t gen;           /* the header gen the keys were read for */
+    uint64_t ksize;         /* key log bytes applied */
+    long krecords;
+    StrSet keys;            /* path -> slot + 1 */
+    char **names;           /* slot -> path, NULL while free */
+    uint64_t nnames;
+    uint64_t hole;          /* no free unsorted slot lies below this */
+    pthread_mutex_t lock;
+    struct VIndex *next;
+} VIndex;
+
+typedef struct {
+    int op;
+    char **args;
+    int nargs;
+    int k, probe, lists, jobs, exact, quant;
+} VxReq;
+
+typedef struct {
+    float score;
+    uint64_t slot;
+} VxHit;
+
+static VIndex *vx_cache;
+static pthread_mutex_t vx_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Dot products of a float32 query with a slot, float32 or int8 (the
+ * slot's scale is applied by the caller). */
+static float vx_dot_f32_c(const float *q, const void *v, size_t n) {
+    const float *x = v;
+    float s = 0;
+    for (size_t i = 0; i < n; i++) s += q[i] * x[i];
+    return s;
+}
+
+static float vx_dot_i8_c(const float *q, const void *v, size_t n) {
+    const int8_t *x = v;
+    float s = 0;
+    for (size_t i = 0; i < n; i++) s += q[i] * x[i];
+    return s;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+__attribute__((target("avx2,fma")))
+static float vx_dot_f32_avx2(const float *q, const void *v, size_t n) {
+    const float *x = v;
+    __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        s0 = _mm256_fmadd_ps(_mm256_loadu_ps(q + i), _mm256_loadu_ps(x + i), s0);
+        s1 = _mm256_fmadd_ps(_mm256_loadu_ps(q + i + 8), _mm256_loadu_ps(x + i + 8), s1);
+    }
+    for (; i + 8 <= n; i += 8) s0 = _mm256_fmadd_ps(_mm256_loadu_ps(q + i), _mm256_loadu_ps(x + i), s0);
+    s0 = _mm256_add_ps(s0, s1);
+    __m128 h = _mm_add_ps(_mm256_castps256_ps128(s0), _mm256_extractf128_ps(s0, 1));
+    h = _mm_add_ps(h, _mm_movehl_ps(h, h));
+    h = _mm_add_ss(h, _mm_shuffle_ps(h, h, 1));
+    float s = _mm_cvtss_f32(h);
+    for (; i < n; i++) s += q[i] * x[i];
+    return s;
+}
+
+__attribute__((target("avx2,fma")))
+static float vx_dot_i8_avx2(const float *q, const void *v, size_t n) {
+    const int8_t *x = v;
+    __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i b = _mm_loadu_si128((const __m128i *)(x + i));
+        __m256 lo = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(b));
+        __m256 hi = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(_mm_srli_si128(b, 8)));
+        s0 = _mm256_fmadd_ps(_mm256_loadu_ps(q + i), lo, s0);
+        s1 = _mm256_fmadd_ps(_mm256_loadu_ps(q + i + 8), hi, s1);
+    }
+    s0 = _mm256_add_ps(s0, s1);
+    __m128 h = _mm_add_ps(_mm256_castps256_ps128(s0), _mm256_extractf128_ps(s0, 1));
+    h = _mm_add_ps(h, _mm_movehl_ps(h, h));
+    h = _mm_add_ss(h, _mm_shuffle_ps(h, h, 1));
+    float s = _mm_cvtss_f32(h);
+    for (; i < n; i++) s += q[i] * x[i];
+    return s;
+}
+
+__attribute__((target("avx512f")))
+static float vx_dot_f32_avx512(const float *q, const void *v, size_t n) {
+    const float *x = v;
+    __m512 s0 = _mm512_setzero_ps(), s1 = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        s0 = _mm512_fmadd_ps(_mm512_loadu_ps(q + i), _mm512_loadu_ps(x + i), s0);
+        s1 = _mm512_fmadd_ps(_mm512_loadu_ps(q + i + 16), _mm512_loadu_ps(x + i + 16), s1);
+    }
+    if (i + 16 <= n) {
+        s0 = _mm512_fmadd_ps(_mm512_loadu_ps(q + i), _mm512_loadu_ps(x + i), s0);
+        i += 16;
+    }
+    if (i < n) {
+        __mmask16 m = (__mmask16)((1u << (n - i)) - 1);
+        s1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(m, q + i), _mm512_maskz_loadu_ps(m, x + i), s1);
+    }
+    return _mm512_reduce_add_ps(_mm512_add_ps(s0, s1));
+}
+
+__attribute__((target("avx512f")))
+static float vx_dot_i8_avx512(const float *q, const void *v, size_t n) {
+    const int8_t *x = v;
+    __m512 s0 = _mm512_setzero_ps(), s1 = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m512 a = _mm512_cvtepi32_ps(_mm512_cvtepi8_epi32(_mm_loadu_si128((const __m128i *)(x + i))));
+        __m512 b = _mm512_cvtepi32_ps(_mm512_cvtepi8_epi32(_mm_loadu_si128((const __m128i *)(x + i + 16))));
+        s0 = _mm512_fmadd_ps(_mm512_loadu_ps(q + i), a, s0);
+        s1 = _mm512_fmadd_ps(_mm512_loadu_ps(q + i + 16), b, s1);
+    }
+    float s = _mm512_reduce_add_ps(_mm512_add_ps(s0, s1));
+    for (; i < n; i++) s += q[i] * x[i];
+    return s;
+}
+#endif
+
+typedef float (*VxDot)(const float *q, const void *v, size_t n);
+
+static VxDot vx_dot[2] = { vx_dot_f32_c, vx_dot_i8_c };
+static const char *vx_isa = "scalar";
+static pthread_once_t vx_once = PTHREAD_ONCE_INIT;
+
+static void vx_pick_kernels(void) {
+#if defined(__x86_64__) && defined(__GNUC__)
+    if (__builtin_cpu_supports("avx512f")) {
+        vx_dot[VX_F32] = vx_dot_f32_avx512;
+        vx_dot[VX_I8] = vx_dot_i8_avx512;
+        vx_isa = "avx512";
+    } else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        vx_dot[VX_F32] = vx_dot_f32_avx2;
+        vx_dot[VX_I8] = vx_dot_i8_avx2;
+        vx_isa = "avx2";
+    }
+#endif
+}
+
+static uint64_t vx_round(uint64_t n, uint64_t to) {
+    return (n + to - 1) / to * to;
+}
+
+static uint32_t vx_stride(uint32_t dim, uint32_t quant) {
+    return (uint32_t)vx_round(quant == VX_I8 ? (uint64_t)dim + 4 : (uint64_t)dim * 4, VX_ALIGN);
+}
+
+static uint64_t vx_data_off(uint32_t dim, uint32_t nlists) {
+    if (!nlists) return VX_PAGE;
+    return vx_round(VX_PAGE + vx_round((uint64_t)(nlists + 1) * 8, VX_ALIGN) + (uint64_t)nlists * dim * 4, VX_PAGE);
+}
+
+static VxHdr *vx_hdr(const VIndex *x) {
+    return (VxHdr *)x->map;
+}
+
+static unsigned char *vx_slot(const VIndex *x, uint64_t i) {
+    const VxHdr *h = vx_hdr(x);
+    return x->map + h->data + i * h->stride;
+}
+
+/* List l holds slots [lists[l], lists[l + 1]). */
+static const uint64_t *vx_lists(const VIndex *x) {
+    return (const uint64_t *)(x->map + VX_PAGE);
+}
+
+static const float *vx_centroids(const VIndex *x) {
+    return (const float *)(x->map + VX_PAGE + vx_round((uint64_t)(vx_hdr(x)->nlists + 1) * 8, VX_ALIGN));
+}
+
+static const char *vx_name(const VIndex *x, uint64_t slot) {
+    return slot < x->nnames ? x->names[slot] : NULL;
+}
+
+static float vx_score(const VxHdr *h, const float *q, const unsigned char *v) {
+    float s = vx_dot[h->quant](q, v, h->dim);
+    if (h->quant == VX_I8) {
+        float scale;
+        memcpy(&scale, v + h->dim, sizeof(scale));
+        s *= scale;
+    }
+    return s;
+}
+
+/* Writes the unit vector v into slot i. */
+static void vx_store(VIndex *x, uint64_t i, const float *v) {
+    const VxHdr *h = vx_hdr(x);
+    unsigned char *p = vx_slot(x, i);
+    if (h->quant == VX_F32) {
+        memcpy(p, v, (size_t)h->dim * sizeof(float));
+        return;
+    }
+    float m = 0;
+    for (uint32_t d = 0; d < h->dim; d++) if (fabsf(v[d]) > m) m = fabsf(v[d]);
+    float scale = m / 127;
+    for (uint32_t d = 0; d < h->dim; d++) ((int8_t *)p)[d] = (int8_t)lrintf(v[d] / scale);
+    memcpy(p + h->dim, &scale, sizeof(scale));
+}
+
+/* Slot i as float32. */
+static void vx_load(const VIndex *x, uint64_t i, float *out) {
+    const VxHdr *h = vx_hdr(x);
+    const unsigned char *p = vx_slot(x, i);
+    if (h->quant == VX_F32) {
+        memcpy(out, p, (size_t)h->dim * sizeof(float));
+        return;
+    }
+    float scale;
+    memcpy(&scale, p + h->dim, sizeof(scale));
+    for (uint32_t d = 0; d < h->dim; d++) out[d] = ((const int8_t *)p)[d] * scale;
+}
+
+static int vx_normalize(float *v, uint32_t n) {
+    double s = 0;
+    for (uint32_t i = 0; i < n; i++) s += (double)v[i] * v[i];
+    if (!(s > 0) || !isfinite(s)) return -1;
+    float inv = (float)(1 / sqrt(s));
+    for (uint32_t i = 0; i < n; i++) v[i] *= inv;
+    return 0;
+}
+
+/* Reads a vector, "[0.1, -0.2, ...]" or "0.1,-0.2,...", into out. Returns
+ * its length, or -1 when it is not a list of at most cap numbers. */
+static long vx_parse(const char *s, float *out, long cap) {
+    long n = 0;
+    for (;;) {
+        while (*s == ',' || *s == '[' || *s == ']' || *s == ' ' || *s == '\t' || *s == '\r' || *s == '\n') s++;
+        if (!*s) return n;
+        char *end;
+        float f = strtof(s, &end);
+        if (end == s || n == cap || !isfinite(f)) return -1;
+        out[n++] = f;
+        s = end;
+    }
+}
+
+/* Room for slot - 1 in x->names. */
+static int vx_fit(VIndex *x, uint64_t slots) {
+    if (slots <= x->nnames) return 0;
+    uint64_t n = x->nnames ? x->nnames : VX_GROW;
+    while (n < slots) n *= 2;
+    char **grown = realloc(x->names, n * sizeof(char *));
+    if (!grown) return -1;
+    memset(grown + x->nnames, 0, (n - x->nnames) * sizeof(char *));
+    x->names = grown;
+    x->nnames = n;
+    return 0;
+}
+
+static void vx_key_drop(VIndex *x, const char *path) {
+    int s = strset_get(&x->keys, path);
+    if (!s) return;
+    char *name = x->names[s - 1];
+    strset_del(&x->keys, name);
+    free(name);
+    x->names[s - 1] = NULL;
+    if ((uint64_t)s - 1 < x->hole) x->hole = (uint64_t)s - 1;
+}
+
+/* Points path at slot, in place of whatever either had before. */
+static int vx_key_set(VIndex *x, const char *path, uint64_t slot) {
+    char *dup = strdup(path);
+    if (!dup || slot >= INT_MAX || vx_fit(x, slot + 1) != 0) {
+        free(dup);
+        return -1;
+    }
+    vx_key_drop(x, dup);
+    if (x->names[slot]) vx_key_drop(x, x->names[slot]);
+    x->names[slot] = dup;
+    strset_add(&x->keys, dup, (int)slot + 1);
+    return 0;
+}
+
+static void vx_key_apply(VIndex *x, const JrnHdr *h) {
+    const char *p = (const char *)(h + 1), *end = (const char *)h + h->len, *a, *b;
+    uint64_t slot;
+    int s;
+    switch (h->type) {
+    case VX_ADD:
+        memcpy(&slot, p, sizeof(slot));
+        p += sizeof(slot);
+        if ((a = jrn_str(&p, end)) && x->map && slot < vx_hdr(x)->count) vx_key_set(x, a, slot);
+        break;
+    case VX_DEL:
+        if ((a = jrn_str(&p, end))) vx_key_drop(x, a);
+        break;
+    case VX_MV:
+        if ((a = jrn_str(&p, end)) && (b = jrn_str(&p, end)) && (s = strset_get(&x->keys, a)))
+            vx_key_set(x, b, (uint64_t)s - 1);
+        break;
+    }
+}
+
+/* Drops what was read of the key log. */
+static void vx_forget(VIndex *x) {
+    for (uint64_t i = 0; i < x->nnames; i++) free(x->names[i]);
+    free(x->names);
+    x->names = NULL;
+    x->nnames = 0;
+    strset_clear(&x->keys);
+    x->gen = x->ksize = x->hole = 0;
+    x->krecords = 0;
+}
+
+static void vx_unmap(VIndex *x) {
+    if (x->map) munmap(x->map, x->map_len);
+    x->map = NULL;
+    x->map_len = 0;
+}
+
+static void vx_close(VIndex *x) {
+    vx_unmap(x);
+    if (x->fd >= 0) close(x->fd);
+    if (x->kfd >= 0) close(x->kfd);
+    x->fd = x->kfd = -1;
+    vx_forget(x);
+}
+
+/* Empties both files; the next add starts a new index. */
+static int vx_reset(VIndex *x) {
+    vx_unmap(x);
+    vx_forget(x);
+    return ftruncate(x->fd, 0) == 0 && ftruncate(x->kfd, 0) == 0 ? 0 : -1;
+}
+
+static int vx_map(VIndex *x, size_t size) {
+    if (x->map && x->map_len == size) return 0;
+    vx_unmap(x);
+    void *m = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, x->fd, 0);
+    if (m == MAP_FAILED) return -1;
+    x->map = m;
+    x->map_len = size;
+    return 0;
+}
+
+static int vx_valid(const VIndex *x) {
+    const VxHdr *h = vx_hdr(x);
+    if (memcmp(h->magic, VX_MAGIC, 8) != 0 || h->dim < 1 || h->dim > VX_MAX_DIM || h->quant > VX_I8 ||
+        h->stride != vx_stride(h->dim, h->quant) || h->data != vx_data_off(h->dim, h->nlists) ||
+        h->data > x->map_len || h->cap > (x->map_len - h->data) / h->stride || h->count > h->cap ||
+        h->grouped > h->count)
+        return 0;
+    const uint64_t *lists = vx_lists(x);
+    for (uint32_t l = 0; h->nlists && l <= h->nlists; l++)
+        if ((l ? lists[l] < lists[l - 1] : lists[0] != 0) || lists[l] > h->grouped) return 0;
+    return !h->nlists || vx_lists(x)[h->nlists] == h->grouped;
+}
+
+/* Applies the key log past x->ksize. A log that does not start with the
+ * header's gen belongs to other slots, and the index is emptied. */
+static int vx_replay(VIndex *x, long *replayed) {
+    struct stat st;
+    if (fstat(x->kfd, &st) != 0) return -1;
+    uint64_t size = (uint64_t)st.st_size;
+    if (size < x->ksize) vx_forget(x);
+    uint64_t len = size - x->ksize, off = 0;
+    char *buf = malloc(len ? len : 1);
+    if (!buf || (len && pread_full(x->kfd, (unsigned char *)buf, len, x->ksize) != (ssize_t)len)) {
+        free(buf);
+        return -1;
+    }
+    if (x->ksize == 0) {
+        const JrnHdr *h = (const JrnHdr *)(buf + 8);
+        uint64_t gen = 0;
+        if (len >= 8 + sizeof(JrnHdr) + 8 && memcmp(buf, VX_KEYS_MAGIC, 8) == 0 && h->type == VX_GEN &&
+            h->len <= len - 8 && crc32c(buf + 12, h->len - 4) == h->crc)
+            memcpy(&gen, h + 1, sizeof(gen));
+        if (gen != vx_hdr(x)->gen) {
+            free(buf);
+            return vx_reset(x);
+        }
+        off = 8 + h->len;
+        x->gen = gen;
+    }
+    while (off + sizeof(JrnHdr) <= len) {
+        const JrnHdr *h = (const JrnHdr *)(buf + off);
+        if (h->len < sizeof(JrnHdr) || h->len % 8 || h->len > len - off || crc32c(buf + off + 4, h->len - 4) != h->crc)
+            break;
+        vx_key_apply(x, h);
+        x->krecords++;
+        (*replayed)++;
+        off += h->len;
+    }
+    free(buf);
+    if (off < len && ftruncate(x->kfd, x->ksize + off) != 0) return -1;
+    x->ksize += off;
+    return 0;
+}
+
+static int vx_replaced(int fd, const char *path) {
+    struct stat a, b;
+    return fstat(fd, &a) != 0 || stat(path, &b) != 0 || a.st_ino != b.st_ino;
+}
+
+/* Brings x up to date with both files under the lock file: remaps a file
+ * another process grew, and reads everything again after a train or a key
+ * log rewrite replaced them. Leaves x->map NULL for an empty index. */
+static int vx_sync(VIndex *x, long *replayed) {
+    if (x->fd >= 0 && (vx_replaced(x->fd, x->path) || vx_replaced(x->kfd, x->keys_path))) vx_close(x);
+    if (x->fd < 0) {
+        x->fd = open(x->path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+        x->kfd = open(x->keys_path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+        if (x->fd < 0 || x->kfd < 0) {
+            int err = errno;
+            vx_close(x);
+            errno = err;
+            return -1;
+        }
+    }
+    struct stat st;
+    if (fstat(x->fd, &st) != 0) return -1;
+    if ((uint64_t)st.st_size < VX_PAGE) return vx_reset(x);
+    if (vx_map(x, (size_t)st.st_size) != 0) return -1;
+    if (!vx_valid(x)) return vx_reset(x);
+    if (x->gen != vx_hdr(x)->gen) vx_forget(x);
+    return vx_replay(x, replayed);
+}
+
+/* Starts an empty index of dim-sized vectors. */
+static int vx_create(VIndex *x, uint32_t dim, uint32_t quant) {
+    VxHdr h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, VX_MAGIC, 8);
+    h.dim = dim;
+    h.quant = quant;
+    h.stride = vx_stride(dim, quant);
+    h.gen = now_ns() | 1;
+    h.cap = VX_GROW;
+    h.data = VX_PAGE;
+    JrnBuf b = { NULL, 0, 0 };
+    int ok = jrn_put(&b, VX_GEN, 0, &h.gen, sizeof(h.gen), NULL, NULL) == 0 && vx_reset(x) == 0 &&
+             ftruncate(x->fd, (off_t)(h.data + h.cap * h.stride)) == 0 &&
+             vx_map(x, (size_t)(h.data + h.cap * h.stride)) == 0 && write_all(x->kfd, VX_KEYS_MAGIC, 8) == 0 &&
+             write_all(x->kfd, b.buf, b.len) == 0;
+    if (ok) {
+        memcpy(x->map, &h, sizeof(h));
+        x->gen = h.gen;
+        x->ksize = 8 + b.len;
+    }
+    free(b.buf);
+    return ok ? 0 : -1;
+}
+
+/* A free slot past the grouped ones, the file grown when there is none. */
+static int vx_alloc(Run *run, VIndex *x, uint64_t *slot) {
+    VxHdr *h = vx_hdr(x);
+    if (x->hole < h->grouped) x->hole = h->grouped;
+    while (x->hole < h->count && vx_name(x, x->hole)) x->hole++;
+    if (x->hole < h->count) {
+        *slot = x->hole;
+        return 0;
+    }
+    if (h->count == h->cap) {
+        uint64_t cap = h->cap * 2 > h->cap + VX_GROW ? h->cap * 2 : h->cap + VX_GROW;
+        size_t size = (size_t)(h->data + cap * h->stride);
+        op_begin(run);
+        op_set_bytes(run, (cap - h->cap) * h->stride);
+        int ok = ftruncate(x->fd, (off_t)size) == 0 && vx_map(x, size) == 0;
+        add_op_ref(run, "vindex", "Grow vector file", "ftruncate(2)", x->path, NULL, NULL, NULL, ok,
+                   ok ? NULL : strerror(errno));
+        if (!ok) return -1;
+        h = vx_hdr(x);
+        h->cap = cap;
+    }
+    *slot = h->count++;
+    return 0;
+}
+
+/* Rewrites the key log as one ADD per live slot once it is mostly dead
+ * records. */
+static void vx_compact_keys(VIndex *x) {
+    if (x->ksize < VX_KEYS_COMPACT || x->krecords <= 2 * (long)x->keys.n + 16) return;
+    char tmp[PATH_MAX + 32];
+    snprintf(tmp, sizeof(tmp), "%s.%ld", x->keys_path, (long)getpid());
+    JrnBuf b = { NULL, 0, 0 };
+    jrn_put(&b, VX_GEN, 0, &x->gen, sizeof(x->gen), NULL, NULL);
+    for (uint64_t i = 0; i < x->nnames; i++)
+        if (x->names[i]) jrn_put(&b, VX_ADD, 0, &i, sizeof(i), x->names[i], NULL);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    int ok = fd >= 0 && write_all(fd, VX_KEYS_MAGIC, 8) == 0 && write_all(fd, b.buf, b.len) == 0;
+    if (fd >= 0 && close(fd) != 0) ok = 0;
+    int kfd = ok && rename(tmp, x->keys_path) == 0 ? open(x->keys_path, O_RDWR | O_APPEND | O_CLOEXEC) : -1;
+    if (kfd >= 0) {
+        close(x->kfd);
+        x->kfd = kfd;
+        x->ksize = 8 + b.len;
+        x->krecords = (long)x->keys.n;
+    } else {
+        unlink(tmp);
+    }
+    free(b.buf);
+}
+
+/* The index of workspace, from the process-wide cache. */
+static VIndex *vx_index(const char *workspace) {
+    struct stat st;
+    char path[PATH_MAX], lock[PATH_MAX + 8];
+    if (stat(workspace, &st) != 0) return NULL;
+    if (!S_ISDIR(st.st_mode)) {
+        errno = ENOTDIR;
+        return NULL;
+    }
+    if (!cache_path("vindex", &st, path, sizeof(path))) {
+        errno = ENOENT;
+        return NULL;
+    }
+    pthread_mutex_lock(&vx_cache_lock);
+    VIndex *x = vx_cache;
+    while (x && strcmp(x->path, path) != 0) x = x->next;
+    if (!x && (x = calloc(1, sizeof(*x)))) {
+        snprintf(x->path, sizeof(x->path), "%s", path);
+        snprintf(x->keys_path, sizeof(x->keys_path), "%s.keys", path);
+        snprintf(lock, sizeof(lock), "%s.lock", path);
+        x->fd = x->kfd = -1;
+        if ((x->lock_fd = open(lock, O_RDWR | O_CREAT | O_CLOEXEC, 0600)) < 0) {
+            free(x);
+            x = NULL;
+        } else {
+            pthread_mutex_init(&x->lock, NULL);
+            x->next = vx_cache;
+            vx_cache = x;
+        }
+    }
+    pthread_mutex_unlock(&vx_cache_lock);
+    return x;
+}
+
+/* Whether key lies at or below the normalized path ("" is everything). */
+static int vx_under(const char *key, const char *path, size_t len) {
+    return !len || (strncmp(key, path, len) == 0 && (key[len] == '\0' || key[len] == '/'));
+}
+
+/* Copies of the keys at or below path; the caller frees them. */
+static char **vx_subtree(const VIndex *x, const char *path, size_t *n) {
+    size_t len = strlen(path), cap = 16;
+    char **out = malloc(cap * sizeof(char *));
+    *n = 0;
+    for (size_t i = 0; out && i < x->keys.cap; i++) {
+        const char *k = x->keys.keys[i];
+        if (!k || !vx_under(k, path, len)) continue;
+        if (*n == cap) {
+            char **grown = realloc(out, (cap *= 2) * sizeof(char *));
+            if (!grown) break;
+            out = grown;
+        }
+        if ((out[*n] = strdup(k))) (*n)++;
+    }
+    return out;
+}
+
+static void vx_free_list(char **list, size_t n) {
+    for (size_t i = 0; i < n; i++) free(list[i]);
+    free(list);
+}
+
+static long vx_remove(VIndex *x, const char *path, JrnBuf *b) {
+    size_t n;
+    char **keys = vx_subtree(x, path, &n);
+    for (size_t i = 0; i < n; i++) {
+        vx_key_drop(x, keys[i]);
+        jrn_put(b, VX_DEL, 0, NULL, 0, keys[i], NULL);
+    }
+    vx_free_list(keys, n);
+    return (long)n;
+}
+
+/* Moves the vectors at or below from to the same places below to, which
+ * loses what it held before (as meta mv does). */
+static long vx_move(VIndex *x, const char *from, const char *to, JrnBuf *b) {
+    size_t fl = strlen(from), n;
+    vx_remove(x, to, b);
+    char **keys = vx_subtree(x, from, &n), dst[PATH_MAX];
+    long moved = 0;
+    for (size_t i = 0; i < n; i++) {
+        int s = strset_get(&x->keys, keys[i]);
+        if ((size_t)snprintf(dst, sizeof(dst), "%s%s", to, keys[i] + fl) >= sizeof(dst) || !s ||
+            vx_key_set(x, dst, (uint64_t)s - 1) != 0)
+            continue;
+        jrn_put(b, VX_MV, 0, NULL, 0, keys[i], dst);
+        moved++;
+    }
+    vx_free_list(keys, n);
+    return moved;
+}
+
+static void vx_reject(Run *run, long *n, long line, const char *path, const char *err) {
+    out_puts(run, (*n)++ ? ",{" : "{");
+    if (line) out_printf(run, "\"line\":%ld,", line);
+    out_puts(run, "\"path\":\"");
+    out_json(run, path);
+    out_puts(run, "\",\"error\":\"");
+    out_json(run, err);
+    out_puts(run, "\"}");
+}
+
+/* add: the argv pair, or every "path<TAB>vector" line of input. */
+static const char *vx_add(Run *run, VIndex *x, const VxReq *rq, char *input, JrnBuf *b) {
+    float *v = malloc(VX_MAX_DIM * sizeof(float));
+    char path[PATH_MAX];
+    long added = 0, updated = 0, rejected = 0, lineno = 0;
+    const char *fail = NULL;
+    if (!v) return strerror(errno);
+    out_puts(run, ",\"result\":{\"rejected\":[");
+    for (char *line = input, *next; !fail && (input ? *line : !lineno); line = next) {
+        const char *key = rq->nargs > 0 ? rq->args[0] : "", *vec = rq->nargs > 1 ? rq->args[1] : "";
+        next = line;
+        lineno++;
+        if (input) {
+            size_t ll = strcspn(line, "\n");
+            next = line + ll + (line[ll] ? 1 : 0);
+            line[ll] = '\0';
+            if (!*line) continue;
+            char *tab = strchr(line, '\t');
+            key = line;
+            vec = tab ? tab + 1 : "";
+            if (tab) *tab = '\0';
+        }
+        long n = vx_parse(vec, v, VX_MAX_DIM);
+        uint64_t slot;
+        if (meta_norm(key, path, sizeof(path)) != 0 || !path[0]) {
+            vx_reject(run, &rejected, input ? lineno : 0, key, "invalid path");
+            continue;
+        }
+        if (n < 1 || vx_normalize(v, (uint32_t)n) != 0) {
+            vx_reject(run, &rejected, input ? lineno : 0, path, n < 1 ? "not a vector" : "zero vector");
+            continue;
+        }
+        if (!x->map && vx_create(x, (uint32_t)n, rq->quant) != 0) {
+            fail = strerror(errno);
+            break;
+        }
+        if ((uint64_t)n != vx_hdr(x)->dim) {
+            char msg[64];
+            snprintf(msg, sizeof(msg), "expected %u numbers", vx_hdr(x)->dim);
+            vx_reject(run, &rejected, input ? lineno : 0, path, msg);
+            continue;
+        }
+        int s = strset_get(&x->keys, path);
+        if (s && (uint64_t)s - 1 >= vx_hdr(x)->grouped) {
+            /* Unsorted slots are overwritten in place; a grouped one would
+             * sit in the wrong list, so the path gets a new slot. */
+            vx_store(x, (uint64_t)s - 1, v);
+            updated++;
+            continue;
+        }
+        if (vx_alloc(run, x, &slot) != 0 || vx_key_set(x, path, slot) != 0) {
+            fail = strerror(errno);
+            break;
+        }
+        vx_store(x, slot, v);
+        jrn_put(b, VX_ADD, 0, &slot, sizeof(slot), path, NULL);
+        if (s) updated++;
+        else added++;
+    }
+    out_printf(run, "],\"added\":%ld,\"updated\":%ld}", added, updated);
+    free(v);
+    return fail;
+}
+
+typedef struct {
+    uint64_t lo, hi;
+} VxRange;
+
+typedef struct {
+    const VIndex *x;
+    const float *q;
+    const VxRange *ranges;
+    int nranges, k, n;
+    uint64_t from, to;      /* positions in the ranges laid end to end */
+    VxHit *heap;            /* min-heap of the best k */
+    long scanned;
+} VxScan;
+
+static void vx_push(VxHit *h, int *n, int k, float score, uint64_t slot) {
+    int i;
+    if (*n < k) {
+        for (i = (*n)++; i && h[(i - 1) / 2].score > score; i = (i - 1) / 2) h[i] = h[(i - 1) / 2];
+    } else if (score > h[0].score) {
+        for (i = 0;;) {
+            int c = 2 * i + 1;
+            if (c >= k) break;
+            if (c + 1 < k && h[c + 1].score < h[c].score) c++;
+            if (h[c].score >= score) break;
+            h[i] = h[c];
+            i = c;
+        }
+    } else {
+        return;
+    }
+    h[i].score = score;
+    h[i].slot = slot;
+}
+
+static void *vx_scan_thread(void *arg) {
+    VxScan *sc = arg;
+    const VxHdr *h = vx_hdr(sc->x);
+    uint64_t pos = 0;
+    for (int r = 0; r < sc->nranges && pos < sc->to; r++) {
+        uint64_t lo = sc->ranges[r].lo, len = sc->ranges[r].hi - lo;
+        uint64_t a = pos > sc->from ? pos : sc->from, e = pos + len < sc->to ? pos + len : sc->to;
+        for (uint64_t p = a; p < e; p++) {
+            uint64_t slot = lo + p - pos;
+            if (!vx_name(sc->x, slot)) continue;
+            vx_push(sc->heap, &sc->n, sc->k, vx_score(h, sc->q, vx_slot(sc->x, slot)), slot);
+            sc->scanned++;
+        }
+        pos += len;
+    }
+    return NULL;
+}
+
+/* Runs fn on n argument blocks of sz bytes each, the first on this thread
+ * (and any a thread could not be started for). */
+static void vx_parallel(void *(*fn)(void *), void *args, size_t sz, int n) {
+    pthread_t t[VX_MAX_THREADS];
+    int started[VX_MAX_THREADS] = { 0 };
+    for (int i = 1; i < n; i++) started[i] = pthread_create(&t[i], NULL, fn, (char *)args + i * sz) == 0;
+    fn(args);
+    for (int i = 1; i < n; i++) {
+        if (started[i]) pthread_join(t[i], NULL);
+        else fn((char *)args + i * sz);
+    }
+}
+
+static int vx_threads(int jobs, uint64_t work) {
+    long n = jobs > 0 ? jobs : sysconf(_SC_NPROCESSORS_ONLN);
+    uint64_t most = (work + VX_SCAN_MIN - 1) / VX_SCAN_MIN;
+    if ((uint64_t)n > most) n = (long)most;
+    if (n > VX_MAX_THREADS) n = VX_MAX_THREADS;
+    return n < 1 ? 1 : (int)n;
+}
+
+static int vx_hit_cmp(const void *a, const void *b) {
+    float x = ((const VxHit *)a)->score, y = ((const VxHit *)b)->score;
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+static const char *vx_search(Run *run, VIndex *x, const VxReq *rq) {
+    const VxHdr *h = x->map ? vx_hdr(x) : NULL;
+    float *q = NULL;
+    VxRange *ranges = NULL;
+    VxScan *scans = NULL;
+    VxHit *hits = NULL;
+    const char *err = NULL;
+    long n = 0, scanned = 0;
+    int nranges = 0, probed = 0, threads = 0;
+    if (posix_memalign((void **)&q, VX_ALIGN, VX_MAX_DIM * sizeof(float)) != 0) return strerror(ENOMEM);
+    n = vx_parse(rq->args[0], q, VX_MAX_DIM);
+    if (n < 1) err = "not a vector";
+    else if (h && (uint64_t)n != h->dim) err = "vector has the wrong dimension";
+    else if (vx_normalize(q, (uint32_t)n) != 0) err = "zero vector";
+    if (err || !h) goto done;
+
+    /* The lists to scan: the --probe nearest the query, then the unsorted
+     * tail; or every slot. */
+    ranges = malloc((h->nlists + 1) * sizeof(VxRange));
+    if (!ranges) {
+        err = strerror(errno);
+        goto done;
+    }
+    if (h->nlists && !rq->exact && (uint32_t)rq->probe < h->nlists) {
+        VxHit *near = malloc(h->nlists * sizeof(VxHit));
+        if (!near) {
+            err = strerror(errno);
+            goto done;
+        }
+        const float *cents = vx_centroids(x);
+        for (uint32_t l = 0; l < h->nlists; l++) {
+            near[l].score = vx_dot[VX_F32](q, cents + (size_t)l * h->dim, h->dim);
+            near[l].slot = l;
+        }
+        qsort(near, h->nlists, sizeof(VxHit), vx_hit_cmp);
+        const uint64_t *lists = vx_lists(x);
+        for (probed = 0; probed < rq->probe; probed++) {
+            uint64_t l = near[probed].slot;
+            if (lists[l + 1] > lists[l]) ranges[nranges++] = (VxRange){ lists[l], lists[l + 1] };
+        }
+        free(near);
+        if (h->count > h->grouped) ranges[nranges++] = (VxRange){ h->grouped, h->count };
+    } else {
+        probed = (int)h->nlists;
+        ranges[nranges++] = (VxRange){ 0, h->count };
+    }
+    uint64_t total = 0;
+    for (int r = 0; r < nranges; r++) total += ranges[r].hi - ranges[r].lo;
+
+    threads = vx_threads(rq->jobs, total);
+    scans = calloc(threads, sizeof(VxScan));
+    hits = malloc((size_t)threads * rq->k * sizeof(VxHit));
+    if (!scans || !hits) {
+        err = strerror(errno);
+        goto done;
+    }
+    for (int t = 0; t < threads; t++)
+        scans[t] = (VxScan){ x, q, ranges, nranges, rq->k, 0, total * t / threads, total * (t + 1) / threads,
+                             hits + (size_t)t * rq->k, 0 };
+    vx_parallel(vx_scan_thread, scans, sizeof(VxScan), threads);
+    n = 0;
+    for (int t = 0; t < threads; t++) {
+        memmove(hits + n, scans[t].heap, scans[t].n * sizeof(VxHit));
+        n += scans[t].n;
+        scanned += scans[t].scanned;
+    }
+    qsort(hits, n, sizeof(VxHit), vx_hit_cmp);
+
+done:
+    if (!err) {
+        out_puts(run, ",\"result\":{\"items\":[");
+        for (long i = 0; h && i < n && i < rq->k; i++) {
+            out_puts(run, i ? ",{\"path\":\"" : "{\"path\":\"");
+            out_json(run, vx_name(x, hits[i].slot));
+            out_printf(run, "\",\"score\":%.6f}", hits[i].score);
+        }
+        out_printf(run, "],\"scanned\":%ld,\"probed\":%d,\"threads\":%d}", scanned, probed, threads);
+    }
+    free(q);
+    free(ranges);
+    free(scans);
+    free(hits);
+    return err;
+}
+
+typedef struct {
+    const VIndex *x;
+    const float *cents;
+    uint32_t nlists;
+    const uint64_t *slots;
+    uint32_t *best;
+    uint64_t lo, hi;
+} VxAssign;
+
+static void *vx_assign_thread(void *arg) {
+    VxAssign *a = arg;
+    const VxHdr *h = vx_hdr(a->x);
+    for (uint64_t i = a->lo; i < a->hi; i++) {
+        /* Slots are unit vectors and int8 scales positive: the unscaled
+         * dot product ranks the centroids the same. */
+        const unsigned char *v = vx_slot(a->x, a->slots[i]);
+        float top = -INFINITY;
+        for (uint32_t l = 0; l < a->nlists; l++) {
+            float s = vx_dot[h->quant](a->cents + (size_t)l * h->dim, v, h->dim);
+            if (s > top) {
+                top = s;
+                a->best[i] = l;
+            }
+        }
+    }
+    return NULL;
+}
+
+/* best[i] = the centroid nearest slots[i]. */
+static void vx_assign(const VIndex *x, const float *cents, uint32_t nlists, const uint64_t *slots, uint64_t n,
+                      uint32_t *best, int jobs) {
+    VxAssign a[VX_MAX_THREADS];
+    int threads = vx_threads(jobs, n * nlists / 64);
+    for (int t = 0; t < threads; t++)
+        a[t] = (VxAssign){ x, cents, nlists, slots, best, n * t / threads, n * (t + 1) / threads };
+    vx_parallel(vx_assign_thread, a, sizeof(VxAssign), threads);
+}
+
+/* Writes the trained index next to x's files and renames it over them,
+ * the key log first: if only that lands, the gens differ and the index
+ * starts over empty. */
+static int vx_write_trained(Run *run, VIndex *x, const float *cents, uint32_t nlists, const uint64_t *order,
+                            const uint64_t *starts, uint64_t n) {
+    const VxHdr *old = vx_hdr(x);
+    VxHdr h = *old;
+    h.nlists = nlists;
+    h.gen = now_ns() | 1;
+    h.cap = h.count = h.grouped = n;
+    h.data = vx_data_off(h.dim, nlists);
+    char tmp[PATH_MAX + 32], ktmp[PATH_MAX + 32];
+    snprintf(tmp, sizeof(tmp), "%s.%ld", x->path, (long)getpid());
+    snprintf(ktmp, sizeof(ktmp), "%s.%ld", x->keys_path, (long)getpid());
+    size_t hlen = (size_t)h.data, buf_len = 1 << 20;
+    unsigned char *head = calloc(1, hlen), *buf = malloc(buf_len > h.stride ? buf_len : h.stride);
+    JrnBuf kb = { NULL, 0, 0 };
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    int kfd = open(ktmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    int ok = head && buf && fd >= 0 && kfd >= 0;
+    op_begin(run);
+    op_set_bytes(run, hlen + n * h.stride);
+    if (ok) {
+        memcpy(head, &h, sizeof(h));
+        memcpy(head + VX_PAGE, starts, (size_t)(nlists + 1) * 8);
+        memcpy(head + VX_PAGE + vx_round((uint64_t)(nlists + 1) * 8, VX_ALIGN), cents,
+               (size_t)nlists * h.dim * sizeof(float));
+        ok = write_all(fd, (const char *)head, hlen) == 0;
+        jrn_put(&kb, VX_GEN, 0, &h.gen, sizeof(h.gen), NULL, NULL);
+    }
+    size_t used = 0;
+    for (uint64_t i = 0; ok && i < n; i++) {
+        memcpy(buf + used, vx_slot(x, order[i]), h.stride);
+        used += h.stride;
+        if (used + h.stride > buf_len || i + 1 == n) {
+            ok = write_all(fd, (const char *)buf, used) == 0;
+            used = 0;
+        }
+        jrn_put(&kb, VX_ADD, 0, &i, sizeof(i), x->names[order[i]], NULL);
+    }
+    ok = ok && write_all(kfd, VX_KEYS_MAGIC, 8) == 0 && write_all(kfd, kb.buf, kb.len) == 0;
+    if (fd >= 0 && close(fd) != 0) ok = 0;
+    if (kfd >= 0 && close(kfd) != 0) ok = 0;
+    add_op_ref(run, "vindex", "Write clustered vectors", "write(2)", tmp, NULL, NULL, NULL, ok,
+               ok ? NULL : strerror(errno));
+    if (ok) {
+        op_begin(run);
+        ok = rename(ktmp, x->keys_path) == 0 && rename(tmp, x->path) == 0;
+        add_op_ref(run, "vindex", "Replace vector index", "rename(2)", x->path, NULL, NULL, NULL, ok,
+                   ok ? NULL : strerror(errno));
+    }
+    if (!ok) {
+        unlink(tmp);
+        unlink(ktmp);
+    }
+    free(head);
+    free(buf);
+    free(kb.buf);
+    return ok ? 0 : -1;
+}
+
+/* train: spherical k-means on a sample, every vector assigned to its
+ * nearest centroid, and the file rewritten list by list. */
+static const char *vx_train(Run *run, VIndex *x, const VxReq *rq) {
+    const VxHdr *h = x->map ? vx_hdr(x) : NULL;
+    uint64_t n = x->keys.n, m;
+    if (!h || n < 2) return "too few vectors to train";
+    uint32_t dim = h->dim, nlists = rq->lists > 0 ? (uint32_t)rq->lists : (uint32_t)sqrt((double)n);
+    if (nlists < 1) nlists = 1;
+    if (nlists > n) nlists = (uint32_t)n;
+    m = (uint64_t)nlists * VX_TRAIN_SAMPLE < n ? (uint64_t)nlists * VX_TRAIN_SAMPLE : n;
+
+    uint64_t *live = malloc(n * sizeof(uint64_t)), *sample = malloc(m * sizeof(uint64_t));
+    uint64_t *order = malloc(n * sizeof(uint64_t)), *starts = calloc(nlists + 1, sizeof(uint64_t));
+    uint32_t *best = malloc(n * sizeof(uint32_t));
+    float *cents = NULL, *sums = malloc((size_t)nlists * dim * sizeof(float)), *v = malloc(dim * sizeof(float));
+    long *sizes = malloc(nlists * sizeof(long));
+    const char *err = NULL;
+    if (!live || !sample || !order || !starts || !best || !sums || !v || !sizes ||
+        posix_memalign((void **)&cents, VX_ALIGN, (size_t)nlists * dim * sizeof(float)) != 0) {
+        err = strerror(ENOMEM);
+        goto done;
+    }
+    uint64_t k = 0;
+    for (uint64_t i = 0; i < h->count && k < n; i++)
+        if (vx_name(x, i)) live[k++] = i;
+    n = k;
+    /* A partial Fisher-Yates shuffle picks the sample; its first nlists
+     * vectors seed the centroids. */
+    memcpy(order, live, n * sizeof(uint64_t));
+    for (uint64_t i = 0; i < m; i++) {
+        uint64_t j = i + rng_below(&run->rng, n - i), t = order[i];
+        order[i] = order[j];
+        order[j] = t;
+        sample[i] = order[i];
+    }
+    for (uint32_t l = 0; l < nlists; l++) vx_load(x, sample[l], cents + (size_t)l * dim);
+    for (int it = 0; it < VX_TRAIN_ITERS; it++) {
+        vx_assign(x, cents, nlists, sample, m, best, rq->jobs);
+        memset(sums, 0, (size_t)nlists * dim * sizeof(float));
+        memset(sizes, 0, nlists * sizeof(long));
+        for (uint64_t i = 0; i < m; i++) {
+            float *sum = sums + (size_t)best[i] * dim;
+            vx_load(x, sample[i], v);
+            for (uint32_t d = 0; d < dim; d++) sum[d] += v[d];
+            sizes[best[i]]++;
+        }
+        for (uint32_t l = 0; l < nlists; l++) {
+            float *c = cents + (size_t)l * dim, *sum = sums + (size_t)l * dim;
+            if (sizes[l] && vx_normalize(sum, dim) == 0) memcpy(c, sum, dim * sizeof(float));
+            else if (!sizes[l]) vx_load(x, sample[rng_below(&run->rng, m)], c);
+        }
+    }
+    vx_assign(x, cents, nlists, live, n, best, rq->jobs);
+
+    /* Counting sort by list. */
+    memset(sizes, 0, nlists * sizeof(long));
+    for (uint64_t i = 0; i < n; i++) sizes[best[i]]++;
+    long largest = 0;
+    for (uint32_t l = 0; l < nlists; l++) {
+        starts[l + 1] = starts[l] + (uint64_t)sizes[l];
+        if (sizes[l] > largest) largest = sizes[l];
+        sizes[l] = (long)starts[l];
+    }
+    for (uint64_t i = 0; i < n; i++) order[sizes[best[i]]++] = live[i];
+    if (vx_write_trained(run, x, cents, nlists, order, starts, n) != 0) {
+        err = strerror(errno);
+        goto done;
+    }
+    out_printf(run, ",\"result\":{\"lists\":%u,\"vectors\":%llu,\"sample\":%llu,\"iterations\":%d,\"largestList\":%ld}",
+               nlists, (unsigned long long)n, (unsigned long long)m, VX_TRAIN_ITERS, largest);
+done:
+    free(live);
+    free(sample);
+    free(order);
+    free(starts);
+    free(best);
+    free(cents);
+    free(sums);
+    free(v);
+    free(sizes);
+    return err;
+}
+
+static void vx_print_stats(Run *run, const VIndex *x) {
+    const VxHdr *h = x->map ? vx_hdr(x) : NULL;
+    out_printf(run, "{\"vectors\":%zu", x->keys.n);
+    if (h)
+        out_printf(run, ",\"dim\":%u,\"quant\":\"%s\",\"slots\":%llu,\"lists\":%u,\"unsorted\":%llu,\"bytes\":%zu",
+                   h->dim, h->quant == VX_I8 ? "int8" : "float32", (unsigned long long)h->count, h->nlists,
+                   (unsigned long long)(h->count - h->grouped), x->map_len);
+    out_printf(run, ",\"keyLogBytes\":%llu,\"isa\":\"%s\"}", (unsigned long long)x->ksize, vx_isa);
+}
+
+/* organizer_cli vindex <workspace> <op> ...: catches up with the files,
+ * runs the op, then appends its key records. */
+static int vx_run(Run *run, const char *workspace, const VxReq *rq, char *input) {
+    pthread_once(&vx_once, vx_pick_kernels);
+    VIndex *x = vx_index(workspace);
+    if (!x) {
+        jrn_error(run, strerror(errno));
+        return -1;
+    }
+    pthread_mutex_lock(&x->lock);
+    long replayed = 0;
+    op_begin(run);
+    if (flock(x->lock_fd, LOCK_EX) != 0 || vx_sync(x, &replayed) != 0) {
+        int err = errno;
+        flock(x->lock_fd, LOCK_UN);
+        pthread_mutex_unlock(&x->lock);
+        jrn_error(run, strerror(err));
+        return -1;
+    }
+    if (replayed)
+        add_op_ref(run, "vindex", "Replay vector keys", "pread(2)", x->keys_path, NULL, NULL, NULL, 1, NULL);
+    else
+        run->op_t0 = 0;
+
+    /* The result is built aside: the ops list has to come first. */
+    Writer saved = run->out;
+    memset(&run->out, 0, sizeof(run->out));
+    JrnBuf b = { NULL, 0, 0 };
+    const char *err = NULL;
+    char path[PATH_MAX], to[PATH_MAX];
+    long changed = 0;
+    switch (rq->op) {
+    case VX_OP_ADD:
+        err = vx_add(run, x, rq, input, &b);
+        break;
+    case VX_OP_RM:
+        for (int i = 0; i < rq->nargs && !err; i++) {
+            if (meta_norm(rq->args[i], path, sizeof(path)) != 0) err = "invalid path";
+            else changed += vx_remove(x, path, &b);
+        }
+        if (!err) out_printf(run, ",\"result\":{\"removed\":%ld}", changed);
+        break;
+    case VX_OP_MV: {
+        int ok = meta_norm(rq->args[0], path, sizeof(path)) == 0 && meta_norm(rq->args[1], to, sizeof(to)) == 0;
+        size_t fl = ok ? strlen(path) : 0, tl = ok ? strlen(to) : 0;
+        if (ok && strcmp(path, to) == 0) out_puts(run, ",\"result\":{\"moved\":0}");
+        else if (!fl || !tl || (tl > fl ? vx_under(to, path, fl) : vx_under(path, to, tl))) err = "invalid path";
+        else out_printf(run, ",\"result\":{\"moved\":%ld}", vx_move(x, path, to, &b));
+        break;
+    }
+    case VX_OP_SEARCH:
+        err = vx_search(run, x, rq);
+        break;
+    case VX_OP_TRAIN:
+        err = vx_train(run, x, rq);
+        /* Both files were replaced: read them again for the stats. */
+        vx_close(x);
+        if (!err && vx_sync(x, &replayed) != 0) err = strerror(errno);
+        break;
+    case VX_OP_STATS:
+        out_puts(run, ",\"result\":");
+        vx_print_stats(run, x);
+        break;
+    }
+    Writer result = run->out;
+    run->out = saved;
+
+    if (b.len) {
+        op_begin(run);
+        op_set_bytes(run, b.len);
+        int ok = write_all(x->kfd, b.buf, b.len) == 0;
+        add_op_ref(run, "vindex", "Append vector keys", "write(2)", x->keys_path, NULL, NULL, NULL, ok,
+                   ok ? NULL : strerror(errno));
+        if (ok) {
+            x->ksize += b.len;
+            for (size_t off = 0; off < b.len; off += ((const JrnHdr *)(b.buf + off))->len) x->krecords++;
+            vx_compact_keys(x);
+        } else {
+            /* Memory is ahead of the log now; the next call rereads it. */
+            err = "could not write the key log";
+            vx_close(x);
+        }
+    }
+    free(b.buf);
+
+    print_ops(run);
+    if (err) {
+        out_puts(run, ",\"result\":null,\"error\":\"");
+        out_json(run, err);
+        out_puts(run, "\"");
+    } else {
+        out_write(run, result.buf, result.len);
+    }
+    free(result.buf);
+    if (rq->op != VX_OP_STATS) {
+        out_puts(run, ",\"index\":");
+        vx_print_stats(run, x);
+    }
+    flock(x->lock_fd, LOCK_UN);
+    pthread_mutex_unlock(&x->lock);
+    finish_json(run);
+    return err ? -1 : 0;
+}
+
+/* Carries the vectors of the files batch bt moved along with them, when
+ * the workspace has an index. Runs under the journal lock once the batch
+ * is committed. */
+static void vx_follow(Journal *j, const JrnBatch *bt) {
+    struct stat st;
+    char path[PATH_MAX], from[PATH_MAX], to[PATH_MAX];
+    if (stat(j->workspace, &st) != 0 || !cache_path("vindex", &st, path, sizeof(path)) || stat(path, &st) != 0 ||
+        st.st_size < VX_PAGE)
+        return;
+    VIndex *x = vx_index(j->workspace);
+    JrnLoad l;
+    if (!x || jrn_load(j, bt, &l) != 0) {
+        if (x) jrn_load_free(&l);
+        return;
+    }
+    long replayed = 0, moved = 0;
+    pthread_mutex_lock(&x->lock);
+    if (flock(x->lock_fd, LOCK_EX) == 0 && vx_sync(x, &replayed) == 0 && x->keys.n) {
+        JrnBuf b = { NULL, 0, 0 };
+        for (long i = 0; i < l.nmoves; i++) {
+            jrn_path(path, sizeof(path), l.sub, NULL, l.moves[i].from);
+            jrn_path(to, sizeof(to), l.sub, NULL, l.moves[i].to);
+            if (meta_norm(path, from, sizeof(from)) != 0 || meta_norm(to, path, sizeof(path)) != 0) continue;
+            int s = strset_get(&x->keys, from);
+            if (s && vx_key_set(x, path, (uint64_t)s - 1) == 0) {
+                jrn_put(&b, VX_MV, 0, NULL, 0, from, path);
+                moved++;
+            }
+        }
+        if (b.len && write_all(x->kfd, b.buf, b.len) == 0) {
+            x->ksize += b.len;
+            x->krecords += moved;
+            vx_compact_keys(x);
+        } else if (b.len) {
+            vx_close(x);
+        }
+        free(b.buf);
+    }
+    flock(x->lock_fd, LOCK_UN);
+    pthread_mutex_unlock(&x->lock);
+    jrn_load_free(&l);
+}
+
+/* ---- FULL-TEXT INDEX ----
+ * ftindex <workspace> [<op>] indexes what documents say, so search finds
+ * files by content and content analysis reads cached text instead of the
+ * files themselves. Ops:
+ *   (none)                  bring the index up to date, print its stats
+ *   query <expr> [--limit N]
+ *                           documents matching expr, best first (BM25),
+ *                           each with a snippet around its first match
+ *   text <path> [<path> ...] [--max N]
+ *                           the first N bytes (default FT_TEXT_DEFAULT)
+ *                           of each file's extracted text
+ * Every op refreshes the index first. In expr all words must appear (AND
+ * is implied), "quoted words" must appear in that order, a OR b takes
+ * either, and -word or NOT word drops documents containing it. Words are
+ * runs of letters and digits, compared case-insensitively for ASCII.
+ *
+ * Text comes from text-like files (ft_text_exts; tags stripped from
+ * HTML and XML) and from PDFs: each unfiltered or FlateDecode stream is
+ * inflated and the strings shown between BT and ET are pulled out. That
+ * covers PDFs with simple fonts; text in fonts with their own glyph
+ * codes (most CID fonts) is left out, and encrypted PDFs give nothing.
+ * At most FT_DOC_MAX bytes of text are kept per file.
+ *
+ * The index is one file in the cache dir, replaced atomically like the
+ * workspace index, which supplies the file list. Each listed document is
+ * stat'ed (an edit in place leaves its directory's mtime alone), and one
+ * whose size and mtime match the previous index keeps its entry; only
+ * new or changed files are read, on --jobs threads. The file holds the document
+ * table, the paths, the cached text, a sorted term dictionary and one
+ * posting list per term: per document the doc id delta, the number of
+ * occurrences, then their token positions, all delta coded as LEB128
+ * varints. Kept documents' postings are copied over with their doc ids
+ * renumbered, nothing re-read or re-tokenized; new ones get ids after
+ * them. */
+#define FT_MAGIC "OFTIDX01"
+#define FT_DOC_MAX (1 << 20)        /* text kept per document */
+#define FT_RAW_MAX (2 << 20)        /* bytes read from a text file */
+#define FT_PDF_MAX (256 << 20)      /* larger PDFs are skipped */
+#define FT_STREAM_MAX (16 << 20)    /* inflated bytes per PDF stream */
+#define FT_PDF_STR 4096             /* longest PDF string kept */
+#define FT_TERM_MAX 32
+#define FT_MAX_THREADS 16
+#define FT_LIMIT_DEFAULT 20
+#define FT_LIMIT_MAX 1000
+#define FT_TEXT_DEFAULT 3000
+#define FT_MAX_ATOMS 32
+#define FT_PHRASE_MAX 16
+#define FT_SNIP_BEFORE 60
+#define FT_SNIP_AFTER 140
+#define FT_OUT_BUF (1 << 20)
+
+enum { FT_NONE, FT_TEXT, FT_MARKUP, FT_PDF };
+enum { FT_OP_REFRESH, FT_OP_QUERY, FT_OP_TEXT };
+static const char *const ft_ops[] = { "refresh", "query", "text" };
+
+static const char *const ft_text_exts[] = {
+    "txt", "md", "markdown", "rst", "csv", "tsv", "json", "log", "ini", "conf", "cfg",
+    "yaml", "yml", "toml", "tex", "css", "js", NULL
+};
+static const char *const ft_markup_exts[] = { "html", "htm", "xhtml", "xml", NULL };
+
+typedef struct {
+    char magic[8];
+    uint64_t dev, ino;          /* the workspace root */
+    uint32_t ndocs, nterms;
+    uint64_t tokens;            /* in all documents, for the average length */
+    uint64_t off_docs, off_paths, off_text, off_terms, off_tpool, off_post;
+    uint64_t paths_len, text_len, tpool_len, post_len;
+    uint64_t file_len;
+} FtHdr;
+
+typedef struct {
+    uint64_t size;
+    int64_t mtime;              /* ns, as in the workspace index */
+    uint64_t text_off;
+    uint32_t text_len, path_off, tokens, type;
+} FtDoc;
+
+typedef struct {
+    uint64_t post_off;          /* the list runs to the next term's */
+    uint32_t name_off, df;
+} FtTerm;
+
+/* A read-only view of the index file. */
+typedef struct {
+    void *map;
+    size_t map_len;
+    uint32_t ndocs, nterms;
+    uint64_t tokens;
+    const FtDoc *docs;
+    const FtTerm *terms;
+    const char *paths, *text, *tpool;
+    const uint8_t *post;
+    uint64_t paths_len, text_len, tpool_len, post_len;
+} FtIndex;
+
+typedef struct {
+    long documents, extracted, kept, removed, failed;
+    uint64_t bytes_read;
+    double ms;
+} FtStats;
+
+static void ft_close(FtIndex *ix) {
+    if (ix->map) munmap(ix->map, ix->map_len);
+    memset(ix, 0, sizeof(*ix));
+}
+
+static int ft_open(FtIndex *ix, const char *path, const struct stat *root) {
+    memset(ix, 0, sizeof(*ix));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    struct stat st;
+    void *p = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(FtHdr))
+        p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return -1;
+    const FtHdr *h = p;
+    uint64_t len = st.st_size;
+    int ok = memcmp(h->magic, FT_MAGIC, 8) == 0 && h->file_len == len &&
+             h->dev == (uint64_t)root->st_dev && h->ino == (uint64_t)root->st_ino &&
+             h->ndocs < len && h->nterms < len;
+    const uint64_t offs[] = { h->off_docs, h->off_paths, h->off_text, h->off_terms, h->off_tpool, h->off_post };
+    const uint64_t sizes[] = { (uint64_t)h->ndocs * sizeof(FtDoc), h->paths_len, h->text_len,
+                               (uint64_t)h->nterms * sizeof(FtTerm), h->tpool_len, h->post_len };
+    for (int i = 0; ok && i < 6; i++) ok = offs[i] % 8 == 0 && offs[i] <= len && sizes[i] <= len - offs[i];
+    if (ok && ((h->paths_len && ((const char *)p)[h->off_paths + h->paths_len - 1] != '\0') ||
+               (h->tpool_len && ((const char *)p)[h->off_tpool + h->tpool_len - 1] != '\0') ||
+               (h->ndocs && !h->paths_len) || (h->nterms && !h->tpool_len)))
+        ok = 0;
+    if (!ok) {
+        munmap(p, st.st_size);
+        return -1;
+    }
+    ix->map = p;
+    ix->map_len = st.st_size;
+    ix->ndocs = h->ndocs;
+    ix->nterms = h->nterms;
+    ix->tokens = h->tokens;
+    ix->docs = (const FtDoc *)((char *)p + h->off_docs);
+    ix->paths = (const char *)p + h->off_paths;
+    ix->text = (const char *)p + h->off_text;
+    ix->terms = (const FtTerm *)((char *)p + h->off_terms);
+    ix->tpool = (const char *)p + h->off_tpool;
+    ix->post = (const uint8_t *)p + h->off_post;
+    ix->paths_len = h->paths_len;
+    ix->text_len = h->text_len;
+    ix->tpool_len = h->tpool_len;
+    ix->post_len = h->post_len;
+    return 0;
+}
+
+/* Accessors clamp, so a damaged file gives wrong answers, not crashes. */
+static const char *ft_doc_path(const FtIndex *ix, uint32_t d) {
+    uint32_t off = ix->docs[d].path_off;
+    return ix->paths + (off < ix->paths_len ? off : ix->paths_len - 1);
+}
+
+static const char *ft_doc_text(const FtIndex *ix, uint32_t d, size_t *len) {
+    const FtDoc *doc = &ix->docs[d];
+    if (doc->text_off > ix->text_len || doc->text_len > ix->text_len - doc->text_off) {
+        *len = 0;
+        return ix->text;
+    }
+    *len = doc->text_len;
+    return ix->text + doc->text_off;
+}
+
+static const char *ft_term_name(const FtIndex *ix, uint32_t k) {
+    uint32_t off = ix->terms[k].name_off;
+    return ix->tpool + (off < ix->tpool_len ? off : ix->tpool_len - 1);
+}
+
+static void ft_term_list(const FtIndex *ix, uint32_t k, const uint8_t **p, const uint8_t **end) {
+    uint64_t a = ix->terms[k].post_off, b = k + 1 < ix->nterms ? ix->terms[k + 1].post_off : ix->post_len;
+    if (a > ix->post_len) a = ix->post_len;
+    if (b > ix->post_len || b < a) b = a;
+    *p = ix->post + a;
+    *end = ix->post + b;
+}
+
+static const char *ft_type_name(uint32_t type) {
+    return type == FT_PDF ? "pdf" : type == FT_TEXT ? "text" : "other";
+}
+
+static int ft_kind(const char *name) {
+    const char *dot = strrchr(name, '.');
+    if (!dot || dot == name) return FT_NONE;
+    dot++;
+    if (strcasecmp(dot, "pdf") == 0) return FT_PDF;
+    for (int i = 0; ft_text_exts[i]; i++) if (strcasecmp(dot, ft_text_exts[i]) == 0) return FT_TEXT;
+    for (int i = 0; ft_markup_exts[i]; i++) if (strcasecmp(dot, ft_markup_exts[i]) == 0) return FT_MARKUP;
+    return FT_NONE;
+}
+
+/* ---- text extraction ---- */
+
+typedef struct {
+    char *buf;
+    size_t len, cap;
+} FtText;
+
+static size_t utf8_put(char *u, uint32_t c) {
+    if (c >= 0xd800 && (c < 0xe000 || c > 0x10ffff)) c = 0xfffd;
+    if (c < 0x80) { u[0] = (char)c; return 1; }
+    if (c < 0x800) { u[0] = (char)(0xc0 | c >> 6); u[1] = (char)(0x80 | (c & 0x3f)); return 2; }
+    if (c < 0x10000) {
+        u[0] = (char)(0xe0 | c >> 12);
+        u[1] = (char)(0x80 | ((c >> 6) & 0x3f));
+        u[2] = (char)(0x80 | (c & 0x3f));
+        return 3;
+    }
+    u[0] = (char)(0xf0 | c >> 18);
+    u[1] = (char)(0x80 | ((c >> 12) & 0x3f));
+    u[2] = (char)(0x80 | ((c >> 6) & 0x3f));
+    u[3] = (char)(0x80 | (c & 0x3f));
+    return 4;
+}
+
+static int ft_full(const FtText *t) {
+    return t->len + 4 > FT_DOC_MAX;
+}
+
+/* Appends code point c. Control characters become spaces, and runs of
+ * white space collapse to one space or one line break. */
+static void ft_cp(FtText *t, uint32_t c) {
+    if (c < 0x20 || c == 0x7f) c = c == '\n' ? '\n' : ' ';
+    if (c == ' ' || c == '\n') {
+        char last = t->len ? t->buf[t->len - 1] : '\n';
+        if (last == '\n' || (last == ' ' && c == ' ')) return;
+        if (last == ' ') { t->buf[t->len - 1] = '\n'; return; }
+    }
+    if (ft_full(t)) return;
+    if (t->len + 4 > t->cap) {
+        size_t cap = t->cap ? t->cap * 2 : 4096;
+        if (cap > FT_DOC_MAX) cap = FT_DOC_MAX;
+        char *g = realloc(t->buf, cap);
+        if (!g) return;
+        t->buf = g;
+        t->cap = cap;
+    }
+    t->len += utf8_put(t->buf + t->len, c);
+}
+
+/* Appends file bytes: valid UTF-8 as it is, any other byte as Latin-1. */
+static void ft_bytes(FtText *t, const unsigned char *p, size_t n) {
+    for (size_t i = 0; i < n && !ft_full(t);) {
+        unsigned c = p[i];
+        size_t len = c < 0x80 ? 1 : c >= 0xc2 && c < 0xe0 ? 2 : c >= 0xe0 && c < 0xf0 ? 3 : c >= 0xf0 && c < 0xf5 ? 4 : 0;
+        uint32_t cp = len == 1 ? c : len == 2 ? c & 0x1f : len == 3 ? c & 0x0f : c & 0x07;
+        int ok = len > 0 && i + len <= n;
+        for (size_t k = 1; ok && k < len; k++) {
+            ok = (p[i + k] & 0xc0) == 0x80;
+            cp = cp << 6 | (p[i + k] & 0x3f);
+        }
+        if (ok && ((len == 3 && cp < 0x800) || (len == 4 && (cp < 0x10000 || cp > 0x10ffff)))) ok = 0;
+        if (!ok) len = 1, cp = c;
+        ft_cp(t, cp);
+        i += len;
+    }
+}
+
+static int ft_hex(unsigned c) {
+    return c >= '0' && c <= '9' ? (int)(c - '0') : (c | 0x20) >= 'a' && (c | 0x20) <= 'f' ? (int)((c | 0x20) - 'a' + 10) : -1;
+}
+
+static int ft_prefix(const unsigned char *p, size_t n, const char *s) {
+    size_t k = strlen(s);
+    return n >= k && strncasecmp((const char *)p, s, k) == 0;
+}
+
+/* Strips tags, comments, scripts and styles from HTML or XML in place and
+ * decodes the common entities. The result is never longer than the input. */
+static size_t ft_strip_markup(unsigned char *p, size_t n) {
+    size_t o = 0;
+    for (size_t i = 0; i < n;) {
+        if (p[i] == '<' && ft_prefix(p + i, n - i, "<!--")) {
+            for (i += 4; i < n && !ft_prefix(p + i, n - i, "-->"); i++) {}
+            i += 3;
+            p[o++] = ' ';
+            continue;
+        }
+        if (p[i] == '<') {
+            const char *close = ft_prefix(p + i, n - i, "<script") ? "</script"
+                              : ft_prefix(p + i, n - i, "<style") ? "</style" : NULL;
+            if (close)
+                for (i++; i < n && !ft_prefix(p + i, n - i, close); i++) {}
+            while (i < n && p[i] != '>') i++;
+            i++;
+            p[o++] = ' ';
+            continue;
+        }
+        if (p[i] == '&') {
+            static const struct { const char *name; uint32_t cp; } ents[] = {
+                { "amp;", '&' }, { "lt;", '<' }, { "gt;", '>' }, { "quot;", '"' }, { "apos;", '\'' }, { "nbsp;", ' ' }
+            };
+            uint32_t cp = 0;
+            size_t used = 0;
+            for (size_t e = 0; e < sizeof(ents) / sizeof(ents[0]) && !used; e++)
+                if (ft_prefix(p + i + 1, n - i - 1, ents[e].name)) cp = ents[e].cp, used = 1 + strlen(ents[e].name);
+            if (!used && i + 2 < n && p[i + 1] == '#') {
+                int hex = p[i + 2] == 'x' || p[i + 2] == 'X';
+                size_t k = i + 2 + hex;
+                for (int v; k < n && k < i + 10 && (v = ft_hex(p[k])) >= 0 && (hex || v < 10); k++)
+                    cp = cp * (hex ? 16 : 10) + (uint32_t)v;
+                if (k < n && p[k] == ';' && k > i + 2 + hex) used = k + 1 - i;
+            }
+            if (used) {
+                o += utf8_put((char *)p + o, cp ? cp : ' ');
+                i += used;
+                continue;
+            }
+        }
+        p[o++] = p[i++];
+    }
+    return o;
+}
+
+/* WinAnsiEncoding for 0x80-0x9f; the rest of the byte range is Latin-1. */
+static const uint16_t ft_winansi[32] = {
+    0x20ac, 0, 0x201a, 0x0192, 0x201e, 0x2026, 0x2020, 0x2021, 0x02c6, 0x2030, 0x0160, 0x2039, 0x0152, 0, 0x017d, 0,
+    0, 0x2018, 0x2019, 0x201c, 0x201d, 0x2022, 0x2013, 0x2014, 0x02dc, 0x2122, 0x0161, 0x203a, 0x0153, 0, 0x017e, 0x0178
+};
+
+/* Appends one PDF string: UTF-16BE with a byte order mark, otherwise one
+ * byte per character. Strings that are mostly zero bytes hold two-byte
+ * glyph codes, which mean nothing without the font, and are dropped. */
+static void ft_pdf_string(FtText *t, const unsigned char *s, size_t n) {
+    if (n >= 2 && s[0] == 0xfe && s[1] == 0xff) {
+        for (size_t i = 2; i + 1 < n; i += 2) {
+            uint32_t c = (uint32_t)s[i] << 8 | s[i + 1];
+            if (c >= 0xd800 && c < 0xdc00 && i + 3 < n) {
+                uint32_t lo = (uint32_t)s[i + 2] << 8 | s[i + 3];
+                if (lo >= 0xdc00 && lo < 0xe000) {
+                    c = 0x10000 + ((c - 0xd800) << 10) + (lo - 0xdc00);
+                    i += 2;
+                }
+            }
+            ft_cp(t, c);
+        }
+        return;
+    }
+    size_t zeros = 0;
+    for (size_t i = 0; i < n; i++) zeros += s[i] == 0;
+    if (2 * zeros >= n) return;
+    for (size_t i = 0; i < n; i++) {
+        unsigned c = s[i];
+        if (c < 0x20) continue;
+        if (c >= 0x80 && c < 0xa0) c = ft_winansi[c - 0x80];
+        if (c) ft_cp(t, c);
+    }
+}
+
+static int ft_pdf_space(unsigned c) {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\f' || c == 0;
+}
+
+static int ft_pdf_delim(unsigned c) {
+    return ft_pdf_space(c) || strchr("()<>[]{}/%", (int)c) != NULL;
+}
+
+/* Pulls the text out of a content stream: the strings shown by Tj, TJ, '
+ * and " between BT and ET, with a line break where the text moves down
+ * and a space for wide gaps inside TJ arrays. */
+static void ft_pdf_content(const unsigned char *p, size_t n, FtText *t) {
+    FtText pend = { NULL, 0, 0 };
+    unsigned char s[FT_PDF_STR];
+    double num[2] = { 0, 0 };
+    int in_text = 0, in_array = 0;
+    for (size_t i = 0; i < n && !ft_full(t);) {
+        unsigned c = p[i];
+        if (ft_pdf_space(c)) { i++; continue; }
+        if (c == '%') {
+            while (i < n && p[i] != '\n' && p[i] != '\r') i++;
+            continue;
+        }
+        if (c == '(') {
+            size_t sl = 0;
+            int depth = 1;
+            for (i++; i < n;) {
+                unsigned ch = p[i++];
+                if (ch == '\\' && i < n) {
+                    ch = p[i++];
+                    if (ch == 'n') ch = '\n';
+                    else if (ch == 'r') ch = '\r';
+                    else if (ch == 't') ch = '\t';
+                    else if (ch == 'b') ch = '\b';
+                    else if (ch == 'f') ch = '\f';
+                    else if (ch >= '0' && ch <= '7') {
+                        ch -= '0';
+                        for (int k = 0; k < 2 && i < n && p[i] >= '0' && p[i] <= '7'; k++) ch = ch * 8 + (p[i++] - '0');
+                        ch &= 0xff;
+                    } else if (ch == '\r' || ch == '\n') {
+                        if (ch == '\r' && i < n && p[i] == '\n') i++;
+                        continue;
+                    }
+                } else if (ch == '(') {
+                    depth++;
+                } else if (ch == ')' && --depth == 0) {
+                    break;
+                }
+                if (sl < sizeof(s)) s[sl++] = (unsigned char)ch;
+            }
+            ft_pdf_string(&pend, s, sl);
+            continue;
+        }
+        if ((c == '<' || c == '>') && i + 1 < n && p[i + 1] == c) {
+            i += 2;
+            continue;
+        }
+        if (c == '<') {
+            size_t sl = 0;
+            int half = -1;
+            for (i++; i < n && p[i] != '>'; i++) {
+                int v = ft_hex(p[i]);
+                if (v < 0) continue;
+                if (half < 0) { half = v; continue; }
+                if (sl < sizeof(s)) s[sl++] = (unsigned char)(half << 4 | v);
+                half = -1;
+            }
+            if (half >= 0 && sl < sizeof(s)) s[sl++] = (unsigned char)(half << 4);
+            i++;
+            ft_pdf_string(&pend, s, sl);
+            continue;
+        }
+        if (c == '[' || c == ']') { in_array = c == '['; i++; continue; }
+        if (c == '/' || c == '<' || c == '>' || c == '{' || c == '}' || c == ')') {
+            for (i++; i < n && !ft_pdf_delim(p[i]); i++) {}
+            continue;
+        }
+        if (c == '-' || c == '+' || c == '.' || (c >= '0' && c <= '9')) {
+            double v = 0, scale = 0, sign = c == '-' ? -1 : 1;
+            if (c == '-' || c == '+') i++;
+            for (; i < n && ((p[i] >= '0' && p[i] <= '9') || p[i] == '.'); i++) {
+                if (p[i] == '.') { if (!scale) scale = 1; continue; }
+                v = v * 10 + (p[i] - '0');
+                if (scale) scale *= 10;
+            }
+            v = sign * (scale ? v / scale : v);
+            if (in_array) {
+                if (v < -200) ft_cp(&pend, ' ');
+            } else {
+                num[0] = num[1];
+                num[1] = v;
+            }
+            continue;
+        }
+        size_t start = i;
+        while (i < n && !ft_pdf_delim(p[i])) i++;
+        size_t ol = i - start;
+        const char *op = (const char *)p + start;
+        if (ol == 0) { i++; continue; }
+#define FT_OP(s) (ol == sizeof(s) - 1 && memcmp(op, s, ol) == 0)
+        if (FT_OP("BT")) {
+            in_text = 1;
+        } else if (FT_OP("ET")) {
+            in_text = 0;
+            ft_cp(t, '\n');
+        } else if (in_text && (FT_OP("Tj") || FT_OP("TJ") || FT_OP("'") || FT_OP("\""))) {
+            if (op[0] == '\'' || op[0] == '"') ft_cp(t, '\n');
+            ft_bytes(t, (const unsigned char *)pend.buf, pend.len);
+        } else if (in_text && (FT_OP("Td") || FT_OP("TD"))) {
+            ft_cp(t, num[1] != 0 ? '\n' : ' ');
+        } else if (in_text && (FT_OP("T*") || FT_OP("Tm"))) {
+            ft_cp(t, FT_OP("T*") ? '\n' : ' ');
+        } else if (FT_OP("BI")) {
+            /* Inline image data is binary: skip to the EI that ends it. */
+            for (; i + 2 < n; i++)
+                if (p[i] == 'E' && p[i + 1] == 'I' && ft_pdf_space(p[i - 1]) && ft_pdf_delim(p[i + 2])) break;
+            i += 2;
+        }
+#undef FT_OP
+        pend.len = 0;
+        num[0] = num[1] = 0;
+        in_array = 0;
+    }
+    free(pend.buf);
+}
+
+static size_t ft_inflate(const unsigned char *in, size_t n, unsigned char **out, size_t *cap) {
+    z_stream z;
+    memset(&z, 0, sizeof(z));
+    if (inflateInit(&z) != Z_OK) return 0;
+    z.next_in = (Bytef *)in;
+    z.avail_in = n > UINT_MAX ? UINT_MAX : (uInt)n;
+    size_t len = 0;
+    for (;;) {
+        if (len == *cap) {
+            size_t c = *cap ? *cap * 2 : 65536;
+            unsigned char *g = c <= FT_STREAM_MAX ? realloc(*out, c) : NULL;
+            if (!g) break;
+            *out = g;
+            *cap = c;
+        }
+        z.next_out = *out + len;
+        z.avail_out = (uInt)(*cap - len);
+        int rc = inflate(&z, Z_NO_FLUSH);
+        len = *cap - z.avail_out;
+        if (rc != Z_OK) break;
+    }
+    inflateEnd(&z);
+    return len;
+}
+
+static int ft_has(const unsigned char *d, size_t n, const char *key) {
+    return memmem(d, n, key, strlen(key)) != NULL;
+}
+
+/* Walks every stream of a PDF and feeds the ones that can hold page
+ * content to ft_pdf_content. Object numbers, the xref and page order are
+ * ignored: streams come in file order, which is page order for most
+ * writers. */
+static void ft_pdf(const unsigned char *p, size_t n, FtText *t) {
+    static const char *const skip[] = {
+        "/Image", "/FontFile", "/Length1", "/Type1C", "/CIDFontType0C", "/OpenType", "/ObjStm", "/XRef",
+        "/Metadata", "/EmbeddedFile", "/Predictor", "/DCT", "/JPX", "/CCITT", "/JBIG2", "/LZW", "/RunLength",
+        "/ASCII85", "/A85", "/ASCIIHex", "/AHx", NULL
+    };
+    if (memmem(p, n, "/Encrypt", 8)) return;
+    unsigned char *buf = NULL;
+    size_t cap = 0;
+    const unsigned char *end = p + n, *at = p;
+    while (!ft_full(t)) {
+        const unsigned char *k = memmem(at, end - at, "stream", 6);
+        if (!k) break;
+        at = k + 6;
+        if (k - p >= 3 && memcmp(k - 3, "end", 3) == 0) continue;
+        const unsigned char *data = at;
+        if (data < end && *data == '\r') data++;
+        if (data < end && *data == '\n') data++;
+        if (data == at) continue;
+        /* The stream's dictionary runs back to its "obj" header. */
+        const unsigned char *d = k;
+        while (d - p > 3 && k - d < 4096 && memcmp(d - 3, "obj", 3) != 0) d--;
+        size_t dn = k - d;
+        int skipped = 0;
+        for (int s = 0; skip[s] && !skipped; s++) skipped = ft_has(d, dn, skip[s]);
+        int flate = ft_has(d, dn, "/FlateDecode") || ft_has(d, dn, "/Fl ") || ft_has(d, dn, "/Fl/");
+        if (skipped || (ft_has(d, dn, "/Filter") && !flate)) continue;
+        const unsigned char *stop = memmem(data, end - data, "endstream", 9);
+        if (!stop) stop = end;
+        at = stop;
+        if (flate) {
+            size_t len = ft_inflate(data, stop - data, &buf, &cap);
+            ft_pdf_content(buf, len, t);
+        } else {
+            ft_pdf_content(data, stop - data, t);
+        }
+    }
+    free(buf);
+}
+
+/* ---- building ---- */
+
+/* One document of the index being built. */
+typedef struct {
+    const char *path;
+    const char *text;           /* into the old index, or owned */
+    char *owned;
+    size_t text_len;
+    uint64_t size;
+    int64_t mtime;
+    uint32_t tokens, type;
+    int err;                    /* errno from extraction */
+} FtBuildDoc;
+
+typedef struct {
+    const char *name;
+    uint32_t df, last;          /* documents so far, the last one's id */
+    uint8_t *buf;
+    size_t len, cap;
+} FtPost;
+
+typedef struct {
+    FtPost *terms;
+    size_t n, cap;
+    uint32_t *slots;            /* term index + 1, open addressing */
+    size_t nslots;
+    Arena names;
+} FtTerms;
+
+static void ft_terms_free(FtTerms *tt) {
+    for (size_t i = 0; i < tt->n; i++) free(tt->terms[i].buf);
+    free(tt->terms);
+    free(tt->slots);
+    arena_free(&tt->names);
+    memset(tt, 0, sizeof(*tt));
+}
+
+/* Index of term in the table, added if new; -1 when out of memory. */
+static long ft_term_id(FtTerms *tt, const char *term) {
+    if (2 * (tt->n + 1) > tt->nslots) {
+        size_t ns = tt->nslots ? tt->nslots * 2 : 65536;
+        uint32_t *g = calloc(ns, sizeof(uint32_t));
+        if (!g) return -1;
+        for (size_t i = 0; i < tt->n; i++) {
+            size_t j = str_hash(tt->terms[i].name) & (ns - 1);
+            while (g[j]) j = (j + 1) & (ns - 1);
+            g[j] = (uint32_t)i + 1;
+        }
+        free(tt->slots);
+        tt->slots = g;
+        tt->nslots = ns;
+    }
+    size_t j = str_hash(term) & (tt->nslots - 1);
+    for (; tt->slots[j]; j = (j + 1) & (tt->nslots - 1))
+        if (strcmp(tt->terms[tt->slots[j] - 1].name, term) == 0) return tt->slots[j] - 1;
+    if (tt->n == tt->cap) {
+        size_t cap = tt->cap ? tt->cap * 2 : 4096;
+        FtPost *g = realloc(tt->terms, cap * sizeof(FtPost));
+        if (!g) return -1;
+        tt->terms = g;
+        tt->cap = cap;
+    }
+    FtPost *t = &tt->terms[tt->n];
+    memset(t, 0, sizeof(*t));
+    if (!(t->name = arena_strdup(&tt->names, term))) return -1;
+    tt->slots[j] = (uint32_t)tt->n + 1;
+    return (long)tt->n++;
+}
+
+static int ft_reserve(FtPost *t, size_t n) {
+    if (t->len + n <= t->cap) return 0;
+    size_t cap = t->cap ? t->cap * 2 : 16;
+    while (cap < t->len + n) cap *= 2;
+    uint8_t *g = realloc(t->buf, cap);
+    if (!g) return -1;
+    t->buf = g;
+    t->cap = cap;
+    return 0;
+}
+
+static void ft_put_varint(FtPost *t, uint64_t v) {
+    while (v >= 0x80) {
+        t->buf[t->len++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    t->buf[t->len++] = (uint8_t)v;
+}
+
+static const uint8_t *ft_get_varint(const uint8_t *p, const uint8_t *end, uint64_t *v) {
+    uint64_t x = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        uint8_t b = *p++;
+        x |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) { *v = x; return p; }
+    }
+    *v = 0;
+    return end;
+}
+
+/* Starts doc's entry in t's list, with the doc id delta and the count. */
+static int ft_begin_entry(FtPost *t, uint32_t doc, uint64_t tf, size_t more) {
+    if (ft_reserve(t, 20 + more) != 0) return -1;
+    ft_put_varint(t, t->df ? doc - t->last : doc);
+    ft_put_varint(t, tf);
+    t->last = doc;
+    t->df++;
+    return 0;
+}
+
+/* Bytes of the separator at s[i] (1-3), or 0 if s[i] starts a word character. */
+static size_t ft_sep(const unsigned char *s, size_t n, size_t i) {
+    unsigned c = s[i];
+    if (c < 0x80) return (c >= '0' && c <= '9') || ((c | 0x20) >= 'a' && (c | 0x20) <= 'z') ? 0 : 1;
+    if (c == 0xe2 && i + 2 < n && (s[i + 1] == 0x80 || s[i + 1] == 0x81)) return 3;
+    if (c == 0xc2 && i + 1 < n && s[i + 1] >= 0xa0 && s[i + 1] <= 0xbf) return 2;
+    return 0;
+}
+
+/* Next word of s from *at: lower-cased into term and cut at FT_TERM_MAX
+ * bytes. Letters, digits and non-ASCII characters make up words, except
+ * the Latin-1 symbols and general punctuation (U+00A0-U+00BF and
+ * U+2000-U+206F), which separate them like ASCII punctuation does.
+ * Returns the word's length, 0 at the end; *start gets its offset. */
+static size_t ft_word(const char *text, size_t n, size_t *at, char term[FT_TERM_MAX + 1], size_t *start) {
+    const unsigned char *s = (const unsigned char *)text;
+    size_t i = *at, sep;
+    while (i < n && (sep = ft_sep(s, n, i)) != 0) i += sep;
+    size_t len = 0;
+    *start = i;
+    while (i < n && ft_sep(s, n, i) == 0) {
+        unsigned char c = s[i++];
+        if (len < FT_TERM_MAX) term[len++] = (char)(c >= 'A' && c <= 'Z' ? c + 32 : c);
+    }
+    term[len] = '\0';
+    *at = i;
+    return len;
+}
+
+typedef struct {
+    uint32_t term, pos;
+} FtTok;
+
+static int ft_tok_cmp(const void *a, const void *b) {
+    const FtTok *x = a, *y = b;
+    if (x->term != y->term) return x->term < y->term ? -1 : 1;
+    return x->pos < y->pos ? -1 : x->pos > y->pos;
+}
+
+/* Tokenizes a new document and appends its postings. */
+static int ft_add_doc(FtTerms *tt, uint32_t doc, FtBuildDoc *d, FtTok **toks, size_t *cap) {
+    char term[FT_TERM_MAX + 1];
+    size_t at = 0, start, n = 0;
+    while (ft_word(d->text, d->text_len, &at, term, &start)) {
+        long id = ft_term_id(tt, term);
+        if (id < 0) return -1;
+        if (n == *cap) {
+            size_t c = *cap ? *cap * 2 : 4096;
+            FtTok *g = realloc(*toks, c * sizeof(FtTok));
+            if (!g) return -1;
+            *toks = g;
+            *cap = c;
+        }
+        (*toks)[n].term = (uint32_t)id;
+        (*toks)[n].pos = (uint32_t)n;
+        n++;
+    }
+    d->tokens = (uint32_t)n;
+    qsort(*toks, n, sizeof(FtTok), ft_tok_cmp);
+    for (size_t i = 0, j; i < n; i = j) {
+        for (j = i + 1; j < n && (*toks)[j].term == (*toks)[i].term; j++) {}
+        FtPost *t = &tt->terms[(*toks)[i].term];
+        if (ft_begin_entry(t, doc, j - i, 5 * (j - i)) != 0) return -1;
+        for (size_t k = i; k < j; k++) ft_put_varint(t, (*toks)[k].pos - (k > i ? (*toks)[k - 1].pos : 0));
+    }
+    return 0;
+}
+
+/* Copies the old index's postings of the documents being kept, with their
+ * ids renumbered by remap (-1 for dropped documents). Positions are
+ * copied as they are. */
+static int ft_carry(FtTerms *tt, const FtIndex *old, const int32_t *remap) {
+    for (uint32_t k = 0; k < old->nterms; k++) {
+        const uint8_t *p, *end;
+        ft_term_list(old, k, &p, &end);
+        long id = -1;
+        uint64_t doc = 0;
+        for (uint32_t j = 0; j < old->terms[k].df && p < end; j++) {
+            uint64_t delta, tf;
+            p = ft_get_varint(p, end, &delta);
+            p = ft_get_varint(p, end, &tf);
+            doc = j ? doc + delta : delta;
+            const uint8_t *pos = p;
+            for (uint64_t i = 0; i < tf && p < end; i++) while (p < end && (*p++ & 0x80)) {}
+            if (doc >= old->ndocs || remap[doc] < 0) continue;
+            if (id < 0 && (id = ft_term_id(tt, ft_term_name(old, k))) < 0) return -1;
+            FtPost *t = &tt->terms[id];
+            if (ft_begin_entry(t, (uint32_t)remap[doc], tf, (size_t)(p - pos)) != 0) return -1;
+            memcpy(t->buf + t->len, pos, (size_t)(p - pos));
+            t->len += (size_t)(p - pos);
+        }
+    }
+    return 0;
+}
+
+typedef struct {
+    FtBuildDoc *docs;
+    size_t n, next;             /* next is claimed atomically */
+    int root_fd;
+    uint64_t bytes;
+} FtJob;
+
+static void ft_extract(FtJob *job, FtBuildDoc *d) {
+    int kind = (int)d->type;
+    int fd = openat(job->root_fd, d->path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    struct stat st;
+    d->type = FT_NONE;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        d->err = errno;
+        if (fd >= 0) close(fd);
+        return;
+    }
+    d->size = st.st_size;
+    d->mtime = stat_mtime_ns(&st);
+    FtText t = { NULL, 0, 0 };
+    if (kind == FT_PDF) {
+        void *m = st.st_size > 0 && st.st_size <= FT_PDF_MAX ? mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)
+                                                              : MAP_FAILED;
+        if (m != MAP_FAILED) {
+            madvise(m, st.st_size, MADV_SEQUENTIAL);
+            ft_pdf(m, st.st_size, &t);
+            munmap(m, st.st_size);
+            __atomic_add_fetch(&job->bytes, (uint64_t)st.st_size, __ATOMIC_RELAXED);
+            d->type = FT_PDF;
+        }
+    } else if (st.st_size > 0) {
+        size_t want = st.st_size < FT_RAW_MAX ? (size_t)st.st_size : FT_RAW_MAX;
+        unsigned char *raw = malloc(want);
+        ssize_t got = raw ? pread_full(fd, raw, want, 0) : -1;
+        if (got < 0) {
+            d->err = raw ? errno : ENOMEM;
+        } else if (!memchr(raw, 0, got < 4096 ? (size_t)got : 4096)) {
+            size_t len = kind == FT_MARKUP ? ft_strip_markup(raw, (size_t)got) : (size_t)got;
+            ft_bytes(&t, raw, len);
+            d->type = FT_TEXT;
+        }
+        if (got > 0) __atomic_add_fetch(&job->bytes, (uint64_t)got, __ATOMIC_RELAXED);
+        free(raw);
+    } else {
+        d->type = FT_TEXT;
+    }
+    close(fd);
+    d->owned = t.buf;
+    d->text = t.buf;
+    d->text_len = t.len;
+}
+
+static void *ft_extract_thread(void *arg) {
+    FtJob *job = arg;
+    size_t k;
+    while ((k = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->n) ft_extract(job, &job->docs[k]);
+    return NULL;
+}
+
+static int ft_name_cmp(const void *a, const void *b) {
+    return strcmp((*(FtPost *const *)a)->name, (*(FtPost *const *)b)->name);
+}
+
+typedef struct {
+    int fd, ok;
+    char *buf;
+    size_t len;
+    uint64_t off;
+} FtOut;
+
+static void ft_flush(FtOut *o) {
+    if (o->ok && o->len && write_all(o->fd, o->buf, o->len) != 0) o->ok = 0;
+    o->len = 0;
+}
+
+static void ft_emit(FtOut *o, const void *p, size_t n) {
+    o->off += n;
+    if (!o->ok || n == 0) return;
+    if (o->len + n > FT_OUT_BUF) {
+        ft_flush(o);
+        if (n >= FT_OUT_BUF) {
+            if (write_all(o->fd, p, n) != 0) o->ok = 0;
+            return;
+        }
+    }
+    memcpy(o->buf + o->len, p, n);
+    o->len += n;
+}
+
+static void ft_pad(FtOut *o) {
+    static const char zero[8];
+    ft_emit(o, zero, (size_t)(-o->off & 7));
+}
+
+/* Writes docs and the terms with postings to path, atomically. */
+static int ft_write(const char *path, const struct stat *root, const FtBuildDoc *docs, size_t ndocs,
+                    const FtTerms *tt) {
+    FtPost **order = malloc((tt->n ? tt->n : 1) * sizeof(FtPost *));
+    FtDoc *table = calloc(ndocs ? ndocs : 1, sizeof(FtDoc));
+    FtTerm *terms = malloc((tt->n ? tt->n : 1) * sizeof(FtTerm));
+    FtOut o = { -1, 1, malloc(FT_OUT_BUF), 0, 0 };
+    int ok = order && table && terms && o.buf;
+    size_t nterms = 0;
+    FtHdr h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, FT_MAGIC, 8);
+    h.dev = root->st_dev;
+    h.ino = root->st_ino;
+    for (size_t i = 0; ok && i < tt->n; i++) if (tt->terms[i].df) order[nterms++] = &tt->terms[i];
+    if (ok) qsort(order, nterms, sizeof(FtPost *), ft_name_cmp);
+    for (size_t i = 0; ok && i < ndocs; i++) {
+        table[i].size = docs[i].size;
+        table[i].mtime = docs[i].mtime;
+        table[i].text_off = h.text_len;
+        table[i].text_len = (uint32_t)docs[i].text_len;
+        table[i].path_off = (uint32_t)h.paths_len;
+        table[i].tokens = docs[i].tokens;
+        table[i].type = docs[i].type;
+        h.text_len += docs[i].text_len;
+        h.paths_len += strlen(docs[i].path) + 1;
+        h.tokens += docs[i].tokens;
+    }
+    for (size_t i = 0; ok && i < nterms; i++) {
+        terms[i].post_off = h.post_len;
+        terms[i].name_off = (uint32_t)h.tpool_len;
+        terms[i].df = order[i]->df;
+        h.post_len += order[i]->len;
+        h.tpool_len += strlen(order[i]->name) + 1;
+    }
+    ok = ok && h.paths_len <= UINT32_MAX && h.tpool_len <= UINT32_MAX;
+    h.ndocs = (uint32_t)ndocs;
+    h.nterms = (uint32_t)nterms;
+    uint64_t off = (sizeof(h) + 7) & ~7ULL;
+#define FT_PLACE(field, bytes) (h.field = off, off = (off + (bytes) + 7) & ~7ULL)
+    FT_PLACE(off_docs, ndocs * sizeof(FtDoc));
+    FT_PLACE(off_paths, h.paths_len);
+    FT_PLACE(off_text, h.text_len);
+    FT_PLACE(off_terms, nterms * sizeof(FtTerm));
+    FT_PLACE(off_tpool, h.tpool_len);
+    FT_PLACE(off_post, h.post_len);
+#undef FT_PLACE
+    h.file_len = off;
+
+    char tmp[PATH_MAX + 16];
+    snprintf(tmp, sizeof(tmp), "%s.%ld", path, (long)getpid());
+    if (ok) o.fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    o.ok = ok && o.fd >= 0;
+    /* Sections go out in header order, each padded to 8 bytes. */
+    ft_emit(&o, &h, sizeof(h));
+    ft_pad(&o);
+    ft_emit(&o, table, ndocs * sizeof(FtDoc));
+    ft_pad(&o);
+    for (size_t i = 0; i < ndocs && o.ok; i++) ft_emit(&o, docs[i].path, strlen(docs[i].path) + 1);
+    ft_pad(&o);
+    for (size_t i = 0; i < ndocs && o.ok; i++) ft_emit(&o, docs[i].text, docs[i].text_len);
+    ft_pad(&o);
+    ft_emit(&o, terms, nterms * sizeof(FtTerm));
+    ft_pad(&o);
+    for (size_t i = 0; i < nterms && o.ok; i++) ft_emit(&o, order[i]->name, strlen(order[i]->name) + 1);
+    ft_pad(&o);
+    for (size_t i = 0; i < nterms && o.ok; i++) ft_emit(&o, order[i]->buf, order[i]->len);
+    ft_pad(&o);
+    ft_flush(&o);
+    ok = o.ok && o.off == h.file_len;
+    free(o.buf);
+    free(order);
+    free(table);
+    free(terms);
+    if (o.fd >= 0 && close(o.fd) != 0) ok = 0;
+    if (!ok || rename(tmp, path) != 0) {
+        int err = errno ? errno : ENOMEM;
+        if (o.fd >= 0) unlink(tmp);
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+/* Brings the full-text index at path up to date with the workspace index
+ * ws. On success ix holds the current index. */
+static int ft_refresh(Run *run, int root_fd, const struct stat *root, const char *path, const WsIndex *ws,
+                      FtIndex *ix, int jobs, FtStats *st) {
+    double t0 = now_us();
+    memset(st, 0, sizeof(*st));
+    StrSet old = { NULL, NULL, 0, 0 };
+    for (uint32_t d = 0; d < ix->ndocs; d++) strset_add(&old, ft_doc_path(ix, d), (int)d + 1);
+    uint8_t *keep = calloc(ix->ndocs ? ix->ndocs : 1, 1);
+    int32_t *remap = malloc((ix->ndocs ? ix->ndocs : 1) * sizeof(int32_t));
+    FtBuildDoc *docs = NULL;
+    size_t ndocs = 0, cap = 0, nfresh = 0;
+    Arena names = { NULL, 0 };
+    FtBuildDoc *fresh = NULL;
+    int rc = keep && remap ? 0 : -1;
+
+    /* Files of a kind we read, split into kept documents and fresh ones. */
+    for (uint32_t i = 1; rc == 0 && i < ws->count; i++) {
+        int kind = ft_kind(ws_name(ws, i));
+        if ((ws->kind[i] & 3) != WS_FILE || kind == FT_NONE) continue;
+        char buf[PATH_MAX];
+        const char *rel = ws_path(ws, i, buf, sizeof(buf));
+        struct stat fst;
+        if (fstatat(root_fd, rel, &fst, AT_SYMLINK_NOFOLLOW) != 0 || !S_ISREG(fst.st_mode)) continue;
+        int o = strset_get(&old, rel) - 1;
+        if (o >= 0 && ix->docs[o].size == (uint64_t)fst.st_size && ix->docs[o].mtime == stat_mtime_ns(&fst)) {
+            keep[o] = 1;
+            continue;
+        }
+        if (nfresh == cap) {
+            cap = cap ? cap * 2 : 256;
+            FtBuildDoc *g = realloc(fresh, cap * sizeof(FtBuildDoc));
+            if (!g) { rc = -1; break; }
+            fresh = g;
+        }
+        FtBuildDoc *d = &fresh[nfresh];
+        memset(d, 0, sizeof(*d));
+        if (!(d->path = arena_strdup(&names, rel))) { rc = -1; break; }
+        d->type = (uint32_t)kind;
+        nfresh++;
+    }
+    strset_clear(&old);
+    for (uint32_t d = 0; rc == 0 && d < ix->ndocs; d++) {
+        remap[d] = keep[d] ? (int32_t)st->kept++ : -1;
+        if (!keep[d]) st->removed++;
+    }
+
+    if (rc == 0 && !nfresh && !st->removed && ix->map) {
+        st->documents = ix->ndocs;
+    } else if (rc == 0) {
+        /* Kept documents keep their order and come first. */
+        ndocs = (size_t)st->kept + nfresh;
+        docs = calloc(ndocs ? ndocs : 1, sizeof(FtBuildDoc));
+        if (!docs) rc = -1;
+        for (uint32_t d = 0, n = 0; rc == 0 && d < ix->ndocs; d++) {
+            if (!keep[d]) continue;
+            FtBuildDoc *b = &docs[n++];
+            b->path = ft_doc_path(ix, d);
+            b->text = ft_doc_text(ix, d, &b->text_len);
+            b->size = ix->docs[d].size;
+            b->mtime = ix->docs[d].mtime;
+            b->tokens = ix->docs[d].tokens;
+            b->type = ix->docs[d].type;
+        }
+        if (rc == 0 && nfresh) {
+            memcpy(docs + st->kept, fresh, nfresh * sizeof(FtBuildDoc));
+            long n = jobs > 0 ? jobs : sysconf(_SC_NPROCESSORS_ONLN);
+            int threads = (int)(n < 1 ? 1 : n > FT_MAX_THREADS ? FT_MAX_THREADS : n);
+            if ((size_t)threads > nfresh) threads = (int)nfresh;
+            FtJob job = { docs + st->kept, nfresh, 0, root_fd, 0 };
+            op_begin(run);
+            vx_parallel(ft_extract_thread, &job, 0, threads);
+            op_set_bytes(run, job.bytes);
+            add_op_ref(run, "ftindex", "Extract document text", "read(2)", path, NULL, NULL, NULL, 1, NULL);
+            st->extracted = (long)nfresh;
+            st->bytes_read = job.bytes;
+            for (size_t k = 0; k < nfresh; k++) {
+                const FtBuildDoc *d = &docs[st->kept + k];
+                if (!d->err) continue;
+                st->failed++;
+                add_op(run, "ftindex", "Extract document text", "openat(2)", d->path, NULL, 0, strerror(d->err));
+            }
+        }
+        FtTerms tt;
+        memset(&tt, 0, sizeof(tt));
+        FtTok *toks = NULL;
+        size_t tcap = 0;
+        if (rc == 0 && ix->map) rc = ft_carry(&tt, ix, remap);
+        for (size_t k = 0; rc == 0 && k < nfresh; k++)
+            rc = ft_add_doc(&tt, (uint32_t)(st->kept + k), &docs[st->kept + k], &toks, &tcap);
+        free(toks);
+        if (rc == 0) {
+            op_begin(run);
+            rc = ft_write(path, root, docs, ndocs, &tt);
+            add_op_ref(run, "ftindex", "Replace full-text index", "rename(2)", path, NULL, NULL, NULL, rc == 0,
+                       rc == 0 ? NULL : strerror(errno));
+        }
+        ft_terms_free(&tt);
+        for (size_t k = 0; docs && k < nfresh; k++) free(docs[st->kept + k].owned);
+        if (rc == 0) {
+            ft_close(ix);
+            rc = ft_open(ix, path, root);
+        }
+        st->documents = (long)ndocs;
+    }
+    int err = errno;
+    free(docs);
+    free(fresh);
+    free(keep);
+    free(remap);
+    arena_free(&names);
+    st->ms = (now_us() - t0) / 1000;
+    errno = err ? err : ENOMEM;
+    return rc;
+}
+
+static void ft_print_stats(Run *run, const FtIndex *ix, const FtStats *st) {
+    out_printf(run, "{\"documents\":%u,\"terms\":%u,\"tokens\":%llu,\"bytes\":%zu,\"extracted\":%ld,"
+               "\"kept\":%ld,\"removed\":%ld,\"failed\":%ld,\"bytesRead\":%llu,\"ms\":%.3f}",
+               ix->ndocs, ix->nterms, (unsigned long long)ix->tokens, ix->map_len, st->extracted, st->kept,
+               st->removed, st->failed, (unsigned long long)st->bytes_read, st->ms);
+}
+
+/* ---- queries ---- */
+
+/* One term's postings, decoded down to where its positions start. */
+typedef struct {
+    uint32_t *doc, *tf;
+    const uint8_t **at;
+    const uint8_t *end;
+    size_t n;
+} FtList;
+
+/* Documents matching part of a query, ascending by id. */
+typedef struct {
+    uint32_t *doc, *pos;        /* pos: token position of the first match */
+    double *score;
+    size_t n;
+} FtHits;
+
+static void ft_list_free(FtList *l) {
+    free(l->doc);
+    free(l->tf);
+    free((void *)l->at);
+    memset(l, 0, sizeof(*l));
+}
+
+static void ft_hits_free(FtHits *h) {
+    free(h->doc);
+    free(h->pos);
+    free(h->score);
+    memset(h, 0, sizeof(*h));
+}
+
+static int ft_hits_alloc(FtHits *h, size_t n) {
+    h->n = 0;
+    h->doc = malloc((n ? n : 1) * sizeof(uint32_t));
+    h->pos = malloc((n ? n : 1) * sizeof(uint32_t));
+    h->score = malloc((n ? n : 1) * sizeof(double));
+    if (h->doc && h->pos && h->score) return 0;
+    ft_hits_free(h);
+    return -1;
+}
+
+static int ft_list(const FtIndex *ix, const char *term, FtList *l) {
+    memset(l, 0, sizeof(*l));
+    uint32_t lo = 0, hi = ix->nterms;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (strcmp(ft_term_name(ix, mid), term) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo == ix->nterms || strcmp(ft_term_name(ix, lo), term) != 0) return 0;
+    const uint8_t *p;
+    uint32_t df = ix->terms[lo].df;
+    ft_term_list(ix, lo, &p, &l->end);
+    if ((size_t)(l->end - p) / 2 < df) df = (uint32_t)((l->end - p) / 2);
+    l->doc = malloc((df ? df : 1) * sizeof(uint32_t));
+    l->tf = malloc((df ? df : 1) * sizeof(uint32_t));
+    l->at = malloc((df ? df : 1) * sizeof(uint8_t *));
+    if (!l->doc || !l->tf || !l->at) {
+        ft_list_free(l);
+        return -1;
+    }
+    uint64_t doc = 0;
+    for (uint32_t j = 0; j < df && p < l->end; j++) {
+        uint64_t delta, tf;
+        p = ft_get_varint(p, l->end, &delta);
+        p = ft_get_varint(p, l->end, &tf);
+        doc = j ? doc + delta : delta;
+        if (doc >= ix->ndocs || (l->n && doc <= l->doc[l->n - 1])) break;
+        l->doc[l->n] = (uint32_t)doc;
+        l->tf[l->n] = (uint32_t)tf;
+        l->at[l->n++] = p;
+        for (uint64_t i = 0; i < tf && p < l->end; i++) while (p < l->end && (*p++ & 0x80)) {}
+    }
+    return 0;
+}
+
+/* Decodes up to max of the tf positions starting at p. */
+static size_t ft_positions(const uint8_t *p, const uint8_t *end, uint32_t tf, uint32_t *out, size_t max) {
+    uint64_t pos = 0, v;
+    size_t n = 0;
+    for (uint32_t i = 0; i < tf && n < max && p < end; i++) {
+        p = ft_get_varint(p, end, &v);
+        pos = i ? pos + v : v;
+        out[n++] = (uint32_t)pos;
+    }
+    return n;
+}
+
+static double ft_bm25(const FtIndex *ix, size_t df, uint32_t tf, uint32_t doc) {
+    double n = ix->ndocs, avg = ix->ndocs ? (double)ix->tokens / ix->ndocs : 1;
+    double idf = log(1 + (n - df + 0.5) / (df + 0.5));
+    double len = ix->docs[doc].tokens;
+    return idf * tf * 2.2 / (tf + 1.2 * (0.25 + 0.75 * len / (avg > 0 ? avg : 1)));
+}
+
+/* Documents containing terms[0..nt) one after another. */
+static int ft_atom(const FtIndex *ix, char terms[][FT_TERM_MAX + 1], int nt, FtHits *h) {
+    FtList l[FT_PHRASE_MAX];
+    int rc = 0;
+    memset(l, 0, sizeof(l));
+    memset(h, 0, sizeof(*h));
+    for (int t = 0; t < nt; t++) if (rc == 0 && ft_list(ix, terms[t], &l[t]) != 0) rc = -1, nt = t;
+    if (rc != 0 || ft_hits_alloc(h, l[0].n) != 0) {
+        for (int t = 0; t < nt; t++) ft_list_free(&l[t]);
+        return -1;
+    }
+    uint32_t *cand = NULL, *next = NULL;
+    size_t cap = 0, at[FT_PHRASE_MAX] = { 0 };
+    for (size_t i = 0; i < l[0].n && rc == 0; i++) {
+        uint32_t doc = l[0].doc[i], count = l[0].tf[i], first = 0;
+        int all = 1;
+        for (int t = 1; t < nt && all; t++) {
+            while (at[t] < l[t].n && l[t].doc[at[t]] < doc) at[t]++;
+            all = at[t] < l[t].n && l[t].doc[at[t]] == doc;
+        }
+        if (!all) continue;
+        if (nt == 1) {
+            ft_positions(l[0].at[i], l[0].end, 1, &first, 1);
+        } else {
+            /* Keep the first word's positions p that have word t at p + t. */
+            size_t need = l[0].tf[i];
+            for (int t = 1; t < nt; t++) if (l[t].tf[at[t]] > need) need = l[t].tf[at[t]];
+            if (need > cap) {
+                uint32_t *a = realloc(cand, need * sizeof(uint32_t)), *b = a ? realloc(next, need * sizeof(uint32_t)) : NULL;
+                if (a) cand = a;
+                if (!b) { rc = -1; break; }
+                next = b;
+                cap = need;
+            }
+            size_t nc = ft_positions(l[0].at[i], l[0].end, l[0].tf[i], cand, cap);
+            for (int t = 1; t < nt && nc; t++) {
+                size_t nn = ft_positions(l[t].at[at[t]], l[t].end, l[t].tf[at[t]], next, cap), k = 0, m = 0;
+                for (size_t c = 0; c < nc; c++) {
+                    while (k < nn && next[k] < cand[c] + (uint32_t)t) k++;
+                    if (k < nn && next[k] == cand[c] + (uint32_t)t) cand[m++] = cand[c];
+                }
+                nc = m;
+            }
+            if (!nc) continue;
+            count = (uint32_t)nc;
+            first = cand[0];
+        }
+        h->doc[h->n] = doc;
+        h->pos[h->n] = first;
+        h->score[h->n++] = count;
+    }
+    for (size_t i = 0; i < h->n; i++) h->score[i] = ft_bm25(ix, h->n, (uint32_t)h->score[i], h->doc[i]);
+    free(cand);
+    free(next);
+    for (int t = 0; t < nt; t++) ft_list_free(&l[t]);
+    if (rc != 0) ft_hits_free(h);
+    return rc;
+}
+
+enum { FT_AND, FT_OR, FT_NOT };
+
+/* a = a AND/OR/NOT b, by doc id; b is freed. Scores add up, and the first
+ * match comes from a unless only b has the document. */
+static int ft_merge(FtHits *a, FtHits *b, int how) {
+    FtHits r;
+    int rc = ft_hits_alloc(&r, a->n + b->n);
+    for (size_t i = 0, j = 0; rc == 0 && (i < a->n || j < b->n);) {
+        int side = i == a->n ? 1 : j == b->n ? -1 : a->doc[i] < b->doc[j] ? -1 : a->doc[i] > b->doc[j];
+        int take = how == FT_OR || (how == FT_AND && side == 0) || (how == FT_NOT && side < 0);
+        if (take) {
+            const FtHits *src = side > 0 ? b : a;
+            size_t k = side > 0 ? j : i;
+            r.doc[r.n] = src->doc[k];
+            r.pos[r.n] = how == FT_OR && side == 0 && b->pos[j] < a->pos[i] ? b->pos[j] : src->pos[k];
+            r.score[r.n++] = (side <= 0 ? a->score[i] : 0) + (side >= 0 && how != FT_NOT ? b->score[j] : 0);
+        }
+        if (side <= 0) i++;
+        if (side >= 0) j++;
+    }
+    ft_hits_free(b);
+    if (rc != 0) return -1;
+    ft_hits_free(a);
+    *a = r;
+    return 0;
+}
+
+typedef struct {
+    char terms[FT_PHRASE_MAX][FT_TERM_MAX + 1];
+    int n, neg, or_prev;        /* or_prev: one clause with the atom before */
+} FtAtom;
+
+/* Splits a query into atoms; a word that splits into several terms
+ * ("e-mail") is matched as a phrase. Returns the count or -1. */
+static int ft_parse(const char *q, FtAtom *atoms) {
+    int n = 0, neg = 0, or_next = 0;
+    size_t len = strlen(q);
+    for (size_t i = 0; i < len;) {
+        if (q[i] == ' ' || q[i] == '\t') { i++; continue; }
+        size_t from, to;
+        int quoted = q[i] == '"';
+        if (q[i] == '-' && i + 1 < len && q[i + 1] != ' ') { neg = 1; i++; continue; }
+        if (quoted) {
+            from = ++i;
+            while (i < len && q[i] != '"') i++;
+            to = i++;
+        } else {
+            from = i;
+            while (i < len && q[i] != ' ' && q[i] != '\t') i++;
+            to = i;
+            if (to - from == 2 && memcmp(q + from, "OR", 2) == 0) { or_next = n > 0; continue; }
+            if (to - from == 3 && memcmp(q + from, "AND", 3) == 0) continue;
+            if (to - from == 3 && memcmp(q + from, "NOT", 3) == 0) { neg = 1; continue; }
+        }
+        if (n == FT_MAX_ATOMS) return -1;
+        FtAtom *a = &atoms[n];
+        size_t at = from, start;
+        a->n = 0;
+        while (a->n < FT_PHRASE_MAX && ft_word(q, to, &at, a->terms[a->n], &start)) a->n++;
+        if (!a->n) continue;
+        a->neg = neg;
+        a->or_prev = or_next && !neg && !atoms[n - 1].neg;
+        neg = or_next = 0;
+        n++;
+    }
+    return n;
+}
+
+typedef struct {
+    double score;
+    uint32_t k;                 /* index into the hits */
+} FtRank;
+
+static int ft_rank_cmp(const void *a, const void *b) {
+    const FtRank *x = a, *y = b;
+    if (x->score != y->score) return x->score > y->score ? -1 : 1;
+    return x->k < y->k ? -1 : x->k > y->k;
+}
+
+/* Writes a snippet of doc's text around token pos, on word boundaries,
+ * with line breaks turned into spaces. */
+static void ft_snippet(Run *run, const FtIndex *ix, uint32_t d, uint32_t pos) {
+    size_t len, at = 0, start = 0, word = 0;
+    const char *text = ft_doc_text(ix, d, &len);
+    char term[FT_TERM_MAX + 1];
+    for (uint32_t i = 0; i <= pos; i++)
+        if (!ft_word(text, len, &at, term, &start)) { start = at = 0; break; }
+    word = at;
+    size_t from = start > FT_SNIP_BEFORE ? start - FT_SNIP_BEFORE : 0;
+    size_t to = word + FT_SNIP_AFTER < len ? word + FT_SNIP_AFTER : len;
+    if (from > 0) {
+        while (from < start && text[from - 1] != ' ' && text[from - 1] != '\n') from++;
+    }
+    if (to < len) {
+        size_t k = to;
+        while (k > word && text[k] != ' ' && text[k] != '\n') k--;
+        if (k > word) to = k;
+        while (to > word && (text[to] & 0xc0) == 0x80) to--;
+    }
+    while (to > word && (text[to - 1] == ' ' || text[to - 1] == '\n')) to--;
+    char *buf = malloc(to - from + 7);
+    if (!buf) return;
+    size_t n = 0;
+    if (from > 0) { memcpy(buf, "...", 3); n = 3; }
+    for (size_t i = from; i < to; i++) buf[n++] = text[i] == '\n' ? ' ' : text[i];
+    if (to < len) { memcpy(buf + n, "...", 3); n += 3; }
+    buf[n] = '\0';
+    out_json(run, buf);
+    free(buf);
+}
+
+static const char *ft_query(Run *run, const FtIndex *ix, const char *q, long limit) {
+    FtAtom *atoms = malloc(FT_MAX_ATOMS * sizeof(FtAtom));
+    int n = atoms ? ft_parse(q, atoms) : -1;
+    if (n < 0) {
+        free(atoms);
+        return atoms ? "too many words in the query" : strerror(ENOMEM);
+    }
+    FtHits res, clause, part;
+    int have = 0, rc = 0;
+    memset(&res, 0, sizeof(res));
+    /* Positive clauses are intersected, each an OR of its atoms; then the
+     * negated atoms are taken out. */
+    for (int i = 0; i < n && rc == 0; i++) {
+        if (atoms[i].neg || atoms[i].or_prev) continue;
+        rc = ft_atom(ix, atoms[i].terms, atoms[i].n, &clause);
+        for (int j = i + 1; rc == 0 && j < n && (atoms[j].or_prev || atoms[j].neg); j++) {
+            if (atoms[j].neg) continue;
+            rc = ft_atom(ix, atoms[j].terms, atoms[j].n, &part);
+            if (rc == 0) rc = ft_merge(&clause, &part, FT_OR);
+        }
+        if (rc == 0 && have) rc = ft_merge(&res, &clause, FT_AND);
+        else if (rc == 0) res = clause, have = 1;
+        if (rc != 0) ft_hits_free(&clause);
+    }
+    for (int i = 0; i < n && rc == 0 && have; i++) {
+        if (!atoms[i].neg) continue;
+        rc = ft_atom(ix, atoms[i].terms, atoms[i].n, &part);
+        if (rc == 0) rc = ft_merge(&res, &part, FT_NOT);
+    }
+    free(atoms);
+    if (rc != 0 || !have) {
+        ft_hits_free(&res);
+        return rc != 0 ? strerror(ENOMEM) : "the query has no words to look for";
+    }
+    FtRank *order = malloc((res.n ? res.n : 1) * sizeof(FtRank));
+    if (!order) {
+        ft_hits_free(&res);
+        return strerror(ENOMEM);
+    }
+    for (size_t i = 0; i < res.n; i++) order[i].score = res.score[i], order[i].k = (uint32_t)i;
+    qsort(order, res.n, sizeof(FtRank), ft_rank_cmp);
+    out_puts(run, ",\"result\":{\"items\":[");
+    for (size_t i = 0; i < res.n && i < (size_t)limit; i++) {
+        uint32_t k = order[i].k, d = res.doc[k];
+        out_puts(run, i ? ",{\"path\":\"" : "{\"path\":\"");
+        out_json(run, ft_doc_path(ix, d));
+        out_printf(run, "\",\"type\":\"%s\",\"score\":%.4f,\"snippet\":\"", ft_type_name(ix->docs[d].type),
+                   res.score[k]);
+        ft_snippet(run, ix, d, res.pos[k]);
+        out_puts(run, "\"}");
+    }
+    out_printf(run, "],\"total\":%zu}", res.n);
+    free(order);
+    ft_hits_free(&res);
+    return NULL;
+}
+
+/* The cached text of each path, cut to max bytes on a character boundary. */
+static const char *ft_text(Run *run, const FtIndex *ix, char **paths, int npaths, long max) {
+    StrSet docs = { NULL, NULL, 0, 0 };
+    for (uint32_t d = 0; d < ix->ndocs; d++) strset_add(&docs, ft_doc_path(ix, d), (int)d + 1);
+    out_puts(run, ",\"result\":{\"items\":[");
+    for (int i = 0; i < npaths; i++) {
+        char rel[PATH_MAX];
+        int ok = meta_norm(paths[i], rel, sizeof(rel)) == 0;
+        int d = ok ? strset_get(&docs, rel) - 1 : -1;
+        out_puts(run, i ? ",{\"path\":\"" : "{\"path\":\"");
+        out_json(run, ok ? rel : paths[i]);
+        if (d < 0) {
+            out_puts(run, ok ? "\",\"error\":\"not indexed\"}" : "\",\"error\":\"invalid path\"}");
+            continue;
+        }
+        size_t len, cut;
+        const char *text = ft_doc_text(ix, (uint32_t)d, &len);
+        cut = len > (size_t)max ? (size_t)max : len;
+        while (cut < len && cut > 0 && (text[cut] & 0xc0) == 0x80) cut--;
+        char *buf = malloc(cut + 1);
+        if (buf) {
+            memcpy(buf, text, cut);
+            buf[cut] = '\0';
+        }
+        out_printf(run, "\",\"type\":\"%s\",\"length\":%zu,\"truncated\":%s,\"text\":\"",
+                   ft_type_name(ix->docs[d].type), len, cut < len ? "true" : "false");
+        if (buf) out_json(run, buf);
+        out_puts(run, "\"}");
+        free(buf);
+    }
+    out_puts(run, "]}");
+    strset_clear(&docs);
+    return NULL;
+}
+
+typedef struct {
+    int op;
+    char **args;
+    int nargs, jobs;
+    long limit, max;
+} FtReq;
+
+/* organizer_cli ftindex <workspace> [op ...]: refreshes against the
+ * workspace index, then answers from the mapped file. One refresh runs at
+ * a time per workspace; readers just map whatever file is current. */
+static int ft_run(Run *run, const char *workspace, const FtReq *rq) {
+    int root_fd = open(workspace, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    struct stat root;
+    char path[PATH_MAX], wpath[PATH_MAX];
+    WsIndex ws;
+    FtIndex ix;
+    FtStats st;
+    memset(&ws, 0, sizeof(ws));
+    memset(&ix, 0, sizeof(ix));
+    int err = 0, lock_fd = -1;
+    op_begin(run);
+    if (root_fd < 0 || fstat(root_fd, &root) != 0 || !cache_path("fulltext", &root, path, sizeof(path)) ||
+        !cache_path("workspace", &root, wpath, sizeof(wpath))) {
+        err = root_fd < 0 || errno ? errno : ENOENT;
+    } else if ((err = ws_current(root_fd, &root, wpath, &ws)) == 0) {
+        char lock[PATH_MAX + 8];
+        snprintf(lock, sizeof(lock), "%s.lock", path);
+        lock_fd = open(lock, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+        if (lock_fd < 0 || flock(lock_fd, LOCK_EX) != 0) err = errno;
+        if (!err && ft_open(&ix, path, &root) != 0) memset(&ix, 0, sizeof(ix));
+        if (!err && ft_refresh(run, root_fd, &root, path, &ws, &ix, rq->jobs, &st) != 0) err = errno;
+        if (lock_fd >= 0) close(lock_fd);
+    }
+    ws_close(&ws);
+    if (root_fd >= 0) close(root_fd);
+    if (err) {
+        ft_close(&ix);
+        jrn_error(run, strerror(err));
+        return -1;
+    }
+    print_ops(run);
+    const char *msg = NULL;
+    if (rq->op == FT_OP_REFRESH) {
+        out_puts(run, ",\"result\":");
+        ft_print_stats(run, &ix, &st);
+    } else {
+        /* The result is built aside: an error replaces it. */
+        Writer saved = run->out;
+        memset(&run->out, 0, sizeof(run->out));
+        msg = rq->op == FT_OP_QUERY ? ft_query(run, &ix, rq->args[0], rq->limit)
+                                    : ft_text(run, &ix, rq->args, rq->nargs, rq->max);
+        Writer result = run->out;
+        run->out = saved;
+        if (msg) {
+            out_puts(run, ",\"result\":null,\"error\":\"");
+            out_json(run, msg);
+            out_puts(run, "\"");
+        } else {
+            out_write(run, result.buf, result.len);
+        }
+        free(result.buf);
+        out_puts(run, ",\"index\":");
+        ft_print_stats(run, &ix, &st);
+    }
+    ft_close(&ix);
+    finish_json(run);
+    return msg ? -1 : 0;
+}
+
+/* ---- BULK MOVE AND BIN ----
+ * move <workspace> <from> <to> [<from> <to> ...]
+ * bin <workspace> trash <path> ... | restore <id> ... | purge <id> ...
+ *     [--background] [--jobs N] | list | import <name> <path> <deleted-ms> ...
+ * Every op takes any number of items, and with --stdin more follow on
+ * standard input, one per line (pairs and triples tab-separated). Each
+ * item gets one op record; the renames go through the I/O backend, so
+ * --io uring batches them.
+ *
+ * The bin is <workspace>/.bin. trash renames each item into it under an
+ * id with RENAME_NOREPLACE, so it never leaves the filesystem. The ids
+ * index a manifest, .bin/.manifest: a header, then fixed 64-byte slots
+ * (original path, type, size, time), and an id is the slot number and
+ * the slot's generation in hex. restore and purge therefore read and
+ * rewrite only the slots they name, and a stale id misses on the
+ * generation. Paths are kept in .bin/.paths, an append-only heap whose
+ * entries name their slot, so a slot pointing at the wrong entry is
+ * caught and found again by a scan. list rewrites the heap once most of
+ * it is dead. Free slots are chained from the header. A chain left stale
+ * by a crash is rebuilt the first time it hands out a slot in use.
+ *
+ * A trashed item's slot is made durable before the item is renamed, so a
+ * crash never leaves an item in the bin without its original path. The
+ * worst case is a slot whose item never arrived, and list frees such
+ * slots. Slots are freed without a sync after the item has left.
+ *
+ * purge first renames the items into .bin/.purge and frees their slots,
+ * so the bin never shows a half-deleted folder. The trees are then
+ * removed on --jobs threads. A work-stealing walk over the dedupe deques
+ * unlinks each directory's files through the directory's own fd. The
+ * directories are then removed deepest first. With --background the
+ * removal happens after the reply: in a detached process for the
+ * one-shot CLI, on a detached thread in serve mode. A later purge clears
+ * whatever an interrupted one left behind in .bin/.purge. */
+#define BIN_MAGIC "OBINMF01"
+#define BIN_DIR ".bin"
+#define BIN_PURGE ".purge"
+#define BIN_DEFAULT_JOBS 4
+#define BIN_MAX_JOBS 64
+#define BIN_HEAP_MIN (1u << 20)     /* smaller heaps are never rewritten */
+
+enum { BIN_FREE = 0, BIN_LIVE = 1 };
+enum { BIN_FILE, BIN_DIRECTORY };
+enum { BIN_OP_TRASH, BIN_OP_RESTORE, BIN_OP_PURGE, BIN_OP_LIST, BIN_OP_IMPORT, BIN_OP_MOVE };
+
+static const char *const bin_ops[] = { "trash", "restore", "purge", "list", "import" };
+static const char *const bin_done[] = { "trashed", "restored", "purged", "listed", "imported" };
+
+typedef struct {
+    char magic[8];
+    uint32_t free_head;         /* first free slot + 1, 0 for none */
+    uint32_t pad;
+    char reserved[48];
+} BinHdr;
+
+typedef struct {
+    uint32_t crc;               /* CRC-32C of the rest of the slot */
+    uint32_t gen;               /* bumped each time the slot is handed out */
+    uint32_t state, type;
+    uint32_t next_free;         /* free slots: the next free one + 1 */
+    uint32_t path_len;
+    uint64_t path_off;          /* of its BinPath in the heap */
+    int64_t deleted_ms;         /* since the epoch */
+    uint64_t size, ino;
+    char reserved[8];
+} BinSlot;
+
+/* Heap entry, followed by the path and a NUL. */
+typedef struct {
+    uint32_t slot, gen, len, pad;
+} BinPath;
+
+typedef struct {
+    int root_fd, bin_fd, mf_fd, heap_fd;
+    const char *bin_path;       /* <workspace>/.bin, for op records */
+    BinHdr hdr;
+    uint32_t nslots;
+    uint64_t heap_len;
+    uint8_t *claimed;           /* slots this call has already used */
+    uint32_t nclaimed;
+} Bin;
+
+typedef struct {
+    int op;
+    char **args;
+    long nargs;
+    int jobs, background;
+} BinReq;
+
+/* One item of a batch: its rename and what the reply says about it. */
+typedef struct {
+    IoReq req;
+    Run *run;
+    const Io *io;
+    const char *op;             /* "bin" or "move" */
+    int ofd, nfd;
+    const char *oname, *nname;  /* the rename, relative to ofd and nfd */
+    const char *rel;            /* workspace path */
+    const char *desc, *from, *to;
+    char id[17];
+    uint32_t slot;
+    BinSlot s;
+    int res;                    /* the rename's result */
+    const char *err;            /* the item failed before any rename */
+} BinItem;
+
+/* 0 when all len bytes were read. */
+static int bin_pread(int fd, void *buf, size_t len, off_t off) {
+    return pread_full(fd, buf, len, off) == (ssize_t)len ? 0 : -1;
+}
+
+static void bin_close(Bin *b) {
+    if (b->mf_fd >= 0) {
+        flock(b->mf_fd, LOCK_UN);
+        close(b->mf_fd);
+    }
+    if (b->heap_fd >= 0) close(b->heap_fd);
+    if (b->bin_fd >= 0) close(b->bin_fd);
+    if (b->root_fd >= 0) close(b->root_fd);
+    free(b->claimed);
+    b->mf_fd = b->heap_fd = b->bin_fd = b->root_fd = -1;
+    b->claimed = NULL;
+}
+
+/* Opens the workspace's bin, made on first use, and locks its manifest.
+ * Returns 0 or an errno. */
+static int bin_open(Bin *b, Run *run, const char *workspace) {
+    memset(b, 0, sizeof(*b));
+    b->root_fd = b->bin_fd = b->mf_fd = b->heap_fd = -1;
+    b->bin_path = arena_join(&run->arena, workspace, BIN_DIR);
+    struct stat st;
+    if ((b->root_fd = open(workspace, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0 ||
+        (mkdirat(b->root_fd, BIN_DIR, 0777) != 0 && errno != EEXIST) ||
+        (b->bin_fd = openat(b->root_fd, BIN_DIR, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC)) < 0 ||
+        (b->mf_fd = openat(b->bin_fd, ".manifest", O_RDWR | O_CREAT | O_CLOEXEC, 0644)) < 0 ||
+        (b->heap_fd = openat(b->bin_fd, ".paths", O_RDWR | O_CREAT | O_CLOEXEC, 0644)) < 0 ||
+        flock(b->mf_fd, LOCK_EX) != 0 || fstat(b->mf_fd, &st) != 0) {
+        int err = errno;
+        bin_close(b);
+        return err;
+    }
+    if (st.st_size == 0) {
+        memcpy(b->hdr.magic, BIN_MAGIC, 8);
+        if (pwrite(b->mf_fd, &b->hdr, sizeof(b->hdr), 0) != (ssize_t)sizeof(b->hdr)) {
+            int err = errno;
+            bin_close(b);
+            return err;
+        }
+    } else if (bin_pread(b->mf_fd, &b->hdr, sizeof(b->hdr), 0) != 0 || memcmp(b->hdr.magic, BIN_MAGIC, 8) != 0) {
+        bin_close(b);
+        return EBADMSG;
+    }
+    /* The file size, not the header, says how many slots there are: a
+     * crash may have cut the header update. */
+    b->nslots = st.st_size > (off_t)sizeof(BinHdr) ? (uint32_t)((st.st_size - sizeof(BinHdr)) / sizeof(BinSlot)) : 0;
+    if (fstat(b->heap_fd, &st) != 0) {
+        int err = errno;
+        bin_close(b);
+        return err;
+    }
+    b->heap_len = (uint64_t)st.st_size;
+    return 0;
+}
+
+static off_t bin_slot_off(uint32_t i) {
+    return (off_t)sizeof(BinHdr) + (off_t)i * (off_t)sizeof(BinSlot);
+}
+
+/* Reads slot i; -1 when it is past the end or fails its CRC. */
+static int bin_read_slot(const Bin *b, uint32_t i, BinSlot *s) {
+    if (i >= b->nslots || bin_pread(b->mf_fd, s, sizeof(*s), bin_slot_off(i)) != 0) return -1;
+    return s->crc == crc32c((const char *)s + 4, sizeof(*s) - 4) ? 0 : -1;
+}
+
+static int bin_write_slot(Bin *b, uint32_t i, BinSlot *s) {
+    s->crc = crc32c((const char *)s + 4, sizeof(*s) - 4);
+    if (pwrite(b->mf_fd, s, sizeof(*s), bin_slot_off(i)) != (ssize_t)sizeof(*s)) return -1;
+    if (i >= b->nslots) b->nslots = i + 1;
+    return 0;
+}
+
+static int bin_write_hdr(Bin *b) {
+    return pwrite(b->mf_fd, &b->hdr, sizeof(b->hdr), 0) == (ssize_t)sizeof(b->hdr) ? 0 : -1;
+}
+
+static void bin_format_id(char out[17], uint32_t slot, uint32_t gen) {
+    snprintf(out, 17, "%08x%08x", slot, gen);
+}
+
+/* Marks slot i as used by this call; 0 if it already was. */
+static int bin_claim(Bin *b, uint32_t i) {
+    if (i >= b->nclaimed) {
+        uint32_t n = b->nclaimed ? b->nclaimed : 1024;
+        while (n <= i) n *= 2;
+        uint8_t *g = realloc(b->claimed, n);
+        if (!g) return 0;
+        memset(g + b->nclaimed, 0, n - b->nclaimed);
+        b->claimed = g;
+        b->nclaimed = n;
+    }
+    if (b->claimed[i]) return 0;
+    b->claimed[i] = 1;
+    return 1;
+}
+
+/* Rechains every free (or torn) slot this call has not used. */
+static int bin_rebuild_free(Bin *b) {
+    b->hdr.free_head = 0;
+    for (uint32_t i = b->nslots; i-- > 0;) {
+        BinSlot s;
+        if (bin_read_slot(b, i, &s) == 0 && s.state == BIN_LIVE) continue;
+        if (i < b->nclaimed && b->claimed[i]) continue;
+        if (bin_read_slot(b, i, &s) != 0) memset(&s, 0, sizeof(s));
+        s.state = BIN_FREE;
+        s.next_free = b->hdr.free_head;
+        if (bin_write_slot(b, i, &s) != 0) return -1;
+        b->hdr.free_head = i + 1;
+    }
+    return 0;
+}
+
+/* A slot for a new item, with its generation bumped: the head of the free
+ * chain, or a new one at the end. */
+static int bin_alloc(Bin *b, uint32_t *slot, BinSlot *s) {
+    for (int pass = 0; pass < 2 && b->hdr.free_head; pass++) {
+        uint32_t i = b->hdr.free_head - 1;
+        if (bin_read_slot(b, i, s) == 0 && s->state == BIN_FREE && bin_claim(b, i)) {
+            b->hdr.free_head = s->next_free;
+            *slot = i;
+            s->gen++;
+            return 0;
+        }
+        if (bin_rebuild_free(b) != 0) return -1;
+    }
+    *slot = b->nslots;
+    memset(s, 0, sizeof(*s));
+    s->gen = 1;
+    return bin_claim(b, *slot) ? 0 : -1;
+}
+
+static int bin_release(Bin *b, uint32_t i, BinSlot *s) {
+    s->state = BIN_FREE;
+    s->next_free = b->hdr.free_head;
+    if (bin_write_slot(b, i, s) != 0) return -1;
+    b->hdr.free_head = i + 1;
+    return 0;
+}
+
+/* Appends slot's path to buf, the heap entries of this call. */
+static int bin_put_path(Bin *b, JrnBuf *buf, uint32_t slot, BinSlot *s, const char *path) {
+    size_t len = strlen(path), need = sizeof(BinPath) + len + 1;
+    if (buf->len + need > buf->cap) {
+        size_t cap = buf->cap ? buf->cap : 64 * 1024;
+        while (cap < buf->len + need) cap *= 2;
+        char *g = realloc(buf->buf, cap);
+        if (!g) return -1;
+        buf->buf = g;
+        buf->cap = cap;
+    }
+    BinPath p = { slot, s->gen, (uint32_t)len, 0 };
+    s->path_off = b->heap_len + buf->len;
+    s->path_len = (uint32_t)len;
+    memcpy(buf->buf + buf->len, &p, sizeof(p));
+    memcpy(buf->buf + buf->len + sizeof(p), path, len + 1);
+    buf->len += need;
+    return 0;
+}
+
+/* The heap entry of a live slot. When the slot points at the wrong one
+ * (a heap rewrite cut short), the heap is scanned for it and the slot
+ * fixed. Returns 0 with the path in out. */
+static int bin_path_of(Bin *b, uint32_t slot, BinSlot *s, char *out, size_t sz) {
+    BinPath p;
+    if (s->path_len < sz && s->path_off + sizeof(p) + s->path_len <= b->heap_len &&
+        bin_pread(b->heap_fd, &p, sizeof(p), (off_t)s->path_off) == 0 && p.slot == slot && p.gen == s->gen &&
+        p.len == s->path_len && bin_pread(b->heap_fd, out, p.len, (off_t)(s->path_off + sizeof(p))) == 0) {
+        out[p.len] = '\0';
+        return 0;
+    }
+    for (uint64_t off = 0; off + sizeof(p) <= b->heap_len; off += sizeof(p) + p.len + 1) {
+        if (bin_pread(b->heap_fd, &p, sizeof(p), (off_t)off) != 0) break;
+        if (p.slot != slot || p.gen != s->gen || p.len >= sz) continue;
+        if (bin_pread(b->heap_fd, out, p.len, (off_t)(off + sizeof(p))) != 0) break;
+        out[p.len] = '\0';
+        s->path_off = off;
+        s->path_len = p.len;
+        bin_write_slot(b, slot, s);
+        return 0;
+    }
+    return -1;
+}
+
+/* Looks an id up: its slot must be live with the same generation. */
+static const char *bin_lookup(Bin *b, const char *id, uint32_t *slot, BinSlot *s) {
+    uint32_t gen = 0;
+    *slot = 0;
+    if (strlen(id) != 16) return "not in the bin";
+    for (int i = 0; i < 16; i++) {
+        int d = ft_hex((unsigned char)id[i]);
+        if (d < 0) return "not in the bin";
+        if (i < 8) *slot = *slot << 4 | (uint32_t)d;
+        else gen = gen << 4 | (uint32_t)d;
+    }
+    if (bin_read_slot(b, *slot, s) != 0 || s->state != BIN_LIVE || s->gen != gen) return "not in the bin";
+    if (!bin_claim(b, *slot)) return "listed twice";
+    return NULL;
+}
+
+/* Normalizes a workspace path; NULL for the root, "..", or the bin. */
+static const char *bin_norm(Run *run, const char *path) {
+    char buf[PATH_MAX];
+    if (meta_norm(path, buf, sizeof(buf)) != 0 || !buf[0]) return NULL;
+    size_t n = strlen(BIN_DIR);
+    if (strncmp(buf, BIN_DIR, n) == 0 && (buf[n] == '\0' || buf[n] == '/')) return NULL;
+    return arena_strdup(&run->arena, buf);
+}
+
+/* mkdir -p for the directory that will hold rel, under dfd. */
+static void bin_make_parents(int dfd, const char *rel) {
+    char tmp[PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s", rel);
+    for (char *p = strchr(tmp, '/'); p; p = strchr(p + 1, '/')) {
+        *p = '\0';
+        mkdirat(dfd, tmp, 0777);
+        *p = '/';
+    }
+}
+
+static void bin_rename_done(IoReq *req, int res) {
+    BinItem *it = (BinItem *)req;
+    const char *label = io_label(it->io, "renameat2(2)", "io_uring RENAMEAT");
+    /* No RENAME_NOREPLACE on this filesystem: check, then rename. */
+    if (res == -EINVAL || res == -ENOSYS) {
+        res = move_noreplace(it->ofd, it->oname, it->nfd, it->nname) == 0 ? 0 : -errno;
+        label = "renameat(2)";
+    }
+    it->res = res;
+    op_begin_at(it->run, req->t_ns);
+    add_op_ref(it->run, it->op, it->desc, label, it->from, NULL, it->to, NULL, res >= 0,
+               res >= 0 ? NULL : strerror(-res));
+}
+
+/* Queues the rename of ofd/oname to nfd/nname for it on io. */
+static void bin_queue(BinItem *it, Io *io, int ofd, const char *oname, int nfd, const char *nname) {
+    it->io = io;
+    it->ofd = ofd;
+    it->oname = oname;
+    it->nfd = nfd;
+    it->nname = nname;
+    it->req.done = bin_rename_done;
+    io_renameat(io, &it->req, ofd, oname, nfd, nname, IO_RENAME_NOREPLACE);
+}
+
+/* Records an item that failed before its rename. */
+static void bin_fail(BinItem *it, const char *desc, const char *syscall, const char *err) {
+    it->err = err;
+    it->res = -1;
+    add_op_ref(it->run, it->op, desc, syscall, it->from, NULL, it->to, NULL, 0, err);
+}
+
+/* ---- tree removal ---- */
+
+typedef struct RmWorker {
+    struct RmWalk *walk;
+    int idx;
+    Run *run;                   /* NULL: failures are only counted */
+    Deque dq;
+    char *dents;
+    char **dirs;                /* every directory listed, for the rmdir pass */
+    size_t ndirs, cap;
+    long files, failed;
+    pthread_t tid;
+} RmWorker;
+
+typedef struct RmWalk {
+    const char *base;           /* for op records */
+    int base_fd;
+    RmWorker *workers;
+    int nworkers;
+    long pending;
+} RmWalk;
+
+static void rm_fail(RmWorker *w, const char *syscall, const char *rel, const char *name, int err) {
+    w->failed++;
+    if (!w->run) return;
+    const char *dir = arena_join(&w->run->arena, w->walk->base, rel);
+    add_op_ref(w->run, "bin", "Delete permanently", syscall, dir, name ? arena_strdup(&w->run->arena, name) : NULL,
+               NULL, NULL, 0, strerror(err));
+}
+
+static void rm_push(RmWorker *w, const char *rel, const char *name) {
+    size_t rl = strlen(rel), nl = strlen(name);
+    char *child = malloc(rl + nl + 2);
+    if (!child) return;
+    memcpy(child, rel, rl);
+    child[rl] = '/';
+    memcpy(child + rl + 1, name, nl + 1);
+    __atomic_add_fetch(&w->walk->pending, 1, __ATOMIC_ACQ_REL);
+    deque_push(&w->dq, child);
+}
+
+/* Unlinks rel's files and queues its subdirectories. Takes rel over. */
+static void rm_scan_dir(RmWorker *w, char *rel) {
+    RmWalk *k = w->walk;
+    if (w->ndirs == w->cap) {
+        size_t cap = w->cap ? w->cap * 2 : 256;
+        char **g = realloc(w->dirs, cap * sizeof(char *));
+        if (!g) { free(rel); return; }
+        w->dirs = g;
+        w->cap = cap;
+    }
+    w->dirs[w->ndirs++] = rel;
+    int dfd = openat(k->base_fd, rel, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    DirScan ds;
+    if (dfd < 0 || scan_open(&ds, dfd, w->dents) != 0) {
+        if (errno != ENOENT) rm_fail(w, dfd < 0 ? "openat(2)" : "getdents64(2)", rel, NULL, errno);
+        if (dfd >= 0) close(dfd);
+        return;
+    }
+    const char *name;
+    unsigned char type;
+    while ((name = scan_next(&ds, &type)) != NULL) {
+        if (type == DT_DIR) {
+            rm_push(w, rel, name);
+            continue;
+        }
+        if (unlinkat(dfd, name, 0) == 0) {
+            w->files++;
+        } else if (errno == EISDIR || (errno == EPERM && type == DT_UNKNOWN)) {
+            rm_push(w, rel, name);
+        } else if (errno != ENOENT) {
+            rm_fail(w, "unlinkat(2)", rel, name, errno);
+        }
+    }
+    scan_close(&ds);
+    close(dfd);
+}
+
+static void *rm_worker(void *arg) {
+    RmWorker *w = arg;
+    RmWalk *k = w->walk;
+    int idle = 0;
+    for (;;) {
+        char *rel = deque_pop(&w->dq);
+        for (int j = 1; !rel && j < k->nworkers; j++)
+            rel = deque_steal(&k->workers[(w->idx + j) % k->nworkers].dq);
+        if (!rel) {
+            if (__atomic_load_n(&k->pending, __ATOMIC_ACQUIRE) == 0) break;
+            if (++idle < 64) sched_yield();
+            else { struct timespec ts = { 0, 50000 }; nanosleep(&ts, NULL); }
+            continue;
+        }
+        idle = 0;
+        rm_scan_dir(w, rel);
+        __atomic_sub_fetch(&k->pending, 1, __ATOMIC_ACQ_REL);
+    }
+    return NULL;
+}
+
+static int rm_depth_cmp(const void *a, const void *b) {
+    const char *x = *(char *const *)a, *y = *(char *const *)b;
+    int dx = 0, dy = 0;
+    for (; *x; x++) dx += *x == '/';
+    for (; *y; y++) dy += *y == '/';
+    return dy - dx;
+}
+
+typedef struct {
+    long files, dirs, failed;
+} RmStats;
+
+/* Removes everything inside dir_fd on up to jobs threads, recording
+ * failures on run (when not NULL) against base. */
+static void rm_contents(Run *run, int dir_fd, const char *base, int jobs, RmStats *st) {
+    memset(st, 0, sizeof(*st));
+    if (jobs < 1) jobs = BIN_DEFAULT_JOBS;
+    if (jobs > BIN_MAX_JOBS) jobs = BIN_MAX_JOBS;
+    RmWalk k = { base, dir_fd, calloc(jobs, sizeof(RmWorker)), jobs, 0 };
+    if (!k.workers) { st->failed++; return; }
+    int ok = 1;
+    for (int i = 0; i < jobs && ok; i++) {
+        RmWorker *w = &k.workers[i];
+        w->walk = &k;
+        w->idx = i;
+        w->run = run ? (i ? run_child(run, i) : run) : NULL;
+        pthread_mutex_init(&w->dq.lock, NULL);
+        ok = (w->dents = malloc(DENTS_BUF)) != NULL && (!run || w->run);
+    }
+    /* Top-level entries: files go now, directories seed the walk. */
+    int top = ok ? dup(dir_fd) : -1;
+    DirScan ds;
+    if (top >= 0 && scan_open(&ds, top, k.workers[0].dents) == 0) {
+        const char *name;
+        unsigned char type;
+        int next = 0;
+        char **seeds = NULL;
+        size_t nseeds = 0, scap = 0;
+        while ((name = scan_next(&ds, &type)) != NULL) {
+            if (type != DT_DIR && unlinkat(dir_fd, name, 0) == 0) { st->files++; continue; }
+            if (type != DT_DIR && errno != EISDIR && errno != EPERM) {
+                if (errno != ENOENT) rm_fail(&k.workers[0], "unlinkat(2)", NULL, name, errno);
+                continue;
+            }
+            /* Listing is done before the walk starts: the workers share
+             * the getdents buffer of worker 0. */
+            if (nseeds == scap) {
+                scap = scap ? scap * 2 : 64;
+                char **g = realloc(seeds, scap * sizeof(char *));
+                if (!g) break;
+                seeds = g;
+            }
+            if (!(seeds[nseeds] = strdup(name))) break;
+            nseeds++;
+        }
+        scan_close(&ds);
+        for (size_t i = 0; i < nseeds; i++) {
+            __atomic_add_fetch(&k.pending, 1, __ATOMIC_ACQ_REL);
+            deque_push(&k.workers[next].dq, seeds[i]);
+            next = (next + 1) % jobs;
+        }
+        free(seeds);
+    } else if (ok) {
+        rm_fail(&k.workers[0], "getdents64(2)", NULL, NULL, errno);
+    }
+    if (top >= 0) close(top);
+
+    int started = 1;
+    for (int i = 1; ok && i < jobs; i++, started++)
+        if (pthread_create(&k.workers[i].tid, NULL, rm_worker, &k.workers[i]) != 0) break;
+    if (ok) rm_worker(&k.workers[0]);
+    for (int i = 1; i < started; i++) pthread_join(k.workers[i].tid, NULL);
+    /* A worker that could not start leaves its queue to worker 0. */
+    if (ok && started < jobs) rm_worker(&k.workers[0]);
+
+    size_t ndirs = 0;
+    for (int i = 0; i < jobs; i++) ndirs += k.workers[i].ndirs;
+    char **dirs = malloc((ndirs ? ndirs : 1) * sizeof(char *));
+    ndirs = 0;
+    for (int i = 0; i < jobs; i++) {
+        RmWorker *w = &k.workers[i];
+        for (size_t j = 0; j < w->ndirs; j++) {
+            if (dirs) dirs[ndirs++] = w->dirs[j];
+            else free(w->dirs[j]);
+        }
+        st->files += w->files;
+    }
+    if (dirs) {
+        qsort(dirs, ndirs, sizeof(char *), rm_depth_cmp);
+        for (size_t i = 0; i < ndirs; i++) {
+            if (unlinkat(dir_fd, dirs[i], AT_REMOVEDIR) == 0) st->dirs++;
+            else if (errno != ENOENT) rm_fail(&k.workers[0], "unlinkat(2)", dirs[i], NULL, errno);
+            free(dirs[i]);
+        }
+        free(dirs);
+    }
+    for (int i = 0; i < jobs; i++) {
+        RmWorker *w = &k.workers[i];
+        st->failed += w->failed;
+        free(w->dirs);
+        free(w->dents);
+        free(w->dq.items);
+        pthread_mutex_destroy(&w->dq.lock);
+        if (i && w->run) run_join_child(run, w->run);
+    }
+    free(k.workers);
+}
+
+/* ---- bin ops ---- */
+
+static int64_t bin_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* Makes the slots and heap entries written so far durable. */
+static int bin_commit(Run *run, Bin *b, JrnBuf *heap) {
+    int ok = 1;
+    op_begin(run);
+    op_set_bytes(run, heap->len);
+    if (heap->len) {
+        ok = pwrite(b->heap_fd, heap->buf, heap->len, (off_t)b->heap_len) == (ssize_t)heap->len &&
+             fdatasync(b->heap_fd) == 0;
+        if (ok) b->heap_len += heap->len;
+    }
+    ok = ok && bin_write_hdr(b) == 0 && fdatasync(b->mf_fd) == 0;
+    add_op_ref(run, "bin", "Commit bin manifest", "fdatasync(2)", b->bin_path, ".manifest", NULL, NULL, ok,
+               ok ? NULL : strerror(errno));
+    return ok ? 0 : -1;
+}
+
+/* trash and import: a slot per item, made durable, then the renames into
+ * the bin under each item's id. */
+static void bin_trash(Run *run, Bin *b, const char *workspace, const BinReq *rq, BinItem *items, long n) {
+    int import = rq->op == BIN_OP_IMPORT;
+    JrnBuf heap = { NULL, 0, 0 };
+    int64_t now = bin_now_ms();
+    long pending = 0;
+    for (long i = 0; i < n; i++) {
+        BinItem *it = &items[i];
+        const char *src = import ? rq->args[3 * i] : rq->args[i];
+        it->run = run;
+        it->op = "bin";
+        it->rel = bin_norm(run, import ? rq->args[3 * i + 1] : src);
+        it->from = import ? arena_join(&run->arena, b->bin_path, src) : arena_join(&run->arena, workspace, src);
+        it->to = NULL;
+        struct stat st;
+        int fd = import ? b->bin_fd : b->root_fd;
+        const char *name = import ? src : it->rel;
+        if (!it->rel || (import && (strchr(src, '/') || src[0] == '.'))) {
+            bin_fail(it, "Move to Bin", "", "invalid path");
+            continue;
+        }
+        op_begin(run);
+        if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+            bin_fail(it, "Move to Bin", "fstatat(2)", strerror(errno));
+            continue;
+        }
+        if (bin_alloc(b, &it->slot, &it->s) != 0) {
+            bin_fail(it, "Move to Bin", "pwrite(2)", strerror(errno));
+            continue;
+        }
+        it->s.state = BIN_LIVE;
+        it->s.type = S_ISDIR(st.st_mode) ? BIN_DIRECTORY : BIN_FILE;
+        it->s.size = S_ISDIR(st.st_mode) ? 0 : (uint64_t)st.st_size;
+        it->s.ino = (uint64_t)st.st_ino;
+        it->s.next_free = 0;
+        it->s.deleted_ms = import ? atoll(rq->args[3 * i + 2]) : now;
+        if (bin_put_path(b, &heap, it->slot, &it->s, it->rel) != 0 || bin_write_slot(b, it->slot, &it->s) != 0) {
+            bin_fail(it, "Move to Bin", "pwrite(2)", strerror(errno));
+            continue;
+        }
+        bin_format_id(it->id, it->slot, it->s.gen);
+        it->to = arena_join(&run->arena, b->bin_path, it->id);
+        it->desc = import ? "Import Bin item" : it->s.type == BIN_DIRECTORY ? "Move directory to Bin" : "Move file to Bin";
+        pending++;
+    }
+    int committed = !pending || bin_commit(run, b, &heap) == 0;
+    free(heap.buf);
+
+    Io io;
+    io_init(&io, run->io_mode, run->io_depth);
+    for (long i = 0; i < n; i++) {
+        BinItem *it = &items[i];
+        if (it->err) continue;
+        if (!committed) {
+            bin_fail(it, it->desc, "fdatasync(2)", "could not write the bin manifest");
+            continue;
+        }
+        bin_queue(it, &io, import ? b->bin_fd : b->root_fd, import ? rq->args[3 * i] : it->rel, b->bin_fd, it->id);
+    }
+    io_destroy(&io);
+    /* Items that did not arrive give their slots back. */
+    for (long i = 0; i < n; i++)
+        if (!items[i].err && items[i].res < 0) bin_release(b, items[i].slot, &items[i].s);
+    bin_write_hdr(b);
+}
+
+/* restore and purge: look each id up, then rename the item to its old
+ * path or into .bin/.purge and free its slot. */
+static void bin_take(Run *run, Bin *b, const char *workspace, const BinReq *rq, BinItem *items, long n,
+                     int purge_fd) {
+    int restore = rq->op == BIN_OP_RESTORE;
+    char path[PATH_MAX];
+    Io io;
+    io_init(&io, run->io_mode, run->io_depth);
+    for (long i = 0; i < n; i++) {
+        BinItem *it = &items[i];
+        const char *id = rq->args[i];
+        it->run = run;
+        it->op = "bin";
+        it->from = arena_join(&run->arena, b->bin_path, id);
+        it->to = NULL;
+        it->desc = restore ? "Restore from Bin" : "Delete permanently";
+        snprintf(it->id, sizeof(it->id), "%.16s", id);
+        const char *err = bin_lookup(b, id, &it->slot, &it->s);
+        int known = !err && bin_path_of(b, it->slot, &it->s, path, sizeof(path)) == 0;
+        if (known) it->rel = arena_strdup(&run->arena, path);
+        if (!err && restore && !known) err = "original path lost";
+        if (!err && !restore && purge_fd < 0) err = "no purge area";
+        if (err) {
+            bin_fail(it, it->desc, "", err);
+            continue;
+        }
+        it->to = restore ? arena_join(&run->arena, workspace, path)
+                         : arena_join(&run->arena, arena_join(&run->arena, b->bin_path, BIN_PURGE), id);
+        if (restore) bin_make_parents(b->root_fd, path);
+        bin_queue(it, &io, b->bin_fd, it->id, restore ? b->root_fd : purge_fd, restore ? it->rel : it->id);
+    }
+    io_destroy(&io);
+    for (long i = 0; i < n; i++)
+        if (!items[i].err && items[i].res >= 0) bin_release(b, items[i].slot, &items[i].s);
+    bin_write_hdr(b);
+}
+
+static void bin_print_type(Run *run, uint32_t type) {
+    out_puts(run, type == BIN_DIRECTORY ? "\"directory\"" : "\"file\"");
+}
+
+/* Writes the live heap entries to a new heap and points the slots at it.
+ * The slots are rewritten after the rename; until then bin_path_of finds
+ * their entries by scanning. */
+static void bin_compact_heap(Bin *b, const uint32_t *live, BinSlot *slots, long n) {
+    JrnBuf heap = { NULL, 0, 0 };
+    char path[PATH_MAX];
+    uint64_t old_len = b->heap_len;
+    int ok = 1;
+    for (long i = 0; i < n && ok; i++) {
+        b->heap_len = old_len;
+        if (bin_path_of(b, live[i], &slots[i], path, sizeof(path)) != 0) continue;
+        b->heap_len = 0;    /* offsets into the new heap */
+        ok = bin_put_path(b, &heap, live[i], &slots[i], path) == 0;
+    }
+    b->heap_len = old_len;
+    int fd = ok ? openat(b->bin_fd, ".paths.tmp", O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) : -1;
+    ok = fd >= 0 && write_all(fd, heap.buf, heap.len) == 0 && fdatasync(fd) == 0;
+    if (fd >= 0) close(fd);
+    if (!ok || renameat(b->bin_fd, ".paths.tmp", b->bin_fd, ".paths") != 0) {
+        if (fd >= 0) unlinkat(b->bin_fd, ".paths.tmp", 0);
+        free(heap.buf);
+        return;
+    }
+    int nfd = openat(b->bin_fd, ".paths", O_RDWR | O_CLOEXEC);
+    if (nfd >= 0) {
+        close(b->heap_fd);
+        b->heap_fd = nfd;
+        b->heap_len = heap.len;
+        for (long i = 0; i < n; i++) bin_write_slot(b, live[i], &slots[i]);
+    }
+    free(heap.buf);
+}
+
+/* Every live item, as {id, path, name, type, size, deletedAt}. Slots whose
+ * item is gone are freed on the way. */
+static void bin_list(Run *run, Bin *b) {
+    uint32_t *live = malloc((b->nslots ? b->nslots : 1) * sizeof(uint32_t));
+    BinSlot *slots = malloc((b->nslots ? b->nslots : 1) * sizeof(BinSlot));
+    long n = 0, freed = 0;
+    uint64_t live_bytes = 0;
+    char path[PATH_MAX], id[17];
+    out_puts(run, ",\"result\":{\"items\":[");
+    for (uint32_t i = 0; live && slots && i < b->nslots; i++) {
+        BinSlot s;
+        if (bin_read_slot(b, i, &s) != 0 || s.state != BIN_LIVE) continue;
+        bin_format_id(id, i, s.gen);
+        struct stat st;
+        if (fstatat(b->bin_fd, id, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+            if (errno == ENOENT) {
+                bin_release(b, i, &s);
+                freed++;
+            }
+            continue;
+        }
+        /* Still listed, so it can be purged; restore will say why not. */
+        if (bin_path_of(b, i, &s, path, sizeof(path)) != 0) snprintf(path, sizeof(path), "%s", id);
+        const char *slash = strrchr(path, '/');
+        out_printf(run, "%s{\"id\":\"%s\",\"path\":\"", n ? "," : "", id);
+        out_json(run, path);
+        out_puts(run, "\",\"name\":\"");
+        out_json(run, slash ? slash + 1 : path);
+        out_puts(run, "\",\"type\":");
+        bin_print_type(run, S_ISDIR(st.st_mode) ? BIN_DIRECTORY : BIN_FILE);
+        if (S_ISDIR(st.st_mode)) out_puts(run, ",\"size\":null");
+        else out_printf(run, ",\"size\":%lld", (long long)st.st_size);
+        out_printf(run, ",\"deletedAt\":%lld}", (long long)s.deleted_ms);
+        live[n] = i;
+        slots[n++] = s;
+        live_bytes += sizeof(BinPath) + s.path_len + 1;
+    }
+    out_printf(run, "],\"count\":%ld,\"freed\":%ld}", n, freed);
+    if (freed) bin_write_hdr(b);
+    if (live && slots && b->heap_len >= BIN_HEAP_MIN && live_bytes < b->heap_len / 2) bin_compact_heap(b, live, slots, n);
+    free(live);
+    free(slots);
+}
+
+/* Removes .bin/.purge's contents after the reply has gone out. */
+typedef struct {
+    int fd, jobs;
+} BinPurge;
+
+static void *bin_purge_thread(void *arg) {
+    BinPurge *p = arg;
+    RmStats st;
+    rm_contents(NULL, p->fd, "", p->jobs, &st);
+    close(p->fd);
+    free(p);
+    return NULL;
+}
+
+/* Detaches the removal: a thread in serve mode, else a process of its own
+ * that outlives this one. Falls back to removing it here. */
+static void bin_purge_later(Run *run, int fd, int jobs) {
+    BinPurge *p = malloc(sizeof(BinPurge));
+    pthread_t t;
+    if (p) {
+        p->fd = fd;
+        p->jobs = jobs;
+    }
+    if (p && run->req_id) {
+        if (pthread_create(&t, NULL, bin_purge_thread, p) == 0) {
+            pthread_detach(t);
+            return;
+        }
+    } else if (p) {
+        fflush(NULL);
+        pid_t pid = fork();
+        if (pid == 0) {
+            int null = open("/dev/null", O_RDWR | O_CLOEXEC);
+            if (null >= 0) {
+                dup2(null, STDIN_FILENO);
+                dup2(null, STDOUT_FILENO);
+                dup2(null, STDERR_FILENO);
+            }
+            setsid();
+            bin_purge_thread(p);
+            _exit(0);
+        }
+        if (pid > 0) {
+            free(p);
+            close(fd);
+            return;
+        }
+    }
+    free(p);
+    RmStats st;
+    rm_contents(NULL, fd, "", jobs, &st);
+    close(fd);
+}
+
+static int bin_run(Run *run, const char *workspace, const BinReq *rq) {
+    Bin b;
+    int err = bin_open(&b, run, workspace);
+    if (err) {
+        jrn_error(run, strerror(err));
+        return -1;
+    }
+    long n = rq->op == BIN_OP_IMPORT ? rq->nargs / 3 : rq->nargs;
+    BinItem *items = calloc(n ? n : 1, sizeof(BinItem));
+    if (!items) {
+        bin_close(&b);
+        jrn_error(run, strerror(ENOMEM));
+        return -1;
+    }
+    int purge_fd = -1;
+    if (rq->op == BIN_OP_PURGE) {
+        mkdirat(b.bin_fd, BIN_PURGE, 0777);
+        purge_fd = openat(b.bin_fd, BIN_PURGE, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    }
+    Writer saved = run->out;
+    memset(&run->out, 0, sizeof(run->out));
+    if (rq->op == BIN_OP_LIST) bin_list(run, &b);
+    else if (rq->op == BIN_OP_TRASH || rq->op == BIN_OP_IMPORT) bin_trash(run, &b, workspace, rq, items, n);
+    else bin_take(run, &b, workspace, rq, items, n, purge_fd);
+    /* The list is built aside: it goes after the ops. */
+    Writer listed = run->out;
+    run->out = saved;
+    bin_close(&b);
+
+    long done = 0, failed = 0;
+    for (long i = 0; i < n; i++) {
+        if (items[i].res >= 0) done++;
+        else failed++;
+    }
+    RmStats st = { 0, 0, 0 };
+    int later = purge_fd >= 0 && rq->background;
+    if (purge_fd >= 0 && !later) {
+        op_begin(run);
+        const char *base = arena_join(&run->arena, b.bin_path, BIN_PURGE);
+        rm_contents(run, purge_fd, base, rq->jobs, &st);
+        add_op_ref(run, "bin", "Remove purged items", "unlinkat(2)", base, NULL, NULL, NULL, !st.failed,
+                   st.failed ? "some entries could not be removed" : NULL);
+        close(purge_fd);
+    }
+
+    print_ops(run);
+    if (rq->op == BIN_OP_LIST) {
+        out_write(run, listed.buf, listed.len);
+    } else {
+        out_puts(run, ",\"result\":{\"items\":[");
+        for (long i = 0; i < n; i++) {
+            const BinItem *it = &items[i];
+            out_puts(run, i ? ",{\"id\":\"" : "{\"id\":\"");
+            if (it->res >= 0 || rq->op != BIN_OP_TRASH) out_json(run, it->id);
+            out_puts(run, "\",\"path\":\"");
+            if (it->rel) out_json(run, it->rel);
+            out_printf(run, "\",\"success\":%s", it->res >= 0 ? "true" : "false");
+            if (it->res >= 0 && (rq->op == BIN_OP_TRASH || rq->op == BIN_OP_IMPORT)) {
+                out_puts(run, ",\"type\":");
+                bin_print_type(run, it->s.type);
+            }
+            if (it->res < 0) {
+                out_puts(run, ",\"error\":\"");
+                out_json(run, it->err ? it->err : strerror(-it->res));
+                out_puts(run, "\"");
+            }
+            out_puts(run, "}");
+        }
+        out_printf(run, "],\"%s\":%ld,\"failed\":%ld", bin_done[rq->op], done, failed);
+        if (purge_fd >= 0)
+            out_printf(run, ",\"files\":%ld,\"dirs\":%ld,\"background\":%s", st.files, st.dirs,
+                       later ? "true" : "false");
+        out_puts(run, "}");
+    }
+    free(listed.buf);
+    free(items);
+    finish_json(run);
+    if (later) bin_purge_later(run, purge_fd, rq->jobs);
+    return failed || st.failed ? -1 : 0;
+}
+
+/* move: each pair is renamed from one workspace path to another, never
+ * over an existing entry, making the destination's parents first. */
+static int move_run(Run *run, const char *workspace, char **pairs, long npairs) {
+    int root_fd = open(workspace, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (root_fd < 0) {
+        jrn_error(run, strerror(errno));
+        return -1;
+    }
+    long n = npairs / 2, moved = 0, failed = 0;
+    BinItem *items = calloc(n ? n : 1, sizeof(BinItem));
+    if (!items) {
+        close(root_fd);
+        jrn_error(run, strerror(ENOMEM));
+        return -1;
+    }
+    Io io;
+    io_init(&io, run->io_mode, run->io_depth);
+    for (long i = 0; i < n; i++) {
+        BinItem *it = &items[i];
+        const char *from = bin_norm(run, pairs[2 * i]), *to = bin_norm(run, pairs[2 * i + 1]);
+        size_t fl = from ? strlen(from) : 0;
+        it->run = run;
+        it->op = "move";
+        it->desc = "Move item";
+        it->rel = to;
+        it->from = arena_join(&run->arena, workspace, pairs[2 * i]);
+        it->to = arena_join(&run->arena, workspace, pairs[2 * i + 1]);
+        if (!from || !to || (strncmp(to, from, fl) == 0 && (to[fl] == '\0' || to[fl] == '/'))) {
+            bin_fail(it, it->desc, "", "invalid path");
+            continue;
+        }
+        op_begin(run);
+        bin_make_parents(root_fd, to);
+        bin_queue(it, &io, root_fd, from, root_fd, to);
+    }
+    io_destroy(&io);
+    close(root_fd);
+    print_ops(run);
+    out_puts(run, ",\"result\":{\"items\":[");
+    for (long i = 0; i < n; i++) {
+        const BinItem *it = &items[i];
+        out_puts(run, i ? ",{\"from\":\"" : "{\"from\":\"");
+        out_json(run, pairs[2 * i]);
+        out_puts(run, "\",\"to\":\"");
+        out_json(run, it->rel ? it->rel : pairs[2 * i + 1]);
+        out_printf(run, "\",\"success\":%s", it->res >= 0 ? "true" : "false");
+        if (it->res < 0) {
+            out_puts(run, ",\"error\":\"");
+            out_json(run, it->err ? it->err : strerror(-it->res));
+            out_puts(run, "\"");
+        }
+        out_puts(run, "}");
+        if (it->res >= 0) moved++;
+        else failed++;
+    }
+    out_printf(run, "],\"moved\":%ld,\"failed\":%ld}", moved, failed);
+    free(items);
+    finish_json(run);
+    return failed ? -1 : 0;
+}
+
+/* Appends --stdin's words to *args (malloc'd): tab-separated, one item
+ * per line. The words point into input. */
+static int bin_read_words(char *input, char ***args, long *nargs) {
+    long n = 1;
+    for (const char *c = input; *c; c++) n += *c == '\t' || *c == '\n';
+    char **a = realloc(*args, (*nargs + n) * sizeof(char *));
+    if (!a) return -1;
+    *args = a;
+    for (char *line = input, *next; line && *line; line = next) {
+        next = strchr(line, '\n');
+        if (next) *next++ = '\0';
+        if (!*line) continue;
+        for (char *w = line, *tab; w; w = tab) {
+            tab = strchr(w, '\t');
+            if (tab) *tab++ = '\0';
+            a[(*nargs)++] = w;
+        }
+    }
+    return 0;
+}
+
+/* ---- ARCHIVE EXPORT ----
+ * archive <workspace> [subpath] [--jobs N] [--level L]
+ * Writes the directory as a ZIP to stdout, for folder downloads. The tree
+ * is streamed, never staged: every entry's local header goes out as soon
+ * as its first chunk is read, sizes and CRC follow in a data descriptor,
+ * and the central directory comes last. Entries are named below the
+ * directory's own name. Dotfiles (the bin, metadata) and symlinks are
+ * left out, and anything that cannot be read is skipped with a line on
+ * stderr. Zip64 records are used for files of nearly 4 GB and up, and for
+ * archives past 65535 entries or 4 GB.
+ *
+ * Three stages share a ring of 2 * jobs + 2 chunk slots. A reader thread
+ * walks the tree in name order and fills slots with up to 256 KB of a
+ * file each. --jobs workers compress any filled slot as a raw deflate
+ * fragment, primed with the 32 KB that precede it in the file; every
+ * fragment but a file's last ends on a sync flush, so their
+ * concatenation is one valid deflate stream (the pigz layout). The
+ * calling thread writes finished slots in order, folding the chunk CRCs
+ * together with crc32_combine, and drains its buffer whenever it has to
+ * wait, so the first bytes reach the client at once. Images, audio and
+ * video in formats that are already compressed, and compressed archives
+ * and Office files, are stored: their slots only get a CRC.
+ *
+ * Errors before the first byte are the usual JSON error; once the ZIP has
+ * started, a failed write stops all three stages. */
+#define AR_CHUNK (256 * 1024)
+#define AR_WINDOW (32 * 1024)
+#define AR_DEFAULT_LEVEL 6
+#define AR_MAX_JOBS 64
+#define AR_OUT_BUF (1024 * 1024)
+#define AR_ZIP64_FILE 0xF0000000u   /* files this big get zip64 sizes up front */
+
+enum { AR_FREE, AR_FILLED, AR_DONE };
 
 typedef struct {
-    int id;
-    char op[32];
-    char description[64];
-    char syscall[48];
-    char path[MAX_PATH];
-    char path2[MAX_PATH];
-    int success;
-    char error[128];
-} OpRec;
+    char *name;                 /* "<root>/rel/path", directories end in '/' */
+    uint32_t mode, crc;
+    uint16_t method, dos_time, dos_date;
+    int zip64;
+    uint64_t usize, csize, offset;
+} ArEntry;
 
-static OpRec ops[MAX_OPS];
-static int nops;
+typedef struct {
+    ArEntry *ent;
+    int first, last, state;
+    unsigned char *in, *out;    /* out is in for stored entries */
+    unsigned char *dict;        /* the file's bytes just before in */
+    size_t in_len, out_len, dict_len;
+    uint32_t crc;
+    int failed;                 /* deflate did not finish the fragment */
+} ArSlot;
 
-static void json_escape(const char *s, char *out, size_t outsz) {
-    size_t j = 0;
-    for (; *s && j < outsz - 2; s++) {
-        if (*s == '"' || *s == '\\') { out[j++] = '\\'; out[j++] = *s; }
-        else if (*s == '\n') { out[j++] = '\\'; out[j++] = 'n'; }
-        else out[j++] = *s;
+typedef struct {
+    ArSlot *slots;
+    int nslots, level;
+    size_t out_cap;
+    uint64_t filled, claimed, written;      /* slot sequence numbers */
+    int reader_done, stop;
+    pthread_mutex_t lock;
+    pthread_cond_t room, work, done;
+    const char *base;           /* for stderr lines */
+    char *dents;
+    long skipped;
+} ArPipe;
+
+typedef struct {
+    int fd;
+    unsigned char *buf;
+    size_t len;
+    uint64_t off;               /* bytes of ZIP produced so far */
+    int failed;
+} ArOut;
+
+static const char *const ar_raw_media[] = { "svg", "bmp", "tiff", "tif", "wav" };
+static const char *const ar_packed[] = { "zip", "gz", "tgz", "xz", "zst", "bz2", "7z", "rar", "docx", "xlsx", "pptx" };
+
+/* Whether deflate would only waste CPU on the file. */
+static int ar_stored(const char *name) {
+    const char *dot = strrchr(name, '.');
+    if (!dot) return 0;
+    for (size_t i = 0; i < sizeof(ar_packed) / sizeof(ar_packed[0]); i++)
+        if (strcasecmp(dot + 1, ar_packed[i]) == 0) return 1;
+    if (!is_img(dot) && !is_aud(dot) && !is_vid(dot)) return 0;
+    for (size_t i = 0; i < sizeof(ar_raw_media) / sizeof(ar_raw_media[0]); i++)
+        if (strcasecmp(dot + 1, ar_raw_media[i]) == 0) return 0;
+    return 1;
+}
+
+static void ar_dos_time(time_t t, ArEntry *e) {
+    struct tm tm;
+    if (!localtime_r(&t, &tm) || tm.tm_year < 80) {
+        e->dos_time = 0;
+        e->dos_date = (1 << 5) | 1;     /* 1980-01-01 */
+        return;
     }
-    out[j] = '\0';
+    if (tm.tm_year > 207) tm.tm_year = 207;
+    e->dos_time = (uint16_t)((tm.tm_hour << 11) | (tm.tm_min << 5) | (tm.tm_sec / 2));
+    e->dos_date = (uint16_t)(((tm.tm_year - 80) << 9) | ((tm.tm_mon + 1) << 5) | tm.tm_mday);
 }
 
-static void add_op(const char *op, const char *desc, const char *syscall,
-                   const char *path, const char *path2, int success, const char *err) {
-    if (nops >= MAX_OPS) return;
-    OpRec *r = &ops[nops++];
-    r->id = nops;
-    strncpy(r->op, op, sizeof(r->op) - 1); r->op[sizeof(r->op)-1] = '\0';
-    strncpy(r->description, desc, sizeof(r->description) - 1); r->description[sizeof(r->description)-1] = '\0';
-    strncpy(r->syscall, syscall, sizeof(r->syscall) - 1); r->syscall[sizeof(r->syscall)-1] = '\0';
-    strncpy(r->path, path ? path : "", sizeof(r->path) - 1); r->path[sizeof(r->path)-1] = '\0';
-    strncpy(r->path2, path2 ? path2 : "", sizeof(r->path2) - 1); r->path2[sizeof(r->path2)-1] = '\0';
-    r->success = success;
-    strncpy(r->error, err ? err : "", sizeof(r->error) - 1); r->error[sizeof(r->error)-1] = '\0';
+static unsigned char *ar_le(unsigned char *p, uint64_t v, int n) {
+    for (int i = 0; i < n; i++) p[i] = (unsigned char)(v >> (8 * i));
+    return p + n;
+}
+
+/* ---- output ---- */
+
+static void ar_flush(ArOut *o) {
+    if (o->len && !o->failed && write_all(o->fd, (const char *)o->buf, o->len) != 0) o->failed = 1;
+    o->len = 0;
 }
 
-static void print_json_result(const char *result_json) {
-    printf("{\"operations\":[");
-    for (int i = 0; i < nops; i++) {
-        OpRec *r = &ops[i];
-        char pe[MAX_PATH * 2], p2e[MAX_PATH * 2], ee[256];
-        json_escape(r->path, pe, sizeof(pe));
-        json_escape(r->path2, p2e, sizeof(p2e));
-        json_escape(r->error, ee, sizeof(ee));
-        if (i) printf(",");
-        printf("{\"id\":%d,\"op\":\"%s\",\"description\":\"%s\",\"syscall\":\"%s\",\"path\":\"%s\",\"path2\":\"%s\",\"success\":%s,\"error\":\"%s\"}",
-               r->id, r->op, r->description, r->syscall, pe, p2e, r->success ? "true" : "false", ee);
+static void ar_put(ArOut *o, const void *data, size_t n) {
+    o->off += n;
+    if (o->len + n > AR_OUT_BUF) ar_flush(o);
+    if (n >= AR_OUT_BUF) {
+        if (!o->failed && write_all(o->fd, data, n) != 0) o->failed = 1;
+        return;
     }
-    printf("],\"result\":%s}\n", result_json ? result_json : "null");
+    memcpy(o->buf + o->len, data, n);
+    o->len += n;
 }
 
-static int create_dir_and_files(const char *workspace, const char *dir_name, char *files[], int nfiles) {
-    char dir_path[MAX_PATH];
-    snprintf(dir_path, sizeof(dir_path), "%s/%s", workspace, dir_name);
+static void ar_local_header(ArOut *o, ArEntry *e) {
+    unsigned char h[30 + 20], *p = h;
+    size_t nl = strlen(e->name);
+    e->offset = o->off;
+    p = ar_le(p, 0x04034b50, 4);
+    p = ar_le(p, e->zip64 ? 45 : 20, 2);
+    p = ar_le(p, (1 << 3) | (1 << 11), 2);     /* sizes follow the data; UTF-8 names */
+    p = ar_le(p, e->method, 2);
+    p = ar_le(p, e->dos_time, 2);
+    p = ar_le(p, e->dos_date, 2);
+    p = ar_le(p, 0, 4);
+    p = ar_le(p, e->zip64 ? 0xFFFFFFFFu : 0, 4);
+    p = ar_le(p, e->zip64 ? 0xFFFFFFFFu : 0, 4);
+    p = ar_le(p, nl, 2);
+    p = ar_le(p, e->zip64 ? 20 : 0, 2);
+    ar_put(o, h, 30);
+    ar_put(o, e->name, nl);
+    if (e->zip64) {
+        p = ar_le(h, 0x0001, 2);
+        p = ar_le(p, 16, 2);
+        p = ar_le(p, 0, 8);
+        p = ar_le(p, 0, 8);
+        ar_put(o, h, 20);
+    }
+}
 
-    if (mkdir(dir_path, 0777) == 0) {
-        add_op("mkdir", "Create directory", "mkdir(2)", dir_path, NULL, 1, NULL);
-    } else {
-        add_op("mkdir", "Create directory", "mkdir(2)", dir_path, NULL, 0, strerror(errno));
-        if (errno != EEXIST) return -1;
+static void ar_descriptor(ArOut *o, const ArEntry *e) {
+    unsigned char d[24], *p = d;
+    p = ar_le(p, 0x08074b50, 4);
+    p = ar_le(p, e->crc, 4);
+    p = ar_le(p, e->csize, e->zip64 ? 8 : 4);
+    p = ar_le(p, e->usize, e->zip64 ? 8 : 4);
+    ar_put(o, d, (size_t)(p - d));
+}
+
+/* Central directory record, appended to cd. */
+static int ar_central(char **cd, size_t *len, size_t *cap, const ArEntry *e) {
+    size_t nl = strlen(e->name);
+    unsigned char h[46 + 28], *p = h;
+    unsigned char x[28], *q = x + 4;
+    uint32_t usize = (uint32_t)e->usize, csize = (uint32_t)e->csize, off = (uint32_t)e->offset;
+    if (e->usize >= 0xFFFFFFFFu) { q = ar_le(q, e->usize, 8); usize = 0xFFFFFFFFu; }
+    if (e->csize >= 0xFFFFFFFFu) { q = ar_le(q, e->csize, 8); csize = 0xFFFFFFFFu; }
+    if (e->offset >= 0xFFFFFFFFu) { q = ar_le(q, e->offset, 8); off = 0xFFFFFFFFu; }
+    size_t xl = q == x + 4 ? 0 : (size_t)(q - x);
+    ar_le(ar_le(x, 0x0001, 2), xl ? xl - 4 : 0, 2);
+    int need = e->zip64 || xl ? 45 : 20;
+    p = ar_le(p, 0x02014b50, 4);
+    p = ar_le(p, (3 << 8) | 63, 2);             /* made on Unix, spec 6.3 */
+    p = ar_le(p, need, 2);
+    p = ar_le(p, (1 << 3) | (1 << 11), 2);
+    p = ar_le(p, e->method, 2);
+    p = ar_le(p, e->dos_time, 2);
+    p = ar_le(p, e->dos_date, 2);
+    p = ar_le(p, e->crc, 4);
+    p = ar_le(p, csize, 4);
+    p = ar_le(p, usize, 4);
+    p = ar_le(p, nl, 2);
+    p = ar_le(p, xl, 2);
+    p = ar_le(p, 0, 2);                         /* comment */
+    p = ar_le(p, 0, 2);                         /* disk */
+    p = ar_le(p, 0, 2);                         /* internal attributes */
+    p = ar_le(p, ((uint32_t)e->mode << 16) | (S_ISDIR(e->mode) ? 0x10 : 0), 4);
+    p = ar_le(p, off, 4);
+    size_t n = 46 + nl + xl;
+    if (*len + n > *cap) {
+        size_t c = *cap ? *cap * 2 : 64 * 1024;
+        while (c < *len + n) c *= 2;
+        char *grown = realloc(*cd, c);
+        if (!grown) return -1;
+        *cd = grown;
+        *cap = c;
     }
+    memcpy(*cd + *len, h, 46);
+    memcpy(*cd + *len + 46, e->name, nl);
+    memcpy(*cd + *len + 46 + nl, x, xl);
+    *len += n;
+    return 0;
+}
 
-    for (int i = 0; i < nfiles; i++) {
-        char file_path[MAX_PATH];
-        snprintf(file_path, sizeof(file_path), "%s/%s", dir_path, files[i]);
-        FILE *fp = fopen(file_path, "w");
-        if (fp) {
-            fclose(fp);
-            add_op("writeFile", "Create file", "open(2)/write(2)/close(2)", file_path, NULL, 1, NULL);
-        } else {
-            add_op("writeFile", "Create file", "open(2)/write(2)/close(2)", file_path, NULL, 0, strerror(errno));
-        }
+static void ar_end(ArOut *o, uint64_t entries, uint64_t cd_off, uint64_t cd_len) {
+    unsigned char b[56 + 20 + 22], *p = b;
+    if (entries >= 0xFFFF || cd_off >= 0xFFFFFFFFu || cd_len >= 0xFFFFFFFFu) {
+        uint64_t at = o->off;
+        p = ar_le(p, 0x06064b50, 4);
+        p = ar_le(p, 44, 8);
+        p = ar_le(p, (3 << 8) | 63, 2);
+        p = ar_le(p, 45, 2);
+        p = ar_le(p, 0, 4);
+        p = ar_le(p, 0, 4);
+        p = ar_le(p, entries, 8);
+        p = ar_le(p, entries, 8);
+        p = ar_le(p, cd_len, 8);
+        p = ar_le(p, cd_off, 8);
+        p = ar_le(p, 0x07064b50, 4);
+        p = ar_le(p, 0, 4);
+        p = ar_le(p, at, 8);
+        p = ar_le(p, 1, 4);
     }
+    p = ar_le(p, 0x06054b50, 4);
+    p = ar_le(p, 0, 2);
+    p = ar_le(p, 0, 2);
+    p = ar_le(p, entries < 0xFFFF ? entries : 0xFFFF, 2);
+    p = ar_le(p, entries < 0xFFFF ? entries : 0xFFFF, 2);
+    p = ar_le(p, cd_len < 0xFFFFFFFFu ? cd_len : 0xFFFFFFFFu, 4);
+    p = ar_le(p, cd_off < 0xFFFFFFFFu ? cd_off : 0xFFFFFFFFu, 4);
+    p = ar_le(p, 0, 2);
+    ar_put(o, b, (size_t)(p - b));
+}
 
-    char escaped[MAX_PATH * 2];
-    json_escape(dir_path, escaped, sizeof(escaped));
-    char result[512];
-    snprintf(result, sizeof(result), "{\"dirPath\":\"%s\",\"created\":%d}", escaped, nfiles);
-    print_json_result(result);
-    return 0;
+/* ---- reader ---- */
+
+/* The next free slot, or NULL once the writer has stopped. */
+static ArSlot *ar_slot(ArPipe *p) {
+    pthread_mutex_lock(&p->lock);
+    while (!p->stop && p->filled - p->written >= (uint64_t)p->nslots) pthread_cond_wait(&p->room, &p->lock);
+    ArSlot *s = p->stop ? NULL : &p->slots[p->filled % p->nslots];
+    pthread_mutex_unlock(&p->lock);
+    return s;
 }
 
-static int is_doc(const char *ext) {
-    return strcmp(ext, ".txt")==0 || strcmp(ext, ".pdf")==0 || strcmp(ext, ".docx")==0 ||
-           strcmp(ext, ".doc")==0 || strcmp(ext, ".xlsx")==0 || strcmp(ext, ".pptx")==0;
+static void ar_fill(ArPipe *p, ArSlot *s) {
+    pthread_mutex_lock(&p->lock);
+    s->state = AR_FILLED;
+    p->filled++;
+    pthread_cond_signal(&p->work);
+    pthread_mutex_unlock(&p->lock);
 }
-static int is_img(const char *ext) {
-    return strcmp(ext, ".jpg")==0 || strcmp(ext, ".jpeg")==0 || strcmp(ext, ".png")==0 ||
-           strcmp(ext, ".gif")==0 || strcmp(ext, ".bmp")==0 || strcmp(ext, ".svg")==0;
+
+static ArEntry *ar_entry(const char *root, const char *rel, const char *name, const struct stat *st) {
+    size_t rl = strlen(root), l = strlen(rel), nl = strlen(name);
+    ArEntry *e = calloc(1, sizeof(*e));
+    char *n = e ? malloc(rl + l + nl + 4) : NULL;
+    if (!n) { free(e); return NULL; }
+    char *w = n;
+    memcpy(w, root, rl); w += rl;
+    if (l) { *w++ = '/'; memcpy(w, rel, l); w += l; }
+    if (nl) { *w++ = '/'; memcpy(w, name, nl); w += nl; }
+    if (S_ISDIR(st->st_mode)) *w++ = '/';
+    *w = '\0';
+    e->name = n;
+    e->mode = (uint32_t)st->st_mode;
+    ar_dos_time(st->st_mtime, e);
+    return e;
 }
-static int is_aud(const char *ext) {
-    return strcmp(ext, ".mp3")==0 || strcmp(ext, ".wav")==0 || strcmp(ext, ".aac")==0 ||
-           strcmp(ext, ".flac")==0 || strcmp(ext, ".ogg")==0;
+
+static void ar_skip(ArPipe *p, const char *rel, const char *name, int err) {
+    p->skipped++;
+    fprintf(stderr, "archive: %s/%s%s%s: %s\n", p->base, rel, *rel ? "/" : "", name, strerror(err));
 }
-static int is_vid(const char *ext) {
-    return strcmp(ext, ".mp4")==0 || strcmp(ext, ".mkv")==0 || strcmp(ext, ".avi")==0 ||
-           strcmp(ext, ".mov")==0 || strcmp(ext, ".wmv")==0;
+
+/* Queues one entry and its data. A file that fails after its header has
+ * gone out is cut short there. */
+static void ar_file(ArPipe *p, ArEntry *e, int fd, const struct stat *st, const char *rel, const char *name) {
+    uint64_t left = S_ISREG(st->st_mode) ? (uint64_t)st->st_size : 0;
+    e->method = left && p->level && !ar_stored(name) ? 8 : 0;
+    e->zip64 = left >= AR_ZIP64_FILE;
+    if (fd >= 0 && left) posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    ArSlot *prev = NULL;
+    int first = 1;
+    for (;;) {
+        ArSlot *s = ar_slot(p);
+        if (!s) { if (first) { free(e->name); free(e); } return; }
+        size_t want = left < AR_CHUNK ? (size_t)left : AR_CHUNK, got = 0;
+        while (got < want) {
+            ssize_t n = read(fd, s->in + got, want - got);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) ar_skip(p, rel, name, errno);
+            if (n <= 0) { left = got; break; }
+            got += (size_t)n;
+        }
+        left -= got;
+        s->dict_len = 0;
+        if (prev && e->method) {
+            /* The previous slot is not reused before this one is filled. */
+            size_t keep = prev->in_len < AR_WINDOW ? prev->in_len : AR_WINDOW;
+            memcpy(s->dict, prev->in + prev->in_len - keep, keep);
+            s->dict_len = keep;
+        }
+        s->ent = e;
+        s->in_len = got;
+        s->first = first;
+        s->last = left == 0;
+        ar_fill(p, s);
+        if (s->last) return;
+        prev = s;
+        first = 0;
+    }
 }
 
-/* ---- TEXT TEMPLATES FOR .txt FILES ---- */
-static const char *text_templates[] = {
-    "Meeting Notes - Q4 Planning\n\nDate: 2024-11-15\nAttendees: Alice, Bob, Charlie\n\nAgenda:\n1. Budget review for next quarter\n2. New product roadmap discussion\n3. Team restructuring proposals\n\nKey Decisions:\n- Approved 15% budget increase for R&D\n- Launch date set for March 2025\n- Two new hires approved for engineering team\n\nAction Items:\n- Alice: Prepare detailed budget breakdown by Friday\n- Bob: Draft product requirements document\n- Charlie: Schedule interviews for new positions\n",
-    "Project Status Report\n\nProject: Smart File Organizer v2.0\nStatus: On Track\nSprint: 14 of 20\n\nCompleted This Week:\n- Implemented file categorization algorithm\n- Added support for 15+ file extensions\n- Integrated with cloud storage API\n- Fixed 3 critical bugs from QA testing\n\nPlanned Next Week:\n- User acceptance testing begins\n- Performance optimization for large directories\n- Documentation updates\n\nRisks:\n- Third-party API rate limiting may affect sync speed\n- Need additional testing on Windows platform\n",
-    "Dear Team,\n\nI hope this message finds you well. I wanted to share some exciting updates about our upcoming product launch.\n\nAfter months of hard work, we are pleased to announce that the Smart File Organizer will be released on March 15, 2025. This tool will revolutionize how users manage their digital files.\n\nKey Features:\n- Automatic file categorization by type\n- Smart duplicate detection\n- Cloud backup integration\n- Cross-platform compatibility\n\nPlease review the attached documentation and provide your feedback by end of week.\n\nBest regards,\nThe Development Team\n",
-    "Recipe: Classic Chocolate Chip Cookies\n\nPrep Time: 15 minutes\nCook Time: 12 minutes\nServings: 48 cookies\n\nIngredients:\n- 2 1/4 cups all-purpose flour\n- 1 tsp baking soda\n- 1 tsp salt\n- 1 cup butter, softened\n- 3/4 cup granulated sugar\n- 3/4 cup packed brown sugar\n- 2 large eggs\n- 2 tsp vanilla extract\n- 2 cups chocolate chips\n\nInstructions:\n1. Preheat oven to 375 degrees F\n2. Mix flour, baking soda and salt in a bowl\n3. Beat butter, sugars, eggs and vanilla until creamy\n4. Gradually blend in flour mixture\n5. Stir in chocolate chips\n6. Drop onto ungreased baking sheets\n7. Bake for 9 to 11 minutes or until golden brown\n",
-    "Daily Journal Entry\n\nDate: Wednesday, November 20, 2024\nWeather: Partly cloudy, 18 degrees C\nMood: Productive and optimistic\n\nToday was a remarkably productive day. I managed to complete the file organization module that I have been working on for the past week. The algorithm now correctly identifies and sorts files into their respective categories.\n\nI also had a great meeting with the team where we discussed the roadmap for the next quarter. Everyone seems excited about the new features we are planning to implement.\n\nIn the evening, I went for a run in the park. The autumn leaves are beautiful this time of year. It is amazing how a bit of exercise can clear your mind and boost creativity.\n\nTomorrow, I plan to start working on the user interface improvements and write some unit tests for the sorting algorithm.\n\nGratitude list:\n- Supportive team members\n- Good health\n- Beautiful weather for running\n"
-};
-#define NUM_TEMPLATES 5
+static int ar_name_cmp(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
 
-/* ---- PICK RANDOM ASSET FROM DIRECTORY BY EXTENSION ---- */
-static int pick_random_asset(const char *dir, const char *ext[], int num_exts,
-                             char *out_path, size_t out_sz) {
-    DIR *dp = opendir(dir);
-    if (!dp) return -1;
-    char candidates[64][MAX_PATH];
-    int count = 0;
-    struct dirent *e;
-    while ((e = readdir(dp)) != NULL && count < 64) {
-        if (e->d_name[0] == '.') continue;
-        const char *dot = strrchr(e->d_name, '.');
-        if (!dot) continue;
-        for (int i=0; i<num_exts; i++) {
-            if (strcasecmp(dot, ext[i]) == 0) {
-                snprintf(candidates[count], MAX_PATH, "%s/%s", dir, e->d_name);
-                count++;
-                break;
-            }
+static void ar_walk(ArPipe *p, int dir_fd, const char *root, const char *rel);
+
+/* Queues one child of dir_fd: a file, or a directory and all below it. */
+static void ar_child(ArPipe *p, int dir_fd, const char *root, const char *rel, const char *name) {
+    int fd = openat(dir_fd, name, O_RDONLY | O_NOFOLLOW | O_NONBLOCK | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        if (errno != ELOOP) ar_skip(p, rel, name, errno);
+        if (fd >= 0) close(fd);
+        return;
+    }
+    ArEntry *e = S_ISREG(st.st_mode) || S_ISDIR(st.st_mode) ? ar_entry(root, rel, name, &st) : NULL;
+    if (e && S_ISREG(st.st_mode)) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+        ar_file(p, e, fd, &st, rel, name);
+    } else if (e) {
+        ar_file(p, e, -1, &st, rel, name);
+        size_t rl = strlen(rel);
+        char *sub = malloc(rl + strlen(name) + 2);
+        if (sub) {
+            sprintf(sub, "%s%s%s", rel, rl ? "/" : "", name);
+            ar_walk(p, fd, root, sub);
+            free(sub);
         }
+    } else if (S_ISREG(st.st_mode) || S_ISDIR(st.st_mode)) {
+        ar_skip(p, rel, name, ENOMEM);
     }
-    closedir(dp);
-    if (count == 0) return -1;
-    int idx = rand() % count;
-    strncpy(out_path, candidates[idx], out_sz - 1);
-    out_path[out_sz - 1] = '\0';
-    return 0;
+    close(fd);
 }
 
-/* ---- BINARY COPY ---- */
-static int copy_binary_file(const char *src, const char *dst) {
-    FILE *in = fopen(src, "rb");
-    if (!in) return -1;
-    FILE *out = fopen(dst, "wb");
-    if (!out) { fclose(in); return -1; }
-    char buf[8192];
-    size_t n;
-    while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
-        fwrite(buf, 1, n, out);
+/* Queues everything below dir_fd (rel below the root), each directory
+ * listed in full and sorted before any of it is read. */
+static void ar_walk(ArPipe *p, int dir_fd, const char *root, const char *rel) {
+    DirScan ds;
+    char **names = NULL;
+    size_t n = 0, cap = 0;
+    if (scan_open(&ds, dir_fd, p->dents) == 0) {
+        const char *name;
+        unsigned char type;
+        while ((name = scan_next(&ds, &type)) != NULL) {
+            if (name[0] == '.' || type == DT_LNK) continue;
+            if (n == cap) {
+                cap = cap ? cap * 2 : 64;
+                char **grown = realloc(names, cap * sizeof(char *));
+                if (!grown) break;
+                names = grown;
+            }
+            if ((names[n] = strdup(name)) != NULL) n++;
+        }
+        scan_close(&ds);
     }
-    fclose(in);
-    fclose(out);
-    return 0;
+    if (n) qsort(names, n, sizeof(char *), ar_name_cmp);
+    for (size_t i = 0; i < n; i++) {
+        if (!__atomic_load_n(&p->stop, __ATOMIC_ACQUIRE)) ar_child(p, dir_fd, root, rel, names[i]);
+        free(names[i]);
+    }
+    free(names);
 }
 
-/* ---- FILL AN EMPTY FILE WITH CONTENT ---- */
-static void fill_with_demo_content(const char *file_path, const char *ext,
-                                    const char *assets_path) {
-    /* Only fill if file is empty (0 bytes) */
+typedef struct {
+    ArPipe *p;
+    int dir_fd;
+    const char *root;
     struct stat st;
-    if (stat(file_path, &st) != 0 || st.st_size > 0) return;
-    if (!ext || !assets_path || assets_path[0] == '\0') return;
+} ArReader;
 
-    int success = 0;
+static void *ar_reader(void *arg) {
+    ArReader *r = arg;
+    ArPipe *p = r->p;
+    ArEntry *e = ar_entry(r->root, "", "", &r->st);
+    if (e) ar_file(p, e, -1, &r->st, "", "");
+    ar_walk(p, r->dir_fd, r->root, "");
+    pthread_mutex_lock(&p->lock);
+    p->reader_done = 1;
+    pthread_cond_broadcast(&p->work);
+    pthread_cond_broadcast(&p->done);
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
 
-    if (strcmp(ext, ".txt") == 0) {
-        char asset_dir[MAX_PATH], src[MAX_PATH];
-        snprintf(asset_dir, sizeof(asset_dir), "%s/documents", assets_path);
-        const char *exts[] = { ".txt" };
-        if (pick_random_asset(asset_dir, exts, 1, src, sizeof(src)) == 0) {
-            success = (copy_binary_file(src, file_path) == 0);
-            if (success) {
-                add_op("copyFile", "Fill txt with demo content",
-                       "open(2)/read(2)/write(2)/close(2)", src, file_path, 1, NULL);
-            }
+/* ---- compression ---- */
+
+static void *ar_worker(void *arg) {
+    ArPipe *p = arg;
+    z_stream z;
+    memset(&z, 0, sizeof(z));
+    int ready = deflateInit2(&z, p->level ? p->level : 1, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+    for (;;) {
+        pthread_mutex_lock(&p->lock);
+        while (!p->stop && !p->reader_done && p->claimed == p->filled) pthread_cond_wait(&p->work, &p->lock);
+        if (p->stop || p->claimed == p->filled) {
+            pthread_mutex_unlock(&p->lock);
+            break;
         }
-        if (!success) {
-            FILE *fp = fopen(file_path, "w");
-            if (fp) {
-                fputs(text_templates[rand() % NUM_TEMPLATES], fp);
-                fclose(fp);
-                add_op("writeFile", "Fill file with demo text",
-                       "open(2)/write(2)/close(2)", file_path, NULL, 1, NULL);
+        ArSlot *s = &p->slots[p->claimed++ % p->nslots];
+        pthread_mutex_unlock(&p->lock);
+
+        s->crc = (uint32_t)crc32(0L, s->in, (uInt)s->in_len);
+        s->failed = 0;
+        if (s->ent->method == 0) {
+            s->out = s->in;
+            s->out_len = s->in_len;
+        } else {
+            s->out = s->in + AR_CHUNK;
+            int rc = ready ? deflateReset(&z) : Z_STREAM_ERROR;
+            if (rc == Z_OK && s->dict_len) rc = deflateSetDictionary(&z, s->dict, (uInt)s->dict_len);
+            if (rc == Z_OK) {
+                z.next_in = s->in;
+                z.avail_in = (uInt)s->in_len;
+                z.next_out = s->out;
+                z.avail_out = (uInt)p->out_cap;
+                rc = deflate(&z, s->last ? Z_FINISH : Z_SYNC_FLUSH);
             }
+            s->failed = s->last ? rc != Z_STREAM_END : rc != Z_OK || z.avail_out == 0;
+            s->out_len = p->out_cap - z.avail_out;
         }
+
+        pthread_mutex_lock(&p->lock);
+        s->state = AR_DONE;
+        pthread_cond_broadcast(&p->done);
+        pthread_mutex_unlock(&p->lock);
     }
-    else if (strcmp(ext, ".pdf") == 0) {
-        char asset_dir[MAX_PATH], src[MAX_PATH];
-        snprintf(asset_dir, sizeof(asset_dir), "%s/documents", assets_path);
-        const char *exts[] = { ".pdf" };
-        if (pick_random_asset(asset_dir, exts, 1, src, sizeof(src)) == 0) {
-            if (copy_binary_file(src, file_path) == 0) {
-                add_op("copyFile", "Fill pdf with demo content",
-                       "open(2)/read(2)/write(2)/close(2)", src, file_path, 1, NULL);
-            }
-        }
+    if (ready) deflateEnd(&z);
+    return NULL;
+}
+
+/* ---- writer ---- */
+
+static int archive_dir(Run *run, const char *workspace, const char *sub, int jobs, int level) {
+    if (run->req_id) {
+        jrn_error(run, "archive writes a ZIP to stdout and does not run in serve mode");
+        return -1;
     }
-    else if (is_img(ext)) {
-        char asset_dir[MAX_PATH], src[MAX_PATH];
-        snprintf(asset_dir, sizeof(asset_dir), "%s/images", assets_path);
-        const char *exts[] = { ".jpg", ".jpeg", ".png" };
-        if (pick_random_asset(asset_dir, exts, 3, src, sizeof(src)) == 0) {
-            if (copy_binary_file(src, file_path) == 0) {
-                add_op("copyFile", "Fill image with demo content",
-                       "open(2)/read(2)/write(2)/close(2)", src, file_path, 1, NULL);
-            }
-        }
+    if (isatty(STDOUT_FILENO)) {
+        jrn_error(run, "refusing to write a ZIP to a terminal");
+        return -1;
     }
-    else if (is_aud(ext)) {
-        char asset_dir[MAX_PATH], src[MAX_PATH];
-        snprintf(asset_dir, sizeof(asset_dir), "%s/audio", assets_path);
-        const char *exts[] = { ".mp3" };
-        if (pick_random_asset(asset_dir, exts, 1, src, sizeof(src)) == 0) {
-            if (copy_binary_file(src, file_path) == 0) {
-                add_op("copyFile", "Fill audio with demo content",
-                       "open(2)/read(2)/write(2)/close(2)", src, file_path, 1, NULL);
-            }
+    const char *base = arena_join(&run->arena, workspace, sub);
+    int dir_fd = base ? open(base, O_RDONLY | O_DIRECTORY | O_CLOEXEC) : -1;
+    ArReader r = { NULL, dir_fd, NULL, { 0 } };
+    if (dir_fd < 0 || fstat(dir_fd, &r.st) != 0) {
+        jrn_error(run, strerror(base ? errno : ENOMEM));
+        if (dir_fd >= 0) close(dir_fd);
+        return -1;
+    }
+    /* Entries sit below the directory's own name. */
+    char *root = arena_strdup(&run->arena, base);
+    size_t rl = strlen(root);
+    while (rl > 1 && root[rl - 1] == '/') root[--rl] = '\0';
+    char *slash = strrchr(root, '/');
+    r.root = slash && slash[1] ? slash + 1 : root;
+    if (!*r.root || strcmp(r.root, "/") == 0 || strcmp(r.root, ".") == 0 || strcmp(r.root, "..") == 0)
+        r.root = "archive";
+
+    if (jobs < 1) jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (jobs < 1) jobs = 1;
+    if (jobs > AR_MAX_JOBS) jobs = AR_MAX_JOBS;
+    ArPipe p;
+    memset(&p, 0, sizeof(p));
+    p.level = level;
+    p.base = base;
+    p.nslots = 2 * jobs + 2;
+    z_stream zb;
+    memset(&zb, 0, sizeof(zb));
+    if (deflateInit2(&zb, level ? level : 1, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) == Z_OK) {
+        p.out_cap = deflateBound(&zb, AR_CHUNK) + 64;   /* + the sync flush's empty block */
+        deflateEnd(&zb);
+    }
+    ArOut o = { STDOUT_FILENO, malloc(AR_OUT_BUF), 0, 0, 0 };
+    p.slots = calloc((size_t)p.nslots, sizeof(ArSlot));
+    p.dents = malloc(DENTS_BUF);
+    int ok = p.out_cap && o.buf && p.slots && p.dents;
+    for (int i = 0; ok && i < p.nslots; i++) {
+        /* in, then room for the compressed fragment, then the window */
+        p.slots[i].in = malloc(AR_CHUNK + p.out_cap + AR_WINDOW);
+        p.slots[i].dict = p.slots[i].in ? p.slots[i].in + AR_CHUNK + p.out_cap : NULL;
+        ok = p.slots[i].in != NULL;
+    }
+    pthread_t reader, workers[AR_MAX_JOBS];
+    int nworkers = 0, reading = 0;
+    if (ok) {
+        pthread_mutex_init(&p.lock, NULL);
+        pthread_cond_init(&p.room, NULL);
+        pthread_cond_init(&p.work, NULL);
+        pthread_cond_init(&p.done, NULL);
+        r.p = &p;
+        for (; nworkers < jobs; nworkers++)
+            if (pthread_create(&workers[nworkers], NULL, ar_worker, &p) != 0) break;
+        reading = nworkers > 0 && pthread_create(&reader, NULL, ar_reader, &r) == 0;
+        ok = reading;
+    }
+    if (!ok) {
+        if (nworkers) {
+            pthread_mutex_lock(&p.lock);
+            p.stop = 1;
+            pthread_cond_broadcast(&p.work);
+            pthread_mutex_unlock(&p.lock);
+            for (int i = 0; i < nworkers; i++) pthread_join(workers[i], NULL);
         }
+        jrn_error(run, "out of memory");
     }
-    else if (is_vid(ext)) {
-        char asset_dir[MAX_PATH], src[MAX_PATH];
-        snprintf(asset_dir, sizeof(asset_dir), "%s/videos", assets_path);
-        const char *exts[] = { ".mp4" };
-        if (pick_random_asset(asset_dir, exts, 1, src, sizeof(src)) == 0) {
-            if (copy_binary_file(src, file_path) == 0) {
-                add_op("copyFile", "Fill video with demo content",
-                       "open(2)/read(2)/write(2)/close(2)", src, file_path, 1, NULL);
+
+    /* A client that goes away shows up as a failed write, not a signal. */
+    void (*old_pipe)(int) = signal(SIGPIPE, SIG_IGN);
+    ArEntry **ents = NULL, *cur = NULL;
+    size_t nents = 0, cap = 0;
+    int failed = !ok;
+    while (ok) {
+        pthread_mutex_lock(&p.lock);
+        ArSlot *s = &p.slots[p.written % p.nslots];
+        if (p.written == p.filled ? !p.reader_done : s->state != AR_DONE) {
+            /* Nothing to write yet: let what is buffered go. */
+            pthread_mutex_unlock(&p.lock);
+            ar_flush(&o);
+            pthread_mutex_lock(&p.lock);
+            while (p.written == p.filled ? !p.reader_done : s->state != AR_DONE)
+                pthread_cond_wait(&p.done, &p.lock);
+        }
+        int end = p.written == p.filled;
+        pthread_mutex_unlock(&p.lock);
+        if (end || o.failed) break;
+
+        ArEntry *e = s->ent;
+        if (s->first) {
+            ar_local_header(&o, e);
+            cur = e;
+        }
+        if (s->failed) {
+            fprintf(stderr, "archive: %s: deflate failed\n", e->name);
+            o.failed = 1;
+        }
+        ar_put(&o, s->out, s->out_len);
+        e->crc = s->first ? s->crc : (uint32_t)crc32_combine(e->crc, s->crc, (z_off_t)s->in_len);
+        e->usize += s->in_len;
+        e->csize += s->out_len;
+        if (s->last) {
+            ar_descriptor(&o, e);
+            cur = NULL;
+            if (nents == cap) {
+                cap = cap ? cap * 2 : 256;
+                ArEntry **grown = realloc(ents, cap * sizeof(*ents));
+                if (!grown) {
+                    o.failed = 1;
+                    cur = e;
+                } else {
+                    ents = grown;
+                }
             }
+            if (!cur) ents[nents++] = e;
         }
+
+        pthread_mutex_lock(&p.lock);
+        s->state = AR_FREE;
+        p.written++;
+        pthread_cond_signal(&p.room);
+        pthread_mutex_unlock(&p.lock);
+        if (o.failed) break;
     }
-}
 
-static int organize_directory(const char *base_path, const char *assets_path) {
-    DIR *dp = opendir(base_path);
-    if (!dp) {
-        add_op("readdir", "Read directory entries", "opendir(3)/readdir(3)", base_path, NULL, 0, strerror(errno));
-        printf("{\"operations\":[],\"result\":null,\"error\":\"%s\"}\n", strerror(errno));
-        return -1;
-    }
-    add_op("readdir", "Read directory entries", "opendir(3)/readdir(3)", base_path, NULL, 1, NULL);
-
-    char documents[MAX_PATH], images[MAX_PATH], audio[MAX_PATH], videos[MAX_PATH], others[MAX_PATH];
-    snprintf(documents, sizeof(documents), "%s/Documents", base_path);
-    snprintf(images, sizeof(images), "%s/Images", base_path);
-    snprintf(audio, sizeof(audio), "%s/Audio", base_path);
-    snprintf(videos, sizeof(videos), "%s/Videos", base_path);
-    snprintf(others, sizeof(others), "%s/Others", base_path);
-
-    mkdir(documents, 0777);
-    mkdir(images, 0777);
-    mkdir(audio, 0777);
-    mkdir(videos, 0777);
-    mkdir(others, 0777);
-    add_op("mkdir", "Create category folder", "mkdir(2)", documents, NULL, 1, NULL);
-    add_op("mkdir", "Create category folder", "mkdir(2)", images, NULL, 1, NULL);
-    add_op("mkdir", "Create category folder", "mkdir(2)", audio, NULL, 1, NULL);
-    add_op("mkdir", "Create category folder", "mkdir(2)", videos, NULL, 1, NULL);
-    add_op("mkdir", "Create category folder", "mkdir(2)", others, NULL, 1, NULL);
-
-    char *docs[64], *imgs[64], *auds[64], *vids[64], *oth[64];
-    int d = 0, i = 0, a = 0, v = 0, o = 0;
-    struct dirent *entry;
-    while ((entry = readdir(dp)) != NULL) {
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
-        char ent_path[MAX_PATH];
-        snprintf(ent_path, sizeof(ent_path), "%s/%s", base_path, entry->d_name);
-        struct stat st;
-        if (stat(ent_path, &st) == 0 && S_ISDIR(st.st_mode)) continue;
-
-        char old_path[MAX_PATH], new_path[MAX_PATH];
-        snprintf(old_path, sizeof(old_path), "%s/%s", base_path, entry->d_name);
-        const char *ext = strrchr(entry->d_name, '.');
-        char *dest = others;
-        char **list = oth;
-        int *cnt = &o;
-        if (ext && is_doc(ext)) { dest = documents; list = docs; cnt = &d; }
-        else if (ext && is_img(ext)) { dest = images; list = imgs; cnt = &i; }
-        else if (ext && is_aud(ext)) { dest = audio; list = auds; cnt = &a; }
-        else if (ext && is_vid(ext)) { dest = videos; list = vids; cnt = &v; }
-        snprintf(new_path, sizeof(new_path), "%s/%s", dest, entry->d_name);
-
-        if (rename(old_path, new_path) == 0) {
-            add_op("rename", "Move file to category", "rename(2)", old_path, new_path, 1, NULL);
-            /* Fill the moved file with demo content if it is empty */
-            if (ext) fill_with_demo_content(new_path, ext, assets_path);
-            list[*cnt] = strdup(entry->d_name);
-            (*cnt)++;
-        } else {
-            add_op("rename", "Move file to category", "rename(2)", old_path, new_path, 0, strerror(errno));
+    if (ok) {
+        pthread_mutex_lock(&p.lock);
+        __atomic_store_n(&p.stop, o.failed, __ATOMIC_RELEASE);
+        pthread_cond_broadcast(&p.room);
+        pthread_cond_broadcast(&p.work);
+        pthread_mutex_unlock(&p.lock);
+        pthread_join(reader, NULL);
+        for (int i = 0; i < nworkers; i++) pthread_join(workers[i], NULL);
+        /* After a stop, the entry being written and those the writer never
+         * reached are not in ents. */
+        if (cur) { free(cur->name); free(cur); }
+        for (uint64_t q = p.written; q < p.filled; q++) {
+            ArSlot *s = &p.slots[q % p.nslots];
+            if (s->first) { free(s->ent->name); free(s->ent); }
         }
     }
-    closedir(dp);
-
-    printf("{\"operations\":[");
-    for (int k = 0; k < nops; k++) {
-        OpRec *r = &ops[k];
-        char pe[MAX_PATH * 2], p2e[MAX_PATH * 2], ee[256];
-        json_escape(r->path, pe, sizeof(pe));
-        json_escape(r->path2, p2e, sizeof(p2e));
-        json_escape(r->error, ee, sizeof(ee));
-        if (k) printf(",");
-        printf("{\"id\":%d,\"op\":\"%s\",\"description\":\"%s\",\"syscall\":\"%s\",\"path\":\"%s\",\"path2\":\"%s\",\"success\":%s,\"error\":\"%s\"}",
-               r->id, r->op, r->description, r->syscall, pe, p2e, r->success ? "true" : "false", ee);
-    }
-    printf("],\"result\":{");
-    printf("\"Documents\":[");
-    for (int x = 0; x < d; x++) printf("%s\"%s\"", x ? "," : "", docs[x]);
-    printf("],\"Images\":[");
-    for (int x = 0; x < i; x++) printf("%s\"%s\"", x ? "," : "", imgs[x]);
-    printf("],\"Audio\":[");
-    for (int x = 0; x < a; x++) printf("%s\"%s\"", x ? "," : "", auds[x]);
-    printf("],\"Videos\":[");
-    for (int x = 0; x < v; x++) printf("%s\"%s\"", x ? "," : "", vids[x]);
-    printf("],\"Others\":[");
-    for (int x = 0; x < o; x++) printf("%s\"%s\"", x ? "," : "", oth[x]);
-    printf("]}}\n");
-
-    for (int x = 0; x < d; x++) free(docs[x]);
-    for (int x = 0; x < i; x++) free(imgs[x]);
-    for (int x = 0; x < a; x++) free(auds[x]);
-    for (int x = 0; x < v; x++) free(vids[x]);
-    for (int x = 0; x < o; x++) free(oth[x]);
-    return 0;
+    if (ok && !o.failed) {
+        char *cd = NULL;
+        size_t cd_len = 0, cd_cap = 0;
+        uint64_t cd_off = o.off;
+        for (size_t i = 0; i < nents && !o.failed; i++)
+            if (ar_central(&cd, &cd_len, &cd_cap, ents[i]) != 0) o.failed = 1;
+        if (!o.failed) {
+            ar_put(&o, cd, cd_len);
+            ar_end(&o, nents, cd_off, cd_len);
+            ar_flush(&o);
+        }
+        free(cd);
+    }
+    if (ok && o.failed) {
+        failed = 1;
+        fprintf(stderr, "archive: %s: output closed, stopped\n", base);
+    }
+    signal(SIGPIPE, old_pipe);
+    for (size_t i = 0; i < nents; i++) {
+        free(ents[i]->name);
+        free(ents[i]);
+    }
+    free(ents);
+    if (ok) {
+        pthread_mutex_destroy(&p.lock);
+        pthread_cond_destroy(&p.room);
+        pthread_cond_destroy(&p.work);
+        pthread_cond_destroy(&p.done);
+    }
+    for (int i = 0; p.slots && i < p.nslots; i++) free(p.slots[i].in);
+    free(p.slots);
+    free(p.dents);
+    free(o.buf);
+    close(dir_fd);
+    return failed || p.skipped ? -1 : 0;
 }
 
-int main(int argc, char *argv[]) {
-    nops = 0;
-    srand((unsigned)time(NULL));
+static void usage(void) {
+    fprintf(stderr, "Usage: organizer_cli create-dir <workspace> <dirName> <file1> [file2 ...]\n");
+    fprintf(stderr, "       organizer_cli organize <workspace> [subpath] [assets_path] [--recursive] [--jobs N] [--rules <file>]\n");
+    fprintf(stderr, "                [--sniff] [--sniff-jobs N]   classify by content too (default %d readers)\n", SNIFF_DEFAULT_JOBS);
+    fprintf(stderr, "                [--no-journal]   skip the undo journal\n");
+    fprintf(stderr, "       organizer_cli watch <workspace> [subpath] [assets_path] [--rules <file>] [--sniff]\n");
+    fprintf(stderr, "                [--debounce MS]   keep organizing new files (default %d ms quiet)\n", WATCH_DEBOUNCE_MS);
+    fprintf(stderr, "                [--no-journal]\n");
+    fprintf(stderr, "       organizer_cli undo <workspace> [batch-id]   revert an organize (default: the last one)\n");
+    fprintf(stderr, "       organizer_cli copy <workspace> <src> <dst> [<src> <dst> ...] [--jobs N]\n");
+    fprintf(stderr, "       organizer_cli dedupe <workspace> [subpath] [--jobs N] [--link hard|reflink]\n");
+    fprintf(stderr, "       organizer_cli du <workspace> [subpath] [--jobs N]\n");
+    fprintf(stderr, "       organizer_cli index <workspace> [--watch]\n");
+    fprintf(stderr, "       organizer_cli query <workspace> list|stat|du [path] | search <text> [--limit N]\n");
+    fprintf(stderr, "       organizer_cli search <workspace> <text> [--limit N]\n");
+    fprintf(stderr, "       organizer_cli meta <workspace> [--stdin] <op> [<op> ...]   per-path metadata; ops:\n");
+    fprintf(stderr, "                get <path> | list <path> | set <path> <field> <json> | del <path> <field>\n");
+    fprintf(stderr, "                rm <path> | mv <from> <to>   (--stdin: one op per line, tab-separated)\n");
+    fprintf(stderr, "       organizer_cli vindex <workspace> <op>   embedding index for semantic search; ops:\n");
+    fprintf(stderr, "                add <path> <vector> [--int8] | add --stdin   (path<TAB>vector per line)\n");
+    fprintf(stderr, "                rm <path> [<path> ...] | mv <from> <to> | stats\n");
+    fprintf(stderr, "                search <vector> [--k N] [--probe N] [--exact] [--jobs N]   (default k %d, probe %d)\n",
+            VX_K_DEFAULT, VX_PROBE_DEFAULT);
+    fprintf(stderr, "                train [--lists N] [--jobs N]   group the vectors into IVF lists\n");
+    fprintf(stderr, "       organizer_cli ftindex <workspace> [<op>] [--jobs N]   full-text index of documents; ops:\n");
+    fprintf(stderr, "                (none: refresh) | query <expr> [--limit N] | text <path> [<path> ...] [--max N]\n");
+    fprintf(stderr, "                expr: words (all must match), \"a phrase\", a OR b, -word / NOT word\n");
+    fprintf(stderr, "       organizer_cli move <workspace> <from> <to> [<from> <to> ...] [--stdin]   never replaces\n");
+    fprintf(stderr, "       organizer_cli bin <workspace> <op> [--stdin]   the workspace's recycle bin; ops:\n");
+    fprintf(stderr, "                trash <path> ... | restore <id> ... | list | import <name> <path> <deleted-ms> ...\n");
+    fprintf(stderr, "                purge <id> ... [--jobs N] [--background]   (default %d removal threads)\n",
+            BIN_DEFAULT_JOBS);
+    fprintf(stderr, "       organizer_cli archive <workspace> [subpath] [--jobs N] [--level 0-9]   ZIP on stdout\n");
+    fprintf(stderr, "                (default one compressor per CPU, level %d)\n", AR_DEFAULT_LEVEL);
+    fprintf(stderr, "       organizer_cli serve [--socket <path>] [--workers N]\n");
+    fprintf(stderr, "  any mode: --output ndjson   stream one JSON line per op, then a result line\n");
+    fprintf(stderr, "            --io uring         batch file-system calls through io_uring\n");
+    fprintf(stderr, "            --io-depth N       calls in flight with --io uring (default %d)\n", IO_DEFAULT_DEPTH);
+    fprintf(stderr, "            --profile          add CPU time, peak RSS and page faults to the result\n");
+}
 
+/* Runs one request. Shared by the one-shot CLI and every serve worker. */
+static int dispatch(Run *run, int argc, char *argv[]) {
+    /* --output json|ndjson, --io sync|uring [--io-depth N] and --profile
+     * apply to every mode; strip them before parsing. */
+    if (!run->t0_ns) run->t0_ns = now_ns();
+    for (int i = 2; i < argc; i++) {
+        const char *fmt = NULL, *io = NULL, *depth = NULL;
+        int used = 0;
+        if (strcmp(argv[i], "--profile") == 0) { run->profile = 1; used = 1; }
+        else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) { fmt = argv[i + 1]; used = 2; }
+        else if (strncmp(argv[i], "--output=", 9) == 0) { fmt = argv[i] + 9; used = 1; }
+        else if (strcmp(argv[i], "--io") == 0 && i + 1 < argc) { io = argv[i + 1]; used = 2; }
+        else if (strncmp(argv[i], "--io=", 5) == 0) { io = argv[i] + 5; used = 1; }
+        else if (strcmp(argv[i], "--io-depth") == 0 && i + 1 < argc) { depth = argv[i + 1]; used = 2; }
+        else if (strncmp(argv[i], "--io-depth=", 11) == 0) { depth = argv[i] + 11; used = 1; }
+        if (!used) continue;
+        if (fmt && strcmp(fmt, "ndjson") == 0) run_set_ndjson(run);
+        else if (fmt && strcmp(fmt, "json") != 0) { usage(); return 1; }
+        if (io && strcmp(io, "uring") == 0) run->io_mode = IO_URING;
+        else if (io && strcmp(io, "sync") == 0) run->io_mode = IO_SYNC;
+        else if (io) { usage(); return 1; }
+        if (depth && (run->io_depth = (unsigned)atoi(depth)) < 1) { usage(); return 1; }
+        memmove(&argv[i], &argv[i + used], (argc - i - used + 1) * sizeof(char *));
+        argc -= used;
+        i--;
+    }
     if (argc < 3) {
-        fprintf(stderr, "Usage: organizer_cli create-dir <workspace> <dirName> <file1> [file2 ...]\n");
-        fprintf(stderr, "       organizer_cli organize <workspace> [subpath] [assets_path]\n");
+        usage();
         return 1;
     }
     const char *mode = argv[1];
@@ -361,19 +11450,650 @@ int main(int argc, char *argv[]) {
             fprintf(stderr, "create-dir needs: workspace dirName file1 [file2 ...]\n");
             return 1;
         }
-        return create_dir_and_files(workspace, argv[3], &argv[4], argc - 4) == 0 ? 0 : 1;
+        return create_dir_and_files(run, workspace, argv[3], &argv[4], argc - 4) == 0 ? 0 : 1;
     }
     if (strcmp(mode, "organize") == 0) {
-        char base[MAX_PATH];
-        if (argc >= 4 && argv[3][0])
-            snprintf(base, sizeof(base), "%s/%s", workspace, argv[3]);
-        else
-            snprintf(base, sizeof(base), "%s", workspace);
+        /* Flags may appear anywhere after the mode; the rest are positional. */
+        char *pos[3] = { NULL, NULL, NULL };
+        const char *rules = NULL;
+        int npos = 0, recursive = 0, jobs = 0, sniff_jobs = -1, journal = 1;
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "--recursive") == 0) recursive = 1;
+            else if (strcmp(argv[i], "--no-journal") == 0) journal = 0;
+            else if (strcmp(argv[i], "--sniff") == 0) { if (sniff_jobs < 0) sniff_jobs = SNIFF_DEFAULT_JOBS; }
+            else if (strcmp(argv[i], "--sniff-jobs") == 0 && i + 1 < argc) sniff_jobs = atoi(argv[++i]);
+            else if (strcmp(argv[i], "--rules") == 0 && i + 1 < argc) rules = argv[++i];
+            else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) jobs = atoi(argv[++i]);
+            else if (strncmp(argv[i], "--jobs=", 7) == 0) jobs = atoi(argv[i] + 7);
+            else if (npos < 3) pos[npos++] = argv[i];
+        }
+        if (!pos[0]) {
+            usage();
+            return 1;
+        }
+        if (recursive && jobs < 1) jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+        const char *base = arena_join(&run->arena, pos[0], pos[1]);
+        if (!base) return 1;
 
         /* Optional 4th arg: path to assets directory for demo content */
-        const char *assets_path = (argc >= 5) ? argv[4] : NULL;
-        return organize_directory(base, assets_path) == 0 ? 0 : 1;
+        const char *assets_path = pos[2];
+        const Classifier *cls = rules ? load_rules(run, rules) : &builtin_classifier;
+        if (!cls) return 1;
+        if (sniff_jobs < -1) sniff_jobs = 0;
+        Journal j;
+        int journaled = journal && jrn_open(&j, pos[0]) == 0;
+        if (journaled && jrn_lock(run, &j) != 0) {
+            jrn_error(run, strerror(errno));
+            jrn_close(&j);
+            return 1;
+        }
+        int rc = organize_directory(run, base, assets_path, cls, recursive, jobs, sniff_jobs,
+                                    journaled ? &j : NULL, pos[1] ? pos[1] : "");
+        if (journaled) {
+            jrn_unlock(&j);
+            jrn_close(&j);
+        }
+        return rc == 0 ? 0 : 1;
+    }
+    if (strcmp(mode, "watch") == 0) {
+        char *pos[3] = { NULL, NULL, NULL };
+        const char *rules = NULL;
+        int npos = 0, sniff_jobs = -1, debounce = WATCH_DEBOUNCE_MS, journal = 1;
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "--sniff") == 0) { if (sniff_jobs < 0) sniff_jobs = SNIFF_DEFAULT_JOBS; }
+            else if (strcmp(argv[i], "--no-journal") == 0) journal = 0;
+            else if (strcmp(argv[i], "--sniff-jobs") == 0 && i + 1 < argc) sniff_jobs = atoi(argv[++i]);
+            else if (strcmp(argv[i], "--rules") == 0 && i + 1 < argc) rules = argv[++i];
+            else if (strcmp(argv[i], "--debounce") == 0 && i + 1 < argc) debounce = atoi(argv[++i]);
+            else if (npos < 3) pos[npos++] = argv[i];
+        }
+        if (!pos[0] || debounce < 1) {
+            usage();
+            return 1;
+        }
+        const char *base = arena_join(&run->arena, pos[0], pos[1]);
+        const Classifier *cls = rules ? load_rules(run, rules) : &builtin_classifier;
+        if (!base || !cls) return 1;
+        if (sniff_jobs < -1) sniff_jobs = 0;
+        Journal j;
+        int journaled = journal && jrn_open(&j, pos[0]) == 0;
+        int rc = watch_directory(run, base, pos[2], cls, sniff_jobs, debounce, journaled ? &j : NULL,
+                                 pos[1] ? pos[1] : "");
+        if (journaled) jrn_close(&j);
+        return rc == 0 ? 0 : 1;
+    }
+    if (strcmp(mode, "undo") == 0) {
+        long id = argc > 3 ? atol(argv[3]) : 0;
+        if (argc > 4 || (argc > 3 && id < 1)) {
+            usage();
+            return 1;
+        }
+        Journal j;
+        errno = 0;
+        if (jrn_open(&j, workspace) != 0) {
+            jrn_error(run, errno ? strerror(errno) : "no cache directory");
+            return 1;
+        }
+        int rc = -1;
+        if (jrn_lock(run, &j) != 0) jrn_error(run, strerror(errno));
+        else {
+            rc = undo_batch(run, &j, id);
+            jrn_unlock(&j);
+        }
+        jrn_close(&j);
+        return rc == 0 ? 0 : 1;
+    }
+    if (strcmp(mode, "copy") == 0) {
+        char **pairs = &argv[3];
+        int npairs = 0, jobs = 0;
+        for (int i = 3; i < argc; i++) {
+            if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) jobs = atoi(argv[++i]);
+            else if (strncmp(argv[i], "--jobs=", 7) == 0) jobs = atoi(argv[i] + 7);
+            else pairs[npairs++] = argv[i];
+        }
+        if (npairs < 2 || npairs % 2) {
+            fprintf(stderr, "copy needs: workspace src dst [src dst ...]\n");
+            return 1;
+        }
+        return copy_files(run, workspace, pairs, npairs, jobs) == 0 ? 0 : 1;
+    }
+    if (strcmp(mode, "du") == 0) {
+        const char *sub = NULL;
+        int jobs = 0;
+        for (int i = 3; i < argc; i++) {
+            if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) jobs = atoi(argv[++i]);
+            else if (strncmp(argv[i], "--jobs=", 7) == 0) jobs = atoi(argv[i] + 7);
+            else if (!sub) sub = argv[i];
+        }
+        const char *base = arena_join(&run->arena, workspace, sub);
+        if (!base) return 1;
+        return disk_usage(run, base, jobs) == 0 ? 0 : 1;
+    }
+    if (strcmp(mode, "dedupe") == 0) {
+        const char *sub = NULL;
+        int jobs = 0, link_how = DUP_LINK_NONE;
+        for (int i = 3; i < argc; i++) {
+            if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) jobs = atoi(argv[++i]);
+            else if (strncmp(argv[i], "--jobs=", 7) == 0) jobs = atoi(argv[i] + 7);
+            else if (strcmp(argv[i], "--link") == 0 && i + 1 < argc) {
+                const char *how = argv[++i];
+                if (strcmp(how, "hard") == 0) link_how = DUP_LINK_HARD;
+                else if (strcmp(how, "reflink") == 0) link_how = DUP_LINK_REFLINK;
+                else { usage(); return 1; }
+            }
+            else if (!sub) sub = argv[i];
+        }
+        const char *base = arena_join(&run->arena, workspace, sub);
+        if (!base) return 1;
+        return dedupe(run, base, jobs, link_how) == 0 ? 0 : 1;
+    }
+    if (strcmp(mode, "index") == 0) {
+        int watch = argc > 3 && strcmp(argv[3], "--watch") == 0;
+        return ws_index(run, workspace, watch) == 0 ? 0 : 1;
+    }
+    if (strcmp(mode, "query") == 0 || strcmp(mode, "search") == 0) {
+        /* `search <ws> <text>` is short for `query <ws> search <text>`. */
+        const char *what = strcmp(mode, "search") == 0 ? "search" : NULL, *arg = NULL;
+        long limit = WS_SEARCH_LIMIT;
+        for (int i = 3; i < argc; i++) {
+            if (strcmp(argv[i], "--limit") == 0 && i + 1 < argc) limit = atol(argv[++i]);
+            else if (!what) what = argv[i];
+            else if (!arg) arg = argv[i];
+        }
+        int search = what && strcmp(what, "search") == 0;
+        if (!what || (!search && strcmp(what, "list") && strcmp(what, "stat") && strcmp(what, "du")) ||
+            (search && !arg)) {
+            usage();
+            return 1;
+        }
+        return ws_query(run, workspace, what, arg ? arg : "", limit > 0 ? limit : WS_SEARCH_LIMIT) == 0 ? 0 : 1;
+    }
+    if (strcmp(mode, "meta") == 0) {
+        int from_stdin = argc > 3 && strcmp(argv[3], "--stdin") == 0;
+        MetaOp *ops = NULL;
+        long nops = 0, cap = 0;
+        char *input = NULL;
+        int bad = meta_parse(&argv[3 + from_stdin], argc - 3 - from_stdin, &ops, &nops, &cap) != 0;
+        if (!bad && from_stdin) {
+            /* In serve mode stdin carries the requests. */
+            bad = run->req_id != NULL || meta_read_ops(&input, &ops, &nops, &cap) != 0;
+        }
+        if (bad || !nops) {
+            usage();
+            free(ops);
+            free(input);
+            return 1;
+        }
+        int rc = meta_run(run, workspace, ops, nops);
+        free(ops);
+        free(input);
+        return rc == 0 ? 0 : 1;
+    }
+    if (strcmp(mode, "vindex") == 0) {
+        VxReq rq = { -1, &argv[4], 0, VX_K_DEFAULT, VX_PROBE_DEFAULT, 0, 0, 0, VX_F32 };
+        const int nkinds = (int)(sizeof(vx_ops) / sizeof(vx_ops[0]));
+        int from_stdin = 0;
+        for (int i = 3; i < argc; i++) {
+            if (strcmp(argv[i], "--k") == 0 && i + 1 < argc) rq.k = atoi(argv[++i]);
+            else if (strcmp(argv[i], "--probe") == 0 && i + 1 < argc) rq.probe = atoi(argv[++i]);
+            else if (strcmp(argv[i], "--lists") == 0 && i + 1 < argc) rq.lists = atoi(argv[++i]);
+            else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) rq.jobs = atoi(argv[++i]);
+            else if (strcmp(argv[i], "--exact") == 0) rq.exact = 1;
+            else if (strcmp(argv[i], "--int8") == 0) rq.quant = VX_I8;
+            else if (strcmp(argv[i], "--stdin") == 0) from_stdin = 1;
+            else if (rq.op < 0) {
+                for (rq.op = 0; rq.op < nkinds && strcmp(argv[i], vx_ops[rq.op]) != 0; rq.op++) {}
+                if (rq.op == nkinds) rq.op = -2;
+            }
+            else rq.args[rq.nargs++] = argv[i];
+        }
+        static const int want[] = { 2, 1, 2, 1, 0, 0 };
+        int bad = rq.op < 0 || rq.k < 1 || rq.k > VX_K_MAX || rq.probe < 1 || rq.lists < 0 ||
+                  (from_stdin && rq.op != VX_OP_ADD) ||
+                  (rq.op == VX_OP_RM ? rq.nargs < 1 : rq.nargs != (from_stdin ? 0 : want[rq.op]));
+        char *input = NULL;
+        /* In serve mode stdin carries the requests. */
+        if (!bad && from_stdin) bad = run->req_id != NULL || !(input = read_stdin());
+        if (bad) {
+            usage();
+            return 1;
+        }
+        int rc = vx_run(run, workspace, &rq, input);
+        free(input);
+        return rc == 0 ? 0 : 1;
+    }
+    if (strcmp(mode, "ftindex") == 0) {
+        FtReq rq = { FT_OP_REFRESH, &argv[4], 0, 0, FT_LIMIT_DEFAULT, FT_TEXT_DEFAULT };
+        int named = 0;
+        for (int i = 3; i < argc; i++) {
+            if (strcmp(argv[i], "--limit") == 0 && i + 1 < argc) rq.limit = atol(argv[++i]);
+            else if (strcmp(argv[i], "--max") == 0 && i + 1 < argc) rq.max = atol(argv[++i]);
+            else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) rq.jobs = atoi(argv[++i]);
+            else if (!named) {
+                for (rq.op = 0; rq.op < 3 && strcmp(argv[i], ft_ops[rq.op]) != 0; rq.op++) {}
+                named = 1;
+            }
+            else rq.args[rq.nargs++] = argv[i];
+        }
+        /* A query may come as several words; they make one expression. */
+        if (rq.op == FT_OP_QUERY && rq.nargs > 1) {
+            size_t len = 1;
+            for (int i = 0; i < rq.nargs; i++) len += strlen(rq.args[i]) + 1;
+            char *q = arena_alloc(&run->arena, len);
+            if (!q) return 1;
+            q[0] = '\0';
+            for (int i = 0; i < rq.nargs; i++) strcat(strcat(q, i ? " " : ""), rq.args[i]);
+            rq.args[0] = q;
+            rq.nargs = 1;
+        }
+        if (rq.op == 3 || rq.limit < 1 || rq.limit > FT_LIMIT_MAX || rq.max < 0 ||
+            (rq.op == FT_OP_REFRESH ? rq.nargs != 0 : rq.nargs < 1)) {
+            usage();
+            return 1;
+        }
+        return ft_run(run, workspace, &rq) == 0 ? 0 : 1;
+    }
+    if (strcmp(mode, "bin") == 0 || strcmp(mode, "move") == 0) {
+        BinReq rq = { BIN_OP_MOVE, malloc(argc * sizeof(char *)), 0, BIN_DEFAULT_JOBS, 0 };
+        const int nkinds = (int)(sizeof(bin_ops) / sizeof(bin_ops[0]));
+        int from_stdin = 0, named = mode[0] == 'm';
+        for (int i = 3; i < argc; i++) {
+            if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) rq.jobs = atoi(argv[++i]);
+            else if (strcmp(argv[i], "--background") == 0) rq.background = 1;
+            else if (strcmp(argv[i], "--stdin") == 0) from_stdin = 1;
+            else if (!named) {
+                for (rq.op = 0; rq.op < nkinds && strcmp(argv[i], bin_ops[rq.op]) != 0; rq.op++) {}
+                if (rq.op == nkinds) rq.op = -1;
+                named = 1;
+            }
+            else if (rq.args) rq.args[rq.nargs++] = argv[i];
+        }
+        char *input = NULL;
+        /* In serve mode stdin carries the requests. */
+        int bad = !rq.args || !named || rq.op < 0 || rq.jobs < 1 || (from_stdin && rq.op == BIN_OP_LIST) ||
+                  (from_stdin && (run->req_id || !(input = read_stdin()) ||
+                                  bin_read_words(input, &rq.args, &rq.nargs) != 0));
+        if (!bad) {
+            if (rq.op == BIN_OP_LIST) bad = rq.nargs != 0;
+            else if (rq.op == BIN_OP_MOVE) bad = rq.nargs < 2 || rq.nargs % 2;
+            else if (rq.op == BIN_OP_IMPORT) bad = rq.nargs < 3 || rq.nargs % 3;
+            else bad = rq.nargs < 1;
+        }
+        int rc = 1;
+        if (bad) usage();
+        else if (rq.op == BIN_OP_MOVE) rc = move_run(run, workspace, rq.args, rq.nargs) == 0 ? 0 : 1;
+        else rc = bin_run(run, workspace, &rq) == 0 ? 0 : 1;
+        free(rq.args);
+        free(input);
+        return rc;
+    }
+    if (strcmp(mode, "archive") == 0) {
+        const char *sub = NULL;
+        int jobs = 0, level = AR_DEFAULT_LEVEL;
+        for (int i = 3; i < argc; i++) {
+            if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) jobs = atoi(argv[++i]);
+            else if (strncmp(argv[i], "--jobs=", 7) == 0) jobs = atoi(argv[i] + 7);
+            else if (strcmp(argv[i], "--level") == 0 && i + 1 < argc) level = atoi(argv[++i]);
+            else if (strncmp(argv[i], "--level=", 8) == 0) level = atoi(argv[i] + 8);
+            else if (!sub) sub = argv[i];
+        }
+        if (level < 0 || level > 9) {
+            usage();
+            return 1;
+        }
+        return archive_dir(run, workspace, sub, jobs, level) == 0 ? 0 : 1;
     }
     fprintf(stderr, "Unknown mode: %s\n", mode);
     return 1;
 }
+
+/* ---- SERVE MODE ----
+ * One reader thread per connection splits input into lines and queues them;
+ * a fixed pool of workers runs the requests. Replies are written whole
+ * under the connection's write lock, so concurrent replies never
+ * interleave; clients match them up by "id". */
+#define SERVE_MAX_ARGS 256
+
+typedef struct {
+    int in_fd, out_fd;
+    int close_fd;           /* socket connections own their fd */
+    int refs;               /* reader + queued/in-flight requests */
+    pthread_mutex_t lock;
+    pthread_cond_t idle;
+} Conn;
+
+typedef struct Job {
+    Conn *conn;
+    char *line;
+    double t_recv;
+    struct Job *next;
+} Job;
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    Job *head, *tail;
+} jobq = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, NULL };
+
+static void conn_release(Conn *c) {
+    pthread_mutex_lock(&c->lock);
+    int left = --c->refs;
+    pthread_cond_broadcast(&c->idle);
+    pthread_mutex_unlock(&c->lock);
+    if (left == 0 && c->close_fd) {
+        close(c->in_fd);
+        pthread_mutex_destroy(&c->lock);
+        pthread_cond_destroy(&c->idle);
+        free(c);
+    }
+}
+
+static const char *skip_ws(const char *p) {
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') p++;
+    return p;
+}
+
+/* Decodes the JSON string starting at the opening quote in place into a
+ * fresh heap copy; returns a pointer past the closing quote or NULL. */
+static const char *json_parse_string(const char *p, char **out) {
+    if (*p != '"') return NULL;
+    p++;
+    char *s = malloc(strlen(p) + 1);
+    if (!s) return NULL;
+    size_t j = 0;
+    while (*p && *p != '"') {
+        if (*p != '\\') { s[j++] = *p++; continue; }
+        p++;
+        switch (*p) {
+        case 'n': s[j++] = '\n'; break;
+        case 't': s[j++] = '\t'; break;
+        case 'r': s[j++] = '\r'; break;
+        case 'b': s[j++] = '\b'; break;
+        case 'f': s[j++] = '\f'; break;
+        case 'u': {
+            unsigned cp = 0;
+            for (int k = 1; k <= 4; k++) {
+                char h = p[k];
+                cp <<= 4;
+                if (h >= '0' && h <= '9') cp |= h - '0';
+                else if (h >= 'a' && h <= 'f') cp |= h - 'a' + 10;
+                else if (h >= 'A' && h <= 'F') cp |= h - 'A' + 10;
+                else { free(s); return NULL; }
+            }
+            p += 4;
+            if (cp < 0x80) s[j++] = (char)cp;
+            else if (cp < 0x800) { s[j++] = (char)(0xC0 | (cp >> 6)); s[j++] = (char)(0x80 | (cp & 0x3F)); }
+            else { s[j++] = (char)(0xE0 | (cp >> 12)); s[j++] = (char)(0x80 | ((cp >> 6) & 0x3F)); s[j++] = (char)(0x80 | (cp & 0x3F)); }
+            break;
+        }
+        case '\0': free(s); return NULL;
+        default: s[j++] = *p; break;
+        }
+        p++;
+    }
+    if (*p != '"') { free(s); return NULL; }
+    s[j] = '\0';
+    *out = s;
+    return p + 1;
+}
+
+/* Parses {"id":<string|number>,"argv":["mode",...]}. The id is kept as raw
+ * JSON text so it is echoed back exactly as the client sent it. */
+static int parse_request(const char *line, char **id, char **argv, int *argc) {
+    const char *p = skip_ws(line);
+    *id = NULL;
+    *argc = 0;
+    if (*p++ != '{') return -1;
+    for (;;) {
+        p = skip_ws(p);
+        if (*p == '}') break;
+        char *key;
+        if (!(p = json_parse_string(p, &key))) return -1;
+        p = skip_ws(p);
+        if (*p++ != ':') { free(key); return -1; }
+        p = skip_ws(p);
+        if (strcmp(key, "argv") == 0) {
+            if (*p++ != '[') { free(key); return -1; }
+            argv[(*argc)++] = strdup("organizer_cli");
+            for (;;) {
+                p = skip_ws(p);
+                if (*p == ']') { p++; break; }
+                if (*argc >= SERVE_MAX_ARGS - 1 || !(p = json_parse_string(p, &argv[*argc]))) {
+                    free(key);
+                    return -1;
+                }
+                (*argc)++;
+                p = skip_ws(p);
+                if (*p == ',') p++;
+            }
+        } else {
+            const char *v = p;
+            if (*p == '"') {
+                char *tmp;
+                if (!(p = json_parse_string(p, &tmp))) { free(key); return -1; }
+                free(tmp);
+            } else {
+                while (*p && *p != ',' && *p != '}') p++;
+            }
+            if (strcmp(key, "id") == 0) {
+                const char *e = p;
+                while (e > v && (e[-1] == ' ' || e[-1] == '\t')) e--;
+                free(*id);
+                *id = strndup(v, (size_t)(e - v));
+            }
+        }
+        free(key);
+        p = skip_ws(p);
+        if (*p == ',') p++;
+        else if (*p != '}') return -1;
+    }
+    argv[*argc] = NULL;
+    return *argc > 1 ? 0 : -1;
+}
+
+static void handle_job(Job *job) {
+    char *argv[SERVE_MAX_ARGS];
+    int argc = 0;
+    char *id = NULL;
+    Sink sink = { job->conn->out_fd, &job->conn->lock, 0 };
+
+    Run *run = calloc(1, sizeof(*run));
+    if (!run) return;
+    run->line_sink = &sink;
+    rng_seed(&run->rng, (uint64_t)(now_us() * 1000) ^ (uint64_t)(uintptr_t)job);
+    run->t_recv = job->t_recv;
+
+    int status;
+    if (parse_request(job->line, &id, argv, &argc) != 0) {
+        status = -1;
+    } else {
+        run->req_id = id ? id : "null";
+        status = dispatch(run, argc, argv);
+    }
+    if (status != 0 && run->out.len == 0 && sink.next_op_id == 0 && run->nops == 0) {
+        /* Usage errors print nothing to stdout; still answer the request. */
+        run->req_id = id ? id : "null";
+        out_printf(run, "{%s,\"result\":null,\"error\":\"%s\"",
+                   run->ndjson ? "\"type\":\"result\"" : "\"operations\":[]",
+                   status < 0 ? "malformed request" : "request failed");
+        finish_json(run);
+    }
+    /* JSON-mode replies were built in memory; send them in one write. */
+    run->out.sink = &sink;
+    out_flush(&run->out);
+
+    fprintf(stderr, "serve: id=%s mode=%s %.0fus\n", id ? id : "null",
+            argc > 1 ? argv[1] : "?", now_us() - job->t_recv);
+
+    for (int i = 0; i < argc; i++) free(argv[i]);
+    free(id);
+    free(run->out.buf);
+    arena_free(&run->arena);
+    free(run);
+}
+
+static void *serve_worker(void *arg) {
+    (void)arg;
+    for (;;) {
+        pthread_mutex_lock(&jobq.lock);
+        while (!jobq.head) pthread_cond_wait(&jobq.ready, &jobq.lock);
+        Job *job = jobq.head;
+        jobq.head = job->next;
+        if (!jobq.head) jobq.tail = NULL;
+        pthread_mutex_unlock(&jobq.lock);
+
+        handle_job(job);
+        conn_release(job->conn);
+        free(job->line);
+        free(job);
+    }
+    return NULL;
+}
+
+static void enqueue_line(Conn *c, const char *line, size_t len) {
+    const char *p = line;
+    while (len > 0 && (*p == ' ' || *p == '\t' || *p == '\r')) { p++; len--; }
+    if (len == 0) return;
+    Job *job = calloc(1, sizeof(*job));
+    if (!job || !(job->line = strndup(p, len))) { free(job); return; }
+    job->conn = c;
+    job->t_recv = now_us();
+    pthread_mutex_lock(&c->lock);
+    c->refs++;
+    pthread_mutex_unlock(&c->lock);
+
+    pthread_mutex_lock(&jobq.lock);
+    if (jobq.tail) jobq.tail->next = job; else jobq.head = job;
+    jobq.tail = job;
+    pthread_cond_signal(&jobq.ready);
+    pthread_mutex_unlock(&jobq.lock);
+}
+
+static void *serve_reader(void *arg) {
+    Conn *c = arg;
+    size_t cap = 64 * 1024, len = 0;
+    char *buf = malloc(cap);
+    while (buf) {
+        if (len == cap) {
+            char *grown = realloc(buf, cap * 2);
+            if (!grown) break;
+            buf = grown;
+            cap *= 2;
+        }
+        ssize_t n = read(c->in_fd, buf + len, cap - len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        len += (size_t)n;
+        size_t start = 0;
+        for (size_t i = len - (size_t)n; i < len; i++) {
+            if (buf[i] != '\n') continue;
+            enqueue_line(c, buf + start, i - start);
+            start = i + 1;
+        }
+        memmove(buf, buf + start, len - start);
+        len -= start;
+    }
+    if (buf && len > 0) enqueue_line(c, buf, len);
+    free(buf);
+    conn_release(c);
+    return NULL;
+}
+
+static Conn *conn_new(int in_fd, int out_fd, int close_fd) {
+    Conn *c = calloc(1, sizeof(*c));
+    if (!c) return NULL;
+    c->in_fd = in_fd;
+    c->out_fd = out_fd;
+    c->close_fd = close_fd;
+    c->refs = 1;
+    pthread_mutex_init(&c->lock, NULL);
+    pthread_cond_init(&c->idle, NULL);
+    return c;
+}
+
+static int serve(int argc, char *argv[]) {
+    const char *sock_path = NULL;
+    long workers = sysconf(_SC_NPROCESSORS_ONLN);
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) sock_path = argv[++i];
+        else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) workers = atol(argv[++i]);
+        else { usage(); return 1; }
+    }
+    if (workers < 2) workers = 2;
+
+    signal(SIGPIPE, SIG_IGN);
+    for (long i = 0; i < workers; i++) {
+        pthread_t t;
+        if (pthread_create(&t, NULL, serve_worker, NULL) != 0) {
+            perror("pthread_create");
+            return 1;
+        }
+        pthread_detach(t);
+    }
+
+    if (!sock_path) {
+        /* stdin/stdout pipe: drain the input, then wait for the last reply. */
+        Conn *c = conn_new(STDIN_FILENO, STDOUT_FILENO, 0);
+        if (!c) return 1;
+        c->refs++;
+        serve_reader(c);
+        pthread_mutex_lock(&c->lock);
+        while (c->refs > 1) pthread_cond_wait(&c->idle, &c->lock);
+        pthread_mutex_unlock(&c->lock);
+        return 0;
+    }
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(sock_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "serve: socket path too long\n");
+        return 1;
+    }
+    strcpy(addr.sun_path, sock_path);
+    int lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (lfd < 0) { perror("socket"); return 1; }
+    unlink(sock_path);
+    if (bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(lfd, 64) != 0) {
+        perror("serve: bind/listen");
+        close(lfd);
+        return 1;
+    }
+    chmod(sock_path, 0600);
+    fprintf(stderr, "serve: listening on %s with %ld workers\n", sock_path, workers);
+
+    for (;;) {
+        int fd = accept(lfd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            perror("accept");
+            break;
+        }
+        Conn *c = conn_new(fd, fd, 1);
+        pthread_t t;
+        if (!c || pthread_create(&t, NULL, serve_reader, c) != 0) {
+            close(fd);
+            free(c);
+            continue;
+        }
+        pthread_detach(t);
+    }
+    close(lfd);
+    unlink(sock_path);
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    static Run run;
+    static Sink stdout_sink = { STDOUT_FILENO, NULL, 0 };
+    run.out.sink = &stdout_sink;
+    run.line_sink = &stdout_sink;
+    rng_seed(&run.rng, (uint64_t)(now_us() * 1000) ^ (uint64_t)getpid());
+
+    if (argc >= 2 && strcmp(argv[1], "serve") == 0)
+        return serve(argc, argv);
+    int rc = dispatch(&run, argc, argv);
+    out_flush(&run.out);
+    return rc;
+}
@@ -0,0 +1,243 @@
+/*
+ * Build-time generator for the extension classifier.
+ * Usage: gen_ext_hash <rules.conf> <out.h> [out.js]
+ *
+ * Reads "Category: ext ext ..." lines and emits a header with a perfect
+ * hash over the lowercased extensions: each extension is packed into a
+ * 64-bit key, and a multiplier is searched for so that
+ * (key * mult) >> shift sends every key to its own slot. Classifying a
+ * name is then one multiply, one load and one compare. The optional JS
+ * module gives the web app the same table.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+
+#define MAX_CATS 32
+#define MAX_EXTS 1024
+#define MAX_EXT_LEN 8
+
+static char cat_names[MAX_CATS][64];
+static int ncats;
+static char ext_names[MAX_EXTS][MAX_EXT_LEN + 1];
+static uint64_t ext_keys[MAX_EXTS];
+static int ext_cats[MAX_EXTS];
+static int nexts;
+
+static uint64_t pack(const char *ext) {
+    uint64_t key = 0;
+    for (int i = 0; ext[i]; i++) key |= (uint64_t)(unsigned char)ext[i] << (8 * i);
+    return key;
+}
+
+static uint64_t splitmix64(uint64_t *state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static int load_rules(const char *path) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) { perror(path); return -1; }
+    char line[4096];
+    int lineno = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        lineno++;
+        char *hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+        char *colon = strchr(line, ':');
+        char *p = line;
+        while (isspace((unsigned char)*p)) p++;
+        if (!*p) continue;
+        if (!colon) {
+            fprintf(stderr, "%s:%d: expected 'Category: ext ...'\n", path, lineno);
+            fclose(fp);
+            return -1;
+        }
+        *colon = '\0';
+        char *end = colon;
+        while (end > p && isspace((unsigned char)end[-1])) *--end = '\0';
+        if (ncats == MAX_CATS || strlen(p) >= sizeof(cat_names[0])) {
+            fprintf(stderr, "%s:%d: too many categories or name too long\n", path, lineno);
+            fclose(fp);
+            return -1;
+        }
+        int cat = ncats++;
+        strcpy(cat_names[cat], p);
+
+        for (char *tok = strtok(colon + 1, " \t\r\n,"); tok; tok = strtok(NULL, " \t\r\n,")) {
+            if (*tok == '.') tok++;
+            size_t len = strlen(tok);
+            if (len == 0 || len > MAX_EXT_LEN) {
+                fprintf(stderr, "%s:%d: extension '%s' must be 1-%d characters\n", path, lineno, tok, MAX_EXT_LEN);
+                fclose(fp);
+                return -1;
+            }
+            for (char *c = tok; *c; c++) *c = (char)tolower((unsigned char)*c);
+            uint64_t key = pack(tok);
+            for (int i = 0; i < nexts; i++) {
+                if (ext_keys[i] == key) {
+                    fprintf(stderr, "%s:%d: '.%s' already belongs to %s\n", path, lineno, tok, cat_names[ext_cats[i]]);
+                    fclose(fp);
+                    return -1;
+                }
+            }
+            if (nexts == MAX_EXTS) {
+                fprintf(stderr, "%s:%d: too many extensions\n", path, lineno);
+                fclose(fp);
+                return -1;
+            }
+            strcpy(ext_names[nexts], tok);
+            ext_keys[nexts] = key;
+            ext_cats[nexts] = cat;
+            nexts++;
+        }
+    }
+    fclose(fp);
+    if (ncats + 1 > MAX_CATS) {
+        fprintf(stderr, "%s: no room for the Others category\n", path);
+        return -1;
+    }
+    strcpy(cat_names[ncats], "Others");
+    return 0;
+}
+
+/* Finds a multiplier that places every key in a distinct slot of a table
+ * with 2^bits entries, growing the table if a small one takes too long. */
+static int search(int *bits_out, uint64_t *mult_out) {
+    int bits = 1;
+    while ((1 << bits) < 2 * nexts) bits++;
+    static unsigned char used[1 << 16];
+    uint64_t state = 0x243F6A8885A308D3ULL;
+    for (; bits <= 16; bits++) {
+        for (int attempt = 0; attempt < 1000000; attempt++) {
+            uint64_t mult = splitmix64(&state) | 1;
+            memset(used, 0, (size_t)1 << bits);
+            int ok = 1;
+            for (int i = 0; i < nexts && ok; i++) {
+                unsigned slot = (unsigned)((ext_keys[i] * mult) >> (64 - bits));
+                if (used[slot]) ok = 0;
+                used[slot] = 1;
+            }
+            if (ok) {
+                *bits_out = bits;
+                *mult_out = mult;
+                return 0;
+            }
+        }
+    }
+    return -1;
+}
+
+static void macro_name(const char *cat, char *out, size_t outsz) {
+    size_t j = 0;
+    for (; *cat && j + 1 < outsz; cat++)
+        out[j++] = isalnum((unsigned char)*cat) ? (char)toupper((unsigned char)*cat) : '_';
+    out[j] = '\0';
+}
+
+static int write_header(const char *path, const char *rules, int bits, uint64_t mult) {
+    FILE *fp = fopen(path, "w");
+    if (!fp) { perror(path); return -1; }
+    unsigned size = 1u << bits;
+    uint64_t *keys = calloc(size, sizeof(uint64_t));
+    int *cats = calloc(size, sizeof(int));
+    if (!keys || !cats) { fclose(fp); free(keys); free(cats); return -1; }
+    for (int i = 0; i < nexts; i++) {
+        unsigned slot = (unsigned)((ext_keys[i] * mult) >> (64 - bits));
+        keys[slot] = ext_keys[i];
+        cats[slot] = ext_cats[i];
+    }
+
+    fprintf(fp, "/* Generated by tools/gen_ext_hash from %s - do not edit. */\n", rules);
+    fprintf(fp, "#ifndef EXT_HASH_H\n#define EXT_HASH_H\n\n#include <stdint.h>\n#include <string.h>\n\n");
+    fprintf(fp, "#define EXT_NUM_CATS %d\n", ncats + 1);
+    for (int c = 0; c <= ncats; c++) {
+        char m[80];
+        macro_name(cat_names[c], m, sizeof(m));
+        fprintf(fp, "#define EXT_CAT_%s %d\n", m, c);
+    }
+    fprintf(fp, "\nstatic const char *const ext_cat_names[EXT_NUM_CATS] = {");
+    for (int c = 0; c <= ncats; c++) fprintf(fp, "%s\"%s\"", c ? ", " : " ", cat_names[c]);
+    fprintf(fp, " };\n\n");
+    fprintf(fp, "#define EXT_HASH_MULT 0x%016llxULL\n", (unsigned long long)mult);
+    fprintf(fp, "#define EXT_HASH_SHIFT %d\n\n", 64 - bits);
+    fprintf(fp, "static const uint64_t ext_hash_keys[%u] = {\n", size);
+    for (unsigned i = 0; i < size; i++)
+        fprintf(fp, "%s0x%016llxULL,%s", (i % 4 == 0) ? "    " : " ", (unsigned long long)keys[i],
+                (i % 4 == 3 || i + 1 == size) ? "\n" : "");
+    fprintf(fp, "};\n\nstatic const unsigned char ext_hash_cats[%u] = {", size);
+    for (unsigned i = 0; i < size; i++)
+        fprintf(fp, "%s%d,", (i % 16 == 0) ? "\n    " : " ", keys[i] ? cats[i] : ncats);
+    fprintf(fp, "\n};\n\n");
+    fprintf(fp,
+        "/* Packs an extension (without the dot) into a key, lowercasing ASCII.\n"
+        " * Empty or longer-than-8 extensions give 0, which never matches. */\n"
+        "static inline uint64_t ext_key(const char *ext) {\n"
+        "    uint64_t key = 0;\n"
+        "    for (int i = 0; i < 8; i++) {\n"
+        "        unsigned c = (unsigned char)ext[i];\n"
+        "        if (!c) return key;\n"
+        "        c |= (unsigned)((c - 'A') < 26u) << 5;\n"
+        "        key |= (uint64_t)c << (8 * i);\n"
+        "    }\n"
+        "    return ext[8] ? 0 : key;\n"
+        "}\n\n"
+        "static inline int ext_lookup(uint64_t key) {\n"
+        "    unsigned slot = (unsigned)((key * EXT_HASH_MULT) >> EXT_HASH_SHIFT);\n"
+        "    return (key && ext_hash_keys[slot] == key) ? ext_hash_cats[slot] : EXT_CAT_OTHERS;\n"
+        "}\n\n"
+        "/* Category of a file name, by the text after its last dot. */\n"
+        "static inline int ext_classify(const char *name) {\n"
+        "    const char *dot = strrchr(name, '.');\n"
+        "    return dot ? ext_lookup(ext_key(dot + 1)) : EXT_CAT_OTHERS;\n"
+        "}\n\n"
+        "#endif\n");
+    free(keys);
+    free(cats);
+    return fclose(fp);
+}
+
+static int write_js(const char *path, const char *rules) {
+    FILE *fp = fopen(path, "w");
+    if (!fp) { perror(path); return -1; }
+    fprintf(fp, "// Generated by tools/gen_ext_hash from %s - do not edit.\n\n", rules);
+    fprintf(fp, "export const CATEGORIES = [");
+    for (int c = 0; c <= ncats; c++) fprintf(fp, "%s\"%s\"", c ? ", " : "", cat_names[c]);
+    fprintf(fp, "];\n\nexport const EXT_CATEGORY = {\n");
+    for (int i = 0; i < nexts; i++) fprintf(fp, "  \".%s\": \"%s\",\n", ext_names[i], cat_names[ext_cats[i]]);
+    fprintf(fp, "};\n\n");
+    fprintf(fp,
+        "/** Category for a file name (case-insensitive), \"Others\" when unmatched. */\n"
+        "export function categoryOf(name) {\n"
+        "  const dot = name.lastIndexOf(\".\");\n"
+        "  if (dot < 0) return \"Others\";\n"
+        "  return EXT_CATEGORY[name.slice(dot).toLowerCase()] || \"Others\";\n"
+        "}\n\n"
+        "/** Extensions (with the dot) that map to a category. */\n"
+        "export function extensionsFor(category) {\n"
+        "  return Object.keys(EXT_CATEGORY).filter((ext) => EXT_CATEGORY[ext] === category);\n"
+        "}\n");
+    return fclose(fp);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: gen_ext_hash <rules.conf> <out.h> [out.js]\n");
+        return 1;
+    }
+    if (load_rules(argv[1]) != 0) return 1;
+    int bits;
+    uint64_t mult;
+    if (search(&bits, &mult) != 0) {
+        fprintf(stderr, "gen_ext_hash: no perfect hash found for %d extensions\n", nexts);
+        return 1;
+    }
+    if (write_header(argv[2], argv[1], bits, mult) != 0) return 1;
+    if (argc > 3 && write_js(argv[3], argv[1]) != 0) return 1;
+    return 0;
+}
@@ -1,10 +1,9 @@
 import { NextResponse } from "next/server";
 import path from "path";
 import fs from "fs/promises";
-import crypto from "crypto";
 import { getFileContentInfo } from "../lib/content-analysis";
-import { readMeta, writeMeta, removePathsFromMeta } from "../meta-util";
-import { BIN_DIR, readBinMeta, writeBinMeta, ensureBin } from "../bin-util";
+import { readMeta, writeMeta, addUserWorkspace } from "../meta-util";
+import { trashPaths } from "../bin-util";
 
 const WORKSPACE = process.env.WORKSPACE_PATH || path.join(process.cwd(), "workspace");
 const GEMINI_API = "https://generativelanguage.googleapis.com/v1beta/models";
@@ -107,12 +106,7 @@ async function executeAction(action, params, currentPath, apiKey) {
       if (!base || base === "" || !base.includes("/")) {
         const topLevelName = createdRelPath.split("/")[0];
         if (topLevelName && /^[^/\\<>:"|?*]+$/.test(topLevelName)) {
-          const data = await readMeta().catch(() => ({}));
-          const userWorkspaces = data.userWorkspaces || [];
-          if (!userWorkspaces.includes(topLevelName)) {
-            userWorkspaces.push(topLevelName);
-            await writeMeta({ ...data, userWorkspaces });
-          }
+          await addUserWorkspace(topLevelName).catch(() => {});
         }
       }
       return { success: true, action: "create_folder", path: createdRelPath };
@@ -132,37 +126,8 @@ async function executeAction(action, params, currentPath, apiKey) {
     case "delete": {
       const targetPath = params?.path || params?.target;
       if (!targetPath) throw new Error("path required");
-      const fp = fullPath(targetPath);
-      const safePath = path.normalize(targetPath).replace(/^(\.\.(\/|\\|$))+/, "");
-      if (!fp.startsWith(WORKSPACE) || safePath === ".bin" || safePath.startsWith(".bin/")) throw new Error("Access denied");
-      const stat = await fs.stat(fp);
-
-      await ensureBin();
-      const uuid = crypto.randomUUID();
-      const binPath = path.join(BIN_DIR, uuid);
-      await fs.rename(fp, binPath);
-
-      const binMeta = await readBinMeta();
-      let metaData = { meta: {} };
-      try { metaData = await readMeta(); } catch (_) {}
-      const itemColor = metaData.meta?.[safePath]?.color || null;
-
-      binMeta.items[uuid] = {
-        uuid,
-        originalPath: safePath,
-        name: path.basename(safePath),
-        type: stat.isDirectory() ? "directory" : "file",
-        color: itemColor,
-        deletedAt: new Date().toISOString()
-      };
-      await writeBinMeta(binMeta);
-
-      try {
-        const data = await readMeta();
-        const cleaned = removePathsFromMeta(data, [safePath]);
-        await writeMeta(cleaned);
-      } catch (_) {}
-
+      const [r] = await trashPaths([targetPath]);
+      if (!r.success) throw new Error(r.error || "Delete failed");
       return { success: true, action: "delete", path: targetPath };
     }
     case "rename": {
@@ -473,47 +438,15 @@ async function executeAction(action, params, currentPath, apiKey) {
         }
       }
       if (duplicates.length === 0) return { success: true, action: "remove_duplicates", message: "No duplicates found", removed: 0 };
-      await ensureBin();
-      const binMeta = await readBinMeta();
-      let metaData = { meta: {} };
-      try { metaData = await readMeta(); } catch (_) {}
-      const deletedPaths = [];
-      let removed = 0;
+      const toTrash = [];
       for (const grp of duplicates) {
         if (!Array.isArray(grp) || grp.length < 2) continue;
         for (let i = 1; i < grp.length; i++) {
-          const fp2 = path.join(p, grp[i]);
-          try {
-            const st = await fs.stat(fp2).catch(() => null);
-            if (!st) continue;
-            const relPath = path.join(base, grp[i]).replace(/\\/g, "/");
-            const safePath = path.normalize(relPath).replace(/^(\.\.(\/|\\|$))+/, "");
-            if (safePath === ".bin" || safePath.startsWith(".bin/")) continue;
-            const uuid = crypto.randomUUID();
-            const binPath = path.join(BIN_DIR, uuid);
-            await fs.rename(fp2, binPath);
-            const itemColor = metaData.meta?.[safePath]?.color || null;
-            binMeta.items[uuid] = {
-              uuid,
-              originalPath: safePath,
-              name: grp[i],
-              type: st.isDirectory() ? "directory" : "file",
-              color: itemColor,
-              deletedAt: new Date().toISOString()
-            };
-            deletedPaths.push(safePath);
-            removed++;
-          } catch (_) {}
+          const st = await fs.stat(path.join(p, grp[i])).catch(() => null);
+          if (st) toTrash.push(path.join(base, grp[i]).replace(/\\/g, "/"));
         }
       }
-      if (deletedPaths.length > 0) {
-        await writeBinMeta(binMeta);
-        try {
-          const data = await readMeta();
-          const cleaned = removePathsFromMeta(data, deletedPaths);
-          await writeMeta(cleaned);
-        } catch (_) {}
-      }
+      const removed = toTrash.length ? (await trashPaths(toTrash)).filter((r) => r.success).length : 0;
       return { success: true, action: "remove_duplicates", message: `Removed ${removed} duplicate(s)`, removed, duplicates };
     }
     case "directory_size":
@@ -1,11 +1,47 @@
-import { NextResponse } from "next/server";
 import path from "path";
 import fs from "fs/promises";
+import crypto from "crypto";
+import { runBin, listBin } from "../lib/run-cli";
+import { cliMeta, readMeta, writeMeta, removeMetaPaths } from "./meta-util";
 
 const WORKSPACE = process.env.WORKSPACE_PATH || path.join(process.cwd(), "workspace");
 const BIN_DIR = path.join(WORKSPACE, ".bin");
 const META_FILE = path.join(BIN_DIR, ".metadata.json");
 
+// When the CLI is available the bin is `organizer_cli bin`: items are renamed
+// into .bin under ids from its manifest, whole batches per call, and purged
+// trees are removed on threads after the reply. An item's color is kept in
+// the metadata store under ".bin/<id>" until it is restored or purged. The
+// JSON file is the fallback without the CLI; on first use its items are
+// imported and it is renamed to *.migrated.
+
+let cliReady = null;
+
+async function importJson() {
+  if (!(await listBin())) return false;
+  let data;
+  try {
+    data = JSON.parse(await fs.readFile(META_FILE, "utf8"));
+  } catch {
+    return true;
+  }
+  const items = Object.values(data.items || {});
+  const res = await runBin("import", items.map((i) => [i.uuid, i.originalPath, String(Date.parse(i.deletedAt) || Date.now())]));
+  if (!res) return false;
+  const colors = [];
+  res.items.forEach((r, k) => {
+    if (r.success && items[k].color) colors.push(["set", `.bin/${r.id}`, "meta", JSON.stringify({ color: items[k].color })]);
+  });
+  if (colors.length) await cliMeta(colors);
+  await fs.rename(META_FILE, META_FILE + ".migrated").catch(() => {});
+  return true;
+}
+
+async function cliBin() {
+  if (!cliReady) cliReady = importJson();
+  return cliReady;
+}
+
 async function ensureBin() {
   await fs.mkdir(BIN_DIR, { recursive: true });
   try {
@@ -35,4 +71,250 @@ async function writeBinMeta(data) {
   await fs.writeFile(META_FILE, JSON.stringify(data, null, 2), "utf8");
 }
 
-export { BIN_DIR, META_FILE, readBinMeta, writeBinMeta, ensureBin };
+function safeRel(rel) {
+  return path.normalize(rel || "").replace(/^(\.\.(\/|\\|$))+/, "");
+}
+
+function inBin(rel) {
+  return rel === ".bin" || rel.startsWith(".bin/");
+}
+
+/**
+ * Moves workspace paths to the Bin and drops their metadata, keeping each
+ * one's color. Resolves to one { path, success, type, error } per path.
+ */
+async function trashPaths(relPaths) {
+  const paths = relPaths.map(safeRel);
+  const results = paths.map((p) => ({ path: p, success: false, type: null, error: "Access denied" }));
+  const allowed = paths.filter((p) => p && p !== "." && !inBin(p) && path.join(WORKSPACE, p).startsWith(WORKSPACE));
+  const byPath = new Map(results.map((r) => [r.path, r]));
+  let metaData = { meta: {} };
+  try {
+    metaData = await readMeta();
+  } catch (_) {}
+
+  const res = allowed.length && (await cliBin()) ? await runBin("trash", allowed) : null;
+  if (res) {
+    const colors = [];
+    res.items.forEach((r, k) => {
+      Object.assign(byPath.get(allowed[k]), { success: r.success, type: r.type || null, error: r.error || null });
+      const color = metaData.meta?.[allowed[k]]?.color;
+      if (r.success && color) colors.push(["set", `.bin/${r.id}`, "meta", JSON.stringify({ color })]);
+    });
+    if (colors.length) await cliMeta(colors).catch(() => {});
+  } else if (allowed.length) {
+    await ensureBin();
+    const binMeta = await readBinMeta();
+    for (const safePath of allowed) {
+      const r = byPath.get(safePath);
+      try {
+        const stat = await fs.stat(path.join(WORKSPACE, safePath));
+        const uuid = crypto.randomUUID();
+        await fs.rename(path.join(WORKSPACE, safePath), path.join(BIN_DIR, uuid));
+        binMeta.items[uuid] = {
+          uuid,
+          originalPath: safePath,
+          name: path.basename(safePath),
+          type: stat.isDirectory() ? "directory" : "file",
+          color: metaData.meta?.[safePath]?.color || null,
+          deletedAt: new Date().toISOString()
+        };
+        Object.assign(r, { success: true, type: binMeta.items[uuid].type, error: null });
+      } catch (e) {
+        r.error = e.message;
+      }
+    }
+    await writeBinMeta(binMeta);
+  }
+
+  const deletedPaths = results.filter((r) => r.success).map((r) => r.path);
+  if (deletedPaths.length > 0) {
+    try {
+      await removeMetaPaths(deletedPaths);
+    } catch (_) {}
+  }
+  return results;
+}
+
+/**
+ * The Bin's items, most recently deleted first, as { uuid, path (the id),
+ * name, originalPath, type, color, size (bytes or null), deletedAt }.
+ */
+async function listBinItems() {
+  const items = [];
+  const listed = (await cliBin()) ? await listBin() : null;
+  if (listed) {
+    let metaData = { meta: {} };
+    try {
+      metaData = await readMeta();
+    } catch (_) {}
+    for (const i of listed) {
+      const deletedAt = new Date(i.deletedAt).toISOString();
+      items.push({
+        uuid: i.id,
+        path: i.id,
+        name: i.name,
+        originalPath: i.path,
+        type: i.type,
+        color: metaData.meta?.[`.bin/${i.id}`]?.color || null,
+        size: i.size,
+        deletedAt,
+      });
+    }
+  } else {
+    const meta = await readBinMeta();
+    // Check files actually still exist in .bin and get their sizes
+    for (const [uuid, itemInfo] of Object.entries(meta.items)) {
+      const stat = await fs.stat(path.join(BIN_DIR, uuid)).catch(() => null);
+      if (!stat) continue;
+      items.push({
+        uuid: itemInfo.uuid,
+        path: uuid, // Use uuid as the generic "path" for the frontend components
+        name: itemInfo.name,
+        originalPath: itemInfo.originalPath,
+        type: itemInfo.type,
+        color: itemInfo.color || null,
+        size: stat.isDirectory() ? null : stat.size,
+        deletedAt: itemInfo.deletedAt
+      });
+    }
+  }
+  // Sort by most recently deleted first
+  items.sort((a, b) => new Date(b.deletedAt) - new Date(a.deletedAt));
+  return items;
+}
+
+/** Colors kept for Bin ids, as a Map of id -> color. */
+async function binColors(ids) {
+  const res = await cliMeta(ids.map((id) => ["get", `.bin/${id}`]));
+  const colors = new Map();
+  (res || []).forEach((r, k) => {
+    if (r.fields?.meta?.color) colors.set(ids[k], r.fields.meta.color);
+  });
+  return colors;
+}
+
+/**
+ * Puts Bin items back at their original paths, never over an existing
+ * entry. Resolves to { restored: ids, errors: [{ uuid, error }] }.
+ */
+async function restoreItems(uuids) {
+  const successful = [];
+  const errors = [];
+  if (await cliBin()) {
+    const colors = await binColors(uuids);
+    const res = await runBin("restore", uuids);
+    if (res) {
+      const ops = [];
+      res.items.forEach((r, k) => {
+        const uuid = uuids[k];
+        if (!r.success) {
+          errors.push({ uuid, error: r.error });
+          return;
+        }
+        successful.push(uuid);
+        if (colors.has(uuid)) ops.push(["rm", `.bin/${uuid}`], ["set", r.path, "meta", JSON.stringify({ color: colors.get(uuid) })]);
+      });
+      if (ops.length) await cliMeta(ops).catch(() => {});
+      return { restored: successful, errors };
+    }
+  }
+
+  const binMeta = await readBinMeta();
+  let mainMeta;
+  try {
+    mainMeta = await readMeta();
+  } catch (_) {
+    mainMeta = { meta: {} };
+  }
+  let metaChanged = false;
+
+  for (const uuid of uuids) {
+    if (!binMeta.items[uuid]) {
+      errors.push({ uuid, error: "Not found in bin metadata" });
+      continue;
+    }
+
+    const itemInfo = binMeta.items[uuid];
+    const sourcePath = path.join(BIN_DIR, uuid);
+    const safeTargetRelPath = safeRel(itemInfo.originalPath);
+    const targetPath = path.join(WORKSPACE, safeTargetRelPath);
+
+    if (!targetPath.startsWith(WORKSPACE) || safeTargetRelPath.startsWith(".bin")) {
+      errors.push({ uuid, error: "Invalid target path" });
+      continue;
+    }
+
+    try {
+      // Ensure the parent directory exists
+      await fs.mkdir(path.dirname(targetPath), { recursive: true });
+      await fs.rename(sourcePath, targetPath);
+      delete binMeta.items[uuid];
+      successful.push(uuid);
+
+      // Restore color to metadata if it exists
+      if (itemInfo.color) {
+        mainMeta.meta = mainMeta.meta || {};
+        mainMeta.meta[safeTargetRelPath] = mainMeta.meta[safeTargetRelPath] || {};
+        mainMeta.meta[safeTargetRelPath].color = itemInfo.color;
+        metaChanged = true;
+      }
+    } catch (e) {
+      errors.push({ uuid, error: e.message });
+    }
+  }
+
+  await writeBinMeta(binMeta);
+  if (metaChanged) {
+    await writeMeta(mainMeta).catch(() => {});
+  }
+  return { restored: successful, errors };
+}
+
+/**
+ * Deletes Bin items for good. With the CLI they leave the Bin at once and
+ * their trees are removed in the background. Resolves to { deleted: ids,
+ * errors: [{ uuid, error }] }.
+ */
+async function purgeItems(uuids) {
+  const successful = [];
+  const errors = [];
+  if (await cliBin()) {
+    const colors = await binColors(uuids);
+    const res = await runBin("purge", uuids, { background: true });
+    if (res) {
+      res.items.forEach((r, k) => {
+        if (r.success) successful.push(uuids[k]);
+        else errors.push({ uuid: uuids[k], error: r.error });
+      });
+      const gone = successful.filter((id) => colors.has(id));
+      if (gone.length) await cliMeta(gone.map((id) => ["rm", `.bin/${id}`])).catch(() => {});
+      return { deleted: successful, errors };
+    }
+  }
+
+  const binMeta = await readBinMeta();
+  for (const uuid of uuids) {
+    const sourcePath = path.join(BIN_DIR, uuid);
+    try {
+      const stat = await fs.stat(sourcePath).catch(() => null);
+      if (stat) {
+        if (stat.isDirectory()) {
+          await fs.rm(sourcePath, { recursive: true, force: true });
+        } else {
+          await fs.unlink(sourcePath);
+        }
+      }
+      if (binMeta.items[uuid]) {
+        delete binMeta.items[uuid];
+      }
+      successful.push(uuid);
+    } catch (e) {
+      errors.push({ uuid, error: e.message });
+    }
+  }
+  await writeBinMeta(binMeta);
+  return { deleted: successful, errors };
+}
+
+export { BIN_DIR, META_FILE, readBinMeta, writeBinMeta, ensureBin, trashPaths, listBinItems, restoreItems, purgeItems };
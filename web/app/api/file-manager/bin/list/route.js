@@ -1,8 +1,5 @@
 import { NextResponse } from "next/server";
-import { readBinMeta } from "../../bin-util";
-import fs from "fs/promises";
-import path from "path";
-import { BIN_DIR } from "../../bin-util";
+import { listBinItems } from "../../bin-util";
 
 function formatBytes(bytes) {
   if (bytes === 0) return "0 B";
@@ -14,34 +11,11 @@ function formatBytes(bytes) {
 
 export async function GET() {
   try {
-    const meta = await readBinMeta();
-    const items = [];
-    
-    // Check files actually still exist in .bin and get their sizes
-    for (const [uuid, itemInfo] of Object.entries(meta.items)) {
-      try {
-        const fullPath = path.join(BIN_DIR, uuid);
-        const stat = await fs.stat(fullPath);
-        items.push({
-          uuid: itemInfo.uuid,
-          path: uuid, // Use uuid as the generic "path" for the frontend components
-          name: itemInfo.name,
-          originalPath: itemInfo.originalPath,
-          type: itemInfo.type,
-          color: itemInfo.color || null,
-          size: stat.isDirectory() ? null : formatBytes(stat.size),
-          modified: itemInfo.deletedAt, // show deleted date as modified
-          deletedAt: itemInfo.deletedAt
-        });
-      } catch (e) {
-        // If file doesn't exist anymore for some reason, we could optionally clean it up from meta
-        // but skipping it for the response is fine.
-      }
-    }
-
-    // Sort by most recently deleted first
-    items.sort((a, b) => new Date(b.deletedAt) - new Date(a.deletedAt));
-
+    const items = (await listBinItems()).map((item) => ({
+      ...item,
+      size: item.size == null ? null : formatBytes(item.size),
+      modified: item.deletedAt, // show deleted date as modified
+    }));
     return NextResponse.json({ items });
   } catch (error) {
     return NextResponse.json({ items: [], error: error.message }, { status: 500 });
@@ -1,6 +1,7 @@
 import { NextResponse } from "next/server";
 import path from "path";
 import fs from "fs/promises";
+import { runCopy } from "@/app/api/lib/run-cli";
 
 const WORKSPACE = process.env.WORKSPACE_PATH || path.join(process.cwd(), "workspace");
 
@@ -23,7 +24,7 @@ export async function POST(request) {
     if (items.length === 0) {
       return NextResponse.json({ error: "from and to paths required" }, { status: 400 });
     }
-    const operations = [];
+    const pairs = [];
     for (const { from: copyFrom, to: copyTo } of items) {
       if (!copyFrom || !copyTo) continue;
       const src = fullPath(copyFrom);
@@ -31,6 +32,28 @@ export async function POST(request) {
       if (!src.startsWith(WORKSPACE) || !dest.startsWith(WORKSPACE)) {
         return NextResponse.json({ error: "Access denied" }, { status: 403 });
       }
+      pairs.push({ from: copyFrom, to: copyTo, src, dest });
+    }
+
+    // Try C backend first: the whole batch in one process, copied in parallel
+    const cliResult = await runCopy(pairs.map(({ src, dest }) => ({
+      from: path.relative(WORKSPACE, src),
+      to: path.relative(WORKSPACE, dest),
+    })));
+    if (cliResult && !cliResult.error && cliResult.result && cliResult.result.failed === 0) {
+      return NextResponse.json({
+        success: true,
+        action: "copy",
+        operations: pairs.map(({ from, to }) => ({ from, to })),
+        count: pairs.length,
+        syscalls: cliResult.operations,
+        backend: "c",
+      });
+    }
+
+    // Fallback: Node.js implementation
+    const operations = [];
+    for (const { from: copyFrom, to: copyTo, src, dest } of pairs) {
       const destDir = path.dirname(dest);
       await fs.mkdir(destDir, { recursive: true });
       const srcStat = await fs.stat(src);
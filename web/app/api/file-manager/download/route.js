@@ -1,6 +1,8 @@
 import { NextResponse } from "next/server";
 import path from "path";
 import fs from "fs/promises";
+import { archiveStream } from "@/app/api/lib/run-cli";
+import { zipDirectory } from "../zip-util";
 
 const WORKSPACE = process.env.WORKSPACE_PATH || path.join(process.cwd(), "workspace");
 
@@ -16,8 +18,23 @@ export async function GET(request) {
     }
 
     const stat = await fs.stat(filePath).catch(() => null);
-    if (!stat || stat.isDirectory()) {
-      return NextResponse.json({ error: "Not a file" }, { status: 400 });
+    if (!stat) {
+      return NextResponse.json({ error: "Not found" }, { status: 404 });
+    }
+    if (stat.isDirectory()) {
+      // Folders go out as a ZIP streamed while it is built.
+      const name = safePath === "." ? path.basename(WORKSPACE) : path.basename(safePath);
+      const archive = await archiveStream(safePath === "." ? "" : safePath);
+      if (archive?.error) {
+        return NextResponse.json({ error: archive.error }, { status: 500 });
+      }
+      return new NextResponse(archive ? archive.stream : zipDirectory(filePath, name), {
+        headers: {
+          "Content-Type": "application/zip",
+          "Content-Disposition": `attachment; filename="${name}.zip"`,
+          "Cache-Control": "no-store",
+        },
+      });
     }
 
     const fileBuffer = await fs.readFile(filePath);
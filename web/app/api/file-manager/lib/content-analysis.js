@@ -1,5 +1,6 @@
 import path from "path";
 import fs from "fs/promises";
+import { cachedText } from "../../lib/run-cli";
 
 const WORKSPACE = process.env.WORKSPACE_PATH || path.join(process.cwd(), "workspace");
 const IMAGE_EXT = new Set([".jpg", ".jpeg", ".png", ".gif", ".webp", ".bmp"]);
@@ -31,11 +32,14 @@ export async function getFileContentInfo(relPath, root) {
   const stat = await fs.stat(full).catch(() => null);
   if (!stat || stat.isDirectory()) return null;
 
+  // PDFs and text files come from the CLI's content index when it is there.
   if (ext === ".pdf") {
-    const text = await extractPdfText(full);
+    const text = (await cachedText(relPath, MAX_PDF_TEXT)) ?? (await extractPdfText(full));
     return { path: relPath, type: "pdf", text };
   }
   if (TEXT_EXT.has(ext)) {
+    const cached = await cachedText(relPath, 3000);
+    if (cached != null) return { path: relPath, type: "text", text: cached };
     const buf = await fs.readFile(full, "utf8").catch(() => "");
     return { path: relPath, type: "text", text: (buf || "").slice(0, 3000) };
   }
@@ -1,10 +1,48 @@
 import path from "path";
 import fs from "fs/promises";
+import { runMeta, forgetEmbeddings, moveEmbeddings } from "../lib/run-cli";
 
 const WORKSPACE = process.env.WORKSPACE_PATH || path.join(process.cwd(), "workspace");
 const META_PATH = path.join(WORKSPACE, ".file-organizer-meta.json");
+const MAX_RECENTS = 50;
 
-export async function readMeta() {
+// When the CLI is available, metadata lives in its per-workspace log
+// (`organizer_cli meta`) as fields of each path:
+//   meta       { tags, color, comments, starred, ... }
+//   share      { token, createdAt }
+//   recent     last opened, ms since the epoch
+//   workspace  position in the sidebar (top-level folders only)
+// Each update appends only what changed, and deleting or renaming a folder
+// is one op however many paths lie below it. Embeddings in the CLI's vector
+// index (`organizer_cli vindex`) follow deletes and renames the same way. The JSON file is the fallback
+// without the CLI; on first use it is imported and renamed to *.migrated.
+
+let cliReady = null;
+
+async function importJson() {
+  if (!(await runMeta([["get", ""]]))) return false;
+  let data;
+  try {
+    data = JSON.parse(await fs.readFile(META_PATH, "utf8"));
+  } catch {
+    return true;
+  }
+  if (!(await runMeta(diffOps(emptyMeta(), data)))) return false;
+  await fs.rename(META_PATH, META_PATH + ".migrated").catch(() => {});
+  return true;
+}
+
+/** Runs ops against the CLI store; null means use the JSON file. */
+export async function cliMeta(ops) {
+  if (!cliReady) cliReady = importJson();
+  return (await cliReady) ? runMeta(ops) : null;
+}
+
+function emptyMeta() {
+  return { recents: [], meta: {}, sharedLinks: {}, userWorkspaces: [] };
+}
+
+async function readJson() {
   try {
     const raw = await fs.readFile(META_PATH, "utf8");
     return JSON.parse(raw);
@@ -13,11 +51,136 @@ export async function readMeta() {
   }
 }
 
-export async function writeMeta(data) {
+async function writeJson(data) {
   await fs.mkdir(WORKSPACE, { recursive: true });
   await fs.writeFile(META_PATH, JSON.stringify(data, null, 2), "utf8");
 }
 
+async function editJson(edit) {
+  const data = await readJson();
+  await writeJson(edit(data) || data);
+}
+
+/** The ops that turn the `from` shape into `to`. */
+function diffOps(from, to) {
+  const ops = [];
+  const same = (a, b) => JSON.stringify(a) === JSON.stringify(b);
+  for (const [field, key] of [["meta", "meta"], ["share", "sharedLinks"]]) {
+    const a = from[key] || {};
+    const b = to[key] || {};
+    for (const p of Object.keys(b)) if (!same(a[p], b[p])) ops.push(["set", p, field, JSON.stringify(b[p])]);
+    for (const p of Object.keys(a)) if (!(p in b)) ops.push(["del", p, field]);
+  }
+  // Lists keep their order through the values: newest recent first, sidebar order for workspaces.
+  const now = Date.now();
+  for (const [field, key, value] of [["recent", "recents", (i) => now - i], ["workspace", "userWorkspaces", (i) => i]]) {
+    const a = from[key] || [];
+    const b = to[key] || [];
+    if (same(a, b)) continue;
+    b.forEach((p, i) => ops.push(["set", p, field, String(value(i))]));
+    for (const p of a) if (!b.includes(p)) ops.push(["del", p, field]);
+  }
+  return ops;
+}
+
+function fromItems(items) {
+  const data = emptyMeta();
+  const recents = [];
+  const workspaces = [];
+  for (const { path: p, fields } of items) {
+    if (fields.meta) data.meta[p] = fields.meta;
+    if (fields.share) data.sharedLinks[p] = fields.share;
+    if (fields.recent != null) recents.push([fields.recent, p]);
+    if (fields.workspace != null) workspaces.push([fields.workspace, p]);
+  }
+  data.recents = recents.sort((a, b) => b[0] - a[0]).map(([, p]) => p);
+  data.userWorkspaces = workspaces.sort((a, b) => a[0] - b[0]).map(([, p]) => p);
+  return data;
+}
+
+export async function readMeta() {
+  const res = await cliMeta([["list", ""]]);
+  if (!res) return readJson();
+  const data = fromItems(res[0].items || []);
+  if (data.recents.length > 2 * MAX_RECENTS) {
+    await cliMeta(data.recents.slice(MAX_RECENTS).map((p) => ["del", p, "recent"]));
+  }
+  data.recents = data.recents.slice(0, MAX_RECENTS);
+  return data;
+}
+
+/** Stores data; with the CLI only the fields that differ are written. */
+export async function writeMeta(data) {
+  const res = await cliMeta([["list", ""]]);
+  if (!res) return writeJson(data);
+  const current = fromItems(res[0].items || []);
+  current.recents = current.recents.slice(0, MAX_RECENTS);
+  const ops = diffOps(current, data);
+  if (ops.length) await cliMeta(ops);
+}
+
+/** Merges patch into the path's meta entry (tags, color, comments, ...). */
+export async function updatePathMeta(relPath, patch) {
+  const res = await cliMeta([["get", relPath]]);
+  if (!res) {
+    return editJson((data) => {
+      data.meta = data.meta || {};
+      data.meta[relPath] = { ...(data.meta[relPath] || {}), ...patch };
+    });
+  }
+  const merged = { ...(res[0].fields?.meta || {}), ...patch };
+  await cliMeta([["set", relPath, "meta", JSON.stringify(merged)]]);
+}
+
+export async function addRecent(relPath) {
+  if (await cliMeta([["set", relPath, "recent", String(Date.now())]])) return;
+  await editJson((data) => {
+    data.recents = [relPath, ...(data.recents || []).filter((p) => p !== relPath)].slice(0, MAX_RECENTS);
+  });
+}
+
+export async function setSharedLink(relPath, link) {
+  if (await cliMeta([["set", relPath, "share", JSON.stringify(link)]])) return;
+  await editJson((data) => {
+    data.sharedLinks = data.sharedLinks || {};
+    data.sharedLinks[relPath] = link;
+  });
+}
+
+export async function addUserWorkspace(name) {
+  const data = await readMeta();
+  const userWorkspaces = data.userWorkspaces || [];
+  if (userWorkspaces.includes(name)) return userWorkspaces;
+  userWorkspaces.push(name);
+  if (!(await cliMeta([["set", name, "workspace", String(Date.now())]]))) await writeJson({ ...data, userWorkspaces });
+  return userWorkspaces;
+}
+
+/** Drops the paths and everything below them from every kind of metadata. */
+export async function removeMetaPaths(deletedPaths) {
+  await forgetEmbeddings(deletedPaths);
+  if (await cliMeta(deletedPaths.map((p) => ["rm", p]))) return;
+  await editJson((data) => removePathsFromMeta(data, deletedPaths));
+}
+
+/** Carries a renamed or moved path's metadata, and its subtree's, to the new path. */
+export async function renameMetaPath(from, to) {
+  await moveEmbeddings(from, to);
+  if (await cliMeta([["mv", from, to]])) return;
+  await editJson((data) => {
+    const prefix = from + "/";
+    const move = (p) => (p === from ? to : p.startsWith(prefix) ? to + p.slice(from.length) : p);
+    const rekey = (obj) => Object.fromEntries(Object.entries(obj || {}).map(([p, v]) => [move(p), v]));
+    return {
+      ...data,
+      meta: rekey(data.meta),
+      sharedLinks: rekey(data.sharedLinks),
+      recents: (data.recents || []).map(move),
+      userWorkspaces: (data.userWorkspaces || []).map(move),
+    };
+  });
+}
+
 /** Remove paths from meta (recents, starred, sharedLinks, userWorkspaces). Also removes any path under a deleted directory. */
 export function removePathsFromMeta(data, deletedPaths) {
   const toRemove = new Set(deletedPaths);
@@ -1,7 +1,7 @@
 import { NextResponse } from "next/server";
 import path from "path";
 import fs from "fs/promises";
-import { readMeta, writeMeta } from "../meta-util";
+import { readMeta, updatePathMeta, addRecent, setSharedLink, addUserWorkspace } from "../meta-util";
 
 const WORKSPACE = process.env.WORKSPACE_PATH || path.join(process.cwd(), "workspace");
 
@@ -58,36 +58,24 @@ export async function GET() {
 export async function POST(request) {
   try {
     const body = await request.json();
-    const data = await readMeta();
-    if (body.recents !== undefined) {
-      const pathToAdd = body.path;
-      if (pathToAdd) {
-        data.recents = data.recents || [];
-        data.recents = data.recents.filter((p) => p !== pathToAdd);
-        data.recents.unshift(pathToAdd);
-        data.recents = data.recents.slice(0, 50);
-      }
+    // Each change is its own point update; nothing rewrites the whole store.
+    if (body.recents !== undefined && body.path) {
+      await addRecent(body.path);
     }
     if (body.meta !== undefined && body.path) {
       const safePath = path.normalize(body.path).replace(/^(\.\.(\/|\\|$))+/, "").replace(/\\/g, "/");
-      data.meta = data.meta || {};
-      data.meta[safePath] = { ...(data.meta[safePath] || {}), ...body.meta };
+      await updatePathMeta(safePath, body.meta);
     }
     if (body.sharedLinks !== undefined) {
-      data.sharedLinks = data.sharedLinks || {};
       if (body.sharedLinks.path !== undefined && body.sharedLinks.token !== undefined) {
-        data.sharedLinks[body.sharedLinks.path] = { token: body.sharedLinks.token, createdAt: new Date().toISOString() };
+        await setSharedLink(body.sharedLinks.path, { token: body.sharedLinks.token, createdAt: new Date().toISOString() });
       }
     }
     if (body.userWorkspacesAdd !== undefined) {
       const name = String(body.userWorkspacesAdd).trim();
-      if (name && !/[\\/]/.test(name)) {
-        data.userWorkspaces = data.userWorkspaces || [];
-        if (!data.userWorkspaces.includes(name)) data.userWorkspaces.push(name);
-      }
+      if (name && !/[\\/]/.test(name)) await addUserWorkspace(name);
     }
-    await writeMeta(data);
-    return NextResponse.json(data);
+    return NextResponse.json(await readMeta());
   } catch (e) {
     return NextResponse.json({ error: e.message }, { status: 500 });
   }
@@ -1,6 +1,7 @@
 import { NextResponse } from "next/server";
 import path from "path";
 import fs from "fs/promises";
+import { runMove } from "@/app/api/lib/run-cli";
 
 const WORKSPACE = process.env.WORKSPACE_PATH || path.join(process.cwd(), "workspace");
 
@@ -23,7 +24,7 @@ export async function POST(request) {
     if (items.length === 0) {
       return NextResponse.json({ error: "from and to paths required" }, { status: 400 });
     }
-    const operations = [];
+    const pairs = [];
     for (const { from: moveFrom, to: moveTo } of items) {
       if (!moveFrom || !moveTo) continue;
       const src = fullPath(moveFrom);
@@ -31,6 +32,40 @@ export async function POST(request) {
       if (!src.startsWith(WORKSPACE) || !dest.startsWith(WORKSPACE)) {
         return NextResponse.json({ error: "Access denied" }, { status: 403 });
       }
+      pairs.push({ from: moveFrom, to: moveTo, src, dest });
+    }
+
+    // Try C backend first: the whole batch in one call, renames that never
+    // replace an existing entry
+    const cliResult = await runMove(pairs.map(({ src, dest }) => ({
+      from: path.relative(WORKSPACE, src),
+      to: path.relative(WORKSPACE, dest),
+    })));
+    if (cliResult) {
+      const operations = [];
+      const errors = [];
+      cliResult.items.forEach((r, k) => {
+        const { from, to } = pairs[k];
+        if (r.success) operations.push({ from, to });
+        else errors.push({ from, to, error: r.error });
+      });
+      if (operations.length === 0 && errors.length > 0) {
+        return NextResponse.json({ error: `${errors[0].from}: ${errors[0].error}`, errors }, { status: 500 });
+      }
+      return NextResponse.json({
+        success: true,
+        action: "move",
+        operations,
+        count: operations.length,
+        errors,
+        syscalls: cliResult.operations,
+        backend: "c",
+      });
+    }
+
+    // Fallback: Node.js implementation
+    const operations = [];
+    for (const { from: moveFrom, to: moveTo, dest, src } of pairs) {
       const destDir = path.dirname(dest);
       await fs.mkdir(destDir, { recursive: true });
       await fs.rename(src, dest);
@@ -2,6 +2,7 @@ import { NextResponse } from "next/server";
 import path from "path";
 import fs from "fs/promises";
 import { readMeta } from "../meta-util";
+import { queryIndex, fullTextQuery } from "../../lib/run-cli";
 
 const WORKSPACE = process.env.WORKSPACE_PATH || path.join(process.cwd(), "workspace");
 
@@ -23,16 +24,71 @@ async function walk(dirPath, relPath, results, metaInfo) {
   }
 }
 
+function tagMatches(m, qLower) {
+  const tags = m.tags || [];
+  return tags.some((t) => String(t).toLowerCase().includes(qLower) || qLower.includes(String(t).toLowerCase()));
+}
+
+// Name and initials matches come ranked from the CLI's workspace index;
+// tagged paths are confirmed with a stat each, and files whose text matches
+// (the CLI's content index) fill what room is left. null when there is no index.
+async function searchIndexed(qLower, metaInfo) {
+  const found = await queryIndex("search", qLower);
+  if (!found) return null;
+  const items = found.items.map((it) => ({
+    path: it.path,
+    name: it.name,
+    type: it.type === "directory" ? "directory" : "file",
+    modified: it.modified,
+    color: metaInfo[it.path]?.color || null,
+  }));
+  const seen = new Set(items.map((r) => r.path));
+  for (const [p, m] of Object.entries(metaInfo)) {
+    const norm = p.replace(/\\/g, "/");
+    if (items.length >= 100) break;
+    if (seen.has(norm) || !tagMatches(m, qLower)) continue;
+    const st = await fs.stat(path.join(WORKSPACE, norm)).catch(() => null);
+    if (!st) continue;
+    seen.add(norm);
+    items.push({
+      path: norm,
+      name: path.basename(norm),
+      type: st.isDirectory() ? "directory" : "file",
+      modified: st.mtime.toISOString(),
+      color: m.color || null,
+    });
+  }
+  if (items.length < 100) {
+    for (const hit of (await fullTextQuery(qLower, 100 - items.length)) || []) {
+      if (seen.has(hit.path)) continue;
+      const st = await fs.stat(path.join(WORKSPACE, hit.path)).catch(() => null);
+      if (!st) continue;
+      seen.add(hit.path);
+      items.push({
+        path: hit.path,
+        name: path.basename(hit.path),
+        type: "file",
+        modified: st.mtime.toISOString(),
+        color: metaInfo[hit.path]?.color || null,
+        snippet: hit.snippet,
+      });
+    }
+  }
+  return items.slice(0, 100);
+}
+
 export async function GET(request) {
   try {
     const { searchParams } = new URL(request.url);
     const q = (searchParams.get("q") || "").trim().toLowerCase();
     if (!q) return NextResponse.json({ items: [] });
 
-    const results = [];
     const data = await readMeta().catch(() => ({}));
     const metaInfo = data.meta || {};
-    
+    const indexed = await searchIndexed(q, metaInfo);
+    if (indexed) return NextResponse.json({ items: indexed });
+
+    const results = [];
     await walk(WORKSPACE, "", results, metaInfo);
     const qLower = q.toLowerCase();
 
@@ -48,8 +104,7 @@ export async function GET(request) {
     const tagMatchedPaths = new Set();
     
     for (const [p, m] of Object.entries(metaInfo)) {
-      const tags = m.tags || [];
-      if (tags.some((t) => String(t).toLowerCase().includes(qLower) || qLower.includes(String(t).toLowerCase()))) {
+      if (tagMatches(m, qLower)) {
         const norm = p.replace(/\\/g, "/");
         if (pathSet.has(norm)) tagMatchedPaths.add(norm);
       }
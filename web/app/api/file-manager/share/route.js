@@ -2,23 +2,9 @@ import { NextResponse } from "next/server";
 import path from "path";
 import fs from "fs/promises";
 import crypto from "crypto";
+import { readMeta, setSharedLink } from "../meta-util";
 
 const WORKSPACE = process.env.WORKSPACE_PATH || path.join(process.cwd(), "workspace");
-const META_PATH = path.join(WORKSPACE, ".file-organizer-meta.json");
-
-async function readMeta() {
-  try {
-    const raw = await fs.readFile(META_PATH, "utf8");
-    return JSON.parse(raw);
-  } catch {
-    return { sharedLinks: {} };
-  }
-}
-
-async function writeMeta(data) {
-  await fs.mkdir(WORKSPACE, { recursive: true });
-  await fs.writeFile(META_PATH, JSON.stringify(data, null, 2), "utf8");
-}
 
 function getBaseUrl(request) {
   const host = request.headers.get("x-forwarded-host") || request.headers.get("host");
@@ -48,11 +34,8 @@ export async function POST(request) {
     const stat = await fs.stat(fullPath).catch(() => null);
     if (!stat) return NextResponse.json({ error: "Not found" }, { status: 404 });
 
-    const data = await readMeta();
-    data.sharedLinks = data.sharedLinks || {};
     const token = crypto.randomBytes(12).toString("base64url");
-    data.sharedLinks[safePath] = { token, createdAt: new Date().toISOString() };
-    await writeMeta(data);
+    await setSharedLink(safePath, { token, createdAt: new Date().toISOString() });
 
     const base = getBaseUrl(request);
     return NextResponse.json({ link: `${base}/share/${token}`, token });
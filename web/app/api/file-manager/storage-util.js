@@ -1,14 +1,32 @@
 import path from "path";
 import fs from "fs/promises";
+import { diskUsage, queryIndex, WORKSPACE } from "@/app/api/lib/run-cli";
+
+// Usage of the whole workspace, for the storage widget and the quota check.
+export async function workspaceUsage() {
+  const du = await diskUsage();
+  if (du) return { size: du.sizeBytes, count: du.files, categories: du.categories };
+  return totalSize(WORKSPACE);
+}
 
 export async function totalSize(dirPath) {
+  // Inside the workspace the CLI's index answers without a walk.
+  const rel = path.relative(WORKSPACE, dirPath);
+  if (!rel.startsWith("..") && !path.isAbsolute(rel)) {
+    const du = await queryIndex("du", rel);
+    if (du) return { size: du.sizeBytes, count: du.files };
+  }
+  return walkSize(dirPath);
+}
+
+async function walkSize(dirPath) {
   let size = 0;
   let count = 0;
   const entries = await fs.readdir(dirPath, { withFileTypes: true }).catch(() => []);
   for (const ent of entries) {
     const full = path.join(dirPath, ent.name);
     if (ent.isDirectory()) {
-      const sub = await totalSize(full);
+      const sub = await walkSize(full);
       size += sub.size;
       count += sub.count;
     } else {
@@ -1,7 +1,7 @@
 import { NextResponse } from "next/server";
 import path from "path";
 import fs from "fs/promises";
-import { totalSize } from "../storage-util";
+import { workspaceUsage } from "../storage-util";
 
 const WORKSPACE = process.env.WORKSPACE_PATH || path.join(process.cwd(), "workspace");
 const MAX_STORAGE_BYTES = Number(process.env.MAX_STORAGE_BYTES) || 500 * 1024 * 1024; // 100 MB default
@@ -17,7 +17,7 @@ function formatBytes(bytes) {
 export async function GET() {
   try {
     await fs.mkdir(WORKSPACE, { recursive: true });
-    const { size, count } = await totalSize(WORKSPACE);
+    const { size, count, categories } = await workspaceUsage();
     return NextResponse.json(
       {
         used: formatBytes(size),
@@ -25,6 +25,7 @@ export async function GET() {
         max: formatBytes(MAX_STORAGE_BYTES),
         maxBytes: MAX_STORAGE_BYTES,
         fileCount: count,
+        categories: categories || null,
         location: "workspace/ (server filesystem)",
       },
       {
@@ -2,24 +2,11 @@ import { NextResponse } from "next/server";
 import path from "path";
 import fs from "fs/promises";
 import { writeFile } from "fs/promises";
+import { categoryOf } from "@/app/api/lib/ext-rules";
 
 const WORKSPACE = process.env.WORKSPACE_PATH || path.join(process.cwd(), "workspace");
 const MAX_STORAGE_BYTES = Number(process.env.MAX_STORAGE_BYTES) || 500 * 1024 * 1024;
 
-const DOC_EXT = [".txt", ".pdf", ".docx", ".doc", ".xlsx", ".pptx"];
-const IMG_EXT = [".jpg", ".jpeg", ".png", ".gif", ".bmp", ".svg", ".webp"];
-const AUD_EXT = [".mp3", ".wav", ".aac", ".flac", ".ogg"];
-const VID_EXT = [".mp4", ".mkv", ".avi", ".mov", ".wmv"];
-
-function getCategory(filename) {
-  const ext = path.extname(filename).toLowerCase();
-  if (DOC_EXT.includes(ext)) return "Documents";
-  if (IMG_EXT.includes(ext)) return "Images";
-  if (AUD_EXT.includes(ext)) return "Audio";
-  if (VID_EXT.includes(ext)) return "Videos";
-  return "Others";
-}
-
 function op(id, opName, description, syscall, pathArg, path2 = null, success, error = null) {
   return { id, op: opName, description, syscall, path: pathArg, path2, success, error };
 }
@@ -38,7 +25,7 @@ export async function POST(request) {
 
     const safePath = path.normalize(relPath).replace(/^(\.\.(\/|\\|$))+/, "");
     const baseDir = path.join(WORKSPACE, safePath);
-    const category = getCategory(file.name);
+    const category = categoryOf(file.name);
     const lastSegment = path.basename(safePath);
     const categoryFolders = ["Documents", "Images", "Audio", "Videos", "Others"];
     // If already inside a category folder, save directly there; otherwise route to category subfolder
@@ -65,8 +52,8 @@ export async function POST(request) {
     const buffer = Buffer.from(bytes);
     const fileSize = buffer.length;
 
-    const { totalSize } = await import("../storage-util");
-    const { size: used } = await totalSize(WORKSPACE);
+    const { workspaceUsage } = await import("../storage-util");
+    const { size: used } = await workspaceUsage();
     if (used + fileSize > MAX_STORAGE_BYTES) {
       return NextResponse.json(
         { error: "Storage limit exceeded. Free some space or increase limit." },
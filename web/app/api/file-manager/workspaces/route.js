@@ -1,7 +1,7 @@
 import { NextResponse } from "next/server";
 import path from "path";
 import fs from "fs/promises";
-import { readMeta, writeMeta } from "../meta-util";
+import { readMeta, addUserWorkspace } from "../meta-util";
 
 const WORKSPACE = process.env.WORKSPACE_PATH || path.join(process.cwd(), "workspace");
 const DISK_LABEL = process.env.DISK_LABEL || "Local Disk";
@@ -29,12 +29,7 @@ export async function POST(request) {
     }
     const fullPath = path.join(WORKSPACE, name);
     await fs.mkdir(fullPath, { recursive: false });
-    const data = await readMeta().catch(() => ({}));
-    const userWorkspaces = data.userWorkspaces || [];
-    if (!userWorkspaces.includes(name)) {
-      userWorkspaces.push(name);
-      await writeMeta({ ...data, userWorkspaces });
-    }
+    const userWorkspaces = await addUserWorkspace(name).catch(() => []);
     const entries = await fs.readdir(WORKSPACE, { withFileTypes: true });
     const existingDirs = new Set(entries.filter((e) => e.isDirectory() && !e.name.startsWith(".")).map((e) => e.name));
     const workspaces = userWorkspaces.filter((n) => existingDirs.has(n));
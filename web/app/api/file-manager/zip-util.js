@@ -0,0 +1,129 @@
+import path from "path";
+import fs from "fs/promises";
+import zlib from "zlib";
+import { promisify } from "util";
+import { categoryOf } from "@/app/api/lib/ext-rules";
+
+// ZIP export without the CLI: the same layout `organizer_cli archive` writes
+// (entries below the folder's name, dotfiles and symlinks left out, media
+// stored), one file at a time and without zip64, so it stops at 4 GB.
+
+const deflateRaw = promisify(zlib.deflateRaw);
+const RAW_MEDIA = new Set([".svg", ".bmp", ".tiff", ".tif", ".wav"]);
+const PACKED = new Set([".zip", ".gz", ".tgz", ".xz", ".zst", ".bz2", ".7z", ".rar", ".docx", ".xlsx", ".pptx"]);
+const ZIP32_MAX = 0xffffffff;
+
+const CRC_TABLE = Array.from({ length: 256 }, (_, n) => {
+  let c = n;
+  for (let k = 0; k < 8; k++) c = c & 1 ? 0xedb88320 ^ (c >>> 1) : c >>> 1;
+  return c >>> 0;
+});
+
+function crc32(buf) {
+  let c = 0xffffffff;
+  for (let i = 0; i < buf.length; i++) c = CRC_TABLE[(c ^ buf[i]) & 0xff] ^ (c >>> 8);
+  return (c ^ 0xffffffff) >>> 0;
+}
+
+function stored(name) {
+  const ext = path.extname(name).toLowerCase();
+  if (PACKED.has(ext)) return true;
+  return ["Images", "Audio", "Videos"].includes(categoryOf(name)) && !RAW_MEDIA.has(ext);
+}
+
+function dosTime(date) {
+  if (date.getFullYear() < 1980) return { time: 0, date: (1 << 5) | 1 };
+  return {
+    time: (date.getHours() << 11) | (date.getMinutes() << 5) | (date.getSeconds() >> 1),
+    date: ((date.getFullYear() - 1980) << 9) | ((date.getMonth() + 1) << 5) | date.getDate(),
+  };
+}
+
+async function* walk(dir, rel) {
+  const entries = await fs.readdir(dir, { withFileTypes: true }).catch(() => []);
+  entries.sort((a, b) => (a.name < b.name ? -1 : a.name > b.name ? 1 : 0));
+  for (const ent of entries) {
+    if (ent.name.startsWith(".") || !(ent.isFile() || ent.isDirectory())) continue;
+    const full = path.join(dir, ent.name);
+    yield { full, rel: `${rel}/${ent.name}`, dir: ent.isDirectory() };
+    if (ent.isDirectory()) yield* walk(full, `${rel}/${ent.name}`);
+  }
+}
+
+async function* zipChunks(absDir, root) {
+  const central = [];
+  let offset = 0;
+  const entries = walk(absDir, root);
+  for (let item = { full: absDir, rel: root, dir: true }; item; item = (await entries.next()).value) {
+    const stat = await fs.stat(item.full).catch(() => null);
+    const data = stat && !item.dir ? await fs.readFile(item.full).catch(() => null) : Buffer.alloc(0);
+    if (!stat || !data) continue;
+    const method = data.length && !stored(item.full) ? 8 : 0;
+    const body = method ? await deflateRaw(data) : data;
+    if (offset + body.length + 1024 > ZIP32_MAX) throw new Error("Folder too large to zip without the CLI");
+    const name = Buffer.from(item.dir ? `${item.rel}/` : item.rel, "utf8");
+    const { time, date } = dosTime(stat.mtime);
+    const crc = crc32(data);
+
+    const local = Buffer.alloc(30);
+    local.writeUInt32LE(0x04034b50, 0);
+    local.writeUInt16LE(20, 4);
+    local.writeUInt16LE((1 << 3) | (1 << 11), 6);
+    local.writeUInt16LE(method, 8);
+    local.writeUInt16LE(time, 10);
+    local.writeUInt16LE(date, 12);
+    local.writeUInt16LE(name.length, 26);
+    const desc = Buffer.alloc(16);
+    desc.writeUInt32LE(0x08074b50, 0);
+    desc.writeUInt32LE(crc, 4);
+    desc.writeUInt32LE(body.length, 8);
+    desc.writeUInt32LE(data.length, 12);
+    yield Buffer.concat([local, name, body, desc]);
+
+    const cd = Buffer.alloc(46);
+    cd.writeUInt32LE(0x02014b50, 0);
+    cd.writeUInt16LE((3 << 8) | 63, 4);
+    cd.writeUInt16LE(20, 6);
+    cd.writeUInt16LE((1 << 3) | (1 << 11), 8);
+    cd.writeUInt16LE(method, 10);
+    cd.writeUInt16LE(time, 12);
+    cd.writeUInt16LE(date, 14);
+    cd.writeUInt32LE(crc, 16);
+    cd.writeUInt32LE(body.length, 20);
+    cd.writeUInt32LE(data.length, 24);
+    cd.writeUInt16LE(name.length, 28);
+    cd.writeUInt32LE(((stat.mode << 16) | (item.dir ? 0x10 : 0)) >>> 0, 38);
+    cd.writeUInt32LE(offset, 42);
+    central.push(cd, name);
+    offset += local.length + name.length + body.length + desc.length;
+  }
+  const count = central.length / 2;
+  if (count >= 0xffff) throw new Error("Too many files to zip without the CLI");
+  const cd = Buffer.concat(central);
+  const end = Buffer.alloc(22);
+  end.writeUInt32LE(0x06054b50, 0);
+  end.writeUInt16LE(count, 8);
+  end.writeUInt16LE(count, 10);
+  end.writeUInt32LE(cd.length, 12);
+  end.writeUInt32LE(offset, 16);
+  yield Buffer.concat([cd, end]);
+}
+
+/** A web ReadableStream of the directory as a ZIP, entries below rootName. */
+export function zipDirectory(absDir, rootName) {
+  const chunks = zipChunks(absDir, rootName);
+  return new ReadableStream({
+    async pull(controller) {
+      try {
+        const { value, done } = await chunks.next();
+        if (done) controller.close();
+        else controller.enqueue(new Uint8Array(value));
+      } catch (e) {
+        controller.error(e);
+      }
+    },
+    cancel() {
+      return chunks.return();
+    },
+  });
+}
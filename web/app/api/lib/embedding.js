@@ -1,6 +1,9 @@
+import { indexEmbedding, searchEmbeddings } from "./run-cli";
+
 /**
  * Generate embeddings via OpenAI. Requires OPENAI_API_KEY.
- * Uses text-embedding-3-small (1536 dimensions).
+ * Uses text-embedding-3-small (1536 dimensions). The vectors are stored and
+ * searched by the CLI's vector index (`organizer_cli vindex`).
  */
 const EMBEDDING_MODEL = "text-embedding-3-small";
 const EMBEDDING_DIM = 1536;
@@ -26,4 +29,14 @@ export async function embedText(text) {
   return vec;
 }
 
+/** Embed a file's text and store the vector under its workspace-relative path. */
+export async function indexFileText(relPath, text) {
+  return indexEmbedding(relPath, await embedText(text));
+}
+
+/** The k files whose indexed text is closest in meaning to query, as [{ path, score }]. */
+export async function semanticSearch(query, k = 10) {
+  return searchEmbeddings(await embedText(query), k);
+}
+
 export { EMBEDDING_DIM };
@@ -0,0 +1,46 @@
+// Generated by tools/gen_ext_hash from ext_rules.conf - do not edit.
+
+export const CATEGORIES = ["Documents", "Images", "Audio", "Videos", "Others"];
+
+export const EXT_CATEGORY = {
+  ".txt": "Documents",
+  ".pdf": "Documents",
+  ".docx": "Documents",
+  ".doc": "Documents",
+  ".xlsx": "Documents",
+  ".pptx": "Documents",
+  ".jpg": "Images",
+  ".jpeg": "Images",
+  ".png": "Images",
+  ".gif": "Images",
+  ".bmp": "Images",
+  ".svg": "Images",
+  ".webp": "Images",
+  ".heic": "Images",
+  ".heif": "Images",
+  ".tiff": "Images",
+  ".tif": "Images",
+  ".avif": "Images",
+  ".mp3": "Audio",
+  ".wav": "Audio",
+  ".aac": "Audio",
+  ".flac": "Audio",
+  ".ogg": "Audio",
+  ".mp4": "Videos",
+  ".mkv": "Videos",
+  ".avi": "Videos",
+  ".mov": "Videos",
+  ".wmv": "Videos",
+};
+
+/** Category for a file name (case-insensitive), "Others" when unmatched. */
+export function categoryOf(name) {
+  const dot = name.lastIndexOf(".");
+  if (dot < 0) return "Others";
+  return EXT_CATEGORY[name.slice(dot).toLowerCase()] || "Others";
+}
+
+/** Extensions (with the dot) that map to a category. */
+export function extensionsFor(category) {
+  return Object.keys(EXT_CATEGORY).filter((ext) => EXT_CATEGORY[ext] === category);
+}
@@ -1,11 +1,19 @@
-import { spawnSync } from "child_process";
+import { spawn, spawnSync } from "child_process";
+import readline from "readline";
+import { Readable } from "stream";
+import net from "net";
 import path from "path";
 import fs from "fs";
 
 const WORKSPACE = process.env.WORKSPACE_PATH || path.join(process.cwd(), "workspace");
 
-// CLI lives in project root (parent of web/)
-const CLI_PATH = path.join(process.cwd(), "..", "new_organizer_cli");
+// The CLI that `make` builds in the project root (parent of web/), unless
+// ORGANIZER_CLI_PATH names another build.
+const CLI_PATH = process.env.ORGANIZER_CLI_PATH || path.join(process.cwd(), "..", "organizer_cli");
+
+// Optional long-running `organizer_cli serve --socket <path>`; when set, requests
+// go over one persistent connection instead of spawning a process each time.
+const CLI_SOCKET = process.env.ORGANIZER_CLI_SOCKET || "";
 
 function cliAvailable() {
   try {
@@ -16,47 +24,331 @@ function cliAvailable() {
   }
 }
 
+let server = null;
+
+function serverConnection() {
+  if (server) return server;
+  const sock = net.createConnection(CLI_SOCKET);
+  const pending = new Map();
+  let nextId = 1;
+  let buf = "";
+  const fail = () => {
+    for (const resolve of pending.values()) resolve(null);
+    pending.clear();
+    server = null;
+  };
+  sock.setEncoding("utf8");
+  sock.on("data", (chunk) => {
+    buf += chunk;
+    let nl;
+    while ((nl = buf.indexOf("\n")) >= 0) {
+      const line = buf.slice(0, nl);
+      buf = buf.slice(nl + 1);
+      try {
+        const data = JSON.parse(line);
+        const resolve = pending.get(data.id);
+        if (resolve) {
+          pending.delete(data.id);
+          resolve(data);
+        }
+      } catch {
+        // ignore malformed lines
+      }
+    }
+  });
+  sock.on("error", fail);
+  sock.on("close", fail);
+  server = {
+    request(argv) {
+      return new Promise((resolve) => {
+        const id = nextId++;
+        pending.set(id, resolve);
+        sock.write(JSON.stringify({ id, argv }) + "\n");
+      });
+    },
+  };
+  return server;
+}
+
 /**
- * Run the C organizer CLI. Returns { operations, result, error } or throws.
+ * Run one CLI request, over the serve socket when configured, else by spawning.
+ * Resolves to { operations, result, error, journal } or null when the CLI is
+ * unavailable; journal is set for commands that move files.
  */
-export function runCreateDir(dirName, fileNames) {
+async function runCli(args) {
+  if (CLI_SOCKET) {
+    const data = await serverConnection().request(args);
+    if (data) return { operations: data.operations || [], result: data.result, error: data.error, journal: data.journal };
+  }
   if (!cliAvailable()) return null;
-  const args = ["create-dir", WORKSPACE, dirName, ...fileNames];
   const out = spawnSync(CLI_PATH, args, {
     encoding: "utf8",
-    maxBuffer: 2 * 1024 * 1024,
+    maxBuffer: 64 * 1024 * 1024,
     cwd: path.join(process.cwd(), ".."),
   });
   if (out.error) return null;
   try {
     const line = out.stdout.trim().split("\n").pop();
     const data = JSON.parse(line);
-    return { operations: data.operations || [], result: data.result, error: data.error };
+    return { operations: data.operations || [], result: data.result, error: data.error, journal: data.journal };
   } catch {
     return null;
   }
 }
 
-export function runOrganize(directoryPath) {
-  if (!cliAvailable()) return null;
+/**
+ * Spawn the CLI with `--output ndjson` and hand each parsed line to onLine as
+ * it arrives. Resolves to the final `{"type":"result"}` line, or null.
+ * Output size is unbounded, unlike spawnSync's maxBuffer.
+ */
+function streamCli(args, onLine) {
+  if (!cliAvailable()) return Promise.resolve(null);
+  return new Promise((resolve) => {
+    const child = spawn(CLI_PATH, [...args, "--output", "ndjson"], {
+      cwd: path.join(process.cwd(), ".."),
+      stdio: ["ignore", "pipe", "ignore"],
+    });
+    let summary = null;
+    readline.createInterface({ input: child.stdout }).on("line", (line) => {
+      let data;
+      try {
+        data = JSON.parse(line);
+      } catch {
+        return;
+      }
+      if (data.type === "result") summary = data;
+      else onLine(data);
+    });
+    child.on("error", () => resolve(null));
+    child.on("close", () => resolve(summary));
+  });
+}
+
+export function runCreateDir(dirName, fileNames) {
+  return runCli(["create-dir", WORKSPACE, dirName, ...fileNames]);
+}
+
+/**
+ * Copy workspace-relative { from, to } pairs (files or whole trees) with the
+ * CLI's copy engine (reflink / copy_file_range / sendfile, sparse-aware).
+ */
+export function runCopy(items) {
+  return runCli(["copy", WORKSPACE, ...items.flatMap(({ from, to }) => [from, to])]);
+}
+
+/**
+ * Answer a list / stat / du / search query from the CLI's workspace index
+ * (kept current by `organizer_cli index <workspace> --watch`). Resolves to
+ * the result object, or null when the CLI or the index is unavailable.
+ */
+export async function queryIndex(kind, arg = "") {
+  const out = await runCli(["query", WORKSPACE, kind, arg]);
+  return out && !out.error && out.result ? out.result : null;
+}
+
+/**
+ * Disk usage of the workspace: bytes and file counts, overall and per
+ * category, with hard links counted once. The CLI caches per-directory
+ * totals, so repeat calls only re-read folders that changed. Resolves to
+ * null when the CLI is unavailable.
+ */
+export async function diskUsage() {
+  const out = await runCli(["du", WORKSPACE]);
+  return out && !out.error && out.result ? out.result : null;
+}
+
+// Serve requests carry at most 256 argv words; a set op takes four.
+const META_OPS_PER_CALL = 60;
+
+/**
+ * Apply metadata ops ([["set", path, field, json], ["rm", path], ...]) to the
+ * CLI's per-workspace metadata log, in order. Each call's writes are made
+ * durable together. Resolves to one result per op, or null when the CLI is
+ * unavailable or too old to have `meta`.
+ */
+export async function runMeta(ops) {
+  const results = [];
+  for (let i = 0; i < ops.length; i += META_OPS_PER_CALL) {
+    const out = await runCli(["meta", WORKSPACE, ...ops.slice(i, i + META_OPS_PER_CALL).flat()]);
+    if (!out || out.error || !out.result) return null;
+    results.push(...out.result.results);
+  }
+  return results;
+}
+
+/**
+ * Run one `organizer_cli vindex` op against the workspace's vector index.
+ * Resolves to the op's result object, or null when the CLI is unavailable.
+ */
+async function runVindex(args) {
+  const out = await runCli(["vindex", WORKSPACE, ...args]);
+  return out && !out.error && out.result ? out.result : null;
+}
+
+/** Store a path's embedding (an array of numbers), replacing any it had. */
+export function indexEmbedding(relPath, vector) {
+  return runVindex(["add", relPath, JSON.stringify(vector)]);
+}
+
+/**
+ * The k indexed paths whose embeddings are most similar to vector (cosine),
+ * best first, as [{ path, score }]; null when the CLI is unavailable.
+ */
+export async function searchEmbeddings(vector, k = 10) {
+  const res = await runVindex(["search", JSON.stringify(vector), "--k", String(k)]);
+  return res ? res.items : null;
+}
+
+/** Drop the embeddings of the paths and everything below them. */
+export function forgetEmbeddings(paths) {
+  return paths.length ? runVindex(["rm", ...paths]) : Promise.resolve(null);
+}
+
+/** Carry a renamed or moved path's embeddings, and its subtree's, to the new path. */
+export function moveEmbeddings(from, to) {
+  return runVindex(["mv", from, to]);
+}
+
+/**
+ * Paths whose text matches a full-text query from the CLI's content index
+ * (`organizer_cli ftindex`, refreshed by mtime on each call): words are
+ * ANDed, with OR, NOT / -word and "quoted phrases". Resolves to
+ * [{ path, type, score, snippet }], best first, or null without the CLI.
+ */
+export async function fullTextQuery(expr, limit = 20) {
+  const out = await runCli(["ftindex", WORKSPACE, "query", expr, "--limit", String(limit)]);
+  return out && !out.error && out.result ? out.result.items : null;
+}
+
+/**
+ * The indexed text of a text-like file or PDF, at most max characters, served
+ * from the content index instead of the file. Resolves to a string, or null
+ * when the CLI is unavailable or the file is not indexed.
+ */
+export async function cachedText(relPath, max = 3000) {
+  const out = await runCli(["ftindex", WORKSPACE, "text", relPath, "--max", String(max)]);
+  const item = out && !out.error && out.result ? out.result.items[0] : null;
+  return item && item.text != null ? item.text : null;
+}
+
+// Batch modes take thousands of items per spawn; a serve request carries at
+// most 256 argv words.
+const BATCH_WORDS_PER_CALL = CLI_SOCKET ? 240 : 8192;
+
+/**
+ * Run a batch mode over words, stride words per item, in as few calls as
+ * the argv limits allow. Resolves to { operations, items } merged over the
+ * calls, or null when the CLI is unavailable.
+ */
+async function runBatch(head, words, stride, tail = []) {
+  const per = BATCH_WORDS_PER_CALL - (BATCH_WORDS_PER_CALL % stride);
+  const merged = { operations: [], items: [] };
+  for (let i = 0; i < words.length; i += per) {
+    const out = await runCli([...head, ...words.slice(i, i + per), ...tail]);
+    if (!out || out.error || !out.result) return null;
+    merged.operations.push(...out.operations);
+    merged.items.push(...out.result.items);
+  }
+  return merged;
+}
+
+/**
+ * Move workspace-relative { from, to } pairs with renameat2(RENAME_NOREPLACE),
+ * making the destinations' parents. Resolves to { operations, items } with
+ * one { from, to, success, error } per pair, or null without the CLI.
+ */
+export function runMove(items) {
+  return runBatch(["move", WORKSPACE], items.flatMap(({ from, to }) => [from, to]), 2);
+}
+
+/**
+ * Run an `organizer_cli bin` op on the workspace's recycle bin:
+ *   trash    paths            -> items [{ id, path, success, error }]
+ *   restore  ids              -> the same, path being where it went back to
+ *   purge    ids              -> removed on threads, after the reply with background
+ *   import   [name, path, ms] -> adopt .bin/<name> left by the JSON bin
+ * Resolves to { operations, items }, or null without the CLI.
+ */
+export function runBin(op, args, { background = false } = {}) {
+  return runBatch(["bin", WORKSPACE, op], args.flat(), op === "import" ? 3 : 1, background ? ["--background"] : []);
+}
+
+/** The bin's items as [{ id, path, name, type, size, deletedAt }], or null without the CLI. */
+export async function listBin() {
+  const out = await runCli(["bin", WORKSPACE, "list"]);
+  return out && !out.error && out.result ? out.result.items : null;
+}
+
+/**
+ * Stream a workspace directory as a ZIP from `organizer_cli archive`.
+ * Resolves to { stream }, a web ReadableStream that starts with the first
+ * bytes the CLI writes (cancelling it stops the CLI), or { error } when the
+ * CLI refused before writing, or null without the CLI.
+ */
+export function archiveStream(relPath) {
+  if (!cliAvailable()) return Promise.resolve(null);
+  return new Promise((resolve) => {
+    const child = spawn(CLI_PATH, ["archive", WORKSPACE, relPath], {
+      cwd: path.join(process.cwd(), ".."),
+      stdio: ["ignore", "pipe", "ignore"],
+    });
+    let started = false;
+    child.on("error", () => resolve(null));
+    child.stdout.once("data", (first) => {
+      started = true;
+      if (first.subarray(0, 2).toString("latin1") === "PK") {
+        child.stdout.pause();
+        child.stdout.unshift(first);
+        resolve({ stream: Readable.toWeb(child.stdout) });
+        return;
+      }
+      // A JSON error, printed before any of the archive.
+      let text = first.toString("utf8");
+      child.stdout.on("data", (chunk) => (text += chunk));
+      child.stdout.on("end", () => {
+        try {
+          resolve({ error: JSON.parse(text.trim().split("\n").pop()).error || "archive failed" });
+        } catch {
+          resolve(null);
+        }
+      });
+    });
+    child.stdout.once("end", () => started || resolve(null));
+  });
+}
+
+export async function runOrganize(directoryPath) {
   const subpath = directoryPath ? directoryPath.trim() : "";
   const assetsDir = path.join(process.cwd(), "assets");
-  const args = subpath
-    ? ["organize", WORKSPACE, subpath, assetsDir]
-    : ["organize", WORKSPACE, "", assetsDir];
-  const out = spawnSync(CLI_PATH, args, {
-    encoding: "utf8",
-    maxBuffer: 2 * 1024 * 1024,
-    cwd: path.join(process.cwd(), ".."),
+  const args = ["organize", WORKSPACE, subpath, assetsDir];
+  if (CLI_SOCKET) return runCli(args);
+
+  // Stream the ops and rebuild the per-category lists from the moves.
+  const operations = [];
+  const result = { Documents: [], Images: [], Audio: [], Videos: [], Others: [] };
+  let legacy = null;
+  const summary = await streamCli(args, (line) => {
+    if (!line.type) {
+      legacy = line; // older CLI build without --output ndjson
+      return;
+    }
+    const { type, category, entry, ...op } = line;
+    operations.push(op);
+    if (category && op.success) (result[category] ||= []).push(entry);
   });
-  if (out.error) return null;
-  try {
-    const line = out.stdout.trim().split("\n").pop();
-    const data = JSON.parse(line);
-    return { operations: data.operations || [], result: data.result, error: data.error };
-  } catch {
-    return null;
+  if (!summary) {
+    return legacy && { operations: legacy.operations || [], result: legacy.result, error: legacy.error };
   }
+  return { operations, result: summary.error ? null : result, error: summary.error, journal: summary.journal };
+}
+
+/**
+ * Revert an organize batch from the workspace's journal (the latest one when
+ * batch is omitted). Files are moved back only if they have not been replaced
+ * since; resolves to { operations, result, error, journal } or null.
+ */
+export function runUndo(batch) {
+  return runCli(batch ? ["undo", WORKSPACE, String(batch)] : ["undo", WORKSPACE]);
 }
 
 export { WORKSPACE, cliAvailable };
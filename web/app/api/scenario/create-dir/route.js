@@ -104,7 +104,7 @@ export async function POST(request) {
     const fileNames = userFileNames;
     await fs.mkdir(WORKSPACE, { recursive: true }).catch(() => {});
 
-    const cliResult = runCreateDir(safeDirName, fileNames);
+    const cliResult = await runCreateDir(safeDirName, fileNames);
     if (cliResult) {
       return NextResponse.json({
         operations: cliResult.operations,
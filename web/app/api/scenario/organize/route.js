@@ -2,11 +2,7 @@ import { NextResponse } from "next/server";
 import path from "path";
 import fs from "fs/promises";
 import { runOrganize, WORKSPACE } from "@/app/api/lib/run-cli";
-
-const DOC_EXT = [".txt", ".pdf", ".docx", ".doc", ".xlsx", ".pptx"];
-const IMG_EXT = [".jpg", ".jpeg", ".png", ".gif", ".bmp", ".svg"];
-const AUD_EXT = [".mp3", ".wav", ".aac", ".flac", ".ogg"];
-const VID_EXT = [".mp4", ".mkv", ".avi", ".mov", ".wmv"];
+import { CATEGORIES, categoryOf } from "@/app/api/lib/ext-rules";
 
 const TEXT_TEMPLATES = [
   "Meeting Notes - Q4 Planning\n\nDate: 2024-11-15\nAttendees: Alice, Bob, Charlie\n\nAgenda:\n1. Budget review for next quarter\n2. New product roadmap discussion\n3. Team restructuring proposals\n\nKey Decisions:\n- Approved 15% budget increase for R&D\n- Launch date set for March 2025\n- Two new hires approved for engineering team\n",
@@ -84,15 +80,6 @@ function op(id, opName, description, syscall, pathArg, path2 = null, success, er
   return { id, op: opName, description, syscall, path: pathArg, path2, success, error };
 }
 
-function getCategory(name) {
-  const ext = path.extname(name).toLowerCase();
-  if (DOC_EXT.includes(ext)) return "Documents";
-  if (IMG_EXT.includes(ext)) return "Images";
-  if (AUD_EXT.includes(ext)) return "Audio";
-  if (VID_EXT.includes(ext)) return "Videos";
-  return "Others";
-}
-
 export async function POST(request) {
   const ops = [];
   let id = 0;
@@ -101,12 +88,13 @@ export async function POST(request) {
     const subpath = directoryPath ? path.normalize(directoryPath).replace(/^(\.\.(\/|\\|$))+/, "") : "";
 
     // Try C backend first (real OS system calls)
-    const cliResult = runOrganize(subpath);
+    const cliResult = await runOrganize(subpath);
     if (cliResult) {
       return NextResponse.json({
         operations: cliResult.operations,
         result: cliResult.result,
         backend: "c",
+        ...(cliResult.journal && { journal: cliResult.journal }),
         ...(cliResult.error && { error: cliResult.error }),
       }, cliResult.error ? { status: 500 } : { status: 200 });
     }
@@ -123,14 +111,8 @@ export async function POST(request) {
       return NextResponse.json({ operations: ops, error: e.message, backend: "node" }, { status: 500 });
     }
 
-    const categories = { Documents: [], Images: [], Audio: [], Videos: [], Others: [] };
-    const dirs = {
-      Documents: path.join(basePath, "Documents"),
-      Images: path.join(basePath, "Images"),
-      Audio: path.join(basePath, "Audio"),
-      Videos: path.join(basePath, "Videos"),
-      Others: path.join(basePath, "Others"),
-    };
+    const categories = Object.fromEntries(CATEGORIES.map((c) => [c, []]));
+    const dirs = Object.fromEntries(CATEGORIES.map((c) => [c, path.join(basePath, c)]));
 
     for (const name of Object.keys(dirs)) {
       try {
@@ -143,7 +125,7 @@ export async function POST(request) {
 
     for (const ent of entries) {
       if (ent.name.startsWith(".") || ent.name === ".." || ent.isDirectory()) continue;
-      const category = getCategory(ent.name);
+      const category = categoryOf(ent.name);
       const oldPath = path.join(basePath, ent.name);
       const newPath = path.join(dirs[category], ent.name);
       try {
@@ -0,0 +1,25 @@
+import { NextResponse } from "next/server";
+import { runUndo } from "@/app/api/lib/run-cli";
+
+// Undo needs the C backend's journal; there is no Node.js fallback.
+export async function POST(request) {
+  try {
+    const { batch } = await request.json().catch(() => ({}));
+    if (batch !== undefined && !(Number.isInteger(batch) && batch > 0)) {
+      return NextResponse.json({ error: "batch must be a positive integer" }, { status: 400 });
+    }
+    const cliResult = await runUndo(batch);
+    if (!cliResult) {
+      return NextResponse.json({ error: "Undo needs the C backend" }, { status: 503 });
+    }
+    return NextResponse.json({
+      operations: cliResult.operations,
+      result: cliResult.result,
+      backend: "c",
+      ...(cliResult.journal && { journal: cliResult.journal }),
+      ...(cliResult.error && { error: cliResult.error }),
+    }, cliResult.error ? { status: 500 } : { status: 200 });
+  } catch (e) {
+    return NextResponse.json({ error: e.message }, { status: 500 });
+  }
+}
@@ -577,9 +577,19 @@ export default function FileManager({ currentPath, onNavigate, onOperation }) {
   }
 
   async function handleDownload() {
-    if (!contextMenu.item || contextMenu.item.type === "directory") return;
+    if (!contextMenu.item) return;
+    const url = `${API_BASE}/api/file-manager/download?path=${encodeURIComponent(contextMenu.item.path)}`;
+    if (contextMenu.item.type === "directory") {
+      // The ZIP is streamed; a plain link lets the browser save it as it arrives.
+      const a = document.createElement("a");
+      a.href = url;
+      a.download = `${contextMenu.item.name}.zip`;
+      a.click();
+      setContextMenu({ x: null, y: null, item: null });
+      return;
+    }
     try {
-      const res = await fetch(`${API_BASE}/api/file-manager/download?path=${encodeURIComponent(contextMenu.item.path)}`);
+      const res = await fetch(url);
       const blob = await res.blob();
       const url = window.URL.createObjectURL(blob);
       const a = document.createElement("a");
@@ -1037,6 +1047,7 @@ export default function FileManager({ currentPath, onNavigate, onOperation }) {
                 { label: "Share", icon: <svg className="w-4 h-4" fill="none" stroke="currentColor" viewBox="0 0 24 24"><path strokeLinecap="round" strokeLinejoin="round" strokeWidth={2} d="M18 9v3m0 0v3m0-3h3m-3 0h-3m-2-5a4 4 0 11-8 0 4 4 0 018 0zM3 20a6 6 0 0112 0v1H3v-1z" /></svg>, onClick: handleShare },
                 { label: "Copy link", icon: <svg className="w-4 h-4" fill="none" stroke="currentColor" viewBox="0 0 24 24"><path strokeLinecap="round" strokeLinejoin="round" strokeWidth={2} d="M13.828 10.172a4 4 0 00-5.656 0l-4 4a4 4 0 105.656 5.656l1.102-1.101m-.758-4.899a4 4 0 005.656 0l4-4a4 4 0 00-5.656-5.656l-1.1 1.1" /></svg>, onClick: handleShare },
               ]},
+              { label: "Download as ZIP", icon: "⬇️", onClick: handleDownload },
               { label: "Rename", icon: "✏️", onClick: handleRename },
             ]
           : [
@@ -9,6 +9,12 @@ import SyscallInfo from "./components/SyscallInfo";
 import DeleteConfirmModal from "./components/DeleteConfirmModal";
 
 
+function formatDuration(ns) {
+  if (ns < 1000) return `${ns}ns`;
+  if (ns < 1e6) return `${(ns / 1e3).toFixed(ns < 1e4 ? 1 : 0)}µs`;
+  return `${(ns / 1e6).toFixed(ns < 1e7 ? 1 : 0)}ms`;
+}
+
 function OpRow({ o, onShowInfo }) {
   const isErr = !o.success;
   return (
@@ -43,8 +49,9 @@ function OpRow({ o, onShowInfo }) {
         <div className="text-slate-500 text-xs mt-1">{o.description}</div>
         {isErr && <div className="text-red-600 text-xs mt-1 font-bold">Error: {o.error}</div>}
       </div>
-      <div className="text-xs text-slate-300 group-hover:text-slate-400">
+      <div className="text-xs text-slate-300 group-hover:text-slate-400 text-right">
         ID: {o.id}
+        {o.durNs > 0 && <div title={o.bytes ? `${o.bytes} bytes` : undefined}>{formatDuration(o.durNs)}</div>}
       </div>
     </div>
   );
@@ -195,7 +202,7 @@ export default function Home() {
       const data = await res.json();
       if (!res.ok) throw new Error(data.error || "Request failed");
       setOperations(data.operations || []);
-      setOutput({ type: "organize", result: data.result });
+      setOutput({ type: "organize", result: data.result, batch: data.journal?.batch });
       setBackend(data.backend || null);
       fetchFileTree(); // Update tree
     } catch (e) {
@@ -205,6 +212,28 @@ export default function Home() {
     }
   }
 
+  async function runUndo(batch) {
+    setLoading("undo");
+    setError(null);
+    try {
+      const res = await fetch(`${API_BASE}/api/scenario/undo`, {
+        method: "POST",
+        headers: { "Content-Type": "application/json" },
+        body: JSON.stringify({ batch }),
+      });
+      const data = await res.json();
+      if (!res.ok) throw new Error(data.error || "Request failed");
+      setOperations(data.operations || []);
+      setOutput({ type: "undo", result: data.result });
+      setBackend(data.backend || null);
+      fetchFileTree();
+    } catch (e) {
+      setError(e.message);
+    } finally {
+      setLoading(null);
+    }
+  }
+
   return (
     <div className="min-h-screen font-sans pb-24">
       {/* Educational Modal */}
@@ -519,7 +548,28 @@ export default function Home() {
                     <h4 className="font-bold text-lg text-slate-800">Directory Created</h4>
                     <p className="text-sm text-slate-500 mt-2 max-w-xs mx-auto">{output.result?.created} files generated inside <br /><code className="bg-slate-100 px-2 py-0.5 rounded text-xs font-mono mt-1 inline-block text-slate-700">{output.result?.dirPath}</code></p>
                   </div>
+                ) : output.type === "undo" && output.result ? (
+                  <div className="text-center py-6">
+                    <h4 className="font-bold text-lg text-slate-800">Organize Undone</h4>
+                    <p className="text-sm text-slate-500 mt-2">
+                      {output.result.restored} files moved back from batch #{output.result.undid}
+                      {output.result.failed > 0 && <>, {output.result.failed} changed since and left in place</>}
+                    </p>
+                  </div>
                 ) : output.type === "organize" && output.result ? (
+                  <>
+                  {output.batch && (
+                    <div className="flex items-center justify-between mb-3 text-xs text-slate-500">
+                      <span>Journaled as batch #{output.batch}</span>
+                      <button
+                        onClick={() => runUndo(output.batch)}
+                        disabled={loading !== null}
+                        className="rounded-lg border border-slate-200 px-3 py-1 font-medium text-slate-600 hover:bg-slate-50 disabled:opacity-50"
+                      >
+                        {loading === "undo" ? "Undoing..." : "Undo"}
+                      </button>
+                    </div>
+                  )}
                   <div className="grid grid-cols-2 gap-3">
                     {Object.entries(output.result).map(([folder, files]) => (
                       <div key={folder} className="p-3 rounded-xl border border-slate-100 bg-white/50 hover:bg-white hover:shadow-md transition-all group cursor-default">
@@ -543,6 +593,7 @@ export default function Home() {
                       </div>
                     ))}
                   </div>
+                  </>
                 ) : null}
               </div>
             </section>